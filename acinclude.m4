@@ -80,6 +80,25 @@ AC_DEFUN([AX_CHECK_LIB_EVENT],[
   AC_CHECK_LIB([event],[evdns_resolve_ipv6],,[AC_MSG_ERROR([libevent library not found])])
 ])
 dnl }}}
+dnl {{{ ax_check_lib_sqlite
+AC_DEFUN([AX_CHECK_LIB_SQLITE],[
+  AC_ARG_WITH([sqlite],
+    AC_HELP_STRING([--with-sqlite], [build the sqlite database driver @<:@default=yes@:>@]),
+    [want_sqlite="$withval"], [want_sqlite="yes"])
+  have_sqlite="no"
+  SQLITE_LDFLAGS=""
+  if test "$want_sqlite" = "yes"; then
+    AC_CHECK_HEADER([sqlite3.h],
+      [AC_CHECK_LIB([sqlite3],[sqlite3_prepare_v2],
+        [have_sqlite="yes"
+         SQLITE_LDFLAGS="-lsqlite3"])])
+    if test "$have_sqlite" != "yes"; then
+      AC_MSG_WARN([sqlite3 not found, not building the sqlite driver])
+    fi
+  fi
+  AC_SUBST([SQLITE_LDFLAGS])
+  AM_CONDITIONAL([USE_SQLITE], [test "$have_sqlite" = "yes"])
+])dnl }}}
 dnl {{{ ax_check_lib_pgsql
 dnl  License
 dnl  Copyright © 2008 Mateusz Loskot <mateusz@loskot.net>
@@ -27,6 +27,7 @@
 
 int akick_add(struct ServiceMask *);
 int akick_check_client(struct Service *, struct Channel *, struct Client *);
+int akick_check_restored(struct Service *, struct Channel *);
 int akick_enforce(struct Service *, struct Channel *, struct ServiceMask *);
 int akick_list(unsigned int, dlink_list *);
 void akick_list_free(dlink_list *);
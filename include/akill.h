@@ -25,12 +25,27 @@
 #ifndef INCLUDED_akill_h
 #define INCLUDED_akill_h
 
+#define AKILL_BACKLOG_SLICE  16  /* clients checked between clock reads */
+#define AKILL_BACKLOG_WINDOW 10  /* seconds the drain rate is taken over */
+
+struct AkillBacklog
+{
+  unsigned long checked;        /* clients taken off the delayed list */
+  unsigned long matched;        /* of those, akilled */
+  unsigned int rate;            /* clients checked per second */
+  time_t window_start;
+  unsigned int window_checked;
+};
+
+extern struct AkillBacklog akill_backlog;
+
 int akill_add(struct ServiceMask *);
 struct ServiceMask *akill_find(const char *);
 int akill_check_client(struct Service *, struct Client *);
+unsigned int akill_check_backlog(struct Service *, unsigned int);
 int akill_list(dlink_list *);
 int akill_get_expired(dlink_list *);
-int akill_list_free(dlink_list *);
+void akill_list_free(dlink_list *);
 int akill_remove_mask(const char *);
 
 #endif
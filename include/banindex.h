@@ -0,0 +1,41 @@
+#ifndef INCLUDED_banindex_h
+#define INCLUDED_banindex_h
+
+#define BANINDEX_MIN_SIZE 8     /* slots in a hash once it holds anything */
+#define BANINDEX_V4_BITS  33    /* prefix lengths 0-32 */
+#define BANINDEX_V6_BITS  129   /* prefix lengths 0-128 */
+
+struct Ban;
+struct Client;
+
+/* every ban sharing a 32 bit hash value, the hash itself never compares */
+struct BanBucket
+{
+  unsigned int hashv;
+  dlink_list bans;
+};
+
+struct BanHash
+{
+  struct BanBucket *buckets;
+  unsigned int size;
+  unsigned int count;
+};
+
+struct BanIndex
+{
+  struct BanHash masks;   /* n!u@h, for add_id()/del_id() */
+  struct BanHash keys;    /* address, host, host suffix or nick */
+  dlink_list wild;        /* nothing literal to key on */
+  unsigned short *ipbits; /* address bans per prefix length, v4 then v6 */
+};
+
+struct BanIndex *banindex_create();
+void banindex_free(struct BanIndex *);
+void banindex_add(struct BanIndex *, struct Ban *);
+void banindex_del(struct Ban *);
+struct Ban *banindex_find_mask(const struct BanIndex *, const char *,
+    const char *, const char *);
+struct Ban *banindex_match(const struct BanIndex *, const struct Client *);
+
+#endif /* INCLUDED_banindex_h */
@@ -36,12 +36,12 @@ void add_user_to_channel(struct Channel *, struct Client *, unsigned int, int);
 void destroy_channel(struct Channel *);
 void remove_user_from_channel(struct Membership *);
 struct Ban *find_bmask(const struct Client *, const dlink_list *const);
+struct Ban *find_channel_ban(const struct Client *, const struct Channel *, int);
+int match_ban(const struct Ban *, const struct Client *);
 void set_channel_topic(struct Channel *, const char *,const char *, time_t);
 
 struct Channel
 {
-  struct Channel *hnextch;
-
   dlink_node node;
 
   struct Mode mode;
@@ -55,7 +55,11 @@ struct Channel
   dlink_list exceptlist;
   dlink_list invexlist;
   dlink_list quietlist;
-  
+  struct BanIndex *banindex;    /*!< indexes of the four lists above */
+  struct BanIndex *exceptindex;
+  struct BanIndex *invexindex;
+  struct BanIndex *quietindex;
+
   time_t channelts;
   time_t limit_time;
 
@@ -101,10 +101,19 @@ struct Ban
   char *username;
   char *host;
   char *who;
+  struct CompiledMask *cname;  /* compiled name/username/host masks */
+  struct CompiledMask *cuser;
+  struct CompiledMask *chost;
   struct irc_ssaddr addr;
   int bits;
   char type;
+  char keyed;                  /* in a keys bucket, not on the wild list */
   time_t when;
+  struct BanIndex *index;      /* index of the list the ban is on */
+  dlink_node mnode;            /* in its index, by mask */
+  dlink_node knode;            /* in its index, by key */
+  unsigned int mhash;
+  unsigned int khash;
 };
 
 struct Mode
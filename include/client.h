@@ -41,6 +41,9 @@ extern dlink_list delay_akill_list;
 #define FLAGS_ONACCESS      0x00000020UL /* Client isnt authed with nickserv but does match the access list*/
 #define FLAGS_ENFORCE       0x00000040UL /* User is to be enforced */
 #define FLAGS_SENTCERT      0x00000080UL /* User identified via SSL */
+#define FLAGS_RESTORED      0x00000100UL /* State carried over a warm restart */
+#define FLAGS_SPLIT         0x00000200UL /* Leaving with a split server */
+#define FLAGS_NICKCHECK     0x00000400UL /* NickServ checks put off until the burst is done */
 
 #define STAT_SERVER         0x01
 #define STAT_CLIENT         0x02
@@ -83,17 +86,24 @@ extern dlink_list delay_akill_list;
 #define IsOnAccess(x)           ((x)->flags & FLAGS_ONACCESS)
 #define IsEnforce(x)            ((x)->flags & FLAGS_ENFORCE)
 #define IsSentCert(x)           ((x)->flags & FLAGS_SENTCERT)
+#define IsRestored(x)           ((x)->flags & FLAGS_RESTORED)
+#define IsSplit(x)              ((x)->flags & FLAGS_SPLIT)
+#define IsNickCheck(x)          ((x)->flags & FLAGS_NICKCHECK)
 
 #define SetConnecting(x)        ((x)->flags |= FLAGS_CONNECTING)
 #define SetClosing(x)           ((x)->flags |= FLAGS_CLOSING)
 #define SetOnAccess(x)          ((x)->flags |= FLAGS_ONACCESS)
 #define SetEnforce(x)           ((x)->flags |= FLAGS_ENFORCE)
 #define SetSentCert(x)          ((x)->flags |= FLAGS_SENTCERT)
+#define SetRestored(x)          ((x)->flags |= FLAGS_RESTORED)
+#define SetSplit(x)             ((x)->flags |= FLAGS_SPLIT)
+#define SetNickCheck(x)         ((x)->flags |= FLAGS_NICKCHECK)
 
 #define ClearConnecting(x)      ((x)->flags &= ~FLAGS_CONNECTING)
 #define ClearOnAccess(x)        ((x)->flags &= ~FLAGS_ONACCESS)
 #define ClearEnforce(x)         ((x)->flags &= ~FLAGS_ENFORCE)
 #define ClearSentCert(x)        ((x)->flags &= ~FLAGS_SENTCERT)
+#define ClearNickCheck(x)       ((x)->flags &= ~FLAGS_NICKCHECK)
 
 #define IsServer(x)             ((x)->status & STAT_SERVER)
 #define IsClient(x)             ((x)->status & STAT_CLIENT)
@@ -143,13 +153,12 @@ struct Client
   dlink_node lnode;   /* local server or client list node */
   dlink_node snode;   /* global_server_list node */
   dlink_node *kill_node; /* client is on the kill list */
+  dlink_node *akill_node; /* client is on the delayed akill list */
   dlink_list channel;
 
   dlink_list server_list;   /**< Servers on this server      */
   dlink_list client_list;   /**< Clients on this server      */
 
-  struct Client *hnext;         /* For client hash table lookups by name */
-  struct Client *idhnext;       /* For SID hash table lookups by sid */
   struct Client *from;
   struct Client *servptr;
   struct Client *uplink;        /* services uplink server */
@@ -64,6 +64,7 @@ EXTERN const char *core_modules[];
 EXTERN struct Module *find_module(const char *, int);
 EXTERN void * load_module(const char *);
 EXTERN void unload_module(struct Module *);
+EXTERN void boot_core_modules(void);
 EXTERN void boot_modules(char);
 EXTERN void cleanup_modules();
 EXTERN dlink_list* get_modpaths();
@@ -6,7 +6,9 @@
 extern struct Client me;
 extern struct Callback *connected_cb;
 
+struct Client *make_uplink();
 void connect_server();
+void connect_server_ready();
 CBFUNC server_connected;
 
 #endif /* INCLUDED_connection_h */
@@ -7,7 +7,10 @@
 #define DIGEST_LEN 20
 
 char *generate_md5_salt(char *, int);
-char *crypt_pass(char *, int);
+char *crypt_pass(const char *, int);
+void hmac_set_key(const char *);
+unsigned int hmac_digest(const char *, size_t, unsigned char *);
+void cleanup_hmac();
 void
 base16_encode(char *, size_t, const char *, size_t);
 
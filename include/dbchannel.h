@@ -75,6 +75,9 @@ int dbchannel_list_all(dlink_list *);
 void dbchannel_list_all_free(dlink_list *);
 int dbchannel_list_regular(dlink_list *);
 void dbchannel_list_regular_free(dlink_list *);
+int dbchannel_list_all_match(dlink_list *, const char *, const char *, int);
+int dbchannel_list_regular_match(dlink_list *, const char *, const char *, int);
+int dbchannel_list_forbid_match(dlink_list *, const char *, const char *, int);
 int dbchannel_list_forbid(dlink_list *);
 void dbchannel_list_forbid_free(dlink_list *);
 
@@ -36,6 +36,11 @@ struct InfoList
   char *level;
 };
 
+/*
+ * Column values belong to the result set, the driver may point them
+ * straight into its own copy of the result.  They are valid until
+ * db_free_result() and must not be changed or freed by the caller.
+ */
 typedef struct row
 {
   int col_count;
@@ -46,8 +51,36 @@ typedef struct result_set
 {
   int row_count;
   row_t *rows;
+  void *handle; /* driver private, what the values point into */
 } result_set_t;
 
+/*
+ * Prepared executions queued on a pipeline are sent to the database
+ * together and their results collected together, a driver that supports
+ * it does the whole pipeline in one round trip.  Outside of a transaction
+ * the steps are atomic, a failing step undoes the ones before it and the
+ * ones after it are not run.  The parameters are pointed to, not copied,
+ * and must stay valid until db_pipeline_run().
+ */
+#define DB_PIPELINE_MAX 8
+
+struct DBPipelineStep
+{
+  int query;
+  int type;               /* QUERY or EXECUTE */
+  const char *format;
+  dlink_list args;
+  result_set_t *result;   /* QUERY steps, NULL on error */
+  int rows;               /* EXECUTE steps, rows changed or -1 on error */
+  int error;              /* 0 once the step has succeeded */
+};
+
+struct DBPipeline
+{
+  int count;
+  struct DBPipelineStep steps[DB_PIPELINE_MAX];
+};
+
 typedef struct DataBaseModule
 {
   void *connection;
@@ -64,6 +97,9 @@ typedef struct DataBaseModule
   int64_t (*next_id)(const char *, const char *);
   int64_t (*insert_id)(const char *, const char *);
   int (*is_connected)();
+  int (*reconnect_poll)();  /* optional, 1 connected, 0 pending, -1 failed */
+  int (*execute_pipeline)(struct DBPipeline *); /* optional, TRUE if every
+                                                   step succeeded */
 } database_t;
 
 enum db_queries
@@ -73,7 +109,6 @@ enum db_queries
   GET_NICK_FROM_NICKID,
   GET_ACCID_FROM_NICK,
   GET_NICKID_FROM_NICK,
-  INSERT_ACCOUNT,
   INSERT_NICK,
   DELETE_NICK,
   DELETE_ACCOUNT,
@@ -84,7 +119,6 @@ enum db_queries
   GET_CHAN_ACCESSES,
   GET_CHANID_FROM_CHAN,
   GET_FULL_CHAN,
-  INSERT_CHAN,
   INSERT_CHANACCESS,
   SET_CHAN_LEVEL,
   DELETE_CHAN_ACCESS,
@@ -182,7 +216,6 @@ enum db_queries
   GET_NICKCERT,
   SET_EXPIREBANS_LIFETIME,
   GET_SERVICEMASK_MASKS,
-  INSERT_GROUP,
   GET_FULL_GROUP,
   DELETE_GROUP,
   GET_GROUP_FROM_GROUPID,
@@ -211,6 +244,22 @@ enum db_queries
   GET_CHAN_GROUP_MASTERS,
   SET_SYNCHRONOUS_COMMIT,
   UNSET_SYNCHRONOUS_COMMIT,
+  GET_ALL_NICKACCESS,
+  GET_ALL_NICKCERTS,
+  BATCH_NICK_LAST_SEEN,
+  BATCH_ACCOUNT_LAST,
+  BATCH_CHAN_LAST_USED,
+  GET_NICKS_MATCH,
+  GET_NICKS_OPER_MATCH,
+  GET_FORBIDS_MATCH,
+  GET_CHANNELS_MATCH,
+  GET_CHANNELS_OPER_MATCH,
+  GET_CHANNEL_FORBIDS_MATCH,
+  GET_GROUPS_MATCH,
+  GET_GROUPS_OPER_MATCH,
+  INSERT_ACCOUNT_ID,
+  INSERT_CHAN_ID,
+  INSERT_GROUP_ID,
   QUERY_COUNT
 };
 
@@ -241,6 +290,7 @@ result_set_t *db_vexecute(int, int *, const char *, dlink_list *);
 int db_vexecute_nonquery(int, const char *, dlink_list *);
 
 void db_free_result(result_set_t *result);
+int db_row_int(const row_t *, int);
 
 int64_t db_nextid(const char *, const char *);
 int64_t db_insertid(const char *, const char *);
@@ -249,11 +299,54 @@ int db_begin_transaction();
 int db_commit_transaction();
 int db_rollback_transaction();
 
+void db_pipeline_init(struct DBPipeline *);
+int db_pipeline_execute(struct DBPipeline *, int, const char *, ...);
+int db_pipeline_nonquery(struct DBPipeline *, int, const char *, ...);
+int db_pipeline_run(struct DBPipeline *);
+result_set_t *db_pipeline_result(struct DBPipeline *, int);
+void db_pipeline_free(struct DBPipeline *);
+
+int db_is_connected();
+
 void db_reopen_log();
 void db_log(const char *, ...);
+int db_log_enabled();
+char *db_read_upgrade(const char *, int);
+
+/* names a LIST command shows at most */
+#define DB_LIST_LIMIT 50
+
+/*
+ * Batched updates of frequently changing, non critical columns.  Tables
+ * and their columns, in the order the BATCH_ queries take them.
+ */
+enum BatchTable
+{
+  BATCH_NICKNAME = 0,
+  BATCH_ACCOUNT,
+  BATCH_CHANNEL,
+  BATCH_TABLE_COUNT
+};
+
+enum BatchColumn
+{
+  BATCH_LAST_SEEN = 0,      /* nickname */
+  BATCH_LAST_HOST = 0,      /* account */
+  BATCH_LAST_REALNAME,
+  BATCH_LAST_QUIT,
+  BATCH_LAST_QUITTIME,
+  BATCH_LAST_USED = 0,      /* channel */
+  BATCH_MAX_COLUMNS = 4
+};
+
+void db_batch_set(int, unsigned int, int, const char *);
+void db_batch_set_int(int, unsigned int, int, int);
+void db_batch_flush(void *);
 
 int db_string_list(unsigned int, dlink_list *);
 int db_string_list_by_id(unsigned int, dlink_list *, unsigned int);
+int db_string_list_match(unsigned int, dlink_list *, const char *,
+    const char *, int);
 void db_string_list_free(dlink_list *);
 
 #endif /* INCLUDED_dbm_h */
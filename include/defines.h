@@ -12,6 +12,8 @@
 #define DPATH       PREFIX "/"
 #define LPATH       LOGDIR "services.log"
 #define PPATH       PIDDIR "services.pid"
+#define JPATH       LOCALSTATEDIR "/db.journal"
+#define SPATH       LOCALSTATEDIR "/services.snapshot"
 
 #define SENDMAIL_PATH "/usr/sbin/sendmail -t"
 
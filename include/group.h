@@ -62,6 +62,8 @@ void group_list_all_free(dlink_list *);
 
 int group_list_regular(dlink_list *);
 void group_list_regular_free(dlink_list *);
+int group_list_all_match(dlink_list *, const char *, const char *, int);
+int group_list_regular_match(dlink_list *, const char *, const char *, int);
 
 Group *group_new();
 inline void group_free(Group *);
@@ -29,16 +29,10 @@
 #define FNV1_32_SIZE (1 << FNV1_32_BITS)  /* 2^16 = 65536 */
 #define HASHSIZE FNV1_32_SIZE
 
-enum {
-  HASH_TYPE_ID,
-  HASH_TYPE_CLIENT,
-  HASH_TYPE_CHANNEL,
-  HASH_TYPE_SERVICE,
-  HASH_TYPE_RESERVED
-};
-
 struct Channel;
 struct Service;
+struct KillHost;
+struct KillMask;
 
 void init_hash(void);
 
@@ -56,7 +50,6 @@ struct Client *find_client(const char *);
 struct Client *find_server(const char *);
 struct Service *find_service(const char *);
 struct Channel *hash_find_channel(const char *);
-void *hash_get_bucket(int, unsigned int);
 
 struct MessageQueue *hash_find_mqueue_host(struct MessageQueue **,
   const char *);
@@ -68,5 +61,13 @@ struct TorNode *find_tor(const char *);
 void hash_add_tor(struct TorNode *);
 void hash_del_tor(struct TorNode *);
 
+struct KillHost *find_killhost(const char *);
+void hash_add_killhost(struct KillHost *);
+void hash_del_killhost(struct KillHost *);
+struct KillMask *find_killmask(const char *);
+void hash_add_killmask(struct KillMask *);
+void hash_del_killmask(struct KillMask *);
+
 unsigned int strhash(const char *);
+unsigned int hash_string(const char *);
 #endif  /* INCLUDED_hash_h */
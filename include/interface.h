@@ -16,7 +16,6 @@ struct ServiceMask;
 struct Service
 {
   dlink_node node;
-  struct Service *hnext;
 
   char name[NICKLEN+1];
   struct ServiceMessageTree msg_tree;
@@ -35,6 +34,7 @@ extern dlink_list services_list;
 extern struct Callback *send_newuser_cb;
 extern struct Callback *send_privmsg_cb;
 extern struct Callback *send_notice_cb;
+extern struct Callback *send_notices_cb;
 extern struct Callback *send_gnotice_cb;
 extern struct Callback *send_umode_cb;
 extern struct Callback *send_cloak_cb;
@@ -61,6 +61,7 @@ extern struct Callback *on_umode_change_cb;
 extern struct Callback *on_cmode_change_cb;
 extern struct Callback *on_squit_cb;
 extern struct Callback *on_quit_cb;
+extern struct Callback *on_split_cb;
 extern struct Callback *on_part_cb;
 extern struct Callback *on_join_cb;
 extern struct Callback *on_nick_change_cb;
@@ -68,6 +69,8 @@ extern struct Callback *on_identify_cb;
 extern struct Callback *on_newuser_cb;
 extern struct Callback *on_channel_created_cb;
 extern struct Callback *on_channel_destroy_cb;
+extern struct Callback *on_client_free_cb;
+extern struct Callback *on_channel_free_cb;
 extern struct Callback *on_topic_change_cb;
 extern struct Callback *on_privmsg_cb;
 extern struct Callback *on_notice_cb;
@@ -88,6 +91,7 @@ extern struct Callback *do_event_cb;
 extern struct ModeList *ServerModeList;
 
 void init_interface();
+void load_services_language();
 void cleanup_interface();
 
 struct Service *make_service(char *);
@@ -109,7 +113,7 @@ void do_help(struct Service *, struct Client *, const char *, int, char **);
 void identify_user(struct Client *);
 void send_nick_change(struct Service *, struct Client *, const char *);
 void send_umode(struct Service *, struct Client *, const char *);
-void send_akill(struct Service *, char *, struct ServiceMask *);
+void send_akill(struct Service *, const char *, struct ServiceMask *);
 void send_resv(struct Service *, char *, char *, time_t);
 void send_unresv(struct Service *, char *);
 void send_autojoin(struct Service *, struct Client *, const char *);
@@ -1,16 +1,76 @@
 #ifndef INCLUDED_kill_h
-#define INCLUDED_kill_h 
+#define INCLUDED_kill_h
 
-void init_kill();
-void kill_user(struct Service *, struct Client *, const char *);
-void kill_remove_service(struct Service *);
-void kill_remove_client(struct Client *);
+struct ServiceMask;
+
+/*
+ * Kills and akills wait in one queue and are sent by check_kills() once a
+ * second, oldest first.  At most KILL_RATE go out a second, and none while
+ * the uplink's sendq is over KILL_SENDQ_MAX, so a mass kill can not overrun
+ * it.
+ */
+#define KILL_RATE             50          /* kills and akills sent a second */
+#define KILL_SENDQ_MAX        (32 * 1024) /* sendq bytes that hold sending */
+#define KILL_AKILL_THRESHOLD  3     /* kills waiting on a host to akill it */
+#define KILL_AKILL_DURATION   3600  /* for an akill that replaces kills */
+#define KILL_AKILL_RESEND     60    /* seconds an akill is not sent again */
+#define KILL_WINDOW           10    /* seconds the send rate is taken over */
+
+struct KillHost;
+struct KillMask;
 
 struct KillRequest
 {
+  dlink_node node;            /* in the kill queue */
+  dlink_node host_node;       /* in host->requests */
   struct Service *service;
-  struct Client *client;
-  const char *reason;
+  struct Client *client;      /* NULL for an akill */
+  struct KillHost *host;      /* set if the host may be akilled instead */
+  struct KillMask *akill;     /* set for an akill */
+  char *setter;
+  char *reason;
+  time_t time_set;            /* of the akill */
+  time_t duration;
 };
 
+/* the waiting kills that may become an akill on their host */
+struct KillHost
+{
+  char host[HOSTLEN+1];
+  dlink_list requests;
+};
+
+/* akills waiting or sent lately, to send each only once */
+struct KillMask
+{
+  dlink_node node;
+  time_t sent;                /* 0 while it waits */
+  char mask[USERHOSTLEN+1];
+};
+
+struct KillStats
+{
+  unsigned long kills;        /* kills sent */
+  unsigned long akills;       /* akills sent */
+  unsigned long merged;       /* kills dropped for an akill on their host */
+  unsigned long duplicates;   /* akills not sent again */
+  unsigned long held;         /* seconds sending was held by the sendq */
+  unsigned int rate;          /* kills and akills sent a second */
+  unsigned int peak;          /* most requests ever waiting */
+  time_t window_start;
+  unsigned int window_sent;
+};
+
+extern struct KillStats kill_stats;
+
+void init_kill();
+void kill_user(struct Service *, struct Client *, const char *);
+void kill_user_host(struct Service *, struct Client *, const char *);
+void kill_akill(struct Service *, const char *, struct ServiceMask *);
+void kill_akill_client(struct Service *, const char *, struct ServiceMask *,
+    struct Client *);
+unsigned int kill_queue_length();
+void kill_remove_service(struct Service *);
+void kill_remove_client(struct Client *);
+
 #endif
@@ -10,13 +10,45 @@
 
 #define LANG_TABLE_SIZE 512
 
+/*
+ * A catalog compiled by "langcheck -c" from a .lang file.  The header is
+ * followed by one offset per entry, 0 for none, and the NUL terminated
+ * strings they point to, the lines of an entry joined by newlines.
+ */
+#define LANG_CATALOG_MAGIC    0x4c43534f  /* "OSCL" */
+#define LANG_CATALOG_VERSION  1
+
+struct LanguageCatalog
+{
+  unsigned int magic;
+  unsigned int version;
+  unsigned int lang;
+  unsigned int name;      /* offset of the language name */
+  unsigned int count;     /* entry offsets that follow */
+};
+
+/* An entry without conversions, split into the lines sent for it */
+struct LanguageTemplate
+{
+  char *text;
+  char **lines;
+  int count;
+};
+
 struct LanguageFile
 {
   char *name;
-  char *entries[LANG_TABLE_SIZE];
+  char *entries[LANG_TABLE_SIZE];   /* into catalog when it is mapped */
+  struct LanguageTemplate *templates[LANG_TABLE_SIZE];  /* built on use */
+  char *catalog;
+  size_t catalog_size;
 };
 
 void load_language(struct LanguageFile *, const char *);
 void unload_languages(struct LanguageFile *);
+struct LanguageTemplate *language_template(struct LanguageFile *,
+    unsigned int);
+int language_split(char *, char **);
+int language_max_lines(const char *);
 
 #endif /* INCLUDED_language_h */
@@ -82,6 +82,9 @@ int nickname_set_master(Nickname *, const char *);
 
 int nickname_save(Nickname *);
 
+void init_nickname_access();
+void nickname_access_reload(void *);
+
 int nickname_accesslist_add(struct AccessEntry *);
 int nickname_accesslist_list(Nickname *, dlink_list *);
 int nickname_accesslist_check(Nickname *, const char *);
@@ -108,6 +111,9 @@ void nickname_list_all_free(dlink_list *);
 
 int nickname_list_regular(dlink_list *);
 void nickname_list_regular_free(dlink_list *);
+int nickname_list_all_match(dlink_list *, const char *, const char *, int);
+int nickname_list_regular_match(dlink_list *, const char *, const char *, int);
+int nickname_list_forbid_match(dlink_list *, const char *, const char *, int);
 
 int nickname_list_forbid(dlink_list *);
 void nickname_list_forbid_free(dlink_list *);
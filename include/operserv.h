@@ -5,7 +5,10 @@
 
 #include "operserv-lang.h"
 
-#define OPERSERV_AKILL_CHECK_TIME 10
-#define OPERSERV_AKILL_CHECK_CNT  100
+/* share of the main loop the delayed akill checks may take, in percent,
+ * and the bounds on one slice in microseconds */
+#define OPERSERV_AKILL_CHECK_SHARE 10
+#define OPERSERV_AKILL_CHECK_MIN   1000
+#define OPERSERV_AKILL_CHECK_MAX   50000
 
 #endif /* INCLUDED_operserv_h */
@@ -0,0 +1,23 @@
+#ifndef INCLUDED_replay_h
+#define INCLUDED_replay_h
+
+#define CAPTURE_MAGIC       "# oftc-ircservices capture 1"
+#define CAPTURE_BUFSIZE     65536 /* flushed when full and every second */
+#define REPLAY_POLL_LINES   128   /* lines between polls of the db events */
+#define REPLAY_MAXCOMMANDS  64    /* distinct commands timed separately */
+
+struct ReplayCommand
+{
+  char name[32];
+  unsigned int count;
+  double total;
+  double max;
+};
+
+void init_capture(const char *);
+void cleanup_capture();
+void capture_line(const char *, size_t);
+
+void replay_run(const char *);
+
+#endif /* INCLUDED_replay_h */
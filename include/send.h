@@ -6,6 +6,7 @@
 void send_queued_write(struct Client *);
 void send_queued_all(void);
 void sendto_server(struct Client *, const char *, ...);
+void sendto_server_lines(struct Client *, const char *, char **, int);
 
 #define ALL_MEMBERS  0
 #define NON_CHANOPS  1
@@ -34,6 +34,9 @@ enum ServiceMaskType
   QUIET_MASK,
 };
 
+struct Client;
+struct ServiceMaskMatch;
+
 struct ServiceMask
 {
   unsigned int id;
@@ -45,9 +48,12 @@ struct ServiceMask
   char *reason;
   time_t time_set;
   time_t duration;
+  struct ServiceMaskMatch *compiled; /* split/compiled mask, built on demand */
 };
 
 void free_servicemask(struct ServiceMask *);
+int servicemask_match_client(struct ServiceMask *, struct Client *);
+const char *servicemask_literal_host(struct ServiceMask *);
 
 int servicemask_add_akick_target(unsigned int, unsigned int, unsigned int, unsigned int,
   unsigned int, const char *);
@@ -14,6 +14,8 @@ struct ServicesState_t
   char *dblogfile;
   char *pidfile;
   char *namesuffix;
+  char *capturefile;
+  char *replayfile;
   int foreground;
   int printversion;
   int debugmode;
@@ -24,4 +26,11 @@ struct ServicesState_t
 EXTERN struct ServicesState_t ServicesState;
 EXTERN int dorehash;
 
+/*
+ * Temporaries for the line being parsed and the command being run, reset
+ * after each line and each pass of the main loop.
+ */
+#define REQUEST_ARENA_SIZE  16384
+EXTERN struct Arena *request_arena;
+
 #endif /* INCLUDED_services_h */
@@ -0,0 +1,27 @@
+#ifndef INCLUDED_snapshot_h
+#define INCLUDED_snapshot_h
+
+/*
+ * Clients and channel members found in the snapshot skip the checks
+ * NickServ and ChanServ run on a new user or a join, they passed them
+ * before the restart.  Once the burst is done NickServ reloads their
+ * Nickname and checks them again for forbids, drops and enforcement, and
+ * ChanServ enforces forbids and akicks on the restored channels, so
+ * changes made while services were down still apply.  Access level
+ * changes made meanwhile (restricted channels, deops) only take effect
+ * when the member joins again.
+ */
+#define SNAPSHOT_TIME     300   /* seconds between periodic snapshots */
+#define SNAPSHOT_MAXAGE   900   /* older snapshots are not restored */
+
+void init_snapshot();
+void snapshot_load_start();
+void cleanup_snapshot();
+void snapshot_write();
+
+void snapshot_restore_client(struct Client *);
+int snapshot_restore_channel(struct Channel *);
+int snapshot_channel_restored(struct Channel *);
+int snapshot_member_restored(struct Channel *, struct Client *);
+
+#endif /* INCLUDED_snapshot_h */
@@ -0,0 +1,37 @@
+#ifndef INCLUDED_startup_h
+#define INCLUDED_startup_h
+
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+/*
+ * A startup stage that only touches its own data runs on a worker thread
+ * while the main thread gets on with the rest of the boot.  work() must
+ * not use BlockHeaps, dlink nodes, events or callbacks, done() runs on the
+ * main thread once the work is finished and can.
+ */
+struct StartupTask
+{
+  dlink_node node;
+  const char *name;
+  void (*work)(void *);
+  void (*done)(void *);
+  void *data;
+  double elapsed;       /* time the work took, set by the worker */
+  int pending;          /* started and not waited for yet */
+#ifdef HAVE_PTHREAD
+  pthread_t thread;
+  int threaded;
+#endif
+};
+
+void init_startup();
+void startup_task_start(struct StartupTask *, const char *, void (*)(void *),
+    void (*)(void *), void *);
+void startup_task_wait(struct StartupTask *);
+void startup_wait_all();
+void cleanup_startup();
+void startup_ready(const char *);
+
+#endif /* INCLUDED_startup_h */
@@ -2,8 +2,6 @@
 #define INCLUDED_tor_h
 
 struct TorNode {
-  /* hash linked list */
-  struct TorNode *next;
   /* iteratable list */
   dlink_node node;
 
@@ -1,21 +1,131 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "language.h"
 
 #define FALSE 0
 #define TRUE 1
 
+/* what "langcheck -c" builds up before writing the catalog out */
+static char *data;
+static size_t data_len, data_size;
+static unsigned int offsets[LANG_TABLE_SIZE];
+static unsigned int count;
+
+static void
+data_append(const char *text, size_t len)
+{
+  if(data_len + len + 1 > data_size)
+  {
+    while(data_len + len + 1 > data_size)
+      data_size = data_size ? data_size * 2 : 4096;
+    if((data = realloc(data, data_size)) == NULL)
+    {
+      fprintf(stderr, "Out of memory\n");
+      exit(3);
+    }
+  }
+
+  memcpy(data + data_len, text, len);
+  data_len += len;
+  data[data_len] = '\0';
+}
+
+/* compile_line()
+ *
+ * inputs       - entry number, a line of its text without the tab
+ * output       - none
+ * side effects - the line is added to the entry, same as load_language()
+ *                does when it reads the .lang file itself
+ */
+static void
+compile_line(unsigned int entry, char *text)
+{
+  size_t len = strlen(text);
+
+  if(entry >= LANG_TABLE_SIZE)
+  {
+    fprintf(stderr, "More than %d entries\n", LANG_TABLE_SIZE - 1);
+    exit(3);
+  }
+
+  if(len > 0 && text[len - 1] == '\n')
+    text[--len] = '\0';
+
+  if(offsets[entry] == 0)
+  {
+    /* the previous entry is complete */
+    if(data_len > 0)
+      data_len++;
+    offsets[entry] = data_len;
+  }
+  else
+    data_append("\n", 1);
+
+  data_append(text, len);
+
+  if(entry >= count)
+    count = entry + 1;
+}
+
+static int
+write_catalog(const char *filename, unsigned int lang, unsigned int name)
+{
+  struct LanguageCatalog header;
+  unsigned int base = sizeof(header) + count * sizeof(unsigned int);
+  unsigned int i;
+  FILE *out;
+
+  if((out = fopen(filename, "wb")) == NULL)
+  {
+    fprintf(stderr, "Failed to open: %s\n", filename);
+    return FALSE;
+  }
+
+  header.magic = LANG_CATALOG_MAGIC;
+  header.version = LANG_CATALOG_VERSION;
+  header.lang = lang;
+  header.name = base + name;
+  header.count = count;
+
+  for(i = 0; i < count; i++)
+    if(offsets[i] != 0)
+      offsets[i] += base;
+
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(offsets, sizeof(unsigned int), count, out);
+  fwrite(data, 1, data_len + 1, out);
+
+  if(fclose(out) != 0)
+  {
+    fprintf(stderr, "Failed to write: %s\n", filename);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 int main(int parc, char *parv[])
 {
   FILE *fptr;
   char line[1024+1];
   char *ptr = line;
+  char *output = NULL;
   int lineno = 1;
   int cleanfile = TRUE;
   int tabline = TRUE;
+  unsigned int lang = 0, entry = 0;
+
+  if(parc == 4 && strcmp(parv[1], "-c") == 0)
+  {
+    output = parv[2];
+    parv += 2;
+    parc -= 2;
+  }
 
   if(parc < 2)
   {
-    fprintf(stderr, "Usage: %s <filename>\n", parv[0]);
+    fprintf(stderr, "Usage: %s [-c <catalog>] <filename>\n", parv[0]);
     exit(1);
   }
 
@@ -25,10 +135,22 @@ int main(int parc, char *parv[])
     exit(2);
   }
 
-  ptr = fgets(line, 1024, fptr);
+  if((ptr = fgets(line, 1024, fptr)) == NULL ||
+      (ptr = strchr(line, ' ')) == NULL)
+  {
+    fprintf(stderr, "File %s has no language line\n", parv[1]);
+    exit(2);
+  }
+
   lineno++;
   printf("This language file contains %s", line);
 
+  /* the name goes first, entry offsets are never 0 then */
+  lang = atoi(line);
+  ptr++;
+  ptr[strcspn(ptr, "\n")] = '\0';
+  data_append(ptr, strlen(ptr));
+
   while((ptr = fgets(line, 1024, fptr)) != NULL)
   {
     if(line[0] == ' ')
@@ -43,9 +165,13 @@ int main(int parc, char *parv[])
     }
 
     if(line[0] == '\t')
+    {
       tabline = TRUE;
+      compile_line(entry, line + 1);
+    }
     else 
     {
+      entry++;
       if(!tabline)
         printf("WARNING: Line %d: Previous section had no definition\n", lineno);
       tabline = FALSE;
@@ -60,5 +186,11 @@ int main(int parc, char *parv[])
 
   fclose(fptr);
 
+  if(output != NULL && !write_catalog(output, lang, 0))
+  {
+    remove(output);
+    return 4;
+  }
+
   return 0;
 }
@@ -51,6 +51,7 @@
 #include "mem/dbuf.h"
 #include "mem/memory.h"
 #include "mem/dynlink.h"
+#include "mem/arena.h"
 
 #include "net/irc_getaddrinfo.h"
 #include "net/irc_getnameinfo.h"
@@ -0,0 +1,206 @@
+/*
+ *  oftc-ircservices: an extensible and flexible IRC Services package
+ *  arena.c: A bump allocator for short lived memory.
+ *
+ *  Copyright (C) 2012 Stuart Walsh and the OFTC Coding department
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ *  $Id$
+ */
+
+#include "libioinc.h"
+
+/* every allocation is aligned for any type */
+#define ARENA_ALIGN       (2 * sizeof(void *))
+#define ARENA_ROUND(x)    (((x) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_HEADER      ARENA_ROUND(sizeof(struct ArenaChunk))
+#define chunk_data(c)     ((char *)(c) + ARENA_HEADER)
+
+static struct ArenaChunk *
+arena_new_chunk(struct ArenaChunk *prev, size_t size)
+{
+  struct ArenaChunk *chunk = malloc(ARENA_HEADER + size);
+
+  if(chunk == NULL)
+    outofmemory();
+
+  chunk->prev = prev;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+/* arena_create()
+ *
+ * inputs       - name, size of each chunk
+ * output       - the new arena
+ * side effects - the first chunk is allocated and kept until the arena is
+ *                destroyed
+ */
+struct Arena *
+arena_create(const char *name, size_t chunk_size)
+{
+  struct Arena *arena = MyMalloc(sizeof(struct Arena));
+
+  arena->name = name;
+  arena->chunk_size = ARENA_ROUND(chunk_size);
+  arena->base = arena->current = arena_new_chunk(NULL, arena->chunk_size);
+  return arena;
+}
+
+void
+arena_destroy(struct Arena *arena)
+{
+  if(arena == NULL)
+    return;
+
+  arena_reset(arena);
+  free(arena->base);
+  MyFree(arena);
+}
+
+/* arena_alloc()
+ *
+ * inputs       - arena, number of bytes
+ * output       - uninitialised memory, valid until the arena is reset or
+ *                released past it
+ * side effects - a new chunk is started when the current one is full,
+ *                requests bigger than a chunk get one of their own
+ */
+void *
+arena_alloc(struct Arena *arena, size_t size)
+{
+  struct ArenaChunk *chunk = arena->current;
+  void *ret;
+
+  size = ARENA_ROUND(size > 0 ? size : 1);
+
+  if(chunk->size - chunk->used < size)
+  {
+    chunk = arena_new_chunk(chunk,
+        size > arena->chunk_size ? size : arena->chunk_size);
+    arena->current = chunk;
+  }
+
+  ret = chunk_data(chunk) + chunk->used;
+  chunk->used += size;
+  arena->allocs++;
+
+  return ret;
+}
+
+char *
+arena_strdup(struct Arena *arena, const char *str)
+{
+  size_t len = strlen(str) + 1;
+  char *ret = arena_alloc(arena, len);
+
+  memcpy(ret, str, len);
+  return ret;
+}
+
+/* arena_vsprintf()
+ *
+ * inputs       - arena, format and its arguments
+ * output       - the formatted string
+ * side effects - formats straight into the free end of the current chunk
+ *                when it fits, so most strings cost a single pass
+ */
+char *
+arena_vsprintf(struct Arena *arena, const char *format, va_list args)
+{
+  struct ArenaChunk *chunk = arena->current;
+  size_t room = chunk->size - chunk->used;
+  char *ret = chunk_data(chunk) + chunk->used;
+  va_list copy;
+  int len;
+
+  va_copy(copy, args);
+  len = vsnprintf(ret, room, format, copy);
+  va_end(copy);
+
+  if(len < 0)
+    len = 0;
+
+  if((size_t)len < room)
+  {
+    chunk->used += ARENA_ROUND(len + 1);
+    arena->allocs++;
+    return ret;
+  }
+
+  ret = arena_alloc(arena, len + 1);
+  vsnprintf(ret, len + 1, format, args);
+  return ret;
+}
+
+char *
+arena_sprintf(struct Arena *arena, const char *format, ...)
+{
+  va_list args;
+  char *ret;
+
+  va_start(args, format);
+  ret = arena_vsprintf(arena, format, args);
+  va_end(args);
+
+  return ret;
+}
+
+void
+arena_mark(struct Arena *arena, struct ArenaMark *mark)
+{
+  mark->chunk = arena->current;
+  mark->used = arena->current->used;
+}
+
+/* arena_release()
+ *
+ * inputs       - arena, a mark taken with arena_mark()
+ * output       - none
+ * side effects - everything allocated since the mark is given back and
+ *                the chunks started since then are freed
+ */
+void
+arena_release(struct Arena *arena, const struct ArenaMark *mark)
+{
+  struct ArenaChunk *chunk = arena->current;
+  size_t used = 0;
+
+  for(; chunk != NULL; chunk = chunk->prev)
+    used += chunk->used;
+  if(used > arena->peak)
+    arena->peak = used;
+
+  while(arena->current != mark->chunk)
+  {
+    chunk = arena->current;
+    arena->current = chunk->prev;
+    free(chunk);
+  }
+
+  arena->current->used = mark->used;
+}
+
+void
+arena_reset(struct Arena *arena)
+{
+  struct ArenaMark mark = { arena->base, 0 };
+
+  arena_release(arena, &mark);
+  arena->allocs = 0;
+}
@@ -0,0 +1,71 @@
+/*
+ *  oftc-ircservices: an extensible and flexible IRC Services package
+ *  arena.h: A header for the bump allocator.
+ *
+ *  Copyright (C) 2012 Stuart Walsh and the OFTC Coding department
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ *  $Id$
+ */
+
+#ifndef INCLUDED_libio_mem_arena_h
+#define INCLUDED_libio_mem_arena_h
+
+/*
+ * An arena hands out memory for temporaries by bumping a pointer through
+ * a chunk and takes it all back at once with arena_reset() or
+ * arena_release().  Nothing is freed on its own and the memory is not
+ * zeroed, so it is only for things that die with the work that made them.
+ * Objects that outlive it belong on a BlockHeap or in MyMalloc()ed memory.
+ */
+
+struct ArenaChunk
+{
+  struct ArenaChunk *prev;  /* the chunk filled before this one */
+  size_t size;
+  size_t used;
+  /* data follows */
+};
+
+struct Arena
+{
+  const char *name;
+  size_t chunk_size;
+  struct ArenaChunk *base;     /* kept across resets */
+  struct ArenaChunk *current;  /* chunk allocations come from */
+  unsigned long allocs;        /* since the last reset */
+  size_t peak;                 /* most bytes in use at once */
+};
+
+/* a point in an arena to roll back to */
+struct ArenaMark
+{
+  struct ArenaChunk *chunk;
+  size_t used;
+};
+
+LIBIO_EXTERN struct Arena *arena_create(const char *, size_t);
+LIBIO_EXTERN void arena_destroy(struct Arena *);
+LIBIO_EXTERN void *arena_alloc(struct Arena *, size_t);
+LIBIO_EXTERN char *arena_strdup(struct Arena *, const char *);
+LIBIO_EXTERN char *arena_vsprintf(struct Arena *, const char *, va_list);
+LIBIO_EXTERN char *arena_sprintf(struct Arena *, const char *, ...);
+LIBIO_EXTERN void arena_mark(struct Arena *, struct ArenaMark *);
+LIBIO_EXTERN void arena_release(struct Arena *, const struct ArenaMark *);
+LIBIO_EXTERN void arena_reset(struct Arena *);
+
+#endif /* INCLUDED_libio_mem_arena_h */
@@ -58,14 +58,14 @@ static time_t event_time_min = -1;
 static int eventFind(EVH *func, void *arg);
 
 /*
- * void eventAdd(const char *name, EVH *func, void *arg, time_t when)
+ * int eventAdd(const char *name, EVH *func, void *arg, time_t when)
  *
  * Input: Name of event, function to call, arguments to pass, and frequency
  *	  of the event.
- * Output: None
+ * Output: 1 if the event was added, 0 if the event table is full
  * Side Effects: Adds the event to the event list.
  */
-void
+int
 eventAdd(const char *name, EVH *func, void *arg, time_t when)
 {
   int i;
@@ -85,11 +85,12 @@ eventAdd(const char *name, EVH *func, void *arg, time_t when)
       if ((event_table[i].when < event_time_min) || (event_time_min == -1))
 	event_time_min = event_table[i].when;
 
-      return;
+      return 1;
     }
   }
   /* XXX if reach here, its an error */
   ilog(L_ERROR, "Event table is full! (%d)", i);
+  return 0;
 }
 
 /*
@@ -241,4 +242,6 @@ set_back_events(time_t by)
     else
       event_table[i].when = 0;
   }
+
+  event_time_min = -1;
 }
@@ -29,7 +29,7 @@
  * How many event entries we need to allocate at a time in the block
  * allocator. 16 should be plenty at a time.
  */
-#define	MAX_EVENTS	50
+#define	MAX_EVENTS	100
 
 typedef void EVH(void *);
 
@@ -47,7 +47,7 @@ struct ev_entry
 LIBIO_EXTERN const char *last_event_ran;
 LIBIO_EXTERN struct ev_entry event_table[];
 
-LIBIO_EXTERN void eventAdd(const char *, EVH *, void *, time_t);
+LIBIO_EXTERN int eventAdd(const char *, EVH *, void *, time_t);
 LIBIO_EXTERN void eventAddIsh(const char *, EVH *, void *, time_t);
 LIBIO_EXTERN void eventRun(void);
 LIBIO_EXTERN time_t eventNextTime(void);
@@ -23,6 +23,13 @@
  */
 
 #include "libioinc.h"
+#include <sys/uio.h>
+#include <sys/time.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+# include <sched.h>
+# include <signal.h>
+#endif
 
 #ifdef USE_SYSLOG
 # ifdef HAVE_SYS_SYSLOG_H
@@ -40,7 +47,69 @@ void global_notice(struct Service *, char *, ...);
 /* some older syslogs would overflow at 2024 */
 #define LOG_BUFSIZE 2000
 
-static FBFILE *logFile = NULL;
+/*
+ * Log streams.
+ *
+ * Everything written to a log file goes through a bounded ring of records
+ * which a writer thread drains, so a slow disk never stalls the event
+ * loop.  Producers claim slots with a compare and swap on ring_head and
+ * publish them through the slot sequence number (a Vyukov style bounded
+ * queue); the single writer collects runs of ready records and hands
+ * them to writev().  Opening, reopening and closing a stream are records
+ * too, so they happen on the writer in order with the lines around them.
+ *
+ * When the ring is full a line is dropped rather than blocking, and a
+ * line longer than a record is cut short.  Both are counted and reported
+ * in the main log by the writer.  Without threads, or before init_log()
+ * and after cleanup_log(), records are processed on the spot.
+ */
+#define LOG_RING_SIZE    1024  /* must be a power of two */
+#define LOG_MAX_STREAMS  8
+#define LOG_WRITER_WAIT  100   /* ms the writer sleeps when idle */
+#define LOG_REPORT_TIME  60    /* seconds between drop/truncation reports */
+
+enum
+{
+  LOG_RECORD_DATA,
+  LOG_RECORD_OPEN,
+  LOG_RECORD_CLOSE
+};
+
+struct LogRecord
+{
+  unsigned long seq;
+  int stream;
+  int type;
+  size_t len;
+  char data[LOG_BUFSIZE];
+};
+
+struct LogStream
+{
+  int used;      /* owned by the producers */
+  int fd;        /* owned by the writer */
+};
+
+static struct LogStream log_streams[LOG_MAX_STREAMS];
+static int streams_ready = 0;
+static int main_stream = -1;
+
+static unsigned long log_dropped = 0;
+static unsigned long log_truncated = 0;
+
+#ifdef HAVE_PTHREAD
+static struct LogRecord *log_ring = NULL;
+static unsigned long ring_head = 0;
+static unsigned long ring_tail = 0;
+static pthread_t writer_thread;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static int writer_running = 0;
+static int writer_sleeping = 0;
+static int writer_stop = 0;
+static pthread_t log_main_thread;
+#endif
+
 static int gnotice_logLevel = INIT_LOG_LEVEL;
 static int file_logLevel = INIT_LOG_LEVEL;
 
@@ -73,46 +142,364 @@ static const char *logLevelToString[] =
   "L_TRACE"
 };
 
-/*
- * open_log - open ircd logging file
- * returns true (1) if successful, false (0) otherwise
- */
-static int 
-open_log(const char *filename)
+static void
+log_open_fd(struct LogStream *stream, const char *filename)
 {
-  logFile = fbopen(filename, "a");
+  if (stream->fd != -1)
+    close(stream->fd);
+
+  stream->fd = open(filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
 
-  if (logFile == NULL)
-  {
 #ifdef USE_SYSLOG
+  if (stream->fd == -1)
     syslog(LOG_ERR, "Unable to open log file: %s: %s",
            filename, strerror(errno));
 #endif
-    return (0);
+}
+
+/* handles open and close records, and lines when there is no writer */
+static void
+log_process(const struct LogRecord *rec)
+{
+  struct LogStream *stream = &log_streams[rec->stream];
+
+  switch (rec->type)
+  {
+    case LOG_RECORD_OPEN:
+      log_open_fd(stream, rec->data);
+      break;
+    case LOG_RECORD_CLOSE:
+      if (stream->fd != -1)
+        close(stream->fd);
+      stream->fd = -1;
+      break;
+    default:
+      if (stream->fd != -1 && write(stream->fd, rec->data, rec->len) < 0)
+      {
+        /* nowhere left to complain to */
+      }
+      break;
+  }
+}
+
+/* log_enqueue()
+ *
+ * inputs       - filled in record, whether it may be dropped
+ * output       - none
+ * side effects - record is copied into the ring for the writer, or
+ *                processed right away if there is no writer
+ */
+static void
+log_enqueue(const struct LogRecord *src, int droppable)
+{
+#ifdef HAVE_PTHREAD
+  struct LogRecord *rec;
+  unsigned long pos, seq;
+  long diff;
+
+  if (!__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE))
+  {
+    log_process(src);
+    return;
   }
 
-  return (1);
+  pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+
+  for (;;)
+  {
+    rec = &log_ring[pos & (LOG_RING_SIZE - 1)];
+    seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+    diff = (long)seq - (long)pos;
+
+    if (diff == 0)
+    {
+      if (__atomic_compare_exchange_n(&ring_head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    else if (diff < 0)
+    {
+      /* full, control records have to get through */
+      if (droppable)
+      {
+        __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+        return;
+      }
+      sched_yield();
+      pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    }
+    else
+      pos = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+  }
+
+  rec->stream = src->stream;
+  rec->type = src->type;
+  rec->len = src->len;
+  memcpy(rec->data, src->data, src->len + 1);
+  __atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+
+  if (__atomic_load_n(&writer_sleeping, __ATOMIC_ACQUIRE))
+  {
+    pthread_mutex_lock(&writer_lock);
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+  }
+#else
+  log_process(src);
+#endif
 }
 
-static void 
-write_log(const char *message)
+#ifdef HAVE_PTHREAD
+/* smalldate() is not ours to call from here, it shares a static buffer */
+static void
+log_report_counters(unsigned long *dropped, unsigned long *truncated,
+                    int force)
 {
-  char buf[LOG_BUFSIZE];
-  size_t nbytes = 0;
+  static time_t last_report = 0;
+  unsigned long d = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+  unsigned long t = __atomic_load_n(&log_truncated, __ATOMIC_RELAXED);
+  time_t now = time(NULL);
+  char date[64], buf[LOG_BUFSIZE];
+  struct tm lt;
+  int len;
+
+  if ((d == *dropped && t == *truncated) || main_stream == -1 ||
+      log_streams[main_stream].fd == -1)
+    return;
+
+  if (!force && now - last_report < LOG_REPORT_TIME)
+    return;
+
+  localtime_r(&now, &lt);
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &lt);
+  len = snprintf(buf, sizeof(buf), "[%s] Logging: %lu lines dropped, "
+                 "%lu lines truncated so far\n", date, d, t);
+  if (write(log_streams[main_stream].fd, buf, len) < 0)
+    return;
+
+  last_report = now;
+  *dropped = d;
+  *truncated = t;
+}
+
+/* writes out one run of ready data records for the same stream */
+static unsigned long
+log_write_run(unsigned long tail)
+{
+  struct iovec iov[64];
+  struct LogRecord *rec = &log_ring[tail & (LOG_RING_SIZE - 1)];
+  int stream = rec->stream;
+  int count = 0;
+  int i;
+
+  while (count < 64)
+  {
+    rec = &log_ring[(tail + count) & (LOG_RING_SIZE - 1)];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != tail + count + 1 ||
+        rec->type != LOG_RECORD_DATA || rec->stream != stream)
+      break;
+
+    iov[count].iov_base = rec->data;
+    iov[count].iov_len = rec->len;
+    count++;
+  }
+
+  if (log_streams[stream].fd != -1 && writev(log_streams[stream].fd, iov, count) < 0)
+  {
+    /* nowhere left to complain to */
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    rec = &log_ring[(tail + i) & (LOG_RING_SIZE - 1)];
+    __atomic_store_n(&rec->seq, tail + i + LOG_RING_SIZE, __ATOMIC_RELEASE);
+  }
+
+  return tail + count;
+}
+
+static void *
+log_writer(void *unused)
+{
+  unsigned long reported_dropped = 0, reported_truncated = 0;
+
+  for (;;)
+  {
+    struct LogRecord *rec = &log_ring[ring_tail & (LOG_RING_SIZE - 1)];
+
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) == ring_tail + 1)
+    {
+      if (rec->type == LOG_RECORD_DATA)
+        ring_tail = log_write_run(ring_tail);
+      else
+      {
+        log_process(rec);
+        __atomic_store_n(&rec->seq, ring_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        ring_tail++;
+      }
+      continue;
+    }
+
+    if (__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE))
+    {
+      log_report_counters(&reported_dropped, &reported_truncated, 1);
+      break;
+    }
 
-  if (logFile == NULL)
+    log_report_counters(&reported_dropped, &reported_truncated, 0);
+
+    pthread_mutex_lock(&writer_lock);
+    __atomic_store_n(&writer_sleeping, 1, __ATOMIC_RELEASE);
+
+    /* a record may have been published while we were getting here */
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != ring_tail + 1 &&
+        !__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE))
+    {
+      struct timespec ts;
+      struct timeval tv;
+
+      gettimeofday(&tv, NULL);
+      ts.tv_sec = tv.tv_sec;
+      ts.tv_nsec = tv.tv_usec * 1000 + LOG_WRITER_WAIT * 1000000L;
+      if (ts.tv_nsec >= 1000000000L)
+      {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&writer_cond, &writer_lock, &ts);
+    }
+
+    __atomic_store_n(&writer_sleeping, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&writer_lock);
+  }
+
+  return NULL;
+}
+#endif
+
+/* log_stream_open()
+ *
+ * inputs       - path of the log file
+ * output       - stream id to write to, -1 if none is free
+ * side effects - file is opened for appending by the writer
+ */
+int
+log_stream_open(const char *filename)
+{
+  int i;
+
+  if (!streams_ready)
+  {
+    for (i = 0; i < LOG_MAX_STREAMS; i++)
+      log_streams[i].fd = -1;
+    streams_ready = 1;
+  }
+
+  for (i = 0; i < LOG_MAX_STREAMS; i++)
+  {
+    if (!log_streams[i].used)
+    {
+      log_streams[i].used = 1;
+      log_stream_reopen(i, filename);
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+void
+log_stream_reopen(int stream, const char *filename)
+{
+  struct LogRecord rec;
+
+  assert(stream >= 0 && stream < LOG_MAX_STREAMS);
+
+  rec.stream = stream;
+  rec.type = LOG_RECORD_OPEN;
+  rec.len = strlcpy(rec.data, filename, sizeof(rec.data));
+  log_enqueue(&rec, 0);
+}
+
+void
+log_stream_close(int stream)
+{
+  struct LogRecord rec;
+
+  assert(stream >= 0 && stream < LOG_MAX_STREAMS);
+
+  rec.stream = stream;
+  rec.type = LOG_RECORD_CLOSE;
+  rec.len = 0;
+  rec.data[0] = '\0';
+  log_enqueue(&rec, 0);
+  log_streams[stream].used = 0;
+}
+
+/* log_stream_vprintf()
+ *
+ * inputs       - stream id, format and arguments of the line
+ * output       - none
+ * side effects - line is timestamped and queued for the stream
+ */
+void
+log_stream_vprintf(int stream, const char *fmt, va_list args)
+{
+  struct LogRecord rec;
+  size_t len, room = sizeof(rec.data) - 2; /* leave room for the newline */
+  time_t now = CurrentTime;
+  struct tm lt;
+  int n;
+
+  if (stream < 0)
     return;
 
-  nbytes = snprintf(buf, sizeof(buf),
+  /* not smalldate(), worker threads log too */
+  localtime_r(&now, &lt);
+  len = strftime(rec.data, room, "[%Y-%m-%d %H:%M:%S] ", &lt);
+  n = vsnprintf(rec.data + len, room - len, fmt, args);
+
+  if (n < 0)
+    return;
+
+  if ((size_t)n >= room - len)
+  {
+    __atomic_add_fetch(&log_truncated, 1, __ATOMIC_RELAXED);
+    len = room - 1;
+  }
+  else
+    len += n;
+
 #ifdef _WIN32
-                    "[%s] %s\r\n",
-#else
-                    "[%s] %s\n",
+  rec.data[len++] = '\r';
 #endif
-                    smalldate(CurrentTime), message);
-  fbputs(buf, logFile, nbytes);
+  rec.data[len++] = '\n';
+  rec.data[len] = '\0';
+
+  rec.stream = stream;
+  rec.type = LOG_RECORD_DATA;
+  rec.len = len;
+  log_enqueue(&rec, 1);
+}
+
+void
+log_stream_printf(int stream, const char *fmt, ...)
+{
+  va_list args;
+
+  va_start(args, fmt);
+  log_stream_vprintf(stream, fmt, args);
+  va_end(args);
+}
+
+void
+log_get_counters(unsigned long *dropped, unsigned long *truncated)
+{
+  *dropped = __atomic_load_n(&log_dropped, __ATOMIC_RELAXED);
+  *truncated = __atomic_load_n(&log_truncated, __ATOMIC_RELAXED);
 }
-   
+
 void
 ilog(const int priority, const char *fmt, ...)
 {
@@ -128,7 +515,7 @@ ilog(const int priority, const char *fmt, ...)
     return;
 
   va_start(args, fmt);
-  vsprintf(buf, fmt, args);
+  vsnprintf(buf, sizeof(buf), fmt, args);
   va_end(args);
 
 #ifdef USE_SYSLOG  
@@ -136,7 +523,13 @@ ilog(const int priority, const char *fmt, ...)
     syslog(sysLogLevel[priority], "%s", buf);
 #endif
   if(priority <= file_logLevel)
-    write_log(buf);
+    log_stream_printf(main_stream, "%s", buf);
+
+#ifdef HAVE_PTHREAD
+  /* the uplink is only ever written from the main thread */
+  if (!pthread_equal(pthread_self(), log_main_thread))
+    return;
+#endif
 
   if(priority <= gnotice_logLevel)
     global_notice(NULL, buf);
@@ -145,7 +538,24 @@ ilog(const int priority, const char *fmt, ...)
 void
 init_log(const char *filename)
 {
-  open_log(filename);
+#ifdef HAVE_PTHREAD
+  sigset_t all, old;
+  int i;
+
+  log_main_thread = pthread_self();
+  log_ring = MyMalloc(sizeof(struct LogRecord) * LOG_RING_SIZE);
+  for (i = 0; i < LOG_RING_SIZE; i++)
+    log_ring[i].seq = i;
+
+  /* signals are for the main thread, the writer starts with them blocked */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  if (pthread_create(&writer_thread, NULL, log_writer, NULL) == 0)
+    __atomic_store_n(&writer_running, 1, __ATOMIC_RELEASE);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+
+  main_stream = log_stream_open(filename);
 #ifdef USE_SYSLOG
   openlog(PACKAGE, LOG_PID | LOG_NDELAY, LOG_FACILITY);
 #endif
@@ -154,19 +564,53 @@ init_log(const char *filename)
 #endif
 }
 
+/*
+ * cleanup_log - write out whatever is still queued and stop the writer,
+ * anything logged after this is written directly
+ */
 void
 cleanup_log()
 {
-  if(logFile != NULL)
-    fbclose(logFile);
+  int i;
+
+  if (!streams_ready)
+    return;
+
+#ifdef HAVE_PTHREAD
+  if (__atomic_load_n(&writer_running, __ATOMIC_ACQUIRE))
+  {
+    pthread_mutex_lock(&writer_lock);
+    __atomic_store_n(&writer_stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+
+    pthread_join(writer_thread, NULL);
+    __atomic_store_n(&writer_running, 0, __ATOMIC_RELEASE);
+  }
+#endif
+
+  for (i = 0; i < LOG_MAX_STREAMS; i++)
+  {
+    if (log_streams[i].fd != -1)
+      close(log_streams[i].fd);
+    log_streams[i].fd = -1;
+    log_streams[i].used = 0;
+  }
+  main_stream = -1;
+
+#ifdef HAVE_PTHREAD
+  MyFree(log_ring);
+  log_ring = NULL;
+#endif
 }
 
 void
 reopen_log(const char *filename)
 {
-  if (logFile != NULL)
-    fbclose(logFile);
-  open_log(filename);
+  if (main_stream == -1)
+    main_stream = log_stream_open(filename);
+  else
+    log_stream_reopen(main_stream, filename);
 }
 
 void
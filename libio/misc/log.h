@@ -52,6 +52,19 @@ LIBIO_EXTERN void ilog(const int, const char *, ...);
 #endif
 LIBIO_EXTERN const char *get_log_level_as_string(int);
 
+/* queued log files, written out by the log writer */
+LIBIO_EXTERN int log_stream_open(const char *);
+LIBIO_EXTERN void log_stream_reopen(int, const char *);
+LIBIO_EXTERN void log_stream_close(int);
+LIBIO_EXTERN void log_stream_vprintf(int, const char *, va_list);
+#ifdef __GNUC__
+LIBIO_EXTERN void log_stream_printf(int, const char *, ...)
+  __attribute__((format(printf, 2, 3)));
+#else
+LIBIO_EXTERN void log_stream_printf(int, const char *, ...);
+#endif
+LIBIO_EXTERN void log_get_counters(unsigned long *, unsigned long *);
+
 enum {
   LOG_OPER_TYPE,
   LOG_FAILED_OPER_TYPE,
@@ -43,6 +43,16 @@ LIBIO_EXTERN int match_cidr(const char *, const char *);
 
 LIBIO_EXTERN int has_wildcards(const char *);
 
+/*
+ * compile_mask - prepare a mask for repeated matching with match_compiled
+ * match_compiled - same result as match() on the original mask
+ * free_compiled_mask - release a mask from compile_mask
+ */
+struct CompiledMask;
+LIBIO_EXTERN struct CompiledMask *compile_mask(const char *);
+LIBIO_EXTERN int match_compiled(const struct CompiledMask *, const char *);
+LIBIO_EXTERN void free_compiled_mask(struct CompiledMask *);
+
 /*
  * collapse - collapse a string in place, converts multiple adjacent *'s 
  * into a single *.
@@ -95,6 +95,253 @@ match(const char *mask, const char *name)
   return 0;
 }
 
+/*
+ * Compiled masks.
+ *
+ * A mask is split on its '*' runs into segments once, with every literal
+ * already run through ToLower().  Matching then only has to check the
+ * anchored first and last segments in place and find the rest, in order,
+ * with memmem()/memchr() on a lowercased copy of the name.  The result is
+ * always the same as match() on the original mask.
+ */
+struct MaskSegment
+{
+  const unsigned char *text;
+  size_t len;
+  int wild;                  /* contains '?' or '#' */
+};
+
+struct CompiledMask
+{
+  const char *mask;          /* original mask, for over long names */
+  struct MaskSegment *segs;
+  unsigned int nsegs;
+  size_t minlen;
+  int has_star;
+  int anchor_start;
+  int anchor_end;
+};
+
+/* anything longer than this just falls back to match() */
+#define MATCH_BUFSIZE 512
+
+/* compile_mask()
+ *  Build the compiled form of mask, everything lives in one allocation
+ *  which is released with free_compiled_mask().
+ */
+struct CompiledMask *
+compile_mask(const char *mask)
+{
+  struct CompiledMask *cm;
+  struct MaskSegment *seg;
+  unsigned char *text;
+  const unsigned char *p;
+  size_t len;
+  unsigned int nsegs = 0;
+
+  assert(mask != NULL);
+  len = strlen(mask);
+
+  /* count non empty runs between stars */
+  for (p = (const unsigned char *)mask; *p != '\0'; )
+  {
+    if (*p == '*')
+    {
+      ++p;
+      continue;
+    }
+
+    ++nsegs;
+    while (*p != '\0' && *p != '*')
+      ++p;
+  }
+
+  if (nsegs == 0 && strchr(mask, '*') == NULL)
+    nsegs = 1; /* the empty mask only matches the empty name */
+
+  /* always room for one segment, even when the mask is all stars */
+  cm = MyMalloc(sizeof(struct CompiledMask) +
+                (nsegs + 1) * sizeof(struct MaskSegment) + 2 * (len + 1));
+  cm->segs = (struct MaskSegment *)(cm + 1);
+  text = (unsigned char *)(cm->segs + nsegs + 1);
+  memcpy(text, mask, len + 1);
+  cm->mask = (const char *)text;
+  text += len + 1;
+
+  cm->nsegs = nsegs;
+  cm->has_star = strchr(mask, '*') != NULL;
+  cm->anchor_start = *mask != '*';
+  cm->anchor_end = len == 0 || mask[len - 1] != '*';
+
+  seg = cm->segs;
+  seg->text = text;
+
+  for (p = (const unsigned char *)mask; *p != '\0'; ++p)
+  {
+    if (*p == '*')
+    {
+      /* move on once another segment is sure to follow */
+      if (seg->len != 0 && p[1] != '*' && p[1] != '\0')
+      {
+        *text++ = '\0';
+        ++seg;
+        seg->text = text;
+      }
+      continue;
+    }
+
+    if (*p == '?' || *p == '#')
+      seg->wild = 1;
+
+    *text++ = ToLower(*p);
+    seg->len++;
+    cm->minlen++;
+  }
+
+  *text = '\0';
+  return cm;
+}
+
+void
+free_compiled_mask(struct CompiledMask *cm)
+{
+  MyFree(cm);
+}
+
+/* does seg match at name, name already lowercased when folded is set */
+static int
+segment_at(const struct MaskSegment *seg, const unsigned char *name, int folded)
+{
+  size_t i;
+
+  if (!seg->wild)
+  {
+    if (folded)
+      return memcmp(seg->text, name, seg->len) == 0;
+
+    for (i = 0; i < seg->len; ++i)
+      if (seg->text[i] != ToLower(name[i]))
+        return 0;
+    return 1;
+  }
+
+  for (i = 0; i < seg->len; ++i)
+  {
+    unsigned char c = seg->text[i];
+
+    if (c == '?' || c == ToLower(name[i]) || (c == '#' && IsDigit(name[i])))
+      continue;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* first position in [name, end) where seg matches, NULL if none */
+static const unsigned char *
+segment_find(const struct MaskSegment *seg, const unsigned char *name,
+             const unsigned char *end)
+{
+  const unsigned char *last;
+  unsigned char first;
+
+  if ((size_t)(end - name) < seg->len)
+    return NULL;
+
+  if (!seg->wild)
+    return memmem(name, end - name, seg->text, seg->len);
+
+  last = end - seg->len;
+  first = seg->text[0];
+
+  while (name <= last)
+  {
+    if (first != '?' && first != '#')
+    {
+      name = memchr(name, first, last - name + 1);
+      if (name == NULL)
+        return NULL;
+    }
+
+    if (segment_at(seg, name, 1))
+      return name;
+    ++name;
+  }
+
+  return NULL;
+}
+
+/* match_compiled()
+ *  match() against a mask prepared with compile_mask()
+ *      return  1, if match
+ *              0, if no match
+ */
+int
+match_compiled(const struct CompiledMask *cm, const char *name)
+{
+  unsigned char buf[MATCH_BUFSIZE];
+  const unsigned char *n = (const unsigned char *)name;
+  const unsigned char *start, *end;
+  unsigned int first = 0, last = cm->nsegs;
+  size_t nlen;
+  size_t i;
+
+  assert(name != NULL);
+  nlen = strlen(name);
+
+  if (nlen < cm->minlen)
+    return 0;
+
+  if (!cm->has_star)
+    return nlen == cm->minlen && segment_at(&cm->segs[0], n, 0);
+
+  if (nlen >= sizeof(buf))
+    return match(cm->mask, name);
+
+  start = n;
+  end = n + nlen;
+
+  /* cheap rejects first, the fixed prefix and suffix */
+  if (cm->anchor_start)
+  {
+    if (!segment_at(&cm->segs[0], start, 0))
+      return 0;
+    start += cm->segs[0].len;
+    first = 1;
+  }
+
+  if (cm->anchor_end && last > first)
+  {
+    const struct MaskSegment *seg = &cm->segs[last - 1];
+
+    if ((size_t)(end - start) < seg->len || !segment_at(seg, end - seg->len, 0))
+      return 0;
+    end -= seg->len;
+    --last;
+  }
+
+  if (first == last)
+    return 1;
+
+  /* leftmost placement of each middle segment is always good enough */
+  for (i = 0; i < nlen; ++i)
+    buf[i] = ToLower(n[i]);
+
+  start = buf + (start - n);
+  end = buf + (end - n);
+
+  for (; first < last; ++first)
+  {
+    const struct MaskSegment *seg = &cm->segs[first];
+
+    if ((start = segment_find(seg, start, end)) == NULL)
+      return 0;
+    start += seg->len;
+  }
+
+  return 1;
+}
+
 /* match_esc()
  *
  * The match() function with support for escaping characters such
@@ -0,0 +1,173 @@
+/*
+ *  matchbench.c: match() against match_compiled() over ban lists
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ */
+
+/*
+ * Builds ban lists shaped like the ones on a busy channel (host and
+ * domain bans, ident bans, nick prefixes, address ranges, the odd '?'),
+ * then checks a stream of nick!user@host names against every ban, once
+ * with match() and once with the compiled masks.  Both must agree on every
+ * pair, the run fails otherwise.
+ *
+ *   make -C libio/string bench
+ *   ./matchbench [bans per list] [lists] [clients]
+ */
+
+#include "libioinc.h"
+#include <sys/time.h>
+
+static double
+bench_clock()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static const char *domains[] =
+{
+  "dsl.example.net", "cable.example.com", "users.example.org",
+  "pool.isp.example", "dynamic.telco.example.de", "res.example.co.uk"
+};
+#define DOMAINS (sizeof(domains) / sizeof(domains[0]))
+
+static void
+make_ban(char *buf, size_t len, unsigned int i)
+{
+  unsigned int d = i % DOMAINS;
+
+  switch(i % 8)
+  {
+    case 0:
+    case 1:
+      snprintf(buf, len, "*!*@host-%u.%s", i * 7919 % 100000, domains[d]);
+      break;
+    case 2:
+      snprintf(buf, len, "*!*@*.%s", domains[d]);
+      break;
+    case 3:
+      snprintf(buf, len, "*!~user%u@*", i * 31 % 5000);
+      break;
+    case 4:
+      snprintf(buf, len, "spam%u*!*@*", i % 1000);
+      break;
+    case 5:
+      snprintf(buf, len, "*!*@10.%u.%u.*", i % 256, i * 13 % 256);
+      break;
+    case 6:
+      snprintf(buf, len, "*!*@*host-%u*", i * 7919 % 100000);
+      break;
+    default:
+      snprintf(buf, len, "bot??%u!*@*.%s", i % 100, domains[d]);
+      break;
+  }
+}
+
+static void
+make_client(char *buf, size_t len, unsigned int i)
+{
+  if(i % 4 == 0)
+    snprintf(buf, len, "User%u!~user%u@10.%u.%u.%u", i, i % 5000,
+        i % 256, i * 7 % 256, i * 11 % 256);
+  else
+    snprintf(buf, len, "Nick%u!ident%u@host-%u.%s", i, i % 977,
+        i * 104729 % 100000, domains[i % DOMAINS]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned int nbans = argc > 1 ? atoi(argv[1]) : 100;
+  unsigned int nlists = argc > 2 ? atoi(argv[2]) : 50;
+  unsigned int nclients = argc > 3 ? atoi(argv[3]) : 2000;
+  unsigned int total = nbans * nlists;
+  char **bans = MyMalloc(total * sizeof(char *));
+  struct CompiledMask **compiled = MyMalloc(total * sizeof(*compiled));
+  char **clients = MyMalloc(nclients * sizeof(char *));
+  unsigned long plain_hits = 0, compiled_hits = 0, mismatches = 0;
+  double start, plain_time, compiled_time;
+  char buf[256];
+  unsigned int i, j, l;
+
+  for(i = 0; i < total; i++)
+  {
+    make_ban(buf, sizeof(buf), i);
+    DupString(bans[i], buf);
+    compiled[i] = compile_mask(bans[i]);
+  }
+
+  for(i = 0; i < nclients; i++)
+  {
+    make_client(buf, sizeof(buf), i);
+    DupString(clients[i], buf);
+  }
+
+  /* every client joins every list, as a burst over that many channels */
+  start = bench_clock();
+  for(l = 0; l < nlists; l++)
+    for(i = 0; i < nclients; i++)
+      for(j = l * nbans; j < (l + 1) * nbans; j++)
+        plain_hits += match(bans[j], clients[i]) != 0;
+  plain_time = bench_clock() - start;
+
+  start = bench_clock();
+  for(l = 0; l < nlists; l++)
+    for(i = 0; i < nclients; i++)
+      for(j = l * nbans; j < (l + 1) * nbans; j++)
+        compiled_hits += match_compiled(compiled[j], clients[i]) != 0;
+  compiled_time = bench_clock() - start;
+
+  for(i = 0; i < nclients; i++)
+    for(j = 0; j < total; j++)
+      if((match(bans[j], clients[i]) != 0) !=
+          (match_compiled(compiled[j], clients[i]) != 0))
+      {
+        if(mismatches++ < 10)
+          fprintf(stderr, "mismatch: %s against %s\n", bans[j], clients[i]);
+      }
+
+  printf("%u lists of %u bans, %u clients, %lu checks each\n", nlists, nbans,
+      nclients, (unsigned long)total * nclients);
+  printf("match():          %8.3fs %7.1fns/check %lu matched\n", plain_time,
+      plain_time * 1e9 / ((double)total * nclients), plain_hits);
+  printf("match_compiled(): %8.3fs %7.1fns/check %lu matched\n",
+      compiled_time, compiled_time * 1e9 / ((double)total * nclients),
+      compiled_hits);
+  if(compiled_time > 0)
+    printf("speedup:          %8.2fx\n", plain_time / compiled_time);
+
+  for(i = 0; i < total; i++)
+  {
+    free_compiled_mask(compiled[i]);
+    MyFree(bans[i]);
+  }
+  for(i = 0; i < nclients; i++)
+    MyFree(clients[i]);
+  MyFree(compiled);
+  MyFree(bans);
+  MyFree(clients);
+
+  if(mismatches != 0)
+  {
+    fprintf(stderr, "%lu mismatches\n", mismatches);
+    return 1;
+  }
+
+  return 0;
+}
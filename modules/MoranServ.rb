@@ -341,7 +341,7 @@ class MoranServ < ServiceModule
           entry['tokill'] += 1
           if entry['tokill'] > @MAX_TOKILL 
             if not client.is_identified? and Time.new.to_i - client.firsttime < 3600
-              kill_user(client, "Possible spambot -- mail support@oftc.net with questions.")
+              kill_user_host(client, "Possible spambot -- mail support@oftc.net with questions.")
             else
               notice("Wanted to kill #{client.to_str} because they're a spambot | Identified: #{client.is_identified?} | Time online (< 3600 required): #{Time.new.to_i - client.firsttime}")
             end
@@ -41,6 +41,7 @@
 #include "chanaccess.h"
 #include "servicemask.h"
 #include "group.h"
+#include "snapshot.h"
 
 static struct Service *chanserv = NULL;
 static struct Client *chanserv_client = NULL;
@@ -55,6 +56,8 @@ static dlink_node *cs_on_burst_done_hook;
 
 static dlink_list channel_limit_list = { NULL, NULL, 0 };
 static dlink_list channel_expireban_list = { NULL, NULL, 0 };
+/* channels restored from a snapshot, rechecked once the burst is done */
+static dlink_list channel_restored_list = { NULL, NULL, 0 };
 
 static void process_limit_list(void *);
 static void process_expireban_list(void *);
@@ -481,7 +484,7 @@ process_expireban_list(void *param)
       {
         snprintf(ban, IRC_BUFSIZE, "%s!%s@%s", banptr->name, banptr->username,
             banptr->host);
-        DupString(btmp, ban);
+        btmp = arena_strdup(request_arena, ban);
         ilog(L_DEBUG, "ChanServ ExpireBan: BAN %s %d %s", chptr->chname,
           (int)delta, ban);
         dlinkAdd(btmp, make_dlink_node(), &mask_list);
@@ -502,7 +505,7 @@ process_expireban_list(void *param)
       {
         snprintf(ban, IRC_BUFSIZE, "%s!%s@%s", banptr->name, banptr->username,
             banptr->host);
-        DupString(btmp, ban);
+        btmp = arena_strdup(request_arena, ban);
         ilog(L_DEBUG, "ChanServ ExpireBan: QUIET %s %d %s", chptr->chname,
           (int)delta, ban);
         dlinkAdd(btmp, make_dlink_node(), &mask_list);
@@ -1573,10 +1576,8 @@ m_clear_bans(struct Service *service, struct Client *client, int parc,
   DLINK_FOREACH_SAFE(ptr, nptr, chptr->banlist.head)
   {
     const struct Ban *banptr = ptr->data;
-    char *ban = MyMalloc(IRC_BUFSIZE+1);
-
-    snprintf(ban, IRC_BUFSIZE, "%s!%s@%s", banptr->name, banptr->username,
-        banptr->host);
+    char *ban = arena_sprintf(request_arena, "%s!%s@%s", banptr->name,
+        banptr->username, banptr->host);
 
     dlinkAdd(ban, make_dlink_node(), &list);
     numbans++;
@@ -1612,10 +1613,9 @@ m_clear_quiets(struct Service *service, struct Client *client, int parc,
   DLINK_FOREACH_SAFE(ptr, nptr, chptr->quietlist.head)
   {
     const struct Ban *banptr = ptr->data;
-    char *ban = MyMalloc(IRC_BUFSIZE+1);
+    char *ban = arena_sprintf(request_arena, "%s!%s@%s", banptr->name,
+        banptr->username, banptr->host);
 
-    snprintf(ban, IRC_BUFSIZE, "%s!%s@%s", banptr->name, banptr->username,
-        banptr->host);
     dlinkAdd(ban, make_dlink_node(), &list);
     numbans++;
   }
@@ -2015,7 +2015,7 @@ m_unban(struct Service *service, struct Client *client, int parc, char *parv[])
   }
   regchptr = chptr->regchan;
 
-  banp = find_bmask(client, &chptr->banlist);
+  banp = find_channel_ban(client, chptr, CHFL_BAN);
   while(banp != NULL)
   {
     char ban[IRC_BUFSIZE+1];
@@ -2028,7 +2028,7 @@ m_unban(struct Service *service, struct Client *client, int parc, char *parv[])
  
     numbans++;
 
-    banp = find_bmask(client, &chptr->banlist);
+    banp = find_channel_ban(client, chptr, CHFL_BAN);
   }
 
   reply_user(service, service, client, CS_CLEAR_BANS, numbans,
@@ -2052,7 +2052,7 @@ m_unquiet(struct Service *service, struct Client *client, int parc, char *parv[]
   }
   regchptr = chptr->regchan;
 
-  banp = find_bmask(client, &chptr->quietlist);
+  banp = find_channel_ban(client, chptr, CHFL_QUIET);
   while(banp != NULL)
   {
     char ban[IRC_BUFSIZE+1];
@@ -2062,7 +2062,7 @@ m_unquiet(struct Service *service, struct Client *client, int parc, char *parv[]
     unquiet_mask(service, chptr, ban);
     numbans++;
 
-    banp = find_bmask(client, &chptr->quietlist);
+    banp = find_channel_ban(client, chptr, CHFL_QUIET);
   }
 
   reply_user(service, service, client, CS_CLEAR_QUIETS, numbans,
@@ -2210,55 +2210,52 @@ m_sudo(struct Service *service, struct Client *client, int parc, char *parv[])
 static void
 m_list(struct Service *service, struct Client *client, int parc, char *parv[])
 {
-  char *chan;
   int count = 0;
-  int qcount = 0;
-  dlink_list list = { 0 };
   dlink_node *ptr;
+  dlink_list list = { 0 };
 
+  /* one more than is shown tells whether there are more */
   if(parc == 2 && client->access >= OPER_FLAG)
   {
     if(irccmp(parv[2], "FORBID") == 0)
-      qcount = dbchannel_list_forbid(&list);
+      count = dbchannel_list_forbid_match(&list, parv[1],
+          NULL, DB_LIST_LIMIT + 1);
     else
     {
       reply_user(service, service, client, CS_LIST_INVALID_OPTION, parv[2]);
       return;
     }
   }
+  else if(client->access >= OPER_FLAG)
+    count = dbchannel_list_all_match(&list, parv[1], NULL, DB_LIST_LIMIT + 1);
+  else
+    count = dbchannel_list_regular_match(&list, parv[1],
+        NULL, DB_LIST_LIMIT + 1);
 
-  if(qcount == 0 && client->access >= OPER_FLAG)
-    qcount = dbchannel_list_all(&list);
-  else if(qcount == 0)
-    qcount = dbchannel_list_regular(&list);
-
-  if(qcount == 0)
+  if(count == 0)
   {
-    /* XXX TODO FIXME
-     * cache which method was called
-     */
-    db_string_list_free(&list);
-    reply_user(service, service, client, CS_LIST_NO_MATCHES, parv[1]);
+    if(!db_is_connected())
+      reply_user(service, NULL, client, SERV_DB_DOWN, parv[1]);
+    else
+      reply_user(service, service, client, CS_LIST_NO_MATCHES, parv[1]);
     return;
   }
 
+  count = 0;
   DLINK_FOREACH(ptr, list.head)
   {
-    chan = (char *)ptr->data;
-    if(match(parv[1], chan))
-    {
-      count++;
-      reply_user(service, service, client, CS_LIST_ENTRY, chan);
-    }
-    if(count == 50)
+    if(count == DB_LIST_LIMIT)
       break;
+    reply_user(service, service, client, CS_LIST_ENTRY, (char *)ptr->data);
+    count++;
   }
-  /* XXX TODO FIXME
-   * cache which method was called
-   */
-  db_string_list_free(&list);
 
-  reply_user(service, service, client, CS_LIST_END, count);
+  if(ptr != NULL)
+    reply_user(service, service, client, CS_LIST_END_MORE, count);
+  else
+    reply_user(service, service, client, CS_LIST_END, count);
+
+  db_string_list_free(&list);
 }
 
 static void
@@ -2670,6 +2667,7 @@ cs_on_client_join(va_list args)
   struct Channel *chptr;
   struct ChanAccess *access;
   unsigned int level;
+  int restored;
 
   /* Find Channel in hash */
   if((chptr = hash_find_channel(name)) == NULL)
@@ -2679,7 +2677,10 @@ cs_on_client_join(va_list args)
     return pass_callback(cs_join_hook, source_p, name);
   }
 
-  if(dbchannel_is_forbid(name))
+  /* Members carried over a warm restart were checked before it */
+  restored = snapshot_member_restored(chptr, source_p);
+
+  if(!restored && dbchannel_is_forbid(name))
   {
     strlcpy(tmp_name, name, CHANNELLEN);
     kick_user(chanserv, chptr, source_p->name, 
@@ -2688,57 +2689,60 @@ cs_on_client_join(va_list args)
     return NULL;
   }
 
-  if(akick_check_client(chanserv, chptr, source_p))
+  if(!restored && akick_check_client(chanserv, chptr, source_p))
     return pass_callback(cs_join_hook, source_p, name);
 
   if((regchptr = chptr->regchan) == NULL)
     return pass_callback(cs_join_hook, source_p, name);
 
-  if(source_p->nickname == NULL)
-    level = CHUSER_FLAG;
-  else
+  if(!restored)
   {
-    access = chanaccess_find(dbchannel_get_id(regchptr), nickname_get_id(source_p->nickname));
-    if(access == NULL)
-      level = CHIDENTIFIED_FLAG;
+    if(source_p->nickname == NULL)
+      level = CHUSER_FLAG;
     else
-      level = access->level;
+    {
+      access = chanaccess_find(dbchannel_get_id(regchptr), nickname_get_id(source_p->nickname));
+      if(access == NULL)
+        level = CHIDENTIFIED_FLAG;
+      else
+        level = access->level;
 
-    MyFree(access);
-  }
+      MyFree(access);
+    }
 
-  if(dbchannel_get_restricted(regchptr) && level < MEMBER_FLAG &&
-    !MyConnect(source_p) && !IsGod(source_p))
-  {
-    char ban[IRC_BUFSIZE+1];
+    if(dbchannel_get_restricted(regchptr) && level < MEMBER_FLAG &&
+      !MyConnect(source_p) && !IsGod(source_p))
+    {
+      char ban[IRC_BUFSIZE+1];
 
-    snprintf(ban, IRC_BUFSIZE, "*!%s@%s", source_p->username, source_p->host);
-    ban_mask(chanserv, chptr, ban);
-    kick_user(chanserv, chptr, source_p->name, 
-        "Access to this channel is restricted");
-    return pass_callback(cs_join_hook, source_p, name);
-  }
+      snprintf(ban, IRC_BUFSIZE, "*!%s@%s", source_p->username, source_p->host);
+      ban_mask(chanserv, chptr, ban);
+      kick_user(chanserv, chptr, source_p->name, 
+          "Access to this channel is restricted");
+      return pass_callback(cs_join_hook, source_p, name);
+    }
 
-  /* Probably a real use for this channel now */
-  dbchannel_set_last_used(regchptr, CurrentTime);
+    /* Probably a real use for this channel now */
+    dbchannel_set_last_used(regchptr, CurrentTime);
 
-  if(!dbchannel_get_leaveops(regchptr) && (IsChanop(source_p, chptr) && level < CHANOP_FLAG))
-  {
-    deop_user(chanserv, chptr, source_p);
-    reply_user(chanserv, chanserv, source_p, CS_DEOP_REGISTERED, 
-        dbchannel_get_channel(regchptr));
-  }
+    if(!dbchannel_get_leaveops(regchptr) && (IsChanop(source_p, chptr) && level < CHANOP_FLAG))
+    {
+      deop_user(chanserv, chptr, source_p);
+      reply_user(chanserv, chanserv, source_p, CS_DEOP_REGISTERED, 
+          dbchannel_get_channel(regchptr));
+    }
 
-  if((!IsChanop(source_p, chptr)) && level >= CHANOP_FLAG && dbchannel_get_autoop(regchptr))
-  {
-    op_user(chanserv, chptr, source_p);
-  }
-  else if((!IsVoice(source_p, chptr)) && level >= MEMBER_FLAG && 
-      dbchannel_get_autovoice(regchptr))
-  {
-    voice_user(chanserv, chptr, source_p);
+    if((!IsChanop(source_p, chptr)) && level >= CHANOP_FLAG && dbchannel_get_autoop(regchptr))
+    {
+      op_user(chanserv, chptr, source_p);
+    }
+    else if((!IsVoice(source_p, chptr)) && level >= MEMBER_FLAG && 
+        dbchannel_get_autovoice(regchptr))
+    {
+      voice_user(chanserv, chptr, source_p);
+    }
   }
- 
+
   if(dbchannel_get_entrymsg(regchptr) != NULL && dbchannel_get_entrymsg(regchptr)[0] != '\0' &&
       !IsConnecting(me.uplink))
     reply_user(chanserv, chanserv, source_p, CS_ENTRYMSG, dbchannel_get_channel(regchptr),
@@ -2771,6 +2775,10 @@ cs_on_channel_create(va_list args)
   int tmp;
   dlink_list m_list = { 0 };
 
+  /* its members skip the join checks, see cs_check_restored() */
+  if(snapshot_channel_restored(chptr))
+    dlinkAdd(chptr, make_dlink_node(), &channel_restored_list);
+
   if(chptr->regchan != NULL)
   {
     if(dbchannel_get_mlock(chptr->regchan) != NULL)
@@ -2782,6 +2790,10 @@ cs_on_channel_create(va_list args)
           dbchannel_get_topic(chptr->regchan)); 
     }
 
+    /* The masks were set on this channel before a warm restart */
+    if(snapshot_channel_restored(chptr))
+      return pass_callback(cs_channel_create_hook, chptr);
+
     servicemask_list_invex_masks(dbchannel_get_id(chptr->regchan), &m_list);
     invex_mask_many(chanserv, chptr, &m_list);
     servicemask_list_masks_free(&m_list);
@@ -2826,6 +2838,9 @@ cs_on_channel_destroy(va_list args)
   if((ptr = dlinkFindDelete(&channel_limit_list, chan)) != NULL)
     free_dlink_node(ptr);
 
+  if((ptr = dlinkFindDelete(&channel_restored_list, chan)) != NULL)
+    free_dlink_node(ptr);
+
   return pass_callback(cs_channel_destroy_hook, chan);
 }
 
@@ -2867,11 +2882,55 @@ cs_on_topic_change(va_list args)
   return pass_callback(cs_on_topic_change_hook, chan, setter);
 }
 
+/* cs_check_restored()
+ *
+ * inputs       - channel restored from a snapshot
+ * output       - none
+ * side effects - a forbid or akicks added while services were down are
+ *                enforced on the members that skipped the join checks.
+ *                The channel may be gone afterwards.
+ */
+static void
+cs_check_restored(struct Channel *chptr)
+{
+  dlink_node *ptr, *next_ptr;
+  char chname[CHANNELLEN+1];
+
+  if(dbchannel_is_forbid(chptr->chname))
+  {
+    strlcpy(chname, chptr->chname, sizeof(chname));
+
+    DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->members.head)
+    {
+      struct Membership *ms = ptr->data;
+
+      kick_user(chanserv, chptr, ms->client_p->name,
+          "This channel is forbidden and may not be used");
+    }
+
+    send_resv(chanserv, chname, "Forbidden channel",
+        ServicesInfo.def_forbid_dur);
+    return;
+  }
+
+  akick_check_restored(chanserv, chptr);
+}
+
 static void *
 cs_on_burst_done(va_list args)
 {
   dlink_node *ptr;
 
+  /* taken off first, a channel emptied by the checks is destroyed */
+  while((ptr = channel_restored_list.head) != NULL)
+  {
+    struct Channel *chptr = ptr->data;
+
+    dlinkDelete(ptr, &channel_restored_list);
+    free_dlink_node(ptr);
+    cs_check_restored(chptr);
+  }
+
   DLINK_FOREACH(ptr, global_channel_list.head)
   {
     struct Channel *chptr = (struct Channel *)ptr->data;
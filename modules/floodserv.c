@@ -218,7 +218,7 @@ floodserv_unenforce_routine(void *param)
         {
           snprintf(ban, IRC_BUFSIZE, "%s!%s@%s", banptr->name,
             banptr->username, banptr->host);
-          DupString(btmp, ban);
+          btmp = arena_strdup(request_arena, ban);
           ilog(L_DEBUG, "FloodServ: UNENFORCE %s %d %s", chptr->chname,
             (int)delta, ban);
           dlinkAdd(btmp, make_dlink_node(), &quiet_masks);
@@ -562,7 +562,7 @@ fs_on_privmsg(va_list args)
         if (find_tor(source->sockhost) == NULL)
         {
           akill_add(akill);
-          send_akill(floodserv, fsclient->name, akill);
+          kill_akill(floodserv, fsclient->name, akill);
         }
         else
         {
@@ -377,9 +377,7 @@ m_sudo(struct Service *service, struct Client *client, int parc, char *parv[])
 static void
 m_list(struct Service *service, struct Client *client, int parc, char *parv[])
 {
-  char *group;
   int count = 0;
-  int qcount = 0;
   dlink_node *ptr;
   dlink_list list = { 0 };
 
@@ -389,35 +387,36 @@ m_list(struct Service *service, struct Client *client, int parc, char *parv[])
     return;
   }
 
+  /* one more than is shown tells whether there are more */
   if(client->access >= OPER_FLAG)
-    qcount = group_list_all(&list);
+    count = group_list_all_match(&list, parv[1], NULL, DB_LIST_LIMIT + 1);
   else
-    qcount = group_list_regular(&list);
+    count = group_list_regular_match(&list, parv[1], NULL, DB_LIST_LIMIT + 1);
 
-  if(qcount == 0)
+  if(count == 0)
   {
-    reply_user(service, service, client, GS_LIST_NO_MATCHES, parv[1]);
-    /* TODO XXX FIXME use proper free */
-    db_string_list_free(&list);
+    if(!db_is_connected())
+      reply_user(service, NULL, client, SERV_DB_DOWN, parv[1]);
+    else
+      reply_user(service, service, client, GS_LIST_NO_MATCHES, parv[1]);
     return;
   }
 
+  count = 0;
   DLINK_FOREACH(ptr, list.head)
   {
-    group = (char *)ptr->data;
-    if(match(parv[1], group))
-    {
-      count++;
-      reply_user(service, service, client, GS_LIST_ENTRY, group);
-    }
-    if(count == 50)
+    if(count == DB_LIST_LIMIT)
       break;
+    reply_user(service, service, client, GS_LIST_ENTRY, (char *)ptr->data);
+    count++;
   }
 
-  /* TODO XXX FIXME use proper free */
-  db_string_list_free(&list);
+  if(ptr != NULL)
+    reply_user(service, service, client, GS_LIST_END_MORE, count);
+  else
+    reply_user(service, service, client, GS_LIST_END, count);
 
-  reply_user(service, service, client, GS_LIST_END, count);
+  db_string_list_free(&list);
 }
 
 static int
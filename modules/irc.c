@@ -36,6 +36,8 @@
 #include "conf/modules.h"
 #include "hash.h"
 #include "send.h"
+#include "akill.h"
+#include "kill.h"
 
 static void m_privmsg(struct Client *, struct Client *, int, char *[]);
 static void m_notice(struct Client *, struct Client *, int, char *[]);
@@ -59,6 +61,7 @@ static void m_tburst(struct Client *, struct Client *, int, char*[]);
 static void *irc_sendmsg_nick(va_list);
 static void *irc_sendmsg_privmsg(va_list);
 static void *irc_sendmsg_notice(va_list);
+static void *irc_sendmsg_notices(va_list);
 static void *irc_sendmsg_kick(va_list);
 static void *irc_sendmsg_cmode(va_list);
 static void *irc_sendmsg_invite(va_list);
@@ -215,6 +218,7 @@ static dlink_node *connected_hook;
 static dlink_node *newuser_hook;
 static dlink_node *privmsg_hook;
 static dlink_node *notice_hook;
+static dlink_node *notices_hook;
 static dlink_node *kick_hook;
 static dlink_node *cmode_hook;
 static dlink_node *invite_hook;
@@ -247,6 +251,7 @@ INIT_MODULE(irc, "$Revision$")
   newuser_hook    = install_hook(send_newuser_cb, irc_sendmsg_nick);
   privmsg_hook    = install_hook(send_privmsg_cb, irc_sendmsg_privmsg);
   notice_hook     = install_hook(send_notice_cb, irc_sendmsg_notice);
+  notices_hook    = install_hook(send_notices_cb, irc_sendmsg_notices);
   kick_hook       = install_hook(send_kick_cb, irc_sendmsg_kick);
   cmode_hook      = install_hook(send_cmode_cb, irc_sendmsg_cmode);
   invite_hook     = install_hook(send_invite_cb, irc_sendmsg_invite);
@@ -390,6 +395,23 @@ irc_sendmsg_notice(va_list args)
   return NULL;
 }
 
+/** Send a list of lines to an user, one NOTICE each
+ */
+static void *
+irc_sendmsg_notices(va_list args)
+{
+  struct Client *client = va_arg(args, struct Client *);
+  char          *source = va_arg(args, char *);
+  char          *target = va_arg(args, char *);
+  char          **lines = va_arg(args, char **);
+  int           count   = va_arg(args, int);
+  char          prefix[IRC_BUFSIZE];
+
+  snprintf(prefix, sizeof(prefix), ":%s NOTICE %s :", source, target);
+  sendto_server_lines(client, prefix, lines, count);
+  return NULL;
+}
+
 static void *
 irc_sendmsg_kick(va_list args)
 {
@@ -1411,6 +1433,19 @@ m_stats(struct Client *client_p, struct Client *source_p,
       identified_access, identified_count, (identified_access * 1.0 / identified_count * 1.0) * 100,
       identified_ssl, identified_count, (identified_ssl * 1.0 / identified_count * 1.0) * 100);
 
+    sendto_server(me.uplink,
+      ":%s %d %s z :akill backlog: %lu waiting, %u/s checked, %lu checked, %lu akilled",
+      me.name, 249, source_p->name, dlink_list_length(&delay_akill_list),
+      akill_backlog.rate, akill_backlog.checked, akill_backlog.matched);
+
+    sendto_server(me.uplink,
+      ":%s %d %s z :kill queue: %u waiting (peak %u), %u/s sent, %lu kills, "
+      "%lu akills, %lu kills merged into akills, %lu repeated akills dropped, "
+      "held %lus by sendq",
+      me.name, 249, source_p->name, kill_queue_length(), kill_stats.peak,
+      kill_stats.rate, kill_stats.kills, kill_stats.akills, kill_stats.merged,
+      kill_stats.duplicates, kill_stats.held);
+
     sendto_server(me.uplink, ":%s 219 %s %c :End of /STATS report",
       me.name, source_p->name, 'z');
   }
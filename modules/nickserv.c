@@ -52,9 +52,11 @@ static dlink_node *ns_umode_hook;
 static dlink_node *ns_nick_hook;
 static dlink_node *ns_newuser_hook;
 static dlink_node *ns_quit_hook;
+static dlink_node *ns_split_hook;
 static dlink_node *ns_certfp_hook;
 static dlink_node *ns_on_auth_req_hook;
 static dlink_node *ns_on_identify_hook;
+static dlink_node *ns_burst_done_hook;
 
 static dlink_list nick_enforce_list = { NULL, NULL, 0 };
 static dlink_list nick_release_list = { NULL, NULL, 0 };
@@ -62,6 +64,8 @@ static dlink_list nick_release_list = { NULL, NULL, 0 };
 static int guest_number;
 
 static int set_nickname_password(Nickname *, const char *);
+static void ns_reply_unregistered(struct Service *, struct Client *,
+    const char *);
 
 static void process_enforce_list(void *);
 static void process_release_list(void *);
@@ -70,9 +74,11 @@ static void *ns_on_umode_change(va_list);
 static void *ns_on_newuser(va_list);
 static void *ns_on_nick_change(va_list);
 static void *ns_on_quit(va_list);
+static void *ns_on_split(va_list);
 static void *ns_on_certfp(va_list);
 static void *ns_on_auth_requested(va_list);
 static void *ns_on_identify(va_list);
+static void *ns_on_burst_done(va_list);
 
 static void m_drop(struct Service *, struct Client *, int, char *[]);
 static void m_help(struct Service *, struct Client *, int, char *[]);
@@ -337,9 +343,11 @@ INIT_MODULE(nickserv, "$Revision$")
   ns_nick_hook        = install_hook(on_nick_change_cb, ns_on_nick_change);
   ns_newuser_hook     = install_hook(on_newuser_cb, ns_on_newuser);
   ns_quit_hook        = install_hook(on_quit_cb, ns_on_quit);
+  ns_split_hook       = install_hook(on_split_cb, ns_on_split);
   ns_certfp_hook      = install_hook(on_certfp_cb, ns_on_certfp);
   ns_on_auth_req_hook = install_hook(on_auth_request_cb, ns_on_auth_requested);
   ns_on_identify_hook = install_hook(on_identify_cb, ns_on_identify);
+  ns_burst_done_hook  = install_hook(on_burst_done_cb, ns_on_burst_done);
   
   guest_number = 0;
 
@@ -354,9 +362,11 @@ CLEANUP_MODULE
   uninstall_hook(on_nick_change_cb, ns_on_nick_change);
   uninstall_hook(on_newuser_cb, ns_on_newuser);
   uninstall_hook(on_quit_cb, ns_on_quit);
+  uninstall_hook(on_split_cb, ns_on_split);
   uninstall_hook(on_certfp_cb, ns_on_certfp);
   uninstall_hook(on_auth_request_cb, ns_on_auth_requested);
   uninstall_hook(on_identify_cb, ns_on_identify);
+  uninstall_hook(on_burst_done_cb, ns_on_burst_done);
   eventDelete(process_enforce_list, NULL);
   eventDelete(process_release_list, NULL);
   serv_clear_messages(nickserv);
@@ -366,6 +376,23 @@ CLEANUP_MODULE
   ilog(L_DEBUG, "Unloaded nickserv");
 }
 
+/* ns_reply_unregistered()
+ *
+ * inputs       - service, client, nickname that nickname_find() missed
+ * output       - none
+ * side effects - the client is told to register it, unless the database
+ *                is down, when the miss does not mean it is unregistered
+ */
+static void
+ns_reply_unregistered(struct Service *service, struct Client *client,
+    const char *name)
+{
+  if(!db_is_connected())
+    reply_user(service, NULL, client, SERV_DB_DOWN, name);
+  else
+    reply_user(service, service, client, NS_REG_FIRST, name);
+}
+
 static void
 guest_user(struct Client *user)
 {
@@ -688,7 +715,7 @@ m_identify(struct Service *service, struct Client *client,
 
   if((nick = nickname_find(name)) == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, name);
+    ns_reply_unregistered(service, client, name);
     return;
   }
 
@@ -840,7 +867,7 @@ m_cloakstring(struct Service *service, struct Client *client,
 
   if(nick == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, parv[1]);
+    ns_reply_unregistered(service, client, parv[1]);
     return;
   }
  
@@ -904,7 +931,7 @@ m_resetpass(struct Service *service, struct Client *client,
 
   if(nick == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, parv[1]);
+    ns_reply_unregistered(service, client, parv[1]);
     return;
   }
 
@@ -1283,7 +1310,7 @@ m_regain(struct Service *service, struct Client *client, int parc, char *parv[])
 
   if((nick = nickname_find(parv[1])) == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, parv[1]);
+    ns_reply_unregistered(service, client, parv[1]);
     return;
   }
 
@@ -1411,7 +1438,7 @@ m_info(struct Service *service, struct Client *client, int parc, char *parv[])
       }
       if((nick = nickname_find(client->name)) == NULL)
       {
-        reply_user(service, service, client, NS_REG_FIRST, client->name);
+        ns_reply_unregistered(service, client, client->name);
         return;
       }
    }
@@ -1427,8 +1454,7 @@ m_info(struct Service *service, struct Client *client, int parc, char *parv[])
 
     if((nick = nickname_find(parv[1])) == NULL)
     {
-      reply_user(service, service, client, NS_REG_FIRST,
-          parv[1]);
+      ns_reply_unregistered(service, client, parv[1]);
       return;
     }
     name = parv[1];
@@ -1656,7 +1682,7 @@ m_sudo(struct Service *service, struct Client *client, int parc, char *parv[])
   nick = nickname_find(parv[1]);
   if(nick == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, parv[1]);
+    ns_reply_unregistered(service, client, parv[1]);
     return;
   }
 
@@ -1701,7 +1727,7 @@ m_dropnick(struct Service *service, struct Client *client, int parc, char *parv[
   nick = nickname_find(parv[1]);
   if(nick == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, parv[1]);
+    ns_reply_unregistered(service, client, parv[1]);
     return;
   }
 
@@ -1742,7 +1768,7 @@ m_sendpass(struct Service *service, struct Client *client, int parc,
 
   if((nick = nickname_find(parv[1])) == NULL)
   {
-    reply_user(service, service, client, NS_REG_FIRST, parv[1]);
+    ns_reply_unregistered(service, client, parv[1]);
     return;
   }
 
@@ -1822,52 +1848,52 @@ m_sendpass(struct Service *service, struct Client *client, int parc,
 static void
 m_list(struct Service *service, struct Client *client, int parc, char *parv[])
 {
-  char *nick;
   int count = 0;
-  int qcount = 0;
   dlink_node *ptr;
   dlink_list list = { 0 };
 
+  /* one more than is shown tells whether there are more */
   if(parc == 2 && client->access >= OPER_FLAG)
   {
     if(irccmp(parv[2], "FORBID") == 0)
-      qcount = nickname_list_forbid(&list);
+      count = nickname_list_forbid_match(&list, parv[1],
+          NULL, DB_LIST_LIMIT + 1);
     else
     {
       reply_user(service, service, client, NS_LIST_INVALID_OPTION, parv[2]);
       return;
     }
   }
+  else if(client->access >= OPER_FLAG)
+    count = nickname_list_all_match(&list, parv[1], NULL, DB_LIST_LIMIT + 1);
+  else
+    count = nickname_list_regular_match(&list, parv[1],
+        NULL, DB_LIST_LIMIT + 1);
 
-  if(qcount == 0 && client->access >= OPER_FLAG)
-    qcount = nickname_list_all(&list);
-  else if(qcount == 0)
-    qcount = nickname_list_regular(&list);
-
-  if(qcount == 0)
+  if(count == 0)
   {
-    reply_user(service, service, client, NS_LIST_NO_MATCHES, parv[1]);
-    /* TODO XXX FIXME use proper free */
-    db_string_list_free(&list);
+    if(!db_is_connected())
+      reply_user(service, NULL, client, SERV_DB_DOWN, parv[1]);
+    else
+      reply_user(service, service, client, NS_LIST_NO_MATCHES, parv[1]);
     return;
   }
 
+  count = 0;
   DLINK_FOREACH(ptr, list.head)
   {
-    nick = (char *)ptr->data;
-    if(match(parv[1], nick))
-    {
-      count++;
-      reply_user(service, service, client, NS_LIST_ENTRY, nick);
-    }
-    if(count == 50)
+    if(count == DB_LIST_LIMIT)
       break;
+    reply_user(service, service, client, NS_LIST_ENTRY, (char *)ptr->data);
+    count++;
   }
 
-  /* TODO XXX FIXME use proper free */
-  db_string_list_free(&list);
+  if(ptr != NULL)
+    reply_user(service, service, client, NS_LIST_END_MORE, count);
+  else
+    reply_user(service, service, client, NS_LIST_END, count);
 
-  reply_user(service, service, client, NS_LIST_END, count);
+  db_string_list_free(&list);
 }
 
 static void
@@ -1950,6 +1976,9 @@ ns_on_nick_change(va_list args)
   char userhost[USERHOSTLEN+1]; 
   int oldid = 0;
 
+  /* the checks for the new nick are run here */
+  ClearNickCheck(user);
+
   if(IsEnforce(user))
   {
     introduce_client(oldnick, "Enforced Nickname (/msg nickserv help regain)", FALSE);
@@ -2092,30 +2121,36 @@ ns_on_nick_change(va_list args)
   return pass_callback(ns_nick_hook, user, oldnick);
 }
 
-static void *
-ns_on_newuser(va_list args)
+/* ns_check_newuser()
+ *
+ * inputs       - client that has just come onto the network
+ * output       - none
+ * side effects - forbidden and protected nicknames are enforced, and
+ *                clients identified by the ircd or matching an access
+ *                entry get their Nickname
+ */
+static void
+ns_check_newuser(struct Client *newuser)
 {
-  struct Client *newuser = va_arg(args, struct Client*);
   Nickname *nick_p;
   char userhost[USERHOSTLEN+1];
-  
-  if(IsMe(newuser->from))
-    return pass_callback(ns_newuser_hook, newuser);
-
-  ilog(L_DEBUG, "New User: %s!", newuser->name);
 
   if(nickname_is_forbid(newuser->name))
   {
     reply_user(nickserv, nickserv, newuser, NS_NICK_FORBID_IWILLCHANGE, newuser->name);
     newuser->enforce_time = CurrentTime + 10; /* XXX configurable? */
     dlinkAdd(newuser, make_dlink_node(), &nick_enforce_list);
-    return pass_callback(ns_newuser_hook, newuser);
+    return;
   }
- 
+
+  /* Still a database lookup per connecting user: only the access and cert
+   * lists are held in memory.  The nickname itself (password, enforce and
+   * secure flags) is also written by the web frontend, so it is not cached.
+   */
   if((nick_p = nickname_find(newuser->name)) == NULL)
   {
     ilog(L_DEBUG, "New user: %s(nick not registered)", newuser->name);
-    return pass_callback(ns_newuser_hook, newuser);
+    return;
   }
 
   if(IsIdentified(newuser))
@@ -2124,7 +2159,7 @@ ns_on_newuser(va_list args)
       nickname_free(newuser->nickname);
     newuser->nickname = nick_p;
     identify_user(newuser);
-    return pass_callback(ns_newuser_hook, newuser);
+    return;
   }
 
   snprintf(userhost, USERHOSTLEN, "%s@%s", newuser->username, newuser->host);
@@ -2158,35 +2193,141 @@ ns_on_newuser(va_list args)
 
   if(nick_p != newuser->nickname)
     nickname_free(nick_p);
+}
+
+/* ns_check_restored()
+ *
+ * inputs       - client restored from a snapshot
+ * output       - none
+ * side effects - the checks the client skipped when the burst introduced
+ *                it are run now: its Nickname is reloaded, and a forbid,
+ *                drop, access or enforce change made while services were
+ *                down is applied
+ */
+static void
+ns_check_restored(struct Client *user)
+{
+  Nickname *nick_p;
+
+  if(user->nickname == NULL)
+  {
+    /* access entries are looked at again */
+    ClearOnAccess(user);
+    ns_check_newuser(user);
+    return;
+  }
+
+  if(!nickname_is_forbid(user->name))
+  {
+    nick_p = nickname_find(user->name);
+
+    /* nothing to reload from, keep the snapshot's copy */
+    if(nick_p == NULL && !db_is_connected())
+      return;
+
+    if(nick_p != NULL &&
+        nickname_get_id(nick_p) == nickname_get_id(user->nickname))
+    {
+      nickname_free(user->nickname);
+      user->nickname = nick_p;
+
+      if(nickname_get_admin(nick_p) && IsOper(user))
+        user->access = ADMIN_FLAG;
+      else if(IsOper(user))
+        user->access = OPER_FLAG;
+      else
+        user->access = IDENTIFIED_FLAG;
+      return;
+    }
+
+    if(nick_p != NULL)
+      nickname_free(nick_p);
+  }
+
+  /* forbidden, dropped or registered anew while we were away */
+  ClearIdentified(user);
+  ClearOnAccess(user);
+  ClearSentCert(user);
+  nickname_free(user->nickname);
+  user->nickname = NULL;
+  user->access = USER_FLAG;
+  send_umode(nickserv, user, "-R");
+
+  ns_check_newuser(user);
+}
+
+static void *
+ns_on_newuser(va_list args)
+{
+  struct Client *newuser = va_arg(args, struct Client*);
   
+  if(IsMe(newuser->from))
+    return pass_callback(ns_newuser_hook, newuser);
+
+  ilog(L_DEBUG, "New User: %s!", newuser->name);
+
+  /* Checked before a warm restart, checked again once the burst is done */
+  if(IsRestored(newuser))
+    SetNickCheck(newuser);
+  else
+    ns_check_newuser(newuser);
+
   return pass_callback(ns_newuser_hook, newuser);
 }
 
 static void *
-ns_on_quit(va_list args)
+ns_on_burst_done(va_list args)
+{
+  dlink_node *ptr, *next_ptr;
+
+  DLINK_FOREACH_SAFE(ptr, next_ptr, global_client_list.head)
+  {
+    struct Client *client = ptr->data;
+
+    if(IsNickCheck(client))
+    {
+      ClearNickCheck(client);
+      ns_check_restored(client);
+    }
+  }
+
+  return pass_callback(ns_burst_done_hook);
+}
+
+static void
+ns_record_quit(struct Client *user, const char *comment)
 {
-  struct Client *user     = va_arg(args, struct Client *);
-  char          *comment  = va_arg(args, char *);
   Nickname *nick = user->nickname;
+  const char *cloak;
 
-  if(IsServer(user))
-    return pass_callback(ns_quit_hook, user, comment);
+  if(nick == NULL)
+    return;
 
-  if(nick)
-  {
-    const char *cloak = nickname_get_cloak(nick);
+  cloak = nickname_get_cloak(nick);
 
-    nickname_set_last_quit(nick, comment);
+  nickname_set_last_quit(nick, comment);
 
-    if(nickname_get_cloak_on(nick) == TRUE && !EmptyString(cloak))
-      nickname_set_last_host(nick, cloak);
-    else
-      nickname_set_last_host(nick, user->host);
+  if(nickname_get_cloak_on(nick) == TRUE && !EmptyString(cloak))
+    nickname_set_last_host(nick, cloak);
+  else
+    nickname_set_last_host(nick, user->host);
 
-    nickname_set_last_realname(nick, user->info);
-    nickname_set_last_quit_time(nick, CurrentTime);
-    nickname_set_last_seen(nick, CurrentTime);
-  }
+  nickname_set_last_realname(nick, user->info);
+  nickname_set_last_quit_time(nick, CurrentTime);
+  nickname_set_last_seen(nick, CurrentTime);
+}
+
+static void *
+ns_on_quit(va_list args)
+{
+  struct Client *user     = va_arg(args, struct Client *);
+  char          *comment  = va_arg(args, char *);
+
+  /* ns_on_split has already seen to it */
+  if(IsServer(user) || IsSplit(user))
+    return pass_callback(ns_quit_hook, user, comment);
+
+  ns_record_quit(user, comment);
 
   dlinkFindDelete(&nick_enforce_list, user);
   if(IsMe(user->from))
@@ -2195,6 +2336,41 @@ ns_on_quit(va_list args)
   return pass_callback(ns_quit_hook, user, comment);
 }
 
+/* The same as a quit for every user behind the server, but the enforce and
+ * release lists are only walked once for the lot
+ */
+static void *
+ns_on_split(va_list args)
+{
+  struct Client *server   = va_arg(args, struct Client *);
+  dlink_list    *users    = va_arg(args, dlink_list *);
+  char          *comment  = va_arg(args, char *);
+  dlink_node *ptr, *next;
+
+  DLINK_FOREACH(ptr, users->head)
+    ns_record_quit(ptr->data, comment);
+
+  DLINK_FOREACH_SAFE(ptr, next, nick_enforce_list.head)
+  {
+    if(IsSplit((struct Client *)ptr->data))
+    {
+      dlinkDelete(ptr, &nick_enforce_list);
+      free_dlink_node(ptr);
+    }
+  }
+
+  DLINK_FOREACH_SAFE(ptr, next, nick_release_list.head)
+  {
+    if(IsSplit((struct Client *)ptr->data))
+    {
+      dlinkDelete(ptr, &nick_release_list);
+      free_dlink_node(ptr);
+    }
+  }
+
+  return pass_callback(ns_split_hook, server, users, comment);
+}
+
 static void *
 ns_on_certfp(va_list args)
 {
@@ -89,9 +89,11 @@ is_connected()
     return TRUE;
 }
 
+/* behave like an empty database: no error, no rows */
 static char *
 execute_scalar(int id, int *error, const char *format, dlink_list *args)
 {
+  *error = 0;
   return NULL;
 }
 
@@ -104,7 +106,10 @@ execute_nonquery(int id, const char *format, dlink_list *args)
 static result_set_t *
 execute(int id, int *error, const char *format, dlink_list *args)
 {
-  return NULL;
+  static result_set_t empty;
+
+  *error = 0;
+  return &empty;
 }
 
 static void
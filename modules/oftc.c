@@ -48,6 +48,7 @@ static void *oftc_identify(va_list);
 static void *oftc_chops_notice(va_list);
 static void *oftc_sendmsg_newuser(va_list);
 static void *oftc_sendmsg_notice(va_list);
+static void *oftc_sendmsg_notices(va_list);
 static void *oftc_sendmsg_auth(va_list);
 
 static dlink_node *oftc_gnotice_hook;
@@ -60,6 +61,7 @@ static dlink_node *oftc_connected_hook;
 static dlink_node *oftc_chops_notice_hook;
 static dlink_node *oftc_newuser_hook;
 static dlink_node *oftc_notice_hook;
+static dlink_node *oftc_notices_hook;
 static dlink_node *oftc_auth_hook;
 
 static void m_pass(struct Client *, struct Client *, int, char *[]);
@@ -166,6 +168,7 @@ INIT_MODULE(oftc, "$Revision$")
   oftc_chops_notice_hook= install_hook(send_chops_notice_cb, oftc_chops_notice);
   oftc_newuser_hook     = install_hook(send_newuser_cb, oftc_sendmsg_newuser);
   oftc_notice_hook      = install_hook(send_notice_cb, oftc_sendmsg_notice);
+  oftc_notices_hook     = install_hook(send_notices_cb, oftc_sendmsg_notices);
   oftc_auth_hook        = install_hook(send_auth_cb, oftc_sendmsg_auth);
   mod_add_cmd(&gnotice_msgtab);
   mod_add_cmd(&pass_msgtab);
@@ -207,6 +210,7 @@ CLEANUP_MODULE
   uninstall_hook(connected_cb, oftc_server_connected);
   uninstall_hook(send_newuser_cb, oftc_sendmsg_newuser);
   uninstall_hook(send_notice_cb, oftc_sendmsg_notice);
+  uninstall_hook(send_notices_cb, oftc_sendmsg_notices);
   uninstall_hook(send_auth_cb, oftc_sendmsg_auth);
   uninstall_hook(send_autojoin_cb, oftc_sendmsg_svsjoin);
 }
@@ -790,6 +794,27 @@ oftc_sendmsg_notice(va_list args)
   return NULL;
 }
 
+static void*
+oftc_sendmsg_notices(va_list args)
+{
+  struct Client *client = va_arg(args, struct Client *);
+  char          *source = va_arg(args, char *);
+  char          *target = va_arg(args, char *);
+  char          **lines = va_arg(args, char **);
+  int           count   = va_arg(args, int);
+  char          prefix[IRC_BUFSIZE];
+
+  struct Client *source_p = find_client(source);
+  struct Client *target_p = find_client(target);
+
+  snprintf(prefix, sizeof(prefix), ":%s NOTICE %s :",
+    HasID(source_p) ? source_p->id : source_p->name,
+    HasID(target_p) ? target_p->id : target_p->name);
+  sendto_server_lines(client, prefix, lines, count);
+
+  return NULL;
+}
+
 static void*
 oftc_sendmsg_auth(va_list args)
 {
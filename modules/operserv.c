@@ -49,10 +49,12 @@ static struct Service *operserv = NULL;
 static dlink_node *os_newuser_hook;
 static dlink_node *os_burst_done_hook;
 static dlink_node *os_quit_hook;
+static dlink_node *os_event_hook;
 
 static void *os_on_newuser(va_list);
 static void *os_on_burst_done(va_list);
 static void *os_on_quit(va_list);
+static void *os_check_akills(va_list);
 
 static void m_help(struct Service *, struct Client *, int, char *[]);
 static void m_raw(struct Service *, struct Client *, int, char *[]);
@@ -72,7 +74,6 @@ static void m_jupe_list(struct Service *, struct Client *, int, char *[]);
 static void m_jupe_del(struct Service *, struct Client *, int, char *[]);
 
 static void expire_akills(void *);
-static void check_akills(void *);
 
 static struct ServiceMessage help_msgtab = {
   NULL, "HELP", 0, 0, 2, 0, OPER_FLAG, OS_HELP_SHORT, OS_HELP_LONG, m_help
@@ -162,6 +163,7 @@ INIT_MODULE(operserv, "$Revision$")
   os_newuser_hook = install_hook(on_newuser_cb, os_on_newuser);
   os_burst_done_hook = install_hook(on_burst_done_cb, os_on_burst_done);
   os_quit_hook = install_hook(on_quit_cb, os_on_quit);
+  os_event_hook = install_hook(do_event_cb, os_check_akills);
 
   mod_add_servcmd(&operserv->msg_tree, &help_msgtab);
   mod_add_servcmd(&operserv->msg_tree, &mod_msgtab);
@@ -173,7 +175,6 @@ INIT_MODULE(operserv, "$Revision$")
   mod_add_servcmd(&operserv->msg_tree, &jupe_msgtab);
 
   eventAdd("Expire akills", expire_akills, NULL, 60);
-  eventAdd("Check akills", check_akills, NULL, OPERSERV_AKILL_CHECK_TIME);
 
   return operserv;
 }
@@ -183,11 +184,11 @@ CLEANUP_MODULE
   uninstall_hook(on_newuser_cb, os_on_newuser);
   uninstall_hook(on_burst_done_cb, os_on_burst_done);
   uninstall_hook(on_quit_cb, os_on_quit);
+  uninstall_hook(do_event_cb, os_check_akills);
 
   serv_clear_messages(operserv);
 
   eventDelete(expire_akills, NULL);
-  eventDelete(check_akills, NULL);
 
   unload_languages(operserv->languages);
   ilog(L_DEBUG, "Unloaded operserv");
@@ -651,7 +652,8 @@ os_on_newuser(va_list args)
   if(IsMe(newuser->from))
     return pass_callback(os_newuser_hook, newuser);
 
-  dlinkAdd(newuser, make_dlink_node(), &delay_akill_list);
+  newuser->akill_node = make_dlink_node();
+  dlinkAdd(newuser, newuser->akill_node, &delay_akill_list);
 
   return pass_callback(os_newuser_hook, newuser);
 }
@@ -796,21 +798,28 @@ expire_akills(void *param)
   akill_list_free(&list);
 }
 
-static void
-check_akills(void *param)
+/* os_check_akills()
+ *
+ * Runs every pass of the main loop.  The delayed akill list gets a share of
+ * the time since the last pass, so an idle services works through a burst
+ * backlog quickly and a busy one only gives up short slices.
+ */
+static void *
+os_check_akills(va_list args)
 {
-  dlink_node *ptr, *nptr;
-  unsigned int checked = OPERSERV_AKILL_CHECK_CNT;
+  static struct timeval last;
+  long budget;
 
-  DLINK_FOREACH_SAFE(ptr, nptr, delay_akill_list.head)
-  {
-    struct Client *target = (struct Client *)ptr->data;
-    akill_check_client(operserv, target);
-    dlinkDelete(ptr, &delay_akill_list);
-    free_dlink_node(ptr);
-    --checked;
+  budget = ((SystemTime.tv_sec - last.tv_sec) * 1000000 +
+      (SystemTime.tv_usec - last.tv_usec)) * OPERSERV_AKILL_CHECK_SHARE / 100;
+  last = SystemTime;
 
-    if(checked == 0)
-      break;
-  }
+  if(budget < OPERSERV_AKILL_CHECK_MIN)
+    budget = OPERSERV_AKILL_CHECK_MIN;
+  else if(budget > OPERSERV_AKILL_CHECK_MAX)
+    budget = OPERSERV_AKILL_CHECK_MAX;
+
+  akill_check_backlog(operserv, budget);
+
+  return pass_callback(os_event_hook);
 }
@@ -42,8 +42,22 @@
 #include "conf/modules.h"
 
 #define TEMP_BUFSIZE 32
+#define PG_STACK_PARAMS 16  /* parameters bound without a malloc */
+
+/*
+ * The server's idea of each parameter's type, from describing the statement
+ * after preparing it.  Integer and boolean parameters of a matching type
+ * are sent in binary, everything else as text.
+ */
+struct PgStatement
+{
+  int nparams;
+  Oid *types;
+};
 
 static database_t *pgsql;
+static struct PgStatement *statements;
+static int statement_count;
 
 static int pg_connect(const char *);
 static char *pg_execute_scalar(int, int *, const char *, dlink_list*);
@@ -56,8 +70,13 @@ static int pg_begin_transaction();
 static int pg_commit_transaction();
 static int pg_rollback_transaction();
 static void pg_free_result(result_set_t *);
-static int void_to_char(char, char **, void *);
 static int pg_is_connected();
+static int pg_reconnect_poll();
+#ifdef LIBPQ_HAS_PIPELINING
+static int pg_execute_pipeline(struct DBPipeline *);
+#endif
+
+static int pg_resetting = FALSE;
 
 static query_t queries[QUERY_COUNT] = { 
   { GET_FULL_NICK, "SELECT account.id, primary_nick, nickname.id, "
@@ -73,8 +92,6 @@ static query_t queries[QUERY_COUNT] = {
   { GET_NICK_FROM_NICKID, "SELECT nick from nickname WHERE id=$1", QUERY },
   { GET_ACCID_FROM_NICK, "SELECT account_id from nickname WHERE lower(nick)=lower($1)", QUERY },
   { GET_NICKID_FROM_NICK, "SELECT id from nickname WHERE lower(nick)=lower($1)", QUERY },
-  { INSERT_ACCOUNT, "INSERT INTO account (primary_nick, password, salt, email, reg_time) VALUES "
-    "($1, $2, $3, $4, $5)", EXECUTE },
   { INSERT_NICK, "INSERT INTO nickname (id, nick, account_id, reg_time, last_seen) VALUES "
     "($1, $2, $3, $4, $5)", EXECUTE },
   { DELETE_NICK, "DELETE FROM nickname WHERE id=$1", EXECUTE },
@@ -100,8 +117,6 @@ static query_t queries[QUERY_COUNT] = {
       "flag_autolimit, flag_expirebans, flag_floodserv, flag_autoop, "
       "flag_autovoice, flag_leaveops, url, email, topic, mlock, expirebans_lifetime, "
       "flag_autosave, last_used FROM channel WHERE lower(channel)=lower($1)", QUERY },
-  { INSERT_CHAN, "INSERT INTO channel (channel, description, reg_time, last_used) "
-    "VALUES($1, $2, $3, $4)", EXECUTE },
   { INSERT_CHANACCESS, "INSERT INTO channel_access (account_id, channel_id, level) VALUES "
     "($1, $2, $3)", EXECUTE } ,
   { SET_CHAN_LEVEL, "UPDATE channel_access SET level=$1 WHERE account_id=$2", EXECUTE },
@@ -226,12 +241,13 @@ static query_t queries[QUERY_COUNT] = {
     "account.primary_nick=nickname.id RIGHT OUTER JOIN akill ON "
     "akill.setter=account.id WHERE "*/
   { GET_EXPIRED_AKILL, "SELECT id, setter, mask, reason, time, duration FROM akill WHERE "
-    "NOT duration = 0 AND time + duration < $1", QUERY },
+    "duration <> 0 AND time + duration < $1", QUERY },
   { INSERT_SENT_MAIL, "INSERT INTO sent_mail (account_id, email, sent) VALUES "
       "($1, $2, $3)", EXECUTE },
   { GET_SENT_MAIL, "SELECT id FROM sent_mail WHERE account_id=$1 OR email=$2",
     QUERY },
-  { DELETE_EXPIRED_SENT_MAIL, "DELETE FROM sent_mail WHERE sent + $1 < $2", EXECUTE },
+  { DELETE_EXPIRED_SENT_MAIL, "DELETE FROM sent_mail WHERE sent < $2::integer - $1::integer",
+    EXECUTE },
   { GET_NICKS, "SELECT nick FROM account, nickname WHERE account.id=nickname.account_id AND "
        "account.flag_private='f' ORDER BY lower(nick)", QUERY },
   { GET_NICKS_OPER, "SELECT nick FROM nickname ORDER BY lower(nick)", QUERY },
@@ -273,8 +289,6 @@ static query_t queries[QUERY_COUNT] = {
     "id=$2", EXECUTE },
   { GET_SERVICEMASK_MASKS, "SELECT mask FROM channel_akick WHERE channel_id = $1 "
     " AND chmode = $2", QUERY },
-  { INSERT_GROUP, "INSERT INTO \"group\" (name, description, reg_time) "
-    "VALUES ($1, $2, $3)", EXECUTE },
   { GET_FULL_GROUP, "SELECT id, name, description, email, url, flag_private, "
     "reg_time FROM \"group\" WHERE name=$1", QUERY },
   { DELETE_GROUP, "DELETE FROM \"group\" WHERE id=$1", EXECUTE },
@@ -335,6 +349,57 @@ static query_t queries[QUERY_COUNT] = {
     "ORDER BY lower(name)", QUERY },
   { SET_SYNCHRONOUS_COMMIT, "UPDATE pg_settings SET setting = 'on' WHERE name = 'synchronous_commit'", EXECUTE },
   { UNSET_SYNCHRONOUS_COMMIT, "UPDATE pg_settings SET setting = 'off' WHERE name = 'synchronous_commit'", EXECUTE },
+  { GET_ALL_NICKACCESS, "SELECT account_id, entry, NULL FROM account_access "
+    "ORDER BY id", QUERY },
+  { GET_ALL_NICKCERTS, "SELECT account_id, fingerprint, nickname_id FROM "
+    "account_fingerprint ORDER BY id", QUERY },
+  { BATCH_NICK_LAST_SEEN, "UPDATE nickname SET last_seen=v.last_seen FROM "
+    "unnest($1::integer[], $2::integer[]) AS v(id, last_seen) "
+    "WHERE nickname.id=v.id", EXECUTE },
+  { BATCH_ACCOUNT_LAST, "UPDATE account SET "
+    "last_host=COALESCE(v.last_host, account.last_host), "
+    "last_realname=COALESCE(v.last_realname, account.last_realname), "
+    "last_quit_msg=COALESCE(v.last_quit_msg, account.last_quit_msg), "
+    "last_quit_time=COALESCE(v.last_quit_time, account.last_quit_time) FROM "
+    "unnest($1::integer[], $2::varchar[], $3::varchar[], $4::varchar[], "
+    "$5::integer[]) AS v(id, last_host, last_realname, last_quit_msg, "
+    "last_quit_time) WHERE account.id=v.id", EXECUTE },
+  { BATCH_CHAN_LAST_USED, "UPDATE channel SET last_used=v.last_used FROM "
+    "unnest($1::integer[], $2::integer[]) AS v(id, last_used) "
+    "WHERE channel.id=v.id", EXECUTE },
+  /* LIST: $1 is a LIKE pattern on the lowercased name, the names sort after
+   * $2, at most $3 of them */
+  { GET_NICKS_MATCH, "SELECT nick FROM account, nickname WHERE "
+    "account.id=nickname.account_id AND account.flag_private='f' AND "
+    "lower(nick) LIKE $1 ESCAPE '\\' AND lower(nick) > lower($2) "
+    "ORDER BY lower(nick) LIMIT $3", QUERY },
+  { GET_NICKS_OPER_MATCH, "SELECT nick FROM nickname WHERE "
+    "lower(nick) LIKE $1 ESCAPE '\\' AND lower(nick) > lower($2) "
+    "ORDER BY lower(nick) LIMIT $3", QUERY },
+  { GET_FORBIDS_MATCH, "SELECT nick FROM forbidden_nickname WHERE "
+    "lower(nick) LIKE $1 ESCAPE '\\' AND lower(nick) > lower($2) "
+    "ORDER BY lower(nick) LIMIT $3", QUERY },
+  { GET_CHANNELS_MATCH, "SELECT channel FROM channel WHERE flag_private='f' AND "
+    "lower(channel) LIKE $1 ESCAPE '\\' AND lower(channel) > lower($2) "
+    "ORDER BY lower(channel) LIMIT $3", QUERY },
+  { GET_CHANNELS_OPER_MATCH, "SELECT channel FROM channel WHERE "
+    "lower(channel) LIKE $1 ESCAPE '\\' AND lower(channel) > lower($2) "
+    "ORDER BY lower(channel) LIMIT $3", QUERY },
+  { GET_CHANNEL_FORBIDS_MATCH, "SELECT channel FROM forbidden_channel WHERE "
+    "lower(channel) LIKE $1 ESCAPE '\\' AND lower(channel) > lower($2) "
+    "ORDER BY lower(channel) LIMIT $3", QUERY },
+  { GET_GROUPS_MATCH, "SELECT name FROM \"group\" WHERE flag_private='f' AND "
+    "lower(name) LIKE $1 ESCAPE '\\' AND lower(name) > lower($2) "
+    "ORDER BY lower(name) LIMIT $3", QUERY },
+  { GET_GROUPS_OPER_MATCH, "SELECT name FROM \"group\" WHERE "
+    "lower(name) LIKE $1 ESCAPE '\\' AND lower(name) > lower($2) "
+    "ORDER BY lower(name) LIMIT $3", QUERY },
+  { INSERT_ACCOUNT_ID, "INSERT INTO account (id, primary_nick, password, salt, "
+    "email, reg_time) VALUES ($1, $2, $3, $4, $5, $6)", EXECUTE },
+  { INSERT_CHAN_ID, "INSERT INTO channel (id, channel, description, reg_time, "
+    "last_used) VALUES ($1, $2, $3, $4, $5)", EXECUTE },
+  { INSERT_GROUP_ID, "INSERT INTO \"group\" (id, name, description, reg_time) "
+    "VALUES ($1, $2, $3, $4)", EXECUTE },
 };
 
 
@@ -354,16 +419,79 @@ INIT_MODULE(pgsql, "$Revision: 1251 $")
   pgsql->insert_id = pg_insertid;
   pgsql->next_id = pg_nextid;
   pgsql->is_connected = pg_is_connected;
+  pgsql->reconnect_poll = pg_reconnect_poll;
+#ifdef LIBPQ_HAS_PIPELINING
+  pgsql->execute_pipeline = pg_execute_pipeline;
+#endif
 
   return pgsql;
 }
 
 CLEANUP_MODULE
 {
+  int i;
+
+  for(i = 0; i < statement_count; i++)
+    MyFree(statements[i].types);
+  MyFree(statements);
+  statements = NULL;
+  statement_count = 0;
+
   PQfinish(pgsql->connection);
   MyFree(pgsql);
 }
 
+/* pg_describe()
+ *
+ * inputs       - query id, its statement name
+ * output       - none
+ * side effects - the parameter types of the statement are looked up and
+ *                remembered, a statement that can not be described has all
+ *                its parameters sent as text
+ */
+static void
+pg_describe(int id, const char *name)
+{
+  struct PgStatement *stmt;
+  PGresult *result;
+  int i;
+
+  if(id >= statement_count)
+  {
+    int count = statement_count > 0 ? statement_count : QUERY_COUNT;
+
+    while(count <= id)
+      count *= 2;
+    statements = MyRealloc(statements, sizeof(struct PgStatement) * count);
+    memset(statements + statement_count, 0,
+        sizeof(struct PgStatement) * (count - statement_count));
+    statement_count = count;
+  }
+
+  stmt = &statements[id];
+  MyFree(stmt->types);
+  stmt->types = NULL;
+  stmt->nparams = 0;
+
+  result = PQdescribePrepared(pgsql->connection, name);
+  if(result == NULL || PQresultStatus(result) != PGRES_COMMAND_OK)
+  {
+    db_log("PG describe Error: %s", PQerrorMessage(pgsql->connection));
+    PQclear(result);
+    return;
+  }
+
+  stmt->nparams = PQnparams(result);
+  if(stmt->nparams > 0)
+  {
+    stmt->types = MyMalloc(sizeof(Oid) * stmt->nparams);
+    for(i = 0; i < stmt->nparams; i++)
+      stmt->types[i] = PQparamtype(result, i);
+  }
+
+  PQclear(result);
+}
+
 static int 
 pg_prepare(int id, const char *query)
 {
@@ -389,15 +517,125 @@ pg_prepare(int id, const char *query)
     return 0;
   }
 
+  pg_describe(id, name);
+
   db_log("PG prepared: %s (%s)", name, query);
 
   return 1;
 }
 
+static int
+pg_prepare_all()
+{
+  int i;
+
+  for(i = 0; i < QUERY_COUNT; i++)
+  {
+    query_t *query = &queries[i];
+    db_log("Prepare %d: %s", i, query->name);
+    if(query->name == NULL)
+      continue;
+    if(!pg_prepare(i, query->name))
+    {
+      ilog(L_CRIT, "Prepare: %d Failed (%s)", i, PQerrorMessage(pgsql->connection));
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* pg_exec()
+ *
+ * inputs       - sql to run, may be several statements
+ * output       - TRUE on success
+ * side effects - errors go to the db log
+ */
+static int
+pg_exec(const char *sql)
+{
+  PGresult *result;
+  int ret;
+
+  if((result = PQexec(pgsql->connection, sql)) == NULL)
+  {
+    db_log("PG Error: %s", PQerrorMessage(pgsql->connection));
+    return FALSE;
+  }
+
+  ret = PQresultStatus(result);
+  PQclear(result);
+
+  if(ret != PGRES_COMMAND_OK && ret != PGRES_TUPLES_OK)
+  {
+    db_log("PG Error(%d): %s", ret, PQerrorMessage(pgsql->connection));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* pg_schema_version()
+ *
+ * inputs       - none
+ * output       - the version in schema_version, 0 for a database from
+ *                before there was one
+ * side effects - none
+ */
+static int
+pg_schema_version()
+{
+  PGresult *result;
+  int version = 0;
+
+  result = PQexec(pgsql->connection, "SELECT version FROM schema_version");
+  if(result == NULL)
+    return 0;
+
+  if(PQresultStatus(result) == PGRES_TUPLES_OK && PQntuples(result) > 0)
+    version = atoi(PQgetvalue(result, 0, 0));
+  PQclear(result);
+
+  return version;
+}
+
+/* pg_upgrade_schema()
+ *
+ * inputs       - none
+ * output       - TRUE if the schema is as new as the installed scripts
+ * side effects - each pgsql-upgrade-NNN.sql past the database's version
+ *                is run in a transaction of its own
+ */
+static int
+pg_upgrade_schema()
+{
+  int version = pg_schema_version();
+  char *sql;
+
+  while((sql = db_read_upgrade("pgsql", version + 1)) != NULL)
+  {
+    int ok;
+
+    ilog(L_NOTICE, "Upgrading pgsql schema to version %d", version + 1);
+    ok = pg_exec("BEGIN") && pg_exec(sql) && pg_exec("COMMIT");
+    MyFree(sql);
+
+    if(!ok || pg_schema_version() != version + 1)
+    {
+      pg_exec("ROLLBACK");
+      ilog(L_CRIT, "Upgrading pgsql schema to version %d failed",
+          version + 1);
+      return FALSE;
+    }
+    version++;
+  }
+
+  return TRUE;
+}
+
 static int 
 pg_connect(const char *connection_string)
 {
-  int i;
 
   if(pgsql->connection == NULL)
     pgsql->connection = PQconnectdb(connection_string);
@@ -410,22 +648,47 @@ pg_connect(const char *connection_string)
   if(PQstatus(pgsql->connection) != CONNECTION_OK)
     return 0;
 
-  for(i = 0; i < QUERY_COUNT; i++)
+  if(!pg_upgrade_schema() || !pg_prepare_all())
+    return 0;
+
+  pgsql->execute_nonquery(UNSET_SYNCHRONOUS_COMMIT, "", NULL); /* turn safe commits off until burst is completed */
+
+  return 1;
+}
+
+/* pg_reconnect_poll()
+ *  Drives a non blocking reset of the lost connection along, one step per
+ *  call.  Returns 1 once it is back and prepared, 0 while still going and
+ *  -1 if this attempt failed.
+ */
+static int
+pg_reconnect_poll()
+{
+  if(pgsql->connection == NULL)
+    return -1;
+
+  if(!pg_resetting)
   {
-    query_t *query = &queries[i];
-    db_log("Prepare %d: %s", i, query->name);
-    if(query->name == NULL)
-      continue;
-    if(!pg_prepare(i, query->name))
+    if(!PQresetStart(pgsql->connection))
     {
-      ilog(L_CRIT, "Prepare: %d Failed (%s)", i, PQerrorMessage(pgsql->connection));
-      return 0;
+      db_log("PG reset Error: %s", PQerrorMessage(pgsql->connection));
+      return -1;
     }
+    pg_resetting = TRUE;
   }
 
-  pgsql->execute_nonquery(UNSET_SYNCHRONOUS_COMMIT, "", NULL); /* turn safe commits off until burst is completed */
-
-  return 1;
+  switch(PQresetPoll(pgsql->connection))
+  {
+    case PGRES_POLLING_OK:
+      pg_resetting = FALSE;
+      return pg_prepare_all() ? 1 : -1;
+    case PGRES_POLLING_FAILED:
+      pg_resetting = FALSE;
+      db_log("PG reset Error: %s", PQerrorMessage(pgsql->connection));
+      return -1;
+    default:
+      return 0;
+  }
 }
 
 static int
@@ -437,35 +700,75 @@ pg_is_connected()
     return FALSE;
 }
 
-static inline int
-void_to_char(char fmt, char **dst, void *src)
+/* pg_bind()
+ *
+ * inputs       - server type of the parameter, format character, value,
+ *                scratch buffer of TEMP_BUFSIZE for it
+ * output       - FALSE on an unknown format
+ * side effects - value, length and format are set up for PQexecPrepared,
+ *                strings are passed as they are without a copy
+ */
+static int
+pg_bind(Oid type, char fmt, void *src, const char **value, int *length,
+    int *format, char *buf)
 {
-  char tmp[TEMP_BUFSIZE];
+  unsigned char *out = (unsigned char *)buf;
+  uint64_t wide;
+  int i;
+
+  *length = 0;
+  *format = 0;
 
   if(src == NULL)
   {
-    *dst = NULL;
+    *value = NULL;
     return TRUE;
   }
 
   switch(fmt)
   {
     case 'i':
-      snprintf(tmp, sizeof(tmp), "%d", *(int *)src);
-      DupString(*dst, tmp);
+      /* binary integers are big endian of the column's width */
+      switch(type)
+      {
+        case INT2OID:
+          *length = 2;
+          break;
+        case INT4OID:
+          *length = 4;
+          break;
+        case INT8OID:
+          *length = 8;
+          break;
+        default:
+          snprintf(buf, TEMP_BUFSIZE, "%d", *(int *)src);
+          *value = buf;
+          return TRUE;
+      }
+
+      wide = (int64_t)*(int *)src;
+      for(i = *length - 1; i >= 0; i--)
+      {
+        out[i] = wide & 0xff;
+        wide >>= 8;
+      }
+      *format = 1;
+      *value = buf;
       return TRUE;
-      break;
     case 'b':
-      if(((char *)src)[0])
-        DupString(*dst, "1");
+      if(type == BOOLOID)
+      {
+        buf[0] = ((char *)src)[0] ? 1 : 0;
+        *length = 1;
+        *format = 1;
+      }
       else
-        DupString(*dst, "0");
+        strlcpy(buf, ((char *)src)[0] ? "1" : "0", TEMP_BUFSIZE);
+      *value = buf;
       return TRUE;
-      break;
     case 's':
-      DupString(*dst, (char *)src);
+      *value = src;
       return TRUE;
-      break;
     default:
       db_log("PG Unknown param type: %c", fmt);
       break;
@@ -474,69 +777,130 @@ void_to_char(char fmt, char **dst, void *src)
   return FALSE;
 }
 
-size_t
-join_log_params(char *target, int parc, char *parv[])
+static void
+pg_log_query(int id, const char *format, dlink_list *args)
 {
-  size_t length = 0;
-  int i;
+  char log_params[IRC_BUFSIZE] = "";
+  char tmp[TEMP_BUFSIZE];
+  const char *value;
+  dlink_node *ptr;
+  size_t count = 0;
 
-  if(parv[0] != NULL)
-    length += strlcpy(target, parv[0], IRC_BUFSIZE);
-  for(i = 1; i < parc; i++)
+  if(args != NULL)
   {
-    length += strlcat(target, ", ", IRC_BUFSIZE);
-    if(parv[i] != NULL)
-      length += strlcat(target, parv[i], IRC_BUFSIZE);
-    else
-      length += strlcat(target, "NULL", IRC_BUFSIZE);
+    DLINK_FOREACH(ptr, args->head)
+    {
+      if(format[count] == '\0')
+        break;
+
+      if(ptr->data == NULL)
+        value = "NULL";
+      else if(format[count] == 'i')
+      {
+        snprintf(tmp, sizeof(tmp), "%d", *(int *)ptr->data);
+        value = tmp;
+      }
+      else if(format[count] == 'b')
+        value = ((char *)ptr->data)[0] ? "1" : "0";
+      else
+        value = ptr->data;
+
+      if(count > 0)
+        strlcat(log_params, ", ", sizeof(log_params));
+      strlcat(log_params, value, sizeof(log_params));
+      count++;
+    }
   }
 
-  return length;
+  if(id < QUERY_COUNT)
+  {
+    db_log("Executing query %d (%s) Parameters: [%s]", id, queries[id].name, 
+      count > 0 ? log_params : "None");
+  }
+  else
+  {
+    db_log("Execute dynamic query %d Parameters: [%s]", id,
+      count > 0 ? log_params : "None");
+  }
 }
 
-static PGresult *
-internal_execute(int id, int *error, const char *format,
-    dlink_list *args)
+/* pg_call_prepared()
+ *
+ * inputs       - query id, format and parameters, where the result goes
+ * output       - FALSE if the statement could not be sent
+ * side effects - the statement is run and *result set, or with a NULL
+ *                result only sent, for a pipeline to collect it later
+ */
+static int
+pg_call_prepared(int id, const char *format, dlink_list *args,
+    PGresult **result)
 {
-  PGresult *result;
-  char **params = NULL;
+  const char *stack_values[PG_STACK_PARAMS];
+  int stack_lengths[PG_STACK_PARAMS];
+  int stack_formats[PG_STACK_PARAMS];
+  char stack_bufs[PG_STACK_PARAMS][TEMP_BUFSIZE];
+  const char **values = stack_values;
+  int *lengths = stack_lengths;
+  int *formats = stack_formats;
+  char (*bufs)[TEMP_BUFSIZE] = stack_bufs;
+  void *heap = NULL;
   char name[TEMP_BUFSIZE];
-  char log_params[IRC_BUFSIZE];
-  int ret, len, i = 0;
+  int len, sent = TRUE;
   dlink_node *ptr = NULL;
-  size_t count = 0;
+  int count = 0;
 
   len = strlen(format);
-  if (len > 0) {
-    params = MyMalloc(sizeof(char*) * len);
+  if(len > PG_STACK_PARAMS)
+  {
+    heap = MyMalloc((sizeof(char *) + 2 * sizeof(int) + TEMP_BUFSIZE) * len);
+    bufs = heap;
+    values = (const char **)(bufs + len);
+    lengths = (int *)(values + len);
+    formats = lengths + len;
+  }
 
+  if(len > 0)
+  {
     DLINK_FOREACH(ptr, args->head)
     {
-      void_to_char(format[count], &params[count], ptr->data);
+      Oid type = 0;
+
+      if(count >= len)
+        break;
+      if(id < statement_count && count < statements[id].nparams)
+        type = statements[id].types[count];
+
+      pg_bind(type, format[count], ptr->data, &values[count], &lengths[count],
+          &formats[count], bufs[count]);
       count++;
     }
   }
 
   snprintf(name, sizeof(name), "Query: %d", id);
-  if(len > 0)
-    join_log_params(log_params, len, (char**)params);
 
-  result = PQexecPrepared(pgsql->connection, name, len, (const char**)params,
-      NULL, NULL, 0);
+  if(result != NULL)
+    *result = PQexecPrepared(pgsql->connection, name, count, values, lengths,
+        formats, 0);
+  else
+    sent = PQsendQueryPrepared(pgsql->connection, name, count, values,
+        lengths, formats, 0);
 
-  for(i = 0; i < len; i++)
-    MyFree(params[i]);
+  MyFree(heap);
 
-  if(id < QUERY_COUNT)
-  {
-    db_log("Executing query %d (%s) Parameters: [%s]", id, queries[id].name, 
-      len > 0 ? log_params : "None");
-  }
-  else
-  {
-    db_log("Execute dynamic query %d Parameters: [%s]", id,
-      len > 0 ? log_params : "None");
-  }
+  if(db_log_enabled())
+    pg_log_query(id, format, args);
+
+  return sent;
+}
+
+static PGresult *
+internal_execute(int id, int *error, const char *format,
+    dlink_list *args)
+{
+  PGresult *result;
+  int ret;
+
+  pg_call_prepared(id, format, args, &result);
 
   if(result == NULL)
   {
@@ -603,84 +967,201 @@ pg_execute_nonquery(int id, const char *format, dlink_list *args)
   return num_rows;
 }
 
+/* pg_make_result()
+ *
+ * inputs       - a successful PGresult
+ * output       - the result set for it
+ * side effects - the values point into the PGresult, which is kept until
+ *                pg_free_result().  The result set, its rows and their
+ *                column arrays are a single allocation.
+ */
 static result_set_t *
-pg_execute(int id, int *error, const char *format, dlink_list *args)
+pg_make_result(PGresult *result)
 {
-  PGresult *result;
+  static char bool_true[] = "1", bool_false[] = "0";
+  static char timestamp[] = "lalaldate";
   result_set_t *results;
-  int num_cols;
+  char **cells;
+  Oid *types = NULL;
+  int num_rows, num_cols;
   int i, j;
 
-  result = internal_execute(id, error, format, args);
-
-  if(result == NULL)
-    return NULL;
-
-  results = MyMalloc(sizeof(result_set_t));
+  num_rows = PQntuples(result);
+  num_cols = PQnfields(result);
 
-  results->row_count = PQntuples(result);
-  if(results->row_count > 0)
-    results->rows = MyMalloc(sizeof(row_t) * results->row_count);
+  results = MyMalloc(sizeof(result_set_t) + sizeof(row_t) * num_rows +
+      sizeof(char *) * num_rows * num_cols);
+  results->handle = result;
+  results->row_count = num_rows;
+  if(num_rows > 0)
+    results->rows = (row_t *)(results + 1);
+  cells = (char **)(results->rows + num_rows);
 
-  num_cols = PQnfields(result);
+  if(num_cols > 0)
+  {
+    types = MyMalloc(sizeof(Oid) * num_cols);
+    for(j = 0; j < num_cols; j++)
+      types[j] = PQftype(result, j);
+  }
 
-  for(i = 0; i < results->row_count; i++)
+  for(i = 0; i < num_rows; i++)
   {
     row_t *row = &results->rows[i];
 
     row->col_count = num_cols;
-    if(num_cols > 0)
-      row->cols = MyMalloc(sizeof(char**) * num_cols);
-    for(j = 0; j < row->col_count; j++)
+    row->cols = cells + i * num_cols;
+    for(j = 0; j < num_cols; j++)
     {
       if(PQgetisnull(result, i, j))
         row->cols[j] = NULL;
       else
       {
         char *value = PQgetvalue(result, i, j);
-        switch(PQftype(result, j))
+        switch(types[j])
         {
           case BOOLOID:
             if(*value == 't')
-              DupString(row->cols[j], "1");
+              row->cols[j] = bool_true;
             else if(*value == 'f')
-              DupString(row->cols[j], "0");
+              row->cols[j] = bool_false;
             break;
           case TIMESTAMPOID:
-            DupString(row->cols[j], "lalaldate");
+            row->cols[j] = timestamp;
             break;
           default:
-            DupString(row->cols[j], value);
+            row->cols[j] = value;
             break;
         }
       }
     }
   }
-  PQclear(result);
-  *error = 0;
+  MyFree(types);
 
   return results;
 }
 
-static void
-pg_free_result(result_set_t *result)
+static result_set_t *
+pg_execute(int id, int *error, const char *format, dlink_list *args)
 {
-  int i, j;
+  PGresult *result;
+
+  result = internal_execute(id, error, format, args);
 
   if(result == NULL)
-    return;
+    return NULL;
+
+  *error = 0;
+  return pg_make_result(result);
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+/* pg_execute_pipeline()
+ *
+ * inputs       - pipeline
+ * output       - TRUE if every step succeeded
+ * side effects - all the steps are sent, followed by a single sync, before
+ *                any result is read.  Outside of a transaction block the
+ *                server runs everything up to the sync as one implicit
+ *                transaction, so an error rolls back the whole pipeline.
+ *                The connection is blocking, which is fine for the few
+ *                short statements a pipeline holds.
+ */
+static int
+pg_execute_pipeline(struct DBPipeline *pipeline)
+{
+  PGconn *conn = pgsql->connection;
+  PGresult *result;
+  int i, sent, ret, ok = TRUE;
+
+  if(!PQenterPipelineMode(conn))
+  {
+    db_log("PG pipeline Error: %s", PQerrorMessage(conn));
+    return FALSE;
+  }
+
+  for(sent = 0; sent < pipeline->count; sent++)
+  {
+    struct DBPipelineStep *step = &pipeline->steps[sent];
+
+    if(!pg_call_prepared(step->query, step->format, &step->args, NULL))
+    {
+      db_log("PG pipeline send Error: %s", PQerrorMessage(conn));
+      ok = FALSE;
+      break;
+    }
+  }
 
-  for(i = 0; i < result->row_count; i++)
+  if(!PQpipelineSync(conn))
   {
-    row_t *row = &result->rows[i];
+    db_log("PG pipeline sync Error: %s", PQerrorMessage(conn));
+    PQexitPipelineMode(conn);
+    return FALSE;
+  }
+
+  for(i = 0; i < sent; i++)
+  {
+    struct DBPipelineStep *step = &pipeline->steps[i];
+
+    if((result = PQgetResult(conn)) == NULL)
+    {
+      ok = FALSE;
+      break;
+    }
 
-    for(j = 0; j < row->col_count; j++)
+    ret = PQresultStatus(result);
+    if(ret == PGRES_TUPLES_OK || ret == PGRES_COMMAND_OK)
     {
-      MyFree(row->cols[j]);
+      step->error = 0;
+      if(step->type == QUERY)
+        step->result = pg_make_result(result);
+      else
+      {
+        step->rows = atoi(PQcmdTuples(result));
+        PQclear(result);
+      }
     }
-    MyFree(row->cols);
+    else
+    {
+      /* the steps after a failed one come back aborted */
+      if(ret != PGRES_PIPELINE_ABORTED)
+        db_log("PG pipeline Error(%d) in query %d: %s", ret, step->query,
+            PQresultErrorMessage(result));
+      step->error = ret;
+      ok = FALSE;
+      PQclear(result);
+    }
+
+    /* each statement's results end with a NULL */
+    while((result = PQgetResult(conn)) != NULL)
+      PQclear(result);
   }
-  MyFree(result->rows);
+
+  /* then comes the sync */
+  while((result = PQgetResult(conn)) != NULL)
+  {
+    ret = PQresultStatus(result);
+    PQclear(result);
+    if(ret == PGRES_PIPELINE_SYNC)
+      break;
+  }
+
+  if(!PQexitPipelineMode(conn))
+  {
+    db_log("PG pipeline exit Error: %s", PQerrorMessage(conn));
+    ok = FALSE;
+  }
+
+  return ok;
+}
+#endif
+
+static void
+pg_free_result(result_set_t *result)
+{
+  if(result == NULL)
+    return;
+
+  PQclear(result->handle);
   MyFree(result);
 }
 
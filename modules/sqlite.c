@@ -0,0 +1,1137 @@
+/*
+ *  oftc-ircservices: an exstensible and flexible IRC Services package
+ *  sqlite.c : A database module for an embedded sqlite database
+ *
+ *  Copyright (C) 2012 Stuart Walsh and the OFTC Coding department
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ */
+
+/*
+ * The database is a single file, named by dbname in the database{} block
+ * (relative names are taken from LOCALSTATEDIR).  It is opened in WAL mode
+ * and every query is prepared once and reused.  An empty file is given the
+ * schema in services-sqlite.sql, which scripts/pgsql-to-sqlite.rb generates
+ * from the postgresql one.
+ */
+
+#include <sys/stat.h>
+#include <sqlite3.h>
+
+#include "stdinc.h"
+#include "dbm.h"
+#include "language.h"
+#include "parse.h"
+#include "chanserv.h"
+#include "nickname.h"
+#include "interface.h"
+#include "conf/modules.h"
+
+#define TEMP_BUFSIZE 32
+#define SQ_SCHEMA_FILE DATADIR "/" PACKAGE "/services-sqlite.sql"
+#define SQ_BUSY_TIMEOUT 5000 /* ms to wait on a lock held elsewhere */
+
+static database_t *sqlite;
+static sqlite3_stmt **statements;
+static int statement_count;
+
+static int sq_connect(const char *);
+static char *sq_execute_scalar(int, int *, const char *, dlink_list*);
+static result_set_t *sq_execute(int, int *, const char *, dlink_list*);
+static int sq_execute_nonquery(int, const char *, dlink_list*);
+static int sq_prepare(int, const char *);
+static int64_t sq_insertid(const char *, const char *);
+static int64_t sq_nextid(const char *, const char *);
+static int sq_begin_transaction();
+static int sq_commit_transaction();
+static int sq_rollback_transaction();
+static void sq_free_result(result_set_t *);
+static int sq_is_connected();
+
+static query_t queries[QUERY_COUNT] = { 
+  { GET_FULL_NICK, "SELECT account.id, primary_nick, nickname.id, "
+    "(SELECT nick FROM nickname WHERE nickname.id=account.primary_nick), "
+    "password, salt, url, email, cloak, flag_enforce, flag_secure, "
+    "flag_verified, flag_cloak_enabled, flag_admin, flag_email_verified, "
+    "flag_private, language, last_host, last_realname, "
+    "last_quit_msg, last_quit_time, account.reg_time, nickname.reg_time, "
+    "last_seen FROM account, nickname WHERE account.id = nickname.account_id AND "
+    "lower(nick) = lower($1)", QUERY },
+  { GET_NICK_FROM_ACCID, "SELECT nick from account, nickname WHERE account.id=$1 AND "
+    "account.primary_nick=nickname.id", QUERY },
+  { GET_NICK_FROM_NICKID, "SELECT nick from nickname WHERE id=$1", QUERY },
+  { GET_ACCID_FROM_NICK, "SELECT account_id from nickname WHERE lower(nick)=lower($1)", QUERY },
+  { GET_NICKID_FROM_NICK, "SELECT id from nickname WHERE lower(nick)=lower($1)", QUERY },
+  { INSERT_NICK, "INSERT INTO nickname (id, nick, account_id, reg_time, last_seen) VALUES "
+    "($1, $2, $3, $4, $5)", EXECUTE },
+  { DELETE_NICK, "DELETE FROM nickname WHERE id=$1", EXECUTE },
+  { DELETE_ACCOUNT, "DELETE FROM account WHERE id=$1", EXECUTE },
+  { INSERT_NICKACCESS, "INSERT INTO account_access (account_id, entry) VALUES($1, $2)", 
+    EXECUTE },
+  { GET_NICKACCESS, "SELECT id, entry FROM account_access WHERE account_id=$1 ORDER BY id", QUERY },
+  /* CROSS JOIN keeps the few matching rows driving, rather than a walk of
+   * the ORDER BY index */
+  { GET_ADMINS, "SELECT nick FROM account CROSS JOIN nickname WHERE flag_admin=1 AND "
+    "account.primary_nick = nickname.id ORDER BY lower(nick)", QUERY },
+  /* XXX: ORDER BY missing here */
+  { GET_AKILLS, "SELECT akill.id, setter, mask, reason, time, duration FROM akill ORDER BY akill.time",
+    QUERY },
+  { GET_CHAN_ACCESSES, "SELECT channel_access.id, channel_access.channel_id, "
+      "channel_access.account_id, channel_access.group_id, channel_access.level "
+      "FROM channel_access JOIN account ON "
+      "channel_access.account_id=account.id JOIN nickname ON "
+      "account.primary_nick=nickname.id WHERE channel_id=$1 "
+      "ORDER BY level, lower(nickname.nick) DESC", QUERY },
+  { GET_CHANID_FROM_CHAN, "SELECT id from channel WHERE "
+      "lower(channel)=lower($1)", QUERY },
+  { GET_FULL_CHAN, "SELECT id, channel, description, entrymsg, reg_time, "
+      "flag_private, flag_restricted, flag_topic_lock, flag_verbose, "
+      "flag_autolimit, flag_expirebans, flag_floodserv, flag_autoop, "
+      "flag_autovoice, flag_leaveops, url, email, topic, mlock, expirebans_lifetime, "
+      "flag_autosave, last_used FROM channel WHERE lower(channel)=lower($1)", QUERY },
+  { INSERT_CHANACCESS, "INSERT INTO channel_access (account_id, channel_id, level) VALUES "
+    "($1, $2, $3)", EXECUTE } ,
+  { SET_CHAN_LEVEL, "UPDATE channel_access SET level=$1 WHERE account_id=$2", EXECUTE },
+  { DELETE_CHAN_ACCESS, "DELETE FROM channel_access WHERE id=$1", EXECUTE },
+  { GET_CHAN_ACCESS, "SELECT id, channel_id, account_id, group_id, level "
+    "FROM channel_access WHERE channel_id=$1 "
+      "AND (account_id=$2 OR group_id IN (SELECT group_id FROM group_access "
+      "WHERE account_id=$2)) ORDER BY level DESC LIMIT 1", QUERY },
+  { GET_CHAN_ACCESS_EXACT, "SELECT id, channel_id, account_id, group_id, level "
+    "FROM channel_access WHERE channel_id=$1 "
+      "AND account_id=$2 LIMIT 1", QUERY },
+  { DELETE_CHAN, "DELETE FROM channel WHERE id=$1", EXECUTE },
+  { GET_AKILL, "SELECT id, setter, mask, reason, time, duration FROM akill WHERE mask=$1",
+    QUERY },
+  { INSERT_AKILL, "INSERT INTO akill (mask, reason, setter, time, duration) "
+      "VALUES($1, $2, $3, $4, $5)", EXECUTE },
+  { INSERT_SERVICES_AKILL, "INSERT INTO akill (mask, reason, time, duration) "
+      "VALUES($1, $2, $3, $4)", EXECUTE },
+  { SET_NICK_PASSWORD, "UPDATE account SET password=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_SALT, "UPDATE account SET salt=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_URL, "UPDATE account SET url=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_EMAIL, "UPDATE account SET email=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_CLOAK, "UPDATE account SET cloak=lower($1) WHERE id=$2", EXECUTE },
+  { SET_NICK_LAST_QUIT, "UPDATE account SET last_quit_msg=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_LAST_HOST, "UPDATE account SET last_host=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_LAST_REALNAME, "UPDATE account SET last_realname=$1 where id=$2", EXECUTE },
+  { SET_NICK_LANGUAGE, "UPDATE account SET language=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_LAST_QUITTIME, "UPDATE account SET last_quit_time=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_LAST_SEEN, "UPDATE nickname SET last_seen=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_CLOAKON, "UPDATE account SET flag_cloak_enabled=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_SECURE, "UPDATE account SET flag_secure=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_ENFORCE, "UPDATE account SET flag_enforce=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_ADMIN, "UPDATE account SET flag_admin=$1 WHERE id=$2", EXECUTE },
+  { SET_NICK_PRIVATE, "UPDATE account SET flag_private=$1 WHERE id=$2", EXECUTE },
+  { DELETE_NICKACCESS, "DELETE FROM account_access WHERE account_id=$1 AND entry=$2",
+    EXECUTE },
+  { DELETE_ALL_NICKACCESS, "DELETE FROM account_access WHERE account_id=$1", EXECUTE },
+  /*{ DELETE_NICKACCESS_IDX, "DELETE FROM account_access WHERE id = "
+          "(SELECT a.id FROM account_access AS a WHERE $1 = "
+          "(SELECT COUNT(b.id)+1 FROM account_access AS b WHERE b.id < a.id AND "
+          "b.account_id = $2) AND a.account_id = $2)", EXECUTE },*/
+  { SET_NICK_LINK, "UPDATE nickname SET account_id=$1 WHERE account_id=$2", EXECUTE },
+  { SET_NICK_LINK_EXCLUDE, "UPDATE nickname SET account_id=$1 WHERE account_id=$2 AND id=$3", EXECUTE },
+  { INSERT_NICK_CLONE, "INSERT INTO account (primary_nick, password, salt, url, email, cloak, " 
+    "flag_enforce, flag_secure, flag_verified, flag_cloak_enabled, "
+    "flag_admin, flag_email_verified, flag_private, language, last_host, "
+    "last_realname, last_quit_msg, last_quit_time, reg_time) "
+    "SELECT primary_nick, password, salt, url, email, cloak, flag_enforce, "
+    "flag_secure, flag_verified, flag_cloak_enabled, flag_admin, "
+    "flag_email_verified, flag_private, language, last_host, last_realname, "
+    "last_quit_msg, last_quit_time, reg_time FROM account WHERE id=$1", 
+    EXECUTE },
+  { GET_NEW_LINK, "SELECT id FROM nickname WHERE account_id=$1 AND NOT id=$2", QUERY },
+  { SET_CHAN_LAST_USED, "UPDATE channel SET last_used=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_DESC, "UPDATE channel SET description=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_URL, "UPDATE channel SET url=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_EMAIL, "UPDATE channel SET email=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_ENTRYMSG, "UPDATE channel SET entrymsg=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_TOPIC, "UPDATE channel SET topic=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_MLOCK, "UPDATE channel SET mlock=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_PRIVATE, "UPDATE channel SET flag_private=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_RESTRICTED, "UPDATE channel SET flag_restricted=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_TOPICLOCK, "UPDATE channel SET flag_topic_lock=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_VERBOSE, "UPDATE channel SET flag_verbose=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_AUTOLIMIT, "UPDATE channel SET flag_autolimit=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_EXPIREBANS, "UPDATE channel SET flag_expirebans=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_FLOODSERV, "UPDATE channel SET flag_floodserv=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_AUTOOP, "UPDATE channel SET flag_autoop=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_AUTOVOICE, "UPDATE channel SET flag_autovoice=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_AUTOSAVE, "UPDATE channel SET flag_autosave=$1 WHERE id=$2", EXECUTE },
+  { SET_CHAN_LEAVEOPS, "UPDATE channel SET flag_leaveops=$1 WHERE id=$2", EXECUTE },
+  { INSERT_FORBID, "INSERT INTO forbidden_nickname (nick) VALUES ($1)", EXECUTE },
+  { GET_FORBID, "SELECT nick FROM forbidden_nickname WHERE lower(nick)=lower($1)",
+    QUERY },
+  { DELETE_FORBID, "DELETE FROM forbidden_nickname WHERE lower(nick)=lower($1)", 
+    EXECUTE },
+  { INSERT_CHAN_FORBID, "INSERT INTO forbidden_channel (channel) VALUES ($1)", EXECUTE },
+  { GET_CHAN_FORBID, "SELECT channel FROM forbidden_channel WHERE lower(channel)=lower($1)",
+      QUERY },
+  { DELETE_CHAN_FORBID, "DELETE FROM forbidden_channel WHERE lower(channel)=lower($1)",
+    EXECUTE },
+  { INSERT_AKICK_ACCOUNT, "INSERT INTO channel_akick (channel_id, target, setter, reason, "
+    "time, duration, chmode) VALUES ($1, $2, $3, $4, $5, $6, $7)", EXECUTE },
+  { INSERT_AKICK_MASK, "INSERT INTO channel_akick (channel_id, setter, reason, mask, "
+    "time, duration, chmode) VALUES ($1, $2, $3, $4, $5, $6, $7)", EXECUTE },
+  { GET_AKICKS, "SELECT channel_akick.id, channel_id, target, setter, mask, "
+    "reason, time, duration, chmode FROM "
+    "channel_akick WHERE channel_id=$1 AND chmode = $2 ORDER BY channel_akick.id", QUERY },
+  /*{ DELETE_AKICK_IDX, "DELETE FROM channel_akick WHERE id = "
+          "(SELECT id FROM channel_akick AS a WHERE $1 = "
+          "(SELECT COUNT(id)+1 FROM channel_akick AS b WHERE b.id < a.id AND "
+          "b.channel_id = $2) AND channel_id = $2)", EXECUTE },*/
+  { DELETE_AKICK_MASK, "DELETE FROM channel_akick WHERE channel_id=$1 AND mask=$2 "
+    " AND chmode = $3", EXECUTE },
+  { DELETE_AKICK_ACCOUNT, "DELETE FROM channel_akick WHERE channel_id=$1 AND target IN (SELECT account_id "
+    "FROM nickname WHERE lower(nick)=lower($2)) AND chmode = $3", EXECUTE },
+  { SET_NICK_MASTER, "UPDATE account SET primary_nick=$1 WHERE id=$2", EXECUTE },
+  { DELETE_AKILL, "DELETE FROM akill WHERE mask=$1", EXECUTE },
+  { GET_CHAN_MASTER_COUNT, "SELECT COUNT(id) FROM channel_access WHERE channel_id=$1 AND level=4",
+    QUERY },
+  { GET_NICK_LINKS, "SELECT nick FROM nickname WHERE account_id=$1 ORDER BY lower(nick)", QUERY },
+  { GET_NICK_LINKS_COUNT, "SELECT count(nick) FROM nickname WHERE account_id=$1", QUERY },
+  { GET_NICK_CHAN_INFO, "SELECT channel.id, channel, level FROM "
+    "channel, channel_access WHERE "
+      "channel.id=channel_access.channel_id AND channel_access.account_id=$1 "
+      "ORDER BY lower(channel.channel)", QUERY },
+  { GET_CHAN_MASTERS, "SELECT nick FROM account, nickname, channel_access WHERE channel_id=$1 "
+    "AND level=4 AND channel_access.account_id=account.id AND "
+      "account.primary_nick=nickname.id ORDER BY lower(nick)", QUERY },
+  { DELETE_ACCOUNT_CHACCESS, "DELETE FROM channel_access WHERE account_id=$1", EXECUTE },
+  { DELETE_ACCOUNT_GROUPACCESS, "DELETE FROM group_access WHERE account_id=$1", EXECUTE },
+  { DELETE_DUPLICATE_CHACCESS, "DELETE FROM channel_access WHERE "
+      "(account_id=$1 AND level <= (SELECT level FROM channel_access AS x WHERE"
+      " x.account_id=$2 AND x.channel_id = channel_access.channel_id)) OR "
+      "(account_id=$3 AND level  < (SELECT level FROM channel_access AS x WHERE"
+      " x.account_id=$4 AND x.channel_id = channel_access.channel_id))", 
+      EXECUTE },
+  { MERGE_CHACCESS, "UPDATE channel_access SET account_id=$1 WHERE account_id=$2", 
+    EXECUTE },
+  /*{ GET_EXPIRED_AKILL, "SELECT akill.id, nickname.nick, mask, reason, time, duration FROM "
+    "account JOIN nickname ON "
+    "account.primary_nick=nickname.id RIGHT OUTER JOIN akill ON "
+    "akill.setter=account.id WHERE "*/
+  { GET_EXPIRED_AKILL, "SELECT id, setter, mask, reason, time, duration FROM akill WHERE "
+    "duration <> 0 AND time + duration < $1", QUERY },
+  { INSERT_SENT_MAIL, "INSERT INTO sent_mail (account_id, email, sent) VALUES "
+      "($1, $2, $3)", EXECUTE },
+  { GET_SENT_MAIL, "SELECT id FROM sent_mail WHERE account_id=$1 OR email=$2",
+    QUERY },
+  { DELETE_EXPIRED_SENT_MAIL, "DELETE FROM sent_mail WHERE sent < $2 - $1", EXECUTE },
+  { GET_NICKS, "SELECT nick FROM account, nickname WHERE account.id=nickname.account_id AND "
+       "account.flag_private=0 ORDER BY lower(nick)", QUERY },
+  { GET_NICKS_OPER, "SELECT nick FROM nickname ORDER BY lower(nick)", QUERY },
+  { GET_FORBIDS, "SELECT nick FROM forbidden_nickname ORDER BY lower(nick)", QUERY },
+  { GET_CHANNELS, "SELECT channel FROM channel WHERE flag_private=0 ORDER BY lower(channel)", QUERY },
+  { GET_CHANNELS_OPER, "SELECT channel FROM channel ORDER BY lower(channel)", QUERY },
+  { GET_CHANNEL_FORBID_LIST, "SELECT channel FROM forbidden_channel ORDER BY lower(channel)", QUERY },
+  { SAVE_NICK, "UPDATE account SET url=$1, email=$2, cloak=$3, flag_enforce=$4, "
+    "flag_secure=$5, flag_verified=$6, flag_cloak_enabled=$7, "
+      "flag_admin=$8, flag_email_verified=$9, flag_private=$10, language=$11, "
+      "last_host=$12, last_realname=$13, last_quit_msg=$14, last_quit_time=$15 "
+      "WHERE id=$16", EXECUTE },
+  { INSERT_NICKCERT, "INSERT INTO account_fingerprint (account_id, fingerprint, "
+    "nickname_id) VALUES($1, upper($2), $3)", EXECUTE },
+  { GET_NICKCERTS, "SELECT id, fingerprint, nickname_id FROM account_fingerprint "
+    "WHERE account_id=$1 ORDER BY id", QUERY },
+  { DELETE_NICKCERT, "DELETE FROM account_fingerprint WHERE "
+    "account_id=$1 AND fingerprint=upper($2)", EXECUTE },
+  /*{ DELETE_NICKCERT_IDX, "DELETE FROM account_fingerprint WHERE id = "
+          "(SELECT id FROM account_fingerprint AS a WHERE $1 = "
+          "(SELECT COUNT(id)+1 FROM account_fingerprint AS b WHERE b.id < a.id AND "
+          "b.account_id = $2) AND account_id = $2)", EXECUTE },*/
+  { DELETE_ALL_NICKACCESS, "DELETE FROM account_fingerprint WHERE "
+    "account_id=$1", EXECUTE },
+  { INSERT_JUPE, "INSERT INTO jupes (setter, name, reason) VALUES($1, $2, $3)",
+    EXECUTE },
+  { GET_JUPES, "SELECT id, name, reason, setter FROM jupes ORDER BY id", QUERY },
+  { DELETE_JUPE_NAME, "DELETE FROM jupes WHERE lower(name) = lower($1)",
+    EXECUTE },
+  { FIND_JUPE, "SELECT id, name, reason, setter FROM jupes WHERE "
+    "lower(name) = lower($1)", QUERY },
+ { COUNT_CHANNEL_ACCESS_LIST, "SELECT COUNT(*) FROM channel_access "
+    "JOIN account ON channel_access.account_id=account.id "
+    "JOIN nickname ON account.primary_nick=nickname.id WHERE channel_id=$1",
+    QUERY },
+  { GET_NICKCERT, "SELECT fingerprint FROM account_fingerprint WHERE "
+    "fingerprint=upper($1) AND account_id=$2", QUERY },
+  { SET_EXPIREBANS_LIFETIME, "UPDATE channel SET expirebans_lifetime=$1 WHERE "
+    "id=$2", EXECUTE },
+  { GET_SERVICEMASK_MASKS, "SELECT mask FROM channel_akick WHERE channel_id = $1 "
+    " AND chmode = $2", QUERY },
+  { GET_FULL_GROUP, "SELECT id, name, description, email, url, flag_private, "
+    "reg_time FROM \"group\" WHERE name=$1", QUERY },
+  { DELETE_GROUP, "DELETE FROM \"group\" WHERE id=$1", EXECUTE },
+  { GET_GROUP_FROM_GROUPID, "SELECT name FROM \"group\" WHERE id=$1", QUERY },
+  { GET_GROUPID_FROM_GROUP, "SELECT id FROM \"group\" WHERE name=$1", QUERY },
+  { SET_GROUP_URL, "UPDATE \"group\" SET url=$1 WHERE id=$2", EXECUTE },
+  { SET_GROUP_DESC, "UPDATE \"group\" SET description=$1 WHERE id=$2", EXECUTE },
+  { SET_GROUP_EMAIL, "UPDATE \"group\" SET email=$1 WHERE id=$2", EXECUTE },
+  { SET_GROUP_PRIVATE, "UPDATE \"group\" SET flag_private=$1 WHERE id=$2",
+    EXECUTE },
+  { GET_GROUP_ACCESSES, "SELECT group_access.id, group_access.group_id, "
+      "group_access.account_id, group_access.level FROM "
+      "group_access JOIN account ON "
+      "group_access.account_id=account.id JOIN nickname ON "
+      "account.primary_nick=nickname.id WHERE group_id=$1 "
+      "ORDER BY level, lower(nickname.nick) DESC", QUERY },
+  { GET_GROUP_ACCESS, "SELECT id, group_id, account_id, level "
+    "FROM group_access WHERE group_id=$1 AND account_id=$2", QUERY },
+  { INSERT_GROUPACCESS, "INSERT INTO group_access "
+    "(account_id, group_id, level) VALUES ($1, $2, $3)", EXECUTE } ,
+  { DELETE_GROUPACCESS, "DELETE FROM group_access "
+    "WHERE group_id=$1 AND account_id=$2", EXECUTE },
+ { COUNT_GROUP_ACCESS_LIST, "SELECT COUNT(*) FROM group_access "
+    "JOIN account ON group_access.account_id=account.id "
+    "JOIN nickname ON account.primary_nick=nickname.id WHERE group_id=$1",
+    QUERY },
+  { GET_GROUP_MASTERS, "SELECT nick FROM account, nickname, group_access "
+      "WHERE group_id=$1 AND level=3 AND group_access.account_id=account.id "
+      "AND account.primary_nick=nickname.id ORDER BY lower(nick)", QUERY },
+  { GET_GROUP_MASTER_COUNT, "SELECT COUNT(id) FROM group_access "
+    "WHERE group_id=$1 AND level=3", QUERY },
+  { INSERT_CHANACCESS_GROUP, "INSERT INTO channel_access "
+    "(group_id, channel_id, level) VALUES ($1, $2, $3)", EXECUTE } ,
+  { GET_CHAN_ACCESS_GROUP, "SELECT id, channel_id, account_id, group_id, level "
+    "FROM channel_access WHERE channel_id=$1 AND group_id=$2", QUERY },
+  { GET_CHAN_ACCESSES_GROUP, "SELECT ca.id, ca.channel_id, ca.account_id, "
+      "ca.group_id, ca.level FROM channel_access AS ca "
+      "JOIN \"group\" ON ca.group_id=\"group\".id WHERE ca.channel_id=$1 " 
+      "ORDER BY level, lower(\"group\".name) DESC", QUERY },
+  { GET_GROUPS_OPER, "SELECT name FROM \"group\" ORDER BY lower(name) DESC", QUERY },
+  { GET_GROUPS, "SELECT name FROM \"group\" WHERE flag_private=0 ORDER BY lower(name) DESC",
+    QUERY },
+  { GET_GROUP_CHAN_INFO, "SELECT channel.id, channel, level FROM "
+    "channel_access CROSS JOIN channel WHERE "
+    "channel.id=channel_access.channel_id AND channel_access.group_id=$1 "
+    "ORDER BY lower(channel.channel)", QUERY },
+  { GET_AJOINS, "SELECT channel.channel FROM account_autojoin "
+    "JOIN channel ON channel.id=account_autojoin.channel_id WHERE account_autojoin.account_id=$1",
+    QUERY },
+  { INSERT_AJOIN, "INSERT INTO account_autojoin (account_id, channel_id) VALUES "
+    "($1, $2)", EXECUTE },
+  { DELETE_AJOIN, "DELETE FROM account_autojoin WHERE account_id=$1 AND channel_id=$2",
+    EXECUTE },
+  { GET_GROUPS_BY_ACCOUNT, "SELECT group_id, name, level FROM \"group\" JOIN "
+    "group_access ON group_access.group_id = \"group\".id WHERE account_id=$1" },
+  { GET_CHAN_GROUP_MASTERS, "SELECT name FROM \"group\", channel_access WHERE "
+    "channel_id=$1 AND level=4 AND channel_access.group_id=\"group\".id "
+    "ORDER BY lower(name)", QUERY },
+  { SET_SYNCHRONOUS_COMMIT, "PRAGMA synchronous=NORMAL", EXECUTE },
+  { UNSET_SYNCHRONOUS_COMMIT, "PRAGMA synchronous=OFF", EXECUTE },
+  { GET_ALL_NICKACCESS, "SELECT account_id, entry, NULL FROM account_access "
+    "ORDER BY id", QUERY },
+  { GET_ALL_NICKCERTS, "SELECT account_id, fingerprint, nickname_id FROM "
+    "account_fingerprint ORDER BY id", QUERY },
+  /* run once per row, the parameters are the arrays built by db_batch_flush */
+  { BATCH_NICK_LAST_SEEN, "UPDATE nickname SET last_seen=$2 WHERE id=$1",
+    EXECUTE },
+  { BATCH_ACCOUNT_LAST, "UPDATE account SET "
+    "last_host=COALESCE($2, last_host), "
+    "last_realname=COALESCE($3, last_realname), "
+    "last_quit_msg=COALESCE($4, last_quit_msg), "
+    "last_quit_time=COALESCE($5, last_quit_time) WHERE id=$1", EXECUTE },
+  { BATCH_CHAN_LAST_USED, "UPDATE channel SET last_used=$2 WHERE id=$1",
+    EXECUTE },
+  /* LIST: $1 is a LIKE pattern on the lowercased name, the names sort after
+   * $2, at most $3 of them */
+  { GET_NICKS_MATCH, "SELECT nick FROM account, nickname WHERE "
+    "account.id=nickname.account_id AND account.flag_private=0 AND "
+    "lower(nick) LIKE $1 ESCAPE '\\' AND lower(nick) > lower($2) "
+    "ORDER BY lower(nick) LIMIT $3", QUERY },
+  { GET_NICKS_OPER_MATCH, "SELECT nick FROM nickname WHERE "
+    "lower(nick) LIKE $1 ESCAPE '\\' AND lower(nick) > lower($2) "
+    "ORDER BY lower(nick) LIMIT $3", QUERY },
+  { GET_FORBIDS_MATCH, "SELECT nick FROM forbidden_nickname WHERE "
+    "lower(nick) LIKE $1 ESCAPE '\\' AND lower(nick) > lower($2) "
+    "ORDER BY lower(nick) LIMIT $3", QUERY },
+  { GET_CHANNELS_MATCH, "SELECT channel FROM channel WHERE flag_private=0 AND "
+    "lower(channel) LIKE $1 ESCAPE '\\' AND lower(channel) > lower($2) "
+    "ORDER BY lower(channel) LIMIT $3", QUERY },
+  { GET_CHANNELS_OPER_MATCH, "SELECT channel FROM channel WHERE "
+    "lower(channel) LIKE $1 ESCAPE '\\' AND lower(channel) > lower($2) "
+    "ORDER BY lower(channel) LIMIT $3", QUERY },
+  { GET_CHANNEL_FORBIDS_MATCH, "SELECT channel FROM forbidden_channel WHERE "
+    "lower(channel) LIKE $1 ESCAPE '\\' AND lower(channel) > lower($2) "
+    "ORDER BY lower(channel) LIMIT $3", QUERY },
+  { GET_GROUPS_MATCH, "SELECT name FROM \"group\" WHERE flag_private=0 AND "
+    "lower(name) LIKE $1 ESCAPE '\\' AND lower(name) > lower($2) "
+    "ORDER BY lower(name) LIMIT $3", QUERY },
+  { GET_GROUPS_OPER_MATCH, "SELECT name FROM \"group\" WHERE "
+    "lower(name) LIKE $1 ESCAPE '\\' AND lower(name) > lower($2) "
+    "ORDER BY lower(name) LIMIT $3", QUERY },
+  { INSERT_ACCOUNT_ID, "INSERT INTO account (id, primary_nick, password, salt, "
+    "email, reg_time) VALUES ($1, $2, $3, $4, $5, $6)", EXECUTE },
+  { INSERT_CHAN_ID, "INSERT INTO channel (id, channel, description, reg_time, "
+    "last_used) VALUES ($1, $2, $3, $4, $5)", EXECUTE },
+  { INSERT_GROUP_ID, "INSERT INTO \"group\" (id, name, description, reg_time) "
+    "VALUES ($1, $2, $3, $4)", EXECUTE },
+};
+
+INIT_MODULE(sqlite, "$Revision$")
+{
+  sqlite = MyMalloc(sizeof(database_t));
+
+  sqlite->connect = sq_connect;
+  sqlite->execute_scalar = sq_execute_scalar;
+  sqlite->execute = sq_execute;
+  sqlite->execute_nonquery = sq_execute_nonquery;
+  sqlite->free_result = sq_free_result;
+  sqlite->prepare = sq_prepare;
+  sqlite->begin_transaction = sq_begin_transaction;
+  sqlite->commit_transaction = sq_commit_transaction;
+  sqlite->rollback_transaction = sq_rollback_transaction;
+  sqlite->insert_id = sq_insertid;
+  sqlite->next_id = sq_nextid;
+  sqlite->is_connected = sq_is_connected;
+
+  return sqlite;
+}
+
+CLEANUP_MODULE
+{
+  int i;
+
+  for(i = 0; i < statement_count; i++)
+    sqlite3_finalize(statements[i]);
+  MyFree(statements);
+  statements = NULL;
+  statement_count = 0;
+
+  sqlite3_close(sqlite->connection);
+  MyFree(sqlite);
+}
+
+/* sq_exec()
+ *
+ * inputs       - sql to run, may be several statements
+ * output       - TRUE on success
+ * side effects - errors go to the db log
+ */
+static int
+sq_exec(const char *sql)
+{
+  char *errmsg = NULL;
+
+  if(sqlite3_exec(sqlite->connection, sql, NULL, NULL, &errmsg) != SQLITE_OK)
+  {
+    db_log("SQLite Error: %s (%s)", errmsg != NULL ? errmsg : "unknown", sql);
+    sqlite3_free(errmsg);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* sq_prepare()
+ *
+ * inputs       - query id, query text in the postgresql $n style
+ * output       - 1 on success, 0 otherwise
+ * side effects - the statement is compiled and kept for the life of the
+ *                connection
+ */
+static int
+sq_prepare(int id, const char *query)
+{
+  sqlite3_stmt *stmt;
+  char *sql = NULL, *p;
+
+  /* $n is a named parameter to sqlite, ?n is the nth one */
+  DupString(sql, query);
+  for(p = sql; *p != '\0'; p++)
+  {
+    if(*p == '$' && IsDigit(p[1]))
+      *p = '?';
+  }
+
+  if(sqlite3_prepare_v2(sqlite->connection, sql, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    db_log("SQLite prepare Error: %s (%s)",
+        sqlite3_errmsg(sqlite->connection), query);
+    MyFree(sql);
+    return 0;
+  }
+  MyFree(sql);
+
+  if(id >= statement_count)
+  {
+    int count = statement_count > 0 ? statement_count : QUERY_COUNT;
+
+    while(count <= id)
+      count *= 2;
+    statements = MyRealloc(statements, sizeof(sqlite3_stmt *) * count);
+    memset(statements + statement_count, 0,
+        sizeof(sqlite3_stmt *) * (count - statement_count));
+    statement_count = count;
+  }
+
+  sqlite3_finalize(statements[id]);
+  statements[id] = stmt;
+
+  db_log("SQLite prepared: %d (%s)", id, query);
+
+  return 1;
+}
+
+static int
+sq_prepare_all()
+{
+  int i;
+
+  for(i = 0; i < QUERY_COUNT; i++)
+  {
+    query_t *query = &queries[i];
+
+    if(query->name == NULL)
+      continue;
+    if(!sq_prepare(i, query->name))
+    {
+      ilog(L_CRIT, "Prepare: %d Failed (%s)", i,
+          sqlite3_errmsg(sqlite->connection));
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* sq_load_schema()
+ *
+ * inputs       - none
+ * output       - TRUE if the database has tables or was given them
+ * side effects - a database without any tables gets SQ_SCHEMA_FILE
+ */
+static int
+sq_load_schema()
+{
+  sqlite3_stmt *stmt;
+  struct stat st;
+  char *sql;
+  int fd, tables, ok;
+  ssize_t len;
+
+  if(sqlite3_prepare_v2(sqlite->connection,
+        "SELECT COUNT(*) FROM sqlite_master WHERE type='table'", -1, &stmt,
+        NULL) != SQLITE_OK)
+    return FALSE;
+
+  tables = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+  sqlite3_finalize(stmt);
+
+  if(tables > 0)
+    return TRUE;
+
+  if((fd = open(SQ_SCHEMA_FILE, O_RDONLY)) == -1 || fstat(fd, &st) == -1)
+  {
+    ilog(L_CRIT, "Unable to read sqlite schema %s: %s", SQ_SCHEMA_FILE,
+        strerror(errno));
+    if(fd != -1)
+      close(fd);
+    return FALSE;
+  }
+
+  sql = MyMalloc(st.st_size + 1);
+  len = read(fd, sql, st.st_size);
+  close(fd);
+
+  if(len != st.st_size)
+  {
+    ilog(L_CRIT, "Short read on sqlite schema %s", SQ_SCHEMA_FILE);
+    MyFree(sql);
+    return FALSE;
+  }
+
+  ilog(L_NOTICE, "Creating sqlite database from %s", SQ_SCHEMA_FILE);
+  ok = sq_exec("BEGIN") && sq_exec(sql) && sq_exec("COMMIT");
+  if(!ok)
+    sq_exec("ROLLBACK");
+  MyFree(sql);
+
+  return ok;
+}
+
+/* sq_schema_version()
+ *
+ * inputs       - none
+ * output       - the version in schema_version, 0 for a database from
+ *                before there was one
+ * side effects - none
+ */
+static int
+sq_schema_version()
+{
+  sqlite3_stmt *stmt;
+  int version = 0;
+
+  if(sqlite3_prepare_v2(sqlite->connection,
+        "SELECT version FROM schema_version", -1, &stmt, NULL) != SQLITE_OK)
+    return 0;
+
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+    version = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  return version;
+}
+
+/* sq_upgrade_schema()
+ *
+ * inputs       - none
+ * output       - TRUE if the schema is as new as the installed scripts
+ * side effects - each sqlite-upgrade-NNN.sql past the database's version
+ *                is run in a transaction of its own
+ */
+static int
+sq_upgrade_schema()
+{
+  int version = sq_schema_version();
+  char *sql;
+
+  while((sql = db_read_upgrade("sqlite", version + 1)) != NULL)
+  {
+    int ok;
+
+    ilog(L_NOTICE, "Upgrading sqlite schema to version %d", version + 1);
+    ok = sq_exec("BEGIN") && sq_exec(sql) && sq_exec("COMMIT");
+    MyFree(sql);
+
+    if(!ok || sq_schema_version() != version + 1)
+    {
+      sq_exec("ROLLBACK");
+      ilog(L_CRIT, "Upgrading sqlite schema to version %d failed",
+          version + 1);
+      return FALSE;
+    }
+    version++;
+  }
+
+  return TRUE;
+}
+
+/* sq_dbname()
+ *
+ * inputs       - connection string, buffer for the file name and its size
+ * output       - 1 on success, 0 if the name does not fit
+ * side effects - the dbname='...' value is copied out, relative names are
+ *                put under LOCALSTATEDIR
+ */
+static int
+sq_dbname(const char *connection_string, char *buf, size_t len)
+{
+  const char *p = strstr(connection_string, "dbname='");
+  size_t n = 0;
+
+  if(p != NULL)
+  {
+    p += strlen("dbname='");
+    n = strcspn(p, "'");
+  }
+
+  if(n == 0)
+  {
+    p = "services.db";
+    n = strlen(p);
+  }
+
+  /* a truncated name would open, or create, some other database */
+  if(p[0] == '/')
+  {
+    if(n >= len)
+      return 0;
+    memcpy(buf, p, n);
+    buf[n] = '\0';
+  }
+  else if(snprintf(buf, len, "%s/%.*s", LOCALSTATEDIR, (int)n, p) >= (int)len)
+    return 0;
+
+  return 1;
+}
+
+static int
+sq_connect(const char *connection_string)
+{
+  char path[PATH_MAX];
+
+  if(sqlite->connection != NULL)
+    return 1;
+
+  if(!sq_dbname(connection_string, path, sizeof(path)))
+  {
+    ilog(L_CRIT, "sqlite database name is longer than %d characters",
+        (int)sizeof(path) - 1);
+    return 0;
+  }
+
+  if(sqlite3_open(path, (sqlite3 **)&sqlite->connection) != SQLITE_OK)
+  {
+    ilog(L_CRIT, "Unable to open sqlite database %s: %s", path,
+        sqlite3_errmsg(sqlite->connection));
+    sqlite3_close(sqlite->connection);
+    sqlite->connection = NULL;
+    return 0;
+  }
+
+  sqlite3_busy_timeout(sqlite->connection, SQ_BUSY_TIMEOUT);
+
+  if(!sq_exec("PRAGMA journal_mode=WAL") ||
+     !sq_exec("PRAGMA foreign_keys=ON") ||
+     !sq_load_schema() || !sq_upgrade_schema() || !sq_prepare_all())
+  {
+    sqlite3_close(sqlite->connection);
+    sqlite->connection = NULL;
+    return 0;
+  }
+
+  ilog(L_NOTICE, "Using sqlite database %s", path);
+
+  /* turn safe commits off until burst is completed */
+  sqlite->execute_nonquery(UNSET_SYNCHRONOUS_COMMIT, "", NULL);
+
+  return 1;
+}
+
+static int
+sq_is_connected()
+{
+  return sqlite->connection != NULL;
+}
+
+/* sq_bind()
+ *
+ * inputs       - statement, parameter number, format character, value
+ * output       - TRUE on success
+ * side effects - the value is bound to the statement, NULL binds NULL
+ */
+static int
+sq_bind(sqlite3_stmt *stmt, int n, char fmt, void *src)
+{
+  if(src == NULL)
+    return sqlite3_bind_null(stmt, n) == SQLITE_OK;
+
+  switch(fmt)
+  {
+    case 'i':
+      return sqlite3_bind_int(stmt, n, *(int *)src) == SQLITE_OK;
+    case 'b':
+      return sqlite3_bind_int(stmt, n, ((char *)src)[0] ? 1 : 0) == SQLITE_OK;
+    case 's':
+      return sqlite3_bind_text(stmt, n, (char *)src, -1, SQLITE_STATIC) ==
+        SQLITE_OK;
+    default:
+      db_log("SQLite Unknown param type: %c", fmt);
+      break;
+  }
+
+  return FALSE;
+}
+
+static void
+sq_log_query(int id, const char *format, dlink_list *args)
+{
+  char log_params[IRC_BUFSIZE] = "";
+  char tmp[TEMP_BUFSIZE];
+  const char *value;
+  dlink_node *ptr;
+  size_t count = 0;
+
+  if(args != NULL)
+  {
+    DLINK_FOREACH(ptr, args->head)
+    {
+      if(ptr->data == NULL)
+        value = "NULL";
+      else if(format[count] == 'i')
+      {
+        snprintf(tmp, sizeof(tmp), "%d", *(int *)ptr->data);
+        value = tmp;
+      }
+      else if(format[count] == 'b')
+        value = ((char *)ptr->data)[0] ? "1" : "0";
+      else
+        value = ptr->data;
+
+      if(count > 0)
+        strlcat(log_params, ", ", sizeof(log_params));
+      strlcat(log_params, value, sizeof(log_params));
+      count++;
+    }
+  }
+
+  if(id < QUERY_COUNT)
+    db_log("Executing query %d (%s) Parameters: [%s]", id, queries[id].name,
+        count > 0 ? log_params : "None");
+  else
+    db_log("Execute dynamic query %d Parameters: [%s]", id,
+        count > 0 ? log_params : "None");
+}
+
+/* internal_execute()
+ *
+ * inputs       - query id, format, arguments, error
+ * output       - the statement with the arguments bound, ready to step
+ * side effects - none
+ */
+static sqlite3_stmt *
+internal_execute(int id, int *error, const char *format, dlink_list *args)
+{
+  sqlite3_stmt *stmt;
+  dlink_node *ptr;
+  int count = 0;
+
+  if(id < 0 || id >= statement_count || statements[id] == NULL)
+  {
+    db_log("SQLite execute Error: query %d is not prepared", id);
+    *error = 1;
+    return NULL;
+  }
+
+  stmt = statements[id];
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  if(args != NULL)
+  {
+    DLINK_FOREACH(ptr, args->head)
+    {
+      if(!sq_bind(stmt, count + 1, format[count], ptr->data))
+      {
+        db_log("SQLite bind Error: %s", sqlite3_errmsg(sqlite->connection));
+        *error = 1;
+        return NULL;
+      }
+      count++;
+    }
+  }
+
+  sq_log_query(id, format, args);
+
+  *error = 0;
+  return stmt;
+}
+
+static int
+sq_step(sqlite3_stmt *stmt, int *error)
+{
+  int ret = sqlite3_step(stmt);
+
+  if(ret != SQLITE_ROW && ret != SQLITE_DONE)
+  {
+    db_log("SQLite execute Error(%d): %s", ret,
+        sqlite3_errmsg(sqlite->connection));
+    sqlite3_reset(stmt);
+    *error = ret;
+  }
+
+  return ret;
+}
+
+static char *
+sq_execute_scalar(int id, int *error, const char *format, dlink_list *args)
+{
+  sqlite3_stmt *stmt;
+  char *value = NULL;
+
+  if((stmt = internal_execute(id, error, format, args)) == NULL)
+    return NULL;
+
+  if(sq_step(stmt, error) == SQLITE_ROW &&
+      sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+    DupString(value, (const char *)sqlite3_column_text(stmt, 0));
+
+  sqlite3_reset(stmt);
+  return value;
+}
+
+/* sq_parse_array()
+ *
+ * inputs       - a postgresql array literal as built by db_batch_flush,
+ *                array to fill, its size
+ * output       - number of elements
+ * side effects - the literal is unquoted in place, NULL elements are NULL
+ */
+static int
+sq_parse_array(char *literal, char **values, int max)
+{
+  char *in = literal, *out;
+  int count = 0;
+
+  if(*in++ != '{')
+    return 0;
+
+  while(*in != '}' && *in != '\0' && count < max)
+  {
+    if(*in == '"')
+    {
+      values[count++] = out = ++in;
+      while(*in != '"' && *in != '\0')
+      {
+        if(*in == '\\' && in[1] != '\0')
+          in++;
+        *out++ = *in++;
+      }
+      if(*in == '"')
+        in++;
+      *out = '\0';
+    }
+    else
+    {
+      values[count] = in;
+      in += strcspn(in, ",}");
+      if(in - values[count] == 4 && strncmp(values[count], "NULL", 4) == 0)
+        values[count] = NULL;
+      count++;
+    }
+
+    /* the separator, or the closing brace, ends the element */
+    if(*in == ',')
+      *in++ = '\0';
+    else if(*in == '}')
+    {
+      *in = '\0';
+      break;
+    }
+  }
+
+  return count;
+}
+
+/* sq_execute_batch()
+ *
+ * inputs       - query id, one array literal per column
+ * output       - rows updated, -1 on error
+ * side effects - the query is run once per array element, inside the
+ *                transaction db_batch_flush holds
+ */
+static int
+sq_execute_batch(int id, const char *format, dlink_list *args)
+{
+  char *copies[BATCH_MAX_COLUMNS + 1];
+  char **columns[BATCH_MAX_COLUMNS + 1];
+  sqlite3_stmt *stmt;
+  dlink_node *ptr;
+  const char *p;
+  int ncols = 0, rows = 0, changed = 0, error = 0;
+  int i, j, n, max;
+
+  DLINK_FOREACH(ptr, args->head)
+  {
+    if(ncols > BATCH_MAX_COLUMNS)
+      break;
+
+    /* there are never more elements than commas, plus one */
+    max = 1;
+    for(p = ptr->data; *p != '\0'; p++)
+    {
+      if(*p == ',')
+        max++;
+    }
+
+    DupString(copies[ncols], (char *)ptr->data);
+    columns[ncols] = MyMalloc(sizeof(char *) * max);
+    n = sq_parse_array(copies[ncols], columns[ncols], max);
+    if(ncols == 0 || n < rows)
+      rows = n;
+    ncols++;
+  }
+
+  if((stmt = internal_execute(id, &error, format, args)) != NULL)
+  {
+    for(i = 0; i < rows && !error; i++)
+    {
+      sqlite3_reset(stmt);
+      for(j = 0; j < ncols; j++)
+      {
+        if(columns[j][i] == NULL)
+          sqlite3_bind_null(stmt, j + 1);
+        else
+          sqlite3_bind_text(stmt, j + 1, columns[j][i], -1, SQLITE_STATIC);
+      }
+
+      if(sq_step(stmt, &error) == SQLITE_DONE)
+        changed += sqlite3_changes(sqlite->connection);
+    }
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+
+  for(j = 0; j < ncols; j++)
+  {
+    MyFree(copies[j]);
+    MyFree(columns[j]);
+  }
+
+  return error ? -1 : changed;
+}
+
+static int
+sq_execute_nonquery(int id, const char *format, dlink_list *args)
+{
+  sqlite3_stmt *stmt;
+  int error, ret;
+
+  switch(id)
+  {
+    case BATCH_NICK_LAST_SEEN:
+    case BATCH_ACCOUNT_LAST:
+    case BATCH_CHAN_LAST_USED:
+      return sq_execute_batch(id, format, args);
+  }
+
+  if((stmt = internal_execute(id, &error, format, args)) == NULL)
+    return -1;
+
+  while((ret = sq_step(stmt, &error)) == SQLITE_ROW)
+    ;
+
+  sqlite3_reset(stmt);
+
+  if(ret != SQLITE_DONE)
+    return -1;
+
+  return sqlite3_changes(sqlite->connection);
+}
+
+static result_set_t *
+sq_execute(int id, int *error, const char *format, dlink_list *args)
+{
+  sqlite3_stmt *stmt;
+  result_set_t *results;
+  int size = 0, num_cols, ret;
+  int j;
+
+  if((stmt = internal_execute(id, error, format, args)) == NULL)
+    return NULL;
+
+  results = MyMalloc(sizeof(result_set_t));
+  num_cols = sqlite3_column_count(stmt);
+
+  while((ret = sq_step(stmt, error)) == SQLITE_ROW)
+  {
+    row_t *row;
+
+    if(results->row_count == size)
+    {
+      size = size > 0 ? size * 2 : 8;
+      results->rows = MyRealloc(results->rows, sizeof(row_t) * size);
+    }
+
+    row = &results->rows[results->row_count++];
+    row->col_count = num_cols;
+    row->cols = num_cols > 0 ? MyMalloc(sizeof(char *) * num_cols) : NULL;
+
+    for(j = 0; j < num_cols; j++)
+    {
+      if(sqlite3_column_type(stmt, j) == SQLITE_NULL)
+        row->cols[j] = NULL;
+      else
+        DupString(row->cols[j], (const char *)sqlite3_column_text(stmt, j));
+    }
+  }
+
+  sqlite3_reset(stmt);
+
+  if(ret != SQLITE_DONE)
+  {
+    sq_free_result(results);
+    return NULL;
+  }
+
+  *error = 0;
+  return results;
+}
+
+static void
+sq_free_result(result_set_t *result)
+{
+  int i, j;
+
+  if(result == NULL)
+    return;
+
+  for(i = 0; i < result->row_count; i++)
+  {
+    row_t *row = &result->rows[i];
+
+    for(j = 0; j < row->col_count; j++)
+    {
+      MyFree(row->cols[j]);
+    }
+    MyFree(row->cols);
+  }
+  MyFree(result->rows);
+  MyFree(result);
+}
+
+static int
+sq_begin_transaction()
+{
+  return sq_exec("BEGIN");
+}
+
+static int
+sq_commit_transaction()
+{
+  return sq_exec("COMMIT");
+}
+
+static int
+sq_rollback_transaction()
+{
+  return sq_exec("ROLLBACK");
+}
+
+static int64_t
+sq_insertid(const char *table, const char *column)
+{
+  return sqlite3_last_insert_rowid(sqlite->connection);
+}
+
+/* sq_nextid()
+ *
+ * inputs       - table, id column
+ * output       - an id the next insert may use, -1 on error
+ * side effects - none, the insert that uses the id moves the sequence on
+ */
+static int64_t
+sq_nextid(const char *table, const char *column)
+{
+  sqlite3_stmt *stmt;
+  char *query;
+  int64_t id = -1;
+
+  /* never hand out an id a deleted row had, like a postgresql sequence */
+  query = sqlite3_mprintf("SELECT MAX(COALESCE((SELECT seq FROM sqlite_sequence "
+      "WHERE name=%Q), 0), COALESCE((SELECT MAX(\"%w\") FROM \"%w\"), 0)) + 1",
+      table, column, table);
+
+  if(sqlite3_prepare_v2(sqlite->connection, query, -1, &stmt, NULL) != SQLITE_OK)
+  {
+    db_log("SQLite next_id Error: %s", sqlite3_errmsg(sqlite->connection));
+    sqlite3_free(query);
+    return -1;
+  }
+
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+    id = sqlite3_column_int64(stmt, 0);
+  else
+    db_log("SQLite next_id Error: %s", sqlite3_errmsg(sqlite->connection));
+
+  sqlite3_finalize(stmt);
+  sqlite3_free(query);
+  return id;
+}
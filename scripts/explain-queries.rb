@@ -0,0 +1,202 @@
+#!/usr/bin/ruby
+# Query plan regression check for the database drivers.
+#
+# Builds a scratch database from the schema in sql/, seeds it with
+# synthetic data, and EXPLAINs every entry of the driver's queries[] table.
+# Fails when a query reads a large table from end to end, unless the query
+# is listed in WHOLE_TABLE below because it loads everything by design.
+#
+#   ruby explain-queries.rb pgsql [psql options]   (a database it may use,
+#                                                   e.g. -d services_test)
+#   ruby explain-queries.rb sqlite
+#
+# The pgsql check plans with plan_cache_mode = force_generic_plan, the plan
+# services gets once a prepared statement has been run a few times.  It
+# needs PostgreSQL 12 or later, everything is done in the explain_check
+# schema, which is dropped again at the end.
+
+require 'tmpdir'
+
+TOP = File.expand_path('..', File.dirname(__FILE__))
+SQL = File.join(TOP, 'sql')
+
+# rows seeded, a sequential scan over any of these fails the check
+ACCOUNTS = 20000
+CHANNELS = 10000
+GROUPS = 2000
+LARGE = %w(account nickname account_access account_fingerprint
+  account_autojoin channel channel_access channel_akick group_access akill
+  sent_mail)
+
+# queries that are meant to read the whole table
+WHOLE_TABLE = %w(
+  GET_AKILLS GET_NICKS GET_NICKS_OPER GET_CHANNELS GET_CHANNELS_OPER
+  GET_GROUPS GET_GROUPS_OPER GET_SERVICEMASK_MASKS GET_ALL_NICKACCESS
+  GET_ALL_NICKCERTS GET_FORBIDS GET_CHANNEL_FORBID_LIST GET_JUPES
+)
+
+driver = ARGV.shift
+abort "usage: #{$0} pgsql|sqlite [psql options]" unless
+  %w(pgsql sqlite).include?(driver)
+
+# the { ID, "..." "...", TYPE } entries of queries[]
+def load_queries(file)
+  source = File.read(file)
+  source = source.gsub(%r{/\*.*?\*/}m, '').gsub(%r{^\s*//.*$}, '')
+  table = source[/queries\[QUERY_COUNT\]\s*=\s*\{(.*?)\n\};/m, 1] or
+    abort "No queries[] in #{file}"
+
+  table.scan(/\{\s*([A-Z_0-9]+)\s*,\s*((?:"(?:[^"\\]|\\.)*"\s*)+),\s*(?:QUERY|EXECUTE)\s*\}/m).map do |id, strings|
+    sql = strings.scan(/"((?:[^"\\]|\\.)*)"/).map do |(s)|
+      s.gsub(/\\(.)/) { $1 == 'n' ? "\n" : $1 }
+    end.join
+    [id, sql]
+  end
+end
+
+def series(driver, count)
+  if driver == 'pgsql'
+    "generate_series(1, #{count}) AS s(value)"
+  else
+    "generate_series(1, #{count}) AS s"
+  end
+end
+
+def seed(driver)
+  a = ACCOUNTS
+  c = CHANNELS
+  g = GROUPS
+  s = lambda { |n| series(driver, n) }
+
+  <<-EOS
+BEGIN;
+INSERT INTO account (id, primary_nick, password, salt, email, reg_time)
+  SELECT value, value, 'x', 'x', 'user' || value || '@example.org', 0
+  FROM #{s[a]};
+INSERT INTO nickname (id, nick, account_id, reg_time, last_seen)
+  SELECT value, 'nick' || value, value, 0, 0 FROM #{s[a]};
+COMMIT;
+INSERT INTO account_access (account_id, entry)
+  SELECT value, '*@host' || value FROM #{s[a]};
+INSERT INTO account_fingerprint (account_id, fingerprint, nickname_id)
+  SELECT value, 'fp' || value, value FROM #{s[a]};
+INSERT INTO forbidden_nickname (nick) SELECT 'bad' || value FROM #{s[1000]};
+INSERT INTO channel (id, channel, description, reg_time, last_used)
+  SELECT value, '#chan' || value, 'x', 0, 0 FROM #{s[c]};
+INSERT INTO account_autojoin (account_id, channel_id)
+  SELECT value, value % #{c} + 1 FROM #{s[a]};
+INSERT INTO forbidden_channel (channel) SELECT '#bad' || value FROM #{s[1000]};
+INSERT INTO "group" (id, name, reg_time)
+  SELECT value, '@group' || value, 0 FROM #{s[g]};
+INSERT INTO group_access (group_id, account_id, level)
+  SELECT (value - 1) / 5 + 1, value * 7 % #{a} + 1, 1 FROM #{s[g * 5]};
+INSERT INTO channel_access (channel_id, account_id, group_id, level)
+  SELECT (value - 1) / 5 + 1, value * 7 % #{a} + 1, NULL, 1 FROM #{s[c * 5]};
+INSERT INTO channel_akick (channel_id, setter, mask, reason, time, duration)
+  SELECT (value - 1) / 2 + 1, 1, '*!*@host' || value, 'x', value, 0
+  FROM #{s[c * 2]};
+INSERT INTO akill (mask, reason, setter, time, duration)
+  SELECT '*@host' || value, 'x', 1, value, 3600 FROM #{s[a]};
+INSERT INTO sent_mail (account_id, email, sent)
+  SELECT value, 'user' || value || '@example.org', value FROM #{s[a]};
+INSERT INTO jupes (name, reason, setter)
+  SELECT 'jupe' || value || '.example.org', 'x', 1 FROM #{s[100]};
+ANALYZE;
+  EOS
+end
+
+def schema_files(driver)
+  if driver == 'pgsql'
+    %w(nickserv groupserv chanserv operserv).map do |name|
+      File.join(SQL, "#{name}-pgsql.sql")
+    end
+  else
+    [File.join(SQL, 'services-sqlite.sql')]
+  end
+end
+
+# indexes with a WHERE, walking one of them only reads the rows it covers
+def partial_indexes(driver)
+  schema_files(driver).map { |f| File.read(f) }.join.
+    scan(/^CREATE (?:UNIQUE )?INDEX (\w+) ON [^;\n]* WHERE /i).map { |(i)| i }
+end
+
+# every table the plan reads from end to end
+def scans(driver, plan, partial)
+  if driver == 'pgsql'
+    plan.scan(/Seq Scan on "?(\w+)"?/).map { |(t)| t }
+  else
+    plan.scan(/\bSCAN "?(\w+)"?(?: USING (?:COVERING )?INDEX (\w+))?/).
+      reject { |(t, index)| partial.include?(index) }.map { |(t)| t }
+  end
+end
+
+def run(command, input)
+  IO.popen(command, 'r+', :err => [:child, :out]) do |io|
+    io.write(input)
+    io.close_write
+    io.read
+  end
+end
+
+queries = load_queries(File.join(TOP, 'modules', "#{driver}.c"))
+partial = partial_indexes(driver)
+
+if driver == 'pgsql'
+  psql = ['psql', '-X', '-q', '-A', '-t', *ARGV]
+  prologue = "SET client_min_messages = warning;\n" +
+    "SET search_path = explain_check;\n"
+  setup = "DROP SCHEMA IF EXISTS explain_check CASCADE;\n" +
+    "CREATE SCHEMA explain_check;\n" + prologue +
+    schema_files(driver).map { |f| File.read(f) }.join + seed(driver)
+  output = run(psql + ['-v', 'ON_ERROR_STOP=1'], setup)
+  abort "Setting up the scratch schema failed:\n#{output}" unless $?.success?
+
+  explain = lambda do |id, sql|
+    params = sql.scan(/\$(\d+)/).map { |(n)| n.to_i }.max || 0
+    args = params > 0 ? '(' + (['NULL'] * params).join(', ') + ')' : ''
+    run(psql, prologue + "SET plan_cache_mode = force_generic_plan;\n" +
+      "PREPARE q AS #{sql};\nEXPLAIN EXECUTE q#{args};\n")
+  end
+  cleanup = lambda { run(psql, "DROP SCHEMA explain_check CASCADE;\n") }
+else
+  dbfile = File.join(Dir.tmpdir, "explain-check-#{$$}.db")
+  setup = schema_files(driver).map { |f| File.read(f) }.join + seed(driver)
+  output = run(['sqlite3', '-bail', dbfile], setup)
+  abort "Setting up the scratch database failed:\n#{output}" unless $?.success?
+
+  explain = lambda do |id, sql|
+    run(['sqlite3', dbfile], "EXPLAIN QUERY PLAN #{sql};\n")
+  end
+  cleanup = lambda { File.unlink(dbfile) }
+end
+
+failed = []
+errors = []
+
+queries.each do |id, sql|
+  plan = explain.call(id, sql)
+
+  if plan =~ /ERROR|Error|error:/
+    errors << id
+    puts "#{id}: could not be planned\n#{plan.gsub(/^/, '  ')}"
+    next
+  end
+
+  large = scans(driver, plan, partial) & LARGE
+  next if large.empty?
+
+  if WHOLE_TABLE.include?(id)
+    puts "#{id}: reads #{large.join(', ')} (expected)" if $VERBOSE
+    next
+  end
+
+  failed << id
+  puts "#{id}: scans #{large.join(', ')}\n  #{sql}\n#{plan.gsub(/^/, '  ')}"
+end
+
+cleanup.call
+
+puts "#{queries.length} queries, #{failed.length} scanning large tables, " +
+  "#{errors.length} not planned"
+exit(failed.empty? && errors.empty? ? 0 : 1)
@@ -0,0 +1,53 @@
+#!/usr/bin/ruby
+# Generates the schema for the sqlite database driver from the postgresql one.
+#
+#   ruby pgsql-to-sqlite.rb nickserv-pgsql.sql groupserv-pgsql.sql \
+#     chanserv-pgsql.sql operserv-pgsql.sql > services-sqlite.sql
+#
+# sqlite can not add a foreign key to an existing table, so the ALTER TABLEs
+# are folded into the CREATE TABLE they refer to.
+
+def convert(sql)
+  sql = sql.gsub(/\bSERIAL PRIMARY KEY\b/i, 'INTEGER PRIMARY KEY AUTOINCREMENT')
+  sql = sql.gsub(/^(DROP TABLE IF EXISTS \S+) CASCADE;/i, '\1;')
+  sql = sql.gsub(/DEFAULT 'False'/i, 'DEFAULT 0')
+  sql = sql.gsub(/DEFAULT 'True'/i, 'DEFAULT 1')
+  # a partial index is only used when the query has the same term, and the
+  # queries spell true as 1
+  sql = sql.gsub(/^(CREATE INDEX [^\n]* WHERE [^\n]*?)\s*=\s*true\b/i, '\\1=1')
+  # sqlite has no operator classes, and its LIKE does not use an index on
+  # an expression anyway
+  sql = sql.gsub(/^(?:--[^\n]*\n)*CREATE INDEX [^\n]*text_pattern_ops[^\n]*\n/i, '')
+
+  alters = {}
+  # the comment lines explaining an ALTER TABLE go with it
+  sql = sql.gsub(/^\n?(?:--[^\n]*\n)*ALTER TABLE (\S+) ADD (FOREIGN KEY [^;]*);[^\n]*\n/i) do
+    (alters[$1] ||= []) << $2
+    ''
+  end
+
+  alters.each do |table, keys|
+    create = /^(CREATE TABLE #{Regexp.escape(table)}\s*\(.*?)(\n\);)/m
+    abort "No CREATE TABLE for #{table}" unless sql =~ create
+    sql = sql.sub(create) do
+      body, close = $1, $2
+      # the comma goes before any comment on the last column
+      body = body.sub(/^([^\n]*?)(\s*--[^\n]*)?\z/) { "#{$1},#{$2}" }
+      body + "\n  " + keys.join(",\n  ") + close
+    end
+  end
+
+  sql
+end
+
+if ARGV.empty?
+  abort "usage: #{$0} <schema-pgsql.sql>..."
+end
+
+puts '-- Generated by scripts/pgsql-to-sqlite.rb from ' +
+     ARGV.map { |f| File.basename(f) }.join(', ') + ', do not edit.'
+puts
+ARGV.each do |file|
+  puts "-- #{File.basename(file)}"
+  puts convert(File.read(file))
+end
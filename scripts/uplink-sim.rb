@@ -0,0 +1,384 @@
+#!/usr/bin/ruby
+# Synthetic uplink for benchmarking services.
+#
+# Plays a hybrid/OFTC ircd: listens for the services link, sends a generated
+# burst (servers, users, channels, memberships, ban lists), then runs the
+# storms listed in the config and reports throughput, reply latency and the
+# peak RSS of the services process.  Services itself is configured as usual,
+# with its connect{} block pointing here and whichever database driver
+# (nulldb, pgsql) is under test.
+#
+#   ruby uplink-sim.rb uplink-sim.yaml
+
+require 'socket'
+require 'yaml'
+
+conffile = ARGV[0] || File.join(File.dirname(__FILE__), 'uplink-sim.yaml')
+$conf = YAML::load(File.open(conffile))
+
+def conf(key, default)
+  $conf.has_key?(key) ? $conf[key] : default
+end
+
+TS6 = conf('protocol', 'oftc') != 'hybrid'
+SID = conf('sid', '0SM')
+SERVER_NAME = conf('server_name', 'irc.sim')
+SERVICE_NICK = conf('service_nick', 'NickServ')
+
+srand(conf('seed', 1))
+
+def now
+  Process.clock_gettime(Process::CLOCK_MONOTONIC)
+end
+
+def percentile(samples, pct)
+  return nil if samples.empty?
+  sorted = samples.sort
+  sorted[((sorted.length - 1) * pct / 100.0).round]
+end
+
+def ms(value)
+  value.nil? ? '-' : format('%.2f', value * 1000)
+end
+
+# Identifiers: SIDs and UIDs the way hybrid generates them
+UID_CHARS = ('A'..'Z').to_a.concat(('0'..'9').to_a)
+
+def make_sid(i)
+  (i % 10).to_s + ('A'.ord + i / 10 % 26).chr + ('A'.ord + i / 260 % 26).chr
+end
+
+def make_uid(sid, i)
+  id = ''
+  6.times do
+    id = UID_CHARS[i % 36] + id
+    i /= 36
+  end
+  sid + id
+end
+
+# Zipf distributed channel picker, popular channels get most members
+class Zipf
+  def initialize(n, s)
+    total = 0.0
+    @cdf = (1..n).map { |k| total += 1.0 / (k ** s) }
+    @cdf.map! { |v| v / total }
+  end
+
+  def pick
+    r = rand
+    @cdf.bsearch_index { |v| v >= r } || @cdf.length - 1
+  end
+end
+
+User = Struct.new(:nick, :uid, :server, :channels)
+Channel = Struct.new(:name, :ts, :members, :bans)
+
+class Network
+  attr_reader :servers, :users, :channels
+
+  def initialize
+    @servers = (1..conf('servers', 4)).map do |i|
+      { :name => "leaf#{i}.sim", :sid => make_sid(i) }
+    end
+    @users = []
+    @channels = []
+    ts = Time.now.to_i - 86400
+
+    conf('users', 20000).times do |i|
+      server = @servers[i % @servers.length]
+      @users << User.new("sim#{i}", make_uid(server[:sid], i), server, [])
+    end
+
+    conf('channels', 2000).times do |i|
+      bans = (0...conf('bans_per_channel', 5)).map { |b| "*!*@ban#{b}.#{i}.sim" }
+      @channels << Channel.new("#sim#{i}", ts + i, [], bans)
+    end
+
+    zipf = Zipf.new(@channels.length, conf('zipf', 1.1))
+    per_user = conf('channels_per_user', 3)
+    @users.each do |user|
+      (rand(per_user * 2) + 1).times do
+        chan = @channels[zipf.pick]
+        next if user.channels.include?(chan)
+        user.channels << chan
+        chan.members << user
+      end
+    end
+  end
+
+  def target(user)
+    TS6 ? user.uid : user.nick
+  end
+end
+
+# One services link, with a reader thread timestamping what comes back
+class Link
+  attr_reader :lines_in
+
+  def initialize(sock)
+    @sock = sock
+    @out = []
+    @lock = Mutex.new
+    @wlock = Mutex.new
+    @fence = ConditionVariable.new
+    @pongs = 0
+    @eob = nil
+    @waiting = {}
+    @latencies = []
+    @lines_in = 0
+    @reader = Thread.new { read_loop }
+  end
+
+  def send(line)
+    @out << line << "\r\n"
+    flush if @out.length > 2048
+  end
+
+  def flush
+    return if @out.empty?
+    @wlock.synchronize { @sock.write(@out.join) }
+    @out.clear
+  end
+
+  def read_loop
+    while (line = @sock.gets)
+      parv = line.chomp.split(' ')
+      parv.shift if parv[0] && parv[0][0] == ':'
+      @lock.synchronize do
+        @lines_in += 1
+        case parv[0]
+        when 'PING'
+          @wlock.synchronize { @sock.write("PONG #{SERVER_NAME} :#{parv[1]}\r\n") }
+        when 'PONG'
+          @pongs += 1
+          @fence.broadcast
+        when 'EOB'
+          @eob = now
+          @fence.broadcast
+        when 'NOTICE', 'PRIVMSG'
+          if (sent = @waiting.delete(parv[1]))
+            @latencies << now - sent
+          end
+        end
+      end
+    end
+  rescue IOError
+    # the link was closed under us at the end of the run
+  end
+
+  # Services answers PINGs in order, so a PONG means everything sent before
+  # it has been processed
+  def fence
+    @lock.synchronize { @want = @pongs + 1 }
+    send(TS6 ? ":#{SID} PING :#{SERVER_NAME}" : "PING :#{SERVER_NAME}")
+    flush
+    @lock.synchronize do
+      @fence.wait(@lock) while @pongs < @want
+    end
+  end
+
+  def wait_eob
+    @lock.synchronize do
+      @fence.wait(@lock) while @eob.nil?
+      @eob
+    end
+  end
+
+  def expect_reply(target)
+    @lock.synchronize { @waiting[target] = now }
+  end
+
+  def take_latencies
+    @lock.synchronize do
+      samples = @latencies
+      @latencies = []
+      @waiting.clear
+      samples
+    end
+  end
+end
+
+def handshake(link)
+  # services speaks first: PASS, CAPAB, SERVER and its own clients
+  if TS6
+    link.send("PASS #{conf('password', 'password')} TS 6 :#{SID}")
+    link.send('CAPAB :KLN PARA EOB QS UNKLN GLN ENCAP TBURST CHW IE EX QUIET')
+  else
+    link.send("PASS #{conf('password', 'password')} TS 5")
+    link.send('CAPAB :KLN PARA EOB QS UNKLN GLN ENCAP TBURST CHW IE EX')
+  end
+  link.send("SERVER #{SERVER_NAME} 1 :Synthetic uplink")
+  link.send("SVINFO #{TS6 ? 6 : 5} 5 0 :#{Time.now.to_i}")
+  link.flush
+end
+
+def burst(link, net)
+  count = 0
+  net.servers.each do |s|
+    if TS6
+      link.send(":#{SID} SID #{s[:name]} 2 #{s[:sid]} :Synthetic leaf")
+    else
+      link.send(":#{SERVER_NAME} SERVER #{s[:name]} 2 :Synthetic leaf")
+    end
+    count += 1
+  end
+
+  ts = Time.now.to_i - 3600
+  net.users.each do |u|
+    if TS6
+      link.send(":#{u.server[:sid]} UID #{u.nick} 2 #{ts} +i #{u.nick} " +
+                "#{u.nick}.users.sim 127.0.0.1 #{u.uid} :Simulated user")
+    else
+      link.send("NICK #{u.nick} 2 #{ts} +i #{u.nick} #{u.nick}.users.sim " +
+                "#{u.server[:name]} :Simulated user")
+    end
+    count += 1
+  end
+
+  net.channels.each do |c|
+    next if c.members.empty?
+    c.members.each_slice(12).each_with_index do |slice, i|
+      names = slice.each_with_index.map do |u, j|
+        (i == 0 && j == 0 ? '@' : '') + net.target(u)
+      end
+      link.send(":#{TS6 ? SID : SERVER_NAME} SJOIN #{c.ts} #{c.name} +nt :#{names.join(' ')}")
+      count += 1
+    end
+    unless c.bans.empty?
+      if TS6
+        link.send(":#{SID} BMASK #{c.ts} #{c.name} b :#{c.bans.join(' ')}")
+      else
+        link.send(":#{SERVER_NAME} MODE #{c.name} +#{'b' * c.bans.length} #{c.bans.join(' ')}")
+      end
+      count += 1
+    end
+  end
+
+  link.send(TS6 ? ":#{SID} EOB" : "EOB")
+  link.flush
+  count + 1
+end
+
+def pace(link, sent, started, rate)
+  return if rate.nil? || rate <= 0
+  ahead = sent.to_f / rate - (now - started)
+  if ahead > 0
+    link.flush
+    sleep(ahead)
+  end
+end
+
+def run_phase(link, net, phase)
+  type = phase['type']
+  count = phase['count'] || 1000
+  rate = phase['rate']
+  started = now
+  sent = 0
+
+  count.times do |i|
+    user = net.users[i % net.users.length]
+    src = ":#{net.target(user)}"
+
+    case type
+    when 'join'
+      chan = net.channels[rand(net.channels.length)]
+      next if user.channels.include?(chan)
+      user.channels << chan
+      chan.members << user
+      if TS6
+        link.send("#{src} JOIN #{chan.ts} #{chan.name} +")
+      else
+        link.send(":#{SERVER_NAME} SJOIN #{chan.ts} #{chan.name} + :#{user.nick}")
+      end
+    when 'part'
+      chan = user.channels.pop
+      next if chan.nil?
+      chan.members.delete(user)
+      link.send("#{src} PART #{chan.name}")
+    when 'privmsg'
+      link.expect_reply(net.target(user))
+      link.send("#{src} PRIVMSG #{phase['target'] || SERVICE_NICK} :#{phase['text'] || 'HELP'}")
+    when 'register'
+      link.expect_reply(net.target(user))
+      link.send("#{src} PRIVMSG #{SERVICE_NICK} :REGISTER simpass#{i} #{user.nick}@users.sim")
+    when 'identify'
+      link.expect_reply(net.target(user))
+      link.send("#{src} PRIVMSG #{SERVICE_NICK} :IDENTIFY simpass#{i}")
+    when 'drop'
+      # an identified user asking for a DROP code, or sending a wrong one
+      link.expect_reply(net.target(user))
+      auth = phase['auth'] ? " #{Time.now.to_i}:#{'0' * 40}" : ''
+      link.send("#{src} PRIVMSG #{SERVICE_NICK} :DROP#{auth}")
+    when 'sendpass'
+      # mails a signed code, once per account, or checks a wrong one
+      link.expect_reply(net.target(user))
+      auth = phase['auth'] ? " #{Time.now.to_i}:#{'0' * 40} simpass#{i}" : ''
+      link.send("#{src} PRIVMSG #{SERVICE_NICK} :SENDPASS #{user.nick}#{auth}")
+    else
+      abort "Unknown phase type #{type}"
+    end
+
+    sent += 1
+    pace(link, sent, started, rate)
+  end
+
+  link.fence
+  elapsed = now - started
+  { :name => type, :lines => sent, :elapsed => elapsed,
+    :latencies => link.take_latencies }
+end
+
+def peak_rss
+  pidfile = conf('pidfile', nil)
+  return nil if pidfile.nil? || !File.exist?(pidfile)
+  pid = File.read(pidfile).to_i
+  status = File.read("/proc/#{pid}/status") rescue nil
+  return nil if status.nil?
+  status[/^VmHWM:\s+(\d+) kB/, 1].to_i
+end
+
+net = Network.new
+memberships = net.channels.inject(0) { |sum, c| sum + c.members.length }
+puts "Generated #{net.servers.length} servers, #{net.users.length} users, " +
+     "#{net.channels.length} channels, #{memberships} memberships"
+
+server = TCPServer.new(conf('listen_host', '127.0.0.1'), conf('listen_port', 6668))
+puts "Waiting for services on #{conf('listen_host', '127.0.0.1')}:#{conf('listen_port', 6668)}"
+sock = server.accept
+sock.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+link = Link.new(sock)
+
+handshake(link)
+started = now
+lines = burst(link, net)
+if TS6
+  eob = link.wait_eob
+  burst_elapsed = eob - started
+else
+  link.fence
+  burst_elapsed = now - started
+end
+
+results = [{ :name => 'burst', :lines => lines, :elapsed => burst_elapsed,
+             :latencies => [] }]
+(conf('phases', []) || []).each do |phase|
+  results << run_phase(link, net, phase)
+end
+
+puts
+puts format('%-10s %9s %9s %11s %8s %9s %9s', 'phase', 'lines', 'seconds',
+            'lines/s', 'replies', 'p50 ms', 'p99 ms')
+results.each do |r|
+  l = r[:latencies]
+  puts format('%-10s %9d %9.3f %11.0f %8d %9s %9s', r[:name], r[:lines],
+              r[:elapsed], r[:lines] / [r[:elapsed], 1e-9].max, l.length,
+              ms(percentile(l, 50)), ms(percentile(l, 99)))
+end
+
+rss = peak_rss
+puts
+puts rss.nil? ? 'Peak RSS: unknown (set pidfile)' : "Peak RSS: #{rss} kB"
+puts "Lines received from services: #{link.lines_in}"
+
+sock.close
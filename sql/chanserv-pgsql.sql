@@ -24,6 +24,8 @@ CREATE TABLE channel(
   last_used             INTEGER NOT NULL
 );
 CREATE UNIQUE INDEX channel_channel_idx ON channel ((lower(channel)));
+-- LIST pattern matches, LIKE only uses the index above in the C locale
+CREATE INDEX channel_channel_pattern_idx ON channel ((lower(channel)) text_pattern_ops);
 
 DROP TABLE IF EXISTS channel_access;
 CREATE TABLE channel_access(
@@ -35,6 +37,8 @@ CREATE TABLE channel_access(
   UNIQUE (channel_id, account_id)
 );
 CREATE INDEX channel_access_account_id_idx ON channel_access (account_id);
+-- GET_GROUP_CHAN_INFO, most entries are for an account
+CREATE INDEX channel_access_group_id_idx ON channel_access (group_id) WHERE group_id IS NOT NULL;
 
 DROP TABLE IF EXISTS channel_akick;
 CREATE TABLE channel_akick(
@@ -59,3 +63,6 @@ CREATE TABLE forbidden_channel (
 CREATE UNIQUE INDEX forbidden_channel_channel_idx ON forbidden_channel ((lower(channel)));
 CREATE UNIQUE INDEX channel_akick_mode_mask_idx ON channel_akick(channel_id, chmode, mask);
 CREATE UNIQUE INDEX channel_akick_mode_target_idx ON channel_akick(channel_id, chmode, target);
+-- for the ON DELETE actions when an account is dropped
+CREATE INDEX channel_akick_target_idx ON channel_akick(target);
+CREATE INDEX channel_akick_setter_idx ON channel_akick(setter);
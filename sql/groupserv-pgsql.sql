@@ -8,6 +8,8 @@ CREATE TABLE "group" (
   flag_private        BOOLEAN NOT NULL DEFAULT 'False',
   reg_time            INTEGER NOT NULL 
 );
+CREATE INDEX group_name_idx ON "group" ((lower(name)));
+CREATE INDEX group_name_pattern_idx ON "group" ((lower(name)) text_pattern_ops);
 
 DROP TABLE IF EXISTS group_access;
 CREATE TABLE group_access(
@@ -1,3 +1,11 @@
+-- The newest pgsql-upgrade-NNN.sql this schema already includes.  services
+-- runs the upgrade scripts past it when it connects.
+DROP TABLE IF EXISTS schema_version;
+CREATE TABLE schema_version (
+  version             INTEGER NOT NULL
+);
+INSERT INTO schema_version (version) VALUES (1);
+
 DROP TABLE IF EXISTS account CASCADE;
 CREATE TABLE account (
   id                  SERIAL PRIMARY KEY,
@@ -22,6 +30,8 @@ CREATE TABLE account (
   reg_time            INTEGER NOT NULL -- The account itself
 );
 CREATE UNIQUE INDEX account_primary_nick_idx ON account (primary_nick);
+-- GET_ADMINS, there are few admins
+CREATE INDEX account_flag_admin_idx ON account (primary_nick) WHERE flag_admin = true;
 
 DROP TABLE IF EXISTS nickname CASCADE;
 CREATE TABLE nickname (
@@ -32,6 +42,8 @@ CREATE TABLE nickname (
   last_seen           INTEGER
 );
 CREATE UNIQUE INDEX nickname_nick_idx ON nickname ((lower(nick)));
+-- LIST pattern matches, LIKE only uses the index above in the C locale
+CREATE INDEX nickname_nick_pattern_idx ON nickname ((lower(nick)) text_pattern_ops);
 -- this speeds up GET_NICK_LINKS("SELECT nick FROM nickname WHERE account_id=?d") for instance.
 -- it's otherwise not often needed
 CREATE INDEX nickname_account_id_idx ON nickname (account_id);
@@ -66,6 +78,8 @@ CREATE TABLE account_fingerprint (
 );
 CREATE INDEX account_fingerprint_account_id_idx ON account_fingerprint (account_id);
 CREATE UNIQUE INDEX account_fingerprint_fingerprint_idx ON account_fingerprint (fingerprint);
+-- for the ON DELETE SET NULL when a nickname is dropped
+CREATE INDEX account_fingerprint_nickname_id_idx ON account_fingerprint (nickname_id);
 
 DROP TABLE IF EXISTS account_autojoin;
 CREATE TABLE account_autojoin (
@@ -75,3 +89,5 @@ CREATE TABLE account_autojoin (
 );
 CREATE INDEX account_autojoin_idx ON account_autojoin(id);
 CREATE UNIQUE INDEX account_autojoin_account_channel_idx ON account_autojoin(account_id, channel_id);
+-- for the ON DELETE CASCADE when a channel is dropped
+CREATE INDEX account_autojoin_channel_id_idx ON account_autojoin(channel_id);
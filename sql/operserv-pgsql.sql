@@ -8,6 +8,9 @@ CREATE TABLE akill (
   duration        INTEGER NOT NULL,
   UNIQUE (mask)
 );
+-- GET_EXPIRED_AKILL
+CREATE INDEX akill_expiry_idx ON akill ((time + duration)) WHERE duration <> 0;
+CREATE INDEX akill_setter_idx ON akill (setter);
 
 DROP TABLE IF EXISTS sent_mail;
 CREATE TABLE sent_mail (
@@ -16,6 +19,10 @@ CREATE TABLE sent_mail (
   email           VARCHAR(255) NOT NULL,
   sent            INTEGER NOT NULL
 );
+-- GET_SENT_MAIL and DELETE_EXPIRED_SENT_MAIL
+CREATE INDEX sent_mail_account_id_idx ON sent_mail (account_id);
+CREATE INDEX sent_mail_email_idx ON sent_mail (email);
+CREATE INDEX sent_mail_sent_idx ON sent_mail (sent);
 
 DROP TABLE IF EXISTS jupes CASCADE;
 CREATE TABLE jupes (
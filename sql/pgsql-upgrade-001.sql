@@ -0,0 +1,35 @@
+-- Schema version 1: the schema_version table itself, and indexes for the
+-- queries that used to read their whole table.
+--
+-- services runs pgsql-upgrade-NNN.sql past the version in schema_version
+-- when it connects, each in a transaction of its own.  To run one by hand:
+--   psql -1 -f pgsql-upgrade-001.sql
+CREATE TABLE IF NOT EXISTS schema_version (
+  version             INTEGER NOT NULL
+);
+INSERT INTO schema_version (version)
+  SELECT 0 WHERE NOT EXISTS (SELECT 1 FROM schema_version);
+
+-- GET_ADMINS, there are few admins
+CREATE INDEX IF NOT EXISTS account_flag_admin_idx ON account (primary_nick) WHERE flag_admin = true;
+CREATE INDEX IF NOT EXISTS account_fingerprint_nickname_id_idx ON account_fingerprint (nickname_id);
+CREATE INDEX IF NOT EXISTS account_autojoin_channel_id_idx ON account_autojoin(channel_id);
+-- GET_GROUP_CHAN_INFO, most entries are for an account
+CREATE INDEX IF NOT EXISTS channel_access_group_id_idx ON channel_access (group_id) WHERE group_id IS NOT NULL;
+CREATE INDEX IF NOT EXISTS channel_akick_target_idx ON channel_akick(target);
+CREATE INDEX IF NOT EXISTS channel_akick_setter_idx ON channel_akick(setter);
+-- GET_EXPIRED_AKILL
+CREATE INDEX IF NOT EXISTS akill_expiry_idx ON akill ((time + duration)) WHERE duration <> 0;
+CREATE INDEX IF NOT EXISTS akill_setter_idx ON akill (setter);
+-- GET_SENT_MAIL and DELETE_EXPIRED_SENT_MAIL
+CREATE INDEX IF NOT EXISTS sent_mail_account_id_idx ON sent_mail (account_id);
+CREATE INDEX IF NOT EXISTS sent_mail_email_idx ON sent_mail (email);
+CREATE INDEX IF NOT EXISTS sent_mail_sent_idx ON sent_mail (sent);
+-- the LIST commands
+CREATE INDEX IF NOT EXISTS group_name_idx ON "group" ((lower(name)));
+-- LIST pattern matches, LIKE only uses a plain index in the C locale
+CREATE INDEX IF NOT EXISTS nickname_nick_pattern_idx ON nickname ((lower(nick)) text_pattern_ops);
+CREATE INDEX IF NOT EXISTS channel_channel_pattern_idx ON channel ((lower(channel)) text_pattern_ops);
+CREATE INDEX IF NOT EXISTS group_name_pattern_idx ON "group" ((lower(name)) text_pattern_ops);
+
+UPDATE schema_version SET version = 1;
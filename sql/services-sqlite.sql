@@ -0,0 +1,215 @@
+-- Generated by scripts/pgsql-to-sqlite.rb from nickserv-pgsql.sql, groupserv-pgsql.sql, chanserv-pgsql.sql, operserv-pgsql.sql, do not edit.
+
+-- nickserv-pgsql.sql
+-- The newest pgsql-upgrade-NNN.sql this schema already includes.  services
+-- runs the upgrade scripts past it when it connects.
+DROP TABLE IF EXISTS schema_version;
+CREATE TABLE schema_version (
+  version             INTEGER NOT NULL
+);
+INSERT INTO schema_version (version) VALUES (1);
+
+DROP TABLE IF EXISTS account;
+CREATE TABLE account (
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  primary_nick        INTEGER NOT NULL,
+  password            CHAR(40) NOT NULL,      -- base16 encoded sha1(salt+<userpassword>).  lower case
+  salt                CHAR(16) NOT NULL,
+  url                 VARCHAR(255),
+  email               VARCHAR(255) NOT NULL,
+  cloak               VARCHAR(255),
+  flag_enforce        BOOLEAN NOT NULL DEFAULT 0,
+  flag_secure         BOOLEAN NOT NULL DEFAULT 0,
+  flag_verified       BOOLEAN NOT NULL DEFAULT 0,
+  flag_cloak_enabled  BOOLEAN NOT NULL DEFAULT 0,
+  flag_admin          BOOLEAN NOT NULL DEFAULT 0,
+  flag_email_verified BOOLEAN NOT NULL DEFAULT 0,
+  flag_private        BOOLEAN NOT NULL DEFAULT 0,
+  language            INTEGER NOT NULL default '0',
+  last_host           VARCHAR(255),
+  last_realname       VARCHAR(255),
+  last_quit_msg       VARCHAR(512),
+  last_quit_time      INTEGER,
+  reg_time            INTEGER NOT NULL, -- The account itself
+  FOREIGN KEY (primary_nick) REFERENCES nickname(id) DEFERRABLE INITIALLY DEFERRED
+);
+CREATE UNIQUE INDEX account_primary_nick_idx ON account (primary_nick);
+-- GET_ADMINS, there are few admins
+CREATE INDEX account_flag_admin_idx ON account (primary_nick) WHERE flag_admin=1;
+
+DROP TABLE IF EXISTS nickname;
+CREATE TABLE nickname (
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  nick                VARCHAR(255) NOT NULL,
+  account_id          INTEGER REFERENCES account(id) ON DELETE CASCADE NOT NULL,
+  reg_time            INTEGER NOT NULL, -- This nickname
+  last_seen           INTEGER
+);
+CREATE UNIQUE INDEX nickname_nick_idx ON nickname ((lower(nick)));
+-- this speeds up GET_NICK_LINKS("SELECT nick FROM nickname WHERE account_id=?d") for instance.
+-- it's otherwise not often needed
+CREATE INDEX nickname_account_id_idx ON nickname (account_id);
+
+DROP TABLE IF EXISTS forbidden_nickname;
+CREATE TABLE forbidden_nickname (
+  nick                VARCHAR(255) PRIMARY KEY
+);
+-- this is not so much for performance as for unique constraint reasons:
+CREATE UNIQUE INDEX forbidden_nickname_nick_idx ON forbidden_nickname ((lower(nick)));
+
+DROP TABLE IF EXISTS account_access;
+CREATE TABLE account_access (
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  account_id          INTEGER REFERENCES account(id) ON DELETE CASCADE NOT NULL,
+  entry               VARCHAR(255) NOT NULL,
+  UNIQUE (id, entry)
+);
+CREATE INDEX account_access_account_id_idx ON account_access (account_id);
+
+DROP TABLE IF EXISTS account_fingerprint;
+CREATE TABLE account_fingerprint (
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  account_id          INTEGER REFERENCES account(id) ON DELETE CASCADE NOT NULL,
+  fingerprint         VARCHAR(40) NOT NULL,
+  nickname_id         INTEGER REFERENCES nickname(id) ON DELETE SET NULL,
+  UNIQUE(account_id, fingerprint)
+);
+CREATE INDEX account_fingerprint_account_id_idx ON account_fingerprint (account_id);
+CREATE UNIQUE INDEX account_fingerprint_fingerprint_idx ON account_fingerprint (fingerprint);
+-- for the ON DELETE SET NULL when a nickname is dropped
+CREATE INDEX account_fingerprint_nickname_id_idx ON account_fingerprint (nickname_id);
+
+DROP TABLE IF EXISTS account_autojoin;
+CREATE TABLE account_autojoin (
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  account_id          INTEGER REFERENCES account(id) ON DELETE CASCADE NOT NULL,
+  channel_id          INTEGER REFERENCES channel(id) ON DELETE CASCADE NOT NULL
+);
+CREATE INDEX account_autojoin_idx ON account_autojoin(id);
+CREATE UNIQUE INDEX account_autojoin_account_channel_idx ON account_autojoin(account_id, channel_id);
+-- for the ON DELETE CASCADE when a channel is dropped
+CREATE INDEX account_autojoin_channel_id_idx ON account_autojoin(channel_id);
+-- groupserv-pgsql.sql
+DROP TABLE IF EXISTS "group";
+CREATE TABLE "group" (
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  name                VARCHAR(32) NOT NULL,
+  description         VARCHAR(255),
+  url                 VARCHAR(255),
+  email               VARCHAR(255),
+  flag_private        BOOLEAN NOT NULL DEFAULT 0,
+  reg_time            INTEGER NOT NULL 
+);
+CREATE INDEX group_name_idx ON "group" ((lower(name)));
+
+DROP TABLE IF EXISTS group_access;
+CREATE TABLE group_access(
+  id                   INTEGER PRIMARY KEY AUTOINCREMENT,
+  group_id             INTEGER NOT NULL REFERENCES "group"(id) ON DELETE CASCADE,
+  account_id           INTEGER NOT NULL REFERENCES account(id),
+  level                INTEGER NOT NULL,
+  UNIQUE (group_id, account_id)
+);
+CREATE INDEX group_access_account_id_idx ON group_access (account_id);
+-- chanserv-pgsql.sql
+DROP TABLE IF EXISTS channel;
+CREATE TABLE channel(
+  id                    INTEGER PRIMARY KEY AUTOINCREMENT,
+  channel               VARCHAR(255) NOT NULL,
+  flag_private          BOOLEAN NOT NULL DEFAULT 0, -- do not show up in list of channels
+  flag_restricted       BOOLEAN NOT NULL DEFAULT 0, -- only people on the access list can hold channel operator status
+  flag_topic_lock       BOOLEAN NOT NULL DEFAULT 0, -- topics can only be changed via chanserv
+  flag_verbose          BOOLEAN NOT NULL DEFAULT 0, -- notice all chanserv actions to the channel
+  flag_autolimit        BOOLEAN NOT NULL DEFAULT 0, -- sets limit just above the current user count
+  flag_expirebans       BOOLEAN NOT NULL DEFAULT 0, -- Expire old bans
+  flag_floodserv        BOOLEAN NOT NULL DEFAULT 0, -- floodserv should monitor channel
+  flag_autoop           BOOLEAN NOT NULL DEFAULT 0, -- CHANOP or above get op on join
+  flag_autovoice        BOOLEAN NOT NULL DEFAULT 0, -- MEMBER or above get voice on join
+  flag_leaveops         BOOLEAN NOT NULL DEFAULT 0, -- Don't deop people who get chanop but shouldnt
+  flag_autosave         BOOLEAN NOT NULL DEFAULT 0, -- Manually issued CMODEs are persisted in the DB
+  description           VARCHAR(512) NOT NULL,
+  url                   VARCHAR(255),
+  email                 VARCHAR(255),
+  entrymsg              VARCHAR(512),
+  topic                 VARCHAR(512),
+  mlock                 VARCHAR(255),
+  expirebans_lifetime   INTEGER NOT NULL DEFAULT 300,
+  reg_time              INTEGER NOT NULL,
+  last_used             INTEGER NOT NULL
+);
+CREATE UNIQUE INDEX channel_channel_idx ON channel ((lower(channel)));
+
+DROP TABLE IF EXISTS channel_access;
+CREATE TABLE channel_access(
+  id                   INTEGER PRIMARY KEY AUTOINCREMENT,
+  channel_id           INTEGER NOT NULL REFERENCES channel(id) ON DELETE CASCADE,
+  account_id           INTEGER REFERENCES account(id),
+  group_id             INTEGER REFERENCES "group"(id),
+  level                INTEGER NOT NULL,
+  UNIQUE (channel_id, account_id)
+);
+CREATE INDEX channel_access_account_id_idx ON channel_access (account_id);
+-- GET_GROUP_CHAN_INFO, most entries are for an account
+CREATE INDEX channel_access_group_id_idx ON channel_access (group_id) WHERE group_id IS NOT NULL;
+
+DROP TABLE IF EXISTS channel_akick;
+CREATE TABLE channel_akick(
+  id                  INTEGER PRIMARY KEY AUTOINCREMENT,
+  channel_id          INTEGER NOT NULL REFERENCES channel(id) ON DELETE CASCADE,
+  setter              INTEGER REFERENCES account(id) ON DELETE SET NULL,
+  target              INTEGER REFERENCES account(id) ON DELETE CASCADE, -- If a nickname akick
+  mask                VARCHAR(255), -- If a mask akick
+  reason              VARCHAR(512) NOT NULL,
+  time                INTEGER NOT NULL,
+  duration            INTEGER NOT NULL,
+  chmode              INTEGER NOT NULL DEFAULT 0
+	CHECK (((target IS NULL) OR (mask IS NULL)) AND NOT ((target IS NULL) AND 
+	(mask IS NULL)))
+);
+
+DROP TABLE IF EXISTS forbidden_channel;
+CREATE TABLE forbidden_channel (
+  channel             VARCHAR(255) PRIMARY KEY
+);
+-- this is not so much for performance as for unique constraint reasons:
+CREATE UNIQUE INDEX forbidden_channel_channel_idx ON forbidden_channel ((lower(channel)));
+CREATE UNIQUE INDEX channel_akick_mode_mask_idx ON channel_akick(channel_id, chmode, mask);
+CREATE UNIQUE INDEX channel_akick_mode_target_idx ON channel_akick(channel_id, chmode, target);
+-- for the ON DELETE actions when an account is dropped
+CREATE INDEX channel_akick_target_idx ON channel_akick(target);
+CREATE INDEX channel_akick_setter_idx ON channel_akick(setter);
+-- operserv-pgsql.sql
+DROP TABLE IF EXISTS akill;
+CREATE TABLE akill (
+  id              INTEGER PRIMARY KEY AUTOINCREMENT,
+  mask            VARCHAR(255) NOT NULL,
+  reason          VARCHAR(255) NOT NULL,
+  setter          INTEGER REFERENCES account(id) ON DELETE SET NULL,
+  time            INTEGER NOT NULL,
+  duration        INTEGER NOT NULL,
+  UNIQUE (mask)
+);
+-- GET_EXPIRED_AKILL
+CREATE INDEX akill_expiry_idx ON akill ((time + duration)) WHERE duration <> 0;
+CREATE INDEX akill_setter_idx ON akill (setter);
+
+DROP TABLE IF EXISTS sent_mail;
+CREATE TABLE sent_mail (
+  id              INTEGER PRIMARY KEY AUTOINCREMENT,
+  account_id      INTEGER REFERENCES account(id) ON DELETE SET NULL,
+  email           VARCHAR(255) NOT NULL,
+  sent            INTEGER NOT NULL
+);
+-- GET_SENT_MAIL and DELETE_EXPIRED_SENT_MAIL
+CREATE INDEX sent_mail_account_id_idx ON sent_mail (account_id);
+CREATE INDEX sent_mail_email_idx ON sent_mail (email);
+CREATE INDEX sent_mail_sent_idx ON sent_mail (sent);
+
+DROP TABLE IF EXISTS jupes;
+CREATE TABLE jupes (
+  id              INTEGER PRIMARY KEY AUTOINCREMENT,
+  name            VARCHAR(255) NOT NULL,
+  reason          VARCHAR(255) NOT NULL,
+  setter          INTEGER REFERENCES account(id) ON DELETE SET NULL
+);
+CREATE UNIQUE INDEX jupes_name_idx ON jupes (lower(name));
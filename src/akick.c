@@ -36,56 +36,6 @@
 #include "akick.h"
 #include "servicemask.h"
 
-static int
-akick_check_mask(struct Client *client, const char *mask)
-{
-  struct irc_ssaddr addr;
-  struct split_nuh_item nuh;
-  char name[NICKLEN];
-  char user[USERLEN + 1];
-  char host[HOSTLEN + 1];
-  int type, bits, found = 0;
-
-  DupString(nuh.nuhmask, mask);
-  nuh.nickptr  = name;
-  nuh.userptr  = user;
-  nuh.hostptr  = host;
-
-  nuh.nicksize = sizeof(name);
-  nuh.usersize = sizeof(user);
-  nuh.hostsize = sizeof(host);
-
-  split_nuh(&nuh);
-
-  type = parse_netmask(host, &addr, &bits);
-
-  if(match(name, client->name) && match(user, client->username))
-  {
-    switch(type)
-    {
-      case HM_HOST:
-        if(match(host, client->host))
-          found = 1;
-        break;
-      case HM_IPV4:
-        if (client->aftype == AF_INET)
-          if (match_ipv4(&client->ip, &addr, bits))
-            found = 1;
-        break;
-#ifdef IPV6
-      case HM_IPV6:
-        if (client->aftype == AF_INET6)
-          if (match_ipv6(&client->ip, &addr, bits))
-            found = 1;
-        break;
-#endif
-    }
-  }
-  MyFree(nuh.nuhmask);
-  return found;
-}
-
-
 static int
 akick_enforce_one(struct Service *service, struct Channel *chptr,
   struct Client *client, struct ServiceMask *sban)
@@ -106,7 +56,7 @@ akick_enforce_one(struct Service *service, struct Channel *chptr,
     MyFree(nick);
     return FALSE;
   }
-  else if(akick_check_mask(client, sban->mask))
+  else if(servicemask_match_client(sban, client))
   {
     char banmask[IRC_BUFSIZE+1];
     ircsprintf(banmask, "%s", sban->mask);
@@ -144,6 +94,51 @@ akick_check_client(struct Service *service, struct Channel *chptr, struct Client
   return FALSE;
 }
 
+/* akick_check_restored()
+ *
+ * inputs       - service, channel restored from a snapshot
+ * output       - number of members kicked
+ * side effects - members carried over a warm restart, which skipped the
+ *                akick check when they joined, are checked against the
+ *                channel's akicks, loaded once for all of them.  The
+ *                channel may be gone afterwards if everyone was kicked.
+ */
+int
+akick_check_restored(struct Service *service, struct Channel *chptr)
+{
+  dlink_list list = { 0 };
+  dlink_node *ptr, *next_ptr, *aptr;
+  int numkicks = 0;
+
+  if(chptr->regchan == NULL)
+    return 0;
+
+  servicemask_list_akick(dbchannel_get_id(chptr->regchan), &list);
+  if(list.head == NULL)
+    return 0;
+
+  DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->members.head)
+  {
+    struct Membership *ms = ptr->data;
+    struct Client *client = ms->client_p;
+
+    if(!IsRestored(client))
+      continue;
+
+    DLINK_FOREACH(aptr, list.head)
+    {
+      if(akick_enforce_one(service, chptr, client, aptr->data))
+      {
+        numkicks++;
+        break;
+      }
+    }
+  }
+
+  servicemask_list_free(&list);
+  return numkicks;
+}
+
 int
 akick_enforce(struct Service *service, struct Channel *chptr,
   struct ServiceMask *akick)
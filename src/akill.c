@@ -32,80 +32,45 @@
 #include "hostmask.h"
 #include "nickname.h"
 #include "servicemask.h"
+#include "akill.h"
+#include "kill.h"
 
 static dlink_list akill_list_cache = { 0 };
 
+/*
+ * The cached akills indexed for checking clients.  Akills on a literal host
+ * are kept sorted by host so a client only looks at the ones on its own
+ * host, the rest are matched in turn.  Both point into akill_list_cache.
+ */
+static struct ServiceMask **akill_by_host;
+static unsigned int akill_by_host_count;
+static dlink_list akill_wild = { 0 };
+static int akill_index_valid = FALSE;
+
+struct AkillBacklog akill_backlog;
+
 static struct ServiceMask *
 row_to_akill(row_t *row)
 {
   struct ServiceMask *sban;
 
   sban = MyMalloc(sizeof(struct ServiceMask));
-  sban->id = atoi(row->cols[0]);
+  sban->id = db_row_int(row, 0);
 
   if(row->cols[1] != NULL)
-    sban->setter = atoi(row->cols[1]);
+    sban->setter = db_row_int(row, 1);
   else
     sban->setter = 0;
 
   DupString(sban->mask, row->cols[2]);
   DupString(sban->reason, row->cols[3]);
-  sban->time_set = atoi(row->cols[4]);
-  sban->duration = atoi(row->cols[5]);
+  sban->time_set = db_row_int(row, 4);
+  sban->duration = db_row_int(row, 5);
   sban->type = AKILL_MASK;
 
   return sban;
 }
 
-static int
-akill_check_mask(struct Client *client, const char *mask)
-{
-  struct irc_ssaddr addr;
-  struct split_nuh_item nuh;
-  char name[NICKLEN];
-  char user[USERLEN+1];
-  char host[HOSTLEN+1];
-  int type, bits, found = 0;
-
-  DupString(nuh.nuhmask, mask);
-  nuh.nickptr = name;
-  nuh.userptr = user;
-  nuh.hostptr = host;
-
-  nuh.nicksize = sizeof(name);
-  nuh.usersize = sizeof(user);
-  nuh.hostsize = sizeof(host);
-
-  split_nuh(&nuh);
-
-  type = parse_netmask(host, &addr, &bits);
-
-  if(match(name, client->name) && match(user, client->username))
-  {
-    switch(type)
-    {
-      case HM_HOST:
-        if(match(host, client->host))
-          found = 1;
-        break;
-      case HM_IPV4:
-        if (client->aftype == AF_INET)
-          if (match_ipv4(&client->ip, &addr, bits))
-            found = 1;
-        break;
-#ifdef IPV6
-      case HM_IPV6:
-        if (client->aftype == AF_INET6)
-          if (match_ipv6(&client->ip, &addr, bits))
-            found = 1;
-        break;
-#endif
-    }
-  }
-  MyFree(nuh.nuhmask);
-  return found;
-}
-
 void
 akill_list_free(dlink_list *list)
 {
@@ -188,25 +153,122 @@ akill_get_expired(dlink_list *list)
   return dlink_list_length(list);
 }
 
-int
-akill_check_client(struct Service *service, struct Client *client)
+static int
+akill_host_compare(const void *a, const void *b)
+{
+  struct ServiceMask *ma = *(struct ServiceMask * const *)a;
+  struct ServiceMask *mb = *(struct ServiceMask * const *)b;
+
+  return irccmp(servicemask_literal_host(ma), servicemask_literal_host(mb));
+}
+
+static void
+akill_index_clear()
+{
+  dlink_node *ptr, *next;
+
+  DLINK_FOREACH_SAFE(ptr, next, akill_wild.head)
+  {
+    dlinkDelete(ptr, &akill_wild);
+    free_dlink_node(ptr);
+  }
+
+  MyFree(akill_by_host);
+  akill_by_host = NULL;
+  akill_by_host_count = 0;
+
+  akill_list_free(&akill_list_cache);
+  akill_index_valid = FALSE;
+}
+
+/* akill_index_build()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - the akills are loaded and indexed if they have changed
+ *                since the last check
+ */
+static void
+akill_index_build()
 {
   dlink_node *ptr;
+  unsigned int count = 0;
+
+  if(akill_index_valid)
+    return;
 
-  if(dlink_list_length(&akill_list_cache) == 0)
-    akill_list(&akill_list_cache);
+  akill_index_clear();
+  akill_list(&akill_list_cache);
+
+  akill_by_host = MyMalloc((dlink_list_length(&akill_list_cache) + 1) *
+      sizeof(struct ServiceMask *));
 
   DLINK_FOREACH(ptr, akill_list_cache.head)
   {
     struct ServiceMask *sban = (struct ServiceMask *)ptr->data;
 
-    if(akill_check_mask(client, sban->mask))
+    if(servicemask_literal_host(sban) != NULL)
+      akill_by_host[count++] = sban;
+    else
+      dlinkAddTail(sban, make_dlink_node(), &akill_wild);
+  }
+
+  qsort(akill_by_host, count, sizeof(struct ServiceMask *), akill_host_compare);
+  akill_by_host_count = count;
+  akill_index_valid = TRUE;
+}
+
+static void
+akill_send(struct Service *service, struct ServiceMask *sban,
+    struct Client *client)
+{
+  char *setter = nickname_nick_from_id(sban->setter, TRUE);
+
+  /* a host full of clients would send the same akill for each of them */
+  kill_akill_client(service, setter, sban, client);
+  MyFree(setter);
+}
+
+int
+akill_check_client(struct Service *service, struct Client *client)
+{
+  dlink_node *ptr;
+  unsigned int low = 0, high, mid;
+
+  akill_index_build();
+
+  /* first akill on the client's host */
+  high = akill_by_host_count;
+  while(low < high)
+  {
+    mid = (low + high) / 2;
+    if(irccmp(servicemask_literal_host(akill_by_host[mid]), client->host) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  for(; low < akill_by_host_count; low++)
+  {
+    struct ServiceMask *sban = akill_by_host[low];
+
+    if(irccmp(servicemask_literal_host(sban), client->host) != 0)
+      break;
+
+    if(servicemask_match_client(sban, client))
     {
-      char *setter = nickname_nick_from_id(sban->setter, TRUE);
+      akill_send(service, sban, client);
+      return TRUE;
+    }
+  }
 
-      send_akill(service, setter, sban);
-      MyFree(setter);
+  DLINK_FOREACH(ptr, akill_wild.head)
+  {
+    struct ServiceMask *sban = (struct ServiceMask *)ptr->data;
 
+    if(servicemask_match_client(sban, client))
+    {
+      akill_send(service, sban, client);
       return TRUE;
     }
   }
@@ -214,12 +276,68 @@ akill_check_client(struct Service *service, struct Client *client)
   return FALSE;
 }
 
+/* akill_check_backlog()
+ *
+ * inputs       - service to send akills from, time budget in microseconds
+ * output       - number of clients checked
+ * side effects - clients on the delayed akill list are checked oldest
+ *                first until the list is empty or the budget is used up
+ */
+unsigned int
+akill_check_backlog(struct Service *service, unsigned int budget)
+{
+  struct timeval start, now;
+  unsigned int checked = 0;
+  long elapsed;
+
+  if(CurrentTime - akill_backlog.window_start >= AKILL_BACKLOG_WINDOW)
+  {
+    akill_backlog.rate = akill_backlog.window_checked /
+      (CurrentTime - akill_backlog.window_start);
+    akill_backlog.window_start = CurrentTime;
+    akill_backlog.window_checked = 0;
+  }
+
+  if(delay_akill_list.tail == NULL)
+    return 0;
+
+  gettimeofday(&start, NULL);
+
+  while(delay_akill_list.tail != NULL)
+  {
+    dlink_node *ptr = delay_akill_list.tail;
+    struct Client *target = (struct Client *)ptr->data;
+
+    dlinkDelete(ptr, &delay_akill_list);
+    free_dlink_node(ptr);
+    target->akill_node = NULL;
+
+    if(akill_check_client(service, target))
+      akill_backlog.matched++;
+
+    /* the clock is only read every so often, checks are cheap */
+    if(++checked % AKILL_BACKLOG_SLICE == 0)
+    {
+      gettimeofday(&now, NULL);
+      elapsed = (now.tv_sec - start.tv_sec) * 1000000 +
+        (now.tv_usec - start.tv_usec);
+      if(elapsed >= (long)budget)
+        break;
+    }
+  }
+
+  akill_backlog.checked += checked;
+  akill_backlog.window_checked += checked;
+
+  return checked;
+}
+
 int
 akill_add(struct ServiceMask *akill)
 {
   int ret;
 
-  akill_list_free(&akill_list_cache);
+  akill_index_clear();
 
   akill->type = AKILL_MASK;
 
@@ -262,7 +380,7 @@ akill_find(const char *mask)
 int
 akill_remove_mask(const char *mask)
 {
-  akill_list_free(&akill_list_cache);
+  akill_index_clear();
 
   return db_execute_nonquery(DELETE_AKILL, "s", mask);
 }
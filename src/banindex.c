@@ -0,0 +1,498 @@
+/*
+ *  oftc-ircservices: an extensible and flexible IRC Services package
+ *  banindex.c - per channel indexes of the ban, except, invex and quiet lists
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ */
+
+/*
+ * Every mask list of a channel that has ever held an entry gets an index
+ * next to it.  The index keeps two hashes of the same bans:
+ *
+ *  masks - by n!u@h, so add_id() and del_id() find a duplicate or the
+ *          entry to remove without walking the list.
+ *  keys  - by the one literal part of the ban a matching client must
+ *          share: the masked address of an IP ban, the host of a ban with
+ *          a plain host, the domain of a "*.domain" host or, when the host
+ *          is wild, the nick.  A client only has to probe its own address
+ *          at each prefix length in use, its host and sockhost and their
+ *          domain suffixes, and its nick.
+ *
+ * Bans with nothing literal to key on sit on the wild list, which is
+ * always walked.  Every candidate is run through match_ban(), a colliding
+ * hash value costs a compare and never a wrong answer.
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "channel_mode.h"
+#include "channel.h"
+#include "hash.h"
+#include "hostmask.h"
+#include "banindex.h"
+
+/* mask_hash()
+ *
+ * inputs       - nick, user and host parts of a mask
+ * output       - case insensitive hash of the whole mask
+ * side effects - none
+ */
+static unsigned int
+mask_hash(const char *name, const char *user, const char *host)
+{
+  unsigned int hashv = hash_string(name);
+
+  hashv = hashv * 31 + hash_string(user);
+  return hashv * 31 + hash_string(host);
+}
+
+/* addr_hash()
+ *
+ * inputs       - address bytes in network order, their count, prefix length
+ * output       - hash of the prefix and its length
+ * side effects - none
+ */
+static unsigned int
+addr_hash(const unsigned char *addr, int len, int bits)
+{
+  unsigned int hashv = FNV1_32_INIT ^ bits;
+  unsigned char c;
+  int i;
+
+  for (i = 0; i < len && bits > 0; i++, bits -= 8)
+  {
+    c = addr[i];
+    if (bits < 8)
+      c &= 0xff << (8 - bits);
+    hashv = (hashv ^ c) * 16777619;
+  }
+
+  return hashv;
+}
+
+static int
+has_wild(const char *s)
+{
+  return strpbrk(s, "*?#") != NULL;
+}
+
+/* ban_ipbits()
+ *
+ * inputs       - ban
+ * output       - its slot in the prefix length counts, -1 for host bans
+ * side effects - none
+ */
+static int
+ban_ipbits(const struct Ban *bp)
+{
+  if (bp->type == HM_IPV4 && bp->bits >= 0 && bp->bits < BANINDEX_V4_BITS)
+    return bp->bits;
+  if (bp->type == HM_IPV6 && bp->bits >= 0 && bp->bits < BANINDEX_V6_BITS)
+    return BANINDEX_V4_BITS + bp->bits;
+  return -1;
+}
+
+/* ban_key()
+ *
+ * inputs       - ban, where to store its key
+ * output       - TRUE if the ban has something literal to key on
+ * side effects - none
+ */
+static int
+ban_key(const struct Ban *bp, unsigned int *hashv)
+{
+  const struct sockaddr_in *v4 = (const struct sockaddr_in *)&bp->addr;
+  const struct sockaddr_in6 *v6 = (const struct sockaddr_in6 *)&bp->addr;
+
+  if (bp->type != HM_HOST)
+  {
+    if (ban_ipbits(bp) == -1)
+      return FALSE;
+
+    if (bp->type == HM_IPV4)
+      *hashv = addr_hash((const unsigned char *)&v4->sin_addr, 4, bp->bits);
+    else
+      *hashv = addr_hash(v6->sin6_addr.s6_addr, 16, bp->bits);
+    return TRUE;
+  }
+
+  if (!has_wild(bp->host))
+    *hashv = hash_string(bp->host);
+  else if (bp->host[0] == '*' && bp->host[1] == '.' && !has_wild(bp->host + 1))
+    *hashv = hash_string(bp->host + 1);
+  else if (!has_wild(bp->name))
+    *hashv = hash_string(bp->name);
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* bucket_find()
+ *
+ * inputs       - hash, hash value
+ * output       - the bucket for the hash value, NULL if there is none
+ * side effects - none
+ */
+static struct BanBucket *
+bucket_find(const struct BanHash *hash, unsigned int hashv)
+{
+  unsigned int mask, i;
+
+  if (hash->count == 0)
+    return NULL;
+
+  mask = hash->size - 1;
+  for (i = hashv & mask; hash->buckets[i].bans.head != NULL; i = (i + 1) & mask)
+  {
+    if (hash->buckets[i].hashv == hashv)
+      return &hash->buckets[i];
+  }
+
+  return NULL;
+}
+
+static void
+bucket_resize(struct BanHash *hash, unsigned int size)
+{
+  struct BanBucket *old = hash->buckets;
+  unsigned int oldsize = hash->size;
+  unsigned int mask = size - 1;
+  unsigned int i, j;
+
+  hash->buckets = MyMalloc(sizeof(struct BanBucket) * size);
+  hash->size = size;
+
+  for (i = 0; i < oldsize; ++i)
+  {
+    if (old[i].bans.head == NULL)
+      continue;
+
+    for (j = old[i].hashv & mask; hash->buckets[j].bans.head != NULL;
+         j = (j + 1) & mask)
+      ;
+    hash->buckets[j] = old[i];
+  }
+
+  MyFree(old);
+}
+
+static void
+bucket_add(struct BanHash *hash, unsigned int hashv, struct Ban *bp,
+    dlink_node *node)
+{
+  struct BanBucket *bucket = bucket_find(hash, hashv);
+  unsigned int mask, i;
+
+  if (bucket == NULL)
+  {
+    if ((hash->count + 1) * 4 > hash->size * 3)
+      bucket_resize(hash, hash->size ? hash->size * 2 : BANINDEX_MIN_SIZE);
+
+    mask = hash->size - 1;
+    for (i = hashv & mask; hash->buckets[i].bans.head != NULL;
+         i = (i + 1) & mask)
+      ;
+
+    bucket = &hash->buckets[i];
+    bucket->hashv = hashv;
+    hash->count++;
+  }
+
+  dlinkAdd(bp, node, &bucket->bans);
+}
+
+/* bucket_del()
+ *
+ * inputs       - hash, hash value, node of the ban in its bucket
+ * output       - none
+ * side effects - an emptied bucket is removed, shifting back the buckets
+ *                after it so no probe sequence is broken
+ */
+static void
+bucket_del(struct BanHash *hash, unsigned int hashv, dlink_node *node)
+{
+  struct BanBucket *buckets = hash->buckets;
+  struct BanBucket *bucket = bucket_find(hash, hashv);
+  unsigned int mask, i, j, home;
+
+  assert(bucket != NULL);
+
+  dlinkDelete(node, &bucket->bans);
+  if (bucket->bans.head != NULL)
+    return;
+
+  mask = hash->size - 1;
+  i = bucket - buckets;
+
+  for (j = (i + 1) & mask; buckets[j].bans.head != NULL; j = (j + 1) & mask)
+  {
+    home = buckets[j].hashv & mask;
+
+    /* leave it if its home slot lies cyclically within (i, j] */
+    if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+      continue;
+
+    buckets[i] = buckets[j];
+    i = j;
+  }
+
+  memset(&buckets[i], 0, sizeof(struct BanBucket));
+  hash->count--;
+
+  if (hash->size > BANINDEX_MIN_SIZE && hash->count * 8 < hash->size)
+    bucket_resize(hash, hash->size / 2);
+}
+
+struct BanIndex *
+banindex_create()
+{
+  return MyMalloc(sizeof(struct BanIndex));
+}
+
+/* banindex_free()
+ *
+ * inputs       - index, every ban in it already removed
+ * output       - none
+ * side effects - the index is freed
+ */
+void
+banindex_free(struct BanIndex *index)
+{
+  if (index == NULL)
+    return;
+
+  assert(index->masks.count == 0 && index->keys.count == 0);
+  assert(index->wild.head == NULL);
+
+  MyFree(index->masks.buckets);
+  MyFree(index->keys.buckets);
+  MyFree(index->ipbits);
+  MyFree(index);
+}
+
+/* banindex_add()
+ *
+ * inputs       - index, ban just put on the list the index belongs to
+ * output       - none
+ * side effects - the ban is entered in both hashes or on the wild list
+ */
+void
+banindex_add(struct BanIndex *index, struct Ban *bp)
+{
+  int slot;
+
+  bp->index = index;
+  bp->mhash = mask_hash(bp->name, bp->username, bp->host);
+  bucket_add(&index->masks, bp->mhash, bp, &bp->mnode);
+
+  bp->keyed = ban_key(bp, &bp->khash);
+  if (!bp->keyed)
+  {
+    dlinkAdd(bp, &bp->knode, &index->wild);
+    return;
+  }
+
+  bucket_add(&index->keys, bp->khash, bp, &bp->knode);
+
+  if ((slot = ban_ipbits(bp)) != -1)
+  {
+    if (index->ipbits == NULL)
+      index->ipbits = MyMalloc(sizeof(unsigned short) *
+          (BANINDEX_V4_BITS + BANINDEX_V6_BITS));
+    index->ipbits[slot]++;
+  }
+}
+
+/* banindex_del()
+ *
+ * inputs       - ban about to leave its list
+ * output       - none
+ * side effects - the ban is taken out of its index
+ */
+void
+banindex_del(struct Ban *bp)
+{
+  struct BanIndex *index = bp->index;
+  int slot;
+
+  bucket_del(&index->masks, bp->mhash, &bp->mnode);
+
+  if (!bp->keyed)
+    dlinkDelete(&bp->knode, &index->wild);
+  else
+  {
+    bucket_del(&index->keys, bp->khash, &bp->knode);
+    if ((slot = ban_ipbits(bp)) != -1)
+      index->ipbits[slot]--;
+  }
+
+  bp->index = NULL;
+}
+
+/* banindex_find_mask()
+ *
+ * inputs       - index, nick, user and host parts of a mask
+ * output       - the ban with exactly that mask, NULL if there is none
+ * side effects - none
+ */
+struct Ban *
+banindex_find_mask(const struct BanIndex *index, const char *name,
+    const char *user, const char *host)
+{
+  struct BanBucket *bucket;
+  dlink_node *ptr;
+
+  if (index == NULL)
+    return NULL;
+
+  bucket = bucket_find(&index->masks, mask_hash(name, user, host));
+  if (bucket == NULL)
+    return NULL;
+
+  DLINK_FOREACH(ptr, bucket->bans.head)
+  {
+    struct Ban *bp = ptr->data;
+
+    if (!irccmp(bp->name, name) && !irccmp(bp->username, user) &&
+        !irccmp(bp->host, host))
+      return bp;
+  }
+
+  return NULL;
+}
+
+static struct Ban *
+match_bucket(const struct BanIndex *index, unsigned int hashv,
+    const struct Client *who)
+{
+  struct BanBucket *bucket = bucket_find(&index->keys, hashv);
+  dlink_node *ptr;
+
+  if (bucket == NULL)
+    return NULL;
+
+  DLINK_FOREACH(ptr, bucket->bans.head)
+  {
+    if (match_ban(ptr->data, who))
+      return ptr->data;
+  }
+
+  return NULL;
+}
+
+/* match_host()
+ *
+ * inputs       - index, host or sockhost of the client, client
+ * output       - a ban keyed on the host or one of its domains that
+ *                matches the client, NULL if there is none
+ * side effects - none
+ */
+static struct Ban *
+match_host(const struct BanIndex *index, const char *host,
+    const struct Client *who)
+{
+  struct Ban *bp;
+  const char *p;
+
+  if ((bp = match_bucket(index, hash_string(host), who)) != NULL)
+    return bp;
+
+  for (p = strchr(host, '.'); p != NULL; p = strchr(p + 1, '.'))
+  {
+    if ((bp = match_bucket(index, hash_string(p), who)) != NULL)
+      return bp;
+  }
+
+  return NULL;
+}
+
+/* match_addr()
+ *
+ * inputs       - index, client
+ * output       - an address ban matching the client, NULL if there is none
+ * side effects - none
+ */
+static struct Ban *
+match_addr(const struct BanIndex *index, const struct Client *who)
+{
+  const unsigned short *counts = index->ipbits;
+  const unsigned char *addr;
+  struct Ban *bp;
+  int len, bits;
+
+  if (who->aftype == AF_INET)
+  {
+    addr = (const unsigned char *)
+      &((const struct sockaddr_in *)&who->ip)->sin_addr;
+    len = 4;
+  }
+  else if (who->aftype == AF_INET6)
+  {
+    addr = ((const struct sockaddr_in6 *)&who->ip)->sin6_addr.s6_addr;
+    len = 16;
+    counts += BANINDEX_V4_BITS;
+  }
+  else
+    return NULL;
+
+  for (bits = 0; bits <= len * 8; bits++)
+  {
+    if (counts[bits] == 0)
+      continue;
+
+    if ((bp = match_bucket(index, addr_hash(addr, len, bits), who)) != NULL)
+      return bp;
+  }
+
+  return NULL;
+}
+
+/* banindex_match()
+ *
+ * inputs       - index, client
+ * output       - a ban in the index matching the client, NULL if none does
+ * side effects - none
+ */
+struct Ban *
+banindex_match(const struct BanIndex *index, const struct Client *who)
+{
+  struct Ban *bp;
+  dlink_node *ptr;
+
+  if (index == NULL)
+    return NULL;
+
+  if (index->ipbits != NULL && (bp = match_addr(index, who)) != NULL)
+    return bp;
+
+  if ((bp = match_host(index, who->host, who)) != NULL)
+    return bp;
+  if (strcmp(who->host, who->sockhost) != 0 &&
+      (bp = match_host(index, who->sockhost, who)) != NULL)
+    return bp;
+  if ((bp = match_bucket(index, hash_string(who->name), who)) != NULL)
+    return bp;
+
+  DLINK_FOREACH(ptr, index->wild.head)
+  {
+    if (match_ban(ptr->data, who))
+      return ptr->data;
+  }
+
+  return NULL;
+}
@@ -40,20 +40,20 @@ row_to_chanaccess(row_t *row)
 {
   struct ChanAccess *access;
   access = MyMalloc(sizeof(struct ChanAccess));
-  access->id = atoi(row->cols[0]);
-  access->channel = atoi(row->cols[1]);
+  access->id = db_row_int(row, 0);
+  access->channel = db_row_int(row, 1);
 
   if(row->cols[2] != NULL)
-    access->account = atoi(row->cols[2]);
+    access->account = db_row_int(row, 2);
   else
     access->account = 0;
 
   if(row->cols[3] != NULL)
-    access->group = atoi(row->cols[3]);
+    access->group = db_row_int(row, 3);
   else
     access->group = 0;
 
-  access->level = atoi(row->cols[4]);
+  access->level = db_row_int(row, 4);
   return access;
 }
 
@@ -78,20 +78,32 @@ chanaccess_list_free(dlink_list *list)
 int
 chanaccess_list(unsigned int channel, dlink_list *list)
 {
+  struct DBPipeline pipeline;
   result_set_t *results;
-  int error;
-  int i;
-  int res = 0;
+  int steps[2];
+  int i, j;
 
-  results = db_execute(GET_CHAN_ACCESSES, &error, "i", &channel);
-  if(results == NULL && error != 0)
+  /* the account and the group entries come back in one go */
+  db_pipeline_init(&pipeline);
+  steps[0] = db_pipeline_execute(&pipeline, GET_CHAN_ACCESSES, "i", &channel);
+  steps[1] = db_pipeline_execute(&pipeline, GET_CHAN_ACCESSES_GROUP, "i",
+      &channel);
+
+  if(!db_pipeline_run(&pipeline))
   {
-    ilog(L_CRIT, "chanaccess_list: database error %d", error);
+    ilog(L_CRIT, "chanaccess_list: database error %d",
+        pipeline.steps[steps[0]].error != 0 ? pipeline.steps[steps[0]].error :
+        pipeline.steps[steps[1]].error);
+    db_pipeline_free(&pipeline);
     return FALSE;
   }
 
-  if(results != NULL)
+  for(j = 0; j < 2; j++)
   {
+    results = db_pipeline_result(&pipeline, steps[j]);
+    if(results == NULL)
+      continue;
+
     for(i = 0; i < results->row_count; i++)
     {
       row_t *row = &results->rows[i];
@@ -103,27 +115,7 @@ chanaccess_list(unsigned int channel, dlink_list *list)
     db_free_result(results);
   }
 
-  results = db_execute(GET_CHAN_ACCESSES_GROUP, &error, "i", &channel);
-  if(results == NULL && error != 0)
-  {
-    ilog(L_CRIT, "chanaccess_list: database error %d", error);
-    return res;
-  }
-  else if(results == NULL)
-    return res;
-
-  if(results->row_count == 0)
-    return dlink_list_length(list);
-
-  for(i = 0; i < results->row_count; i++)
-  {
-    row_t *row = &results->rows[i];
-    struct ChanAccess *access = row_to_chanaccess(row);
-
-    dlinkAdd(access, make_dlink_node(), list);
-  }
-
-  db_free_result(results);
+  db_pipeline_free(&pipeline);
 
   return dlink_list_length(list);
 }
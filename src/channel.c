@@ -41,6 +41,8 @@
 #include "language.h"
 #include "parse.h"
 #include "interface.h"
+#include "snapshot.h"
+#include "banindex.h"
 
 static BlockHeap *channel_heap = NULL;
 static BlockHeap *member_heap = NULL;
@@ -104,7 +106,8 @@ make_channel(const char *chname)
   strlcpy(chptr->chname, chname, sizeof(chptr->chname));
   dlinkAdd(chptr, &chptr->node, &global_channel_list);
 
-  chptr->regchan = dbchannel_find(chname);
+  if(!snapshot_restore_channel(chptr))
+    chptr->regchan = dbchannel_find(chname);
 
   hash_add_channel(chptr);
 
@@ -115,11 +118,16 @@ void
 remove_ban(struct Ban *bptr, dlink_list *list)
 {
   dlinkDelete(&bptr->node, list);
+  if (bptr->index != NULL)
+    banindex_del(bptr);
 
   MyFree(bptr->name);
   MyFree(bptr->username);
   MyFree(bptr->host);
   MyFree(bptr->who);
+  free_compiled_mask(bptr->cname);
+  free_compiled_mask(bptr->cuser);
+  free_compiled_mask(bptr->chost);
 
   BlockHeapFree(ban_heap, bptr);
 }
@@ -195,6 +203,10 @@ destroy_channel(struct Channel *chptr)
   free_channel_list(&chptr->exceptlist);
   free_channel_list(&chptr->invexlist);
   free_channel_list(&chptr->quietlist);
+  banindex_free(chptr->banindex);
+  banindex_free(chptr->exceptindex);
+  banindex_free(chptr->invexindex);
+  banindex_free(chptr->quietindex);
 
   free_topic(chptr);
 
@@ -207,6 +219,9 @@ destroy_channel(struct Channel *chptr)
     chptr->regchan = NULL;
   }
 
+  /* see on_client_free_cb, hooks must always pass this on */
+  execute_callback(on_channel_free_cb, chptr);
+
   BlockHeapFree(channel_heap, chptr);
 }
 
@@ -258,6 +273,37 @@ add_user_to_channel(struct Channel *chptr, struct Client *who,
   dlinkAdd(ms, &ms->usernode, &who->channel);
 }
 
+/* match_ban()
+ *
+ * inputs       - ban, client
+ * output       - TRUE if the ban covers the client
+ * side effects - none
+ */
+int
+match_ban(const struct Ban *bp, const struct Client *who)
+{
+  if (!match_compiled(bp->cname, who->name) ||
+      !match_compiled(bp->cuser, who->username))
+    return FALSE;
+
+  switch (bp->type)
+  {
+    case HM_HOST:
+      return match_compiled(bp->chost, who->host) ||
+        match_compiled(bp->chost, who->sockhost);
+    case HM_IPV4:
+      return who->aftype == AF_INET &&
+        match_ipv4(&who->ip, &bp->addr, bp->bits);
+    case HM_IPV6:
+      return who->aftype == AF_INET6 &&
+        match_ipv6(&who->ip, &bp->addr, bp->bits);
+    default:
+      assert(0);
+  }
+
+  return FALSE;
+}
+
 struct Ban *
 find_bmask(const struct Client *who, const dlink_list *const list)
 {
@@ -267,32 +313,40 @@ find_bmask(const struct Client *who, const dlink_list *const list)
   {
     struct Ban *bp = ptr->data;
 
-    if (match(bp->name, who->name) && match(bp->username, who->username))
-    {
-      switch (bp->type)
-      {
-        case HM_HOST:
-          if (match(bp->host, who->host) || match(bp->host, who->sockhost))
-            return bp;
-          break;
-        case HM_IPV4:
-          if (who->aftype == AF_INET)
-            if (match_ipv4(&who->ip, &bp->addr, bp->bits))
-              return bp;
-          break;
-        case HM_IPV6:
-          if (who->aftype == AF_INET6)
-            if (match_ipv6(&who->ip, &bp->addr, bp->bits))
-              return bp;
-          break;
-        default:
-          assert(0);
-      }
-    }
+    if (match_ban(bp, who))
+      return bp;
   }
   return NULL;
 }
 
+/* find_channel_ban()
+ *
+ * inputs       - client, channel, CHFL_BAN/EXCEPTION/INVEX/QUIET
+ * output       - an entry of that list matching the client, NULL if none
+ * side effects - none, unlike find_bmask() only the entries sharing a
+ *                literal part with the client are looked at
+ */
+struct Ban *
+find_channel_ban(const struct Client *who, const struct Channel *chptr,
+    int type)
+{
+  switch (type)
+  {
+    case CHFL_BAN:
+      return banindex_match(chptr->banindex, who);
+    case CHFL_EXCEPTION:
+      return banindex_match(chptr->exceptindex, who);
+    case CHFL_INVEX:
+      return banindex_match(chptr->invexindex, who);
+    case CHFL_QUIET:
+      return banindex_match(chptr->quietindex, who);
+    default:
+      assert(0);
+  }
+
+  return NULL;
+}
+
 /*! \brief Allocates a new topic
  * \param chptr Channel to allocate a new topic for
  */
@@ -38,6 +38,7 @@
 #include "language.h"
 #include "parse.h"
 #include "interface.h"
+#include "banindex.h"
 
 /* 10 is a magic number in hybrid 6 NFI where it comes from -db */
 #define BAN_FUDGE	10
@@ -93,7 +94,7 @@ int
 add_id(struct Client *client_p, struct Channel *chptr, char *banid, int type)
 {
   dlink_list *list = NULL;
-  dlink_node *ban = NULL;
+  struct BanIndex **index = NULL;
   size_t len = 0;
   struct Ban *ban_p = NULL;
   char name[NICKLEN];
@@ -122,33 +123,29 @@ add_id(struct Client *client_p, struct Channel *chptr, char *banid, int type)
   {
     case CHFL_BAN:
       list = &chptr->banlist;
+      index = &chptr->banindex;
       clear_ban_cache(chptr);
       break;
     case CHFL_EXCEPTION:
       list = &chptr->exceptlist;
+      index = &chptr->exceptindex;
       clear_ban_cache(chptr);
       break;
     case CHFL_INVEX:
       list = &chptr->invexlist;
+      index = &chptr->invexindex;
       break;
     case CHFL_QUIET:
       list = &chptr->quietlist;
+      index = &chptr->quietindex;
       break;
     default:
       assert(0);
       return 0;
   }
 
-  DLINK_FOREACH(ban, list->head)
-  {
-    ban_p = ban->data;
-    if (!irccmp(ban_p->name, name) &&
-	!irccmp(ban_p->username, user) &&
-	!irccmp(ban_p->host, host))
-    {
-      return 0;
-    }
-  }
+  if (banindex_find_mask(*index, name, user, host) != NULL)
+    return 0;
 
   ban_p = BlockHeapAlloc(ban_heap);
 
@@ -160,6 +157,10 @@ add_id(struct Client *client_p, struct Channel *chptr, char *banid, int type)
   ban_p->len = len - 2; /* -2 for @ and ! */
   ban_p->type = parse_netmask(host, &ban_p->addr, &ban_p->bits);
 
+  ban_p->cname = compile_mask(name);
+  ban_p->cuser = compile_mask(user);
+  ban_p->chost = compile_mask(host);
+
   if (IsClient(client_p))
   {
     ban_p->who = MyMalloc(strlen(client_p->name) +
@@ -173,6 +174,10 @@ add_id(struct Client *client_p, struct Channel *chptr, char *banid, int type)
 
   dlinkAdd(ban_p, &ban_p->node, list);
 
+  if (*index == NULL)
+    *index = banindex_create();
+  banindex_add(*index, ban_p);
+
   return 1;
 }
 
@@ -187,7 +192,8 @@ int
 del_id(struct Channel *chptr, char *banid, int type)
 {
   dlink_list *list = NULL;
-  dlink_node *ban = NULL;
+  struct BanIndex **index = NULL;
+  struct Ban *banptr;
   char name[NICKLEN];
   char user[USERLEN + 1];
   char host[HOSTLEN + 1];
@@ -216,37 +222,32 @@ del_id(struct Channel *chptr, char *banid, int type)
   {
     case CHFL_BAN:
       list = &chptr->banlist;
+      index = &chptr->banindex;
       clear_ban_cache(chptr);
       break;
     case CHFL_EXCEPTION:
       list = &chptr->exceptlist;
+      index = &chptr->exceptindex;
       clear_ban_cache(chptr);
       break;
     case CHFL_INVEX:
       list = &chptr->invexlist;
+      index = &chptr->invexindex;
       break;
     case CHFL_QUIET:
       list = &chptr->quietlist;
+      index = &chptr->quietindex;
       break;
     default:
       assert(0);
       return 0;
   }
 
-  DLINK_FOREACH(ban, list->head)
-  {
-    struct Ban *banptr = ban->data;
-
-    if (!irccmp(name, banptr->name) &&
-	!irccmp(user, banptr->username) &&
-	!irccmp(host, banptr->host))
-    {
-      remove_ban(banptr, list);
-      return 1;
-    }
-  }
+  if ((banptr = banindex_find_mask(*index, name, user, host)) == NULL)
+    return 0;
 
-  return 0;
+  remove_ban(banptr, list);
+  return 1;
 }
 
 /* channel_modes()
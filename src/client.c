@@ -41,6 +41,7 @@
 #include "msg.h"
 #include "nickserv.h"
 #include "kill.h"
+#include "snapshot.h"
 
 dlink_list global_client_list;
 dlink_list global_server_list;
@@ -147,7 +148,6 @@ make_client(struct Client *from)
   else
     client->from = from;
 
-  client->hnext  = client;
   strlcpy(client->username, "unknown", sizeof(client->username));
 
   return client;
@@ -283,7 +283,9 @@ exit_one_client(struct Client *source_p)
   {
     dlinkDelete(&source_p->lnode, &source_p->servptr->server_list);
 
-    dlinkFindDelete(&global_server_list, source_p);
+    /* hybrid servers are never put on it */
+    if(source_p->snode.prev != NULL || global_server_list.head == &source_p->snode)
+      dlinkDelete(&source_p->snode, &global_server_list);
   }
 
   if(HasID(source_p))
@@ -308,11 +310,20 @@ exit_one_client(struct Client *source_p)
 
   ilog(L_DEBUG, "exited: %s", source_p->name);
 
-  if((lp = dlinkFindDelete(&delay_akill_list, source_p)) != NULL)
-    free_dlink_node(lp);
+  if(source_p->akill_node != NULL)
+  {
+    dlinkDelete(source_p->akill_node, &delay_akill_list);
+    free_dlink_node(source_p->akill_node);
+    source_p->akill_node = NULL;
+  }
 
   kill_remove_client(source_p);
 
+  /* last chance to drop anything that points at source_p.  unlike on_quit,
+   * this runs for every client that goes away, hooks must always pass it on
+   */
+  execute_callback(on_client_free_cb, source_p);
+
   /* XXX TODO FIXME
    * We probably want to free the uplink if for whatever reason we get
    * disconnected, though should be infrequent enough we can live for
@@ -348,6 +359,27 @@ recurse_remove_clients(struct Client *source_p)
 }
 
 
+/*
+ * Put every user behind source_p on list and mark it as leaving with the
+ * split, so the whole set can be handed to the modules at once
+ */
+static void
+collect_split_clients(struct Client *source_p, dlink_list *list)
+{
+  dlink_node *ptr = NULL;
+
+  DLINK_FOREACH(ptr, source_p->client_list.head)
+  {
+    struct Client *client_p = ptr->data;
+
+    SetSplit(client_p);
+    dlinkAdd(client_p, make_dlink_node(), list);
+  }
+
+  DLINK_FOREACH(ptr, source_p->server_list.head)
+    collect_split_clients(ptr->data, list);
+}
+
 /*
 ** Remove *everything* that depends on source_p, from all lists, and sending
 ** all necessary QUITs and SQUITs.  source_p itself is still on the lists,
@@ -357,6 +389,22 @@ static void
 remove_dependents(struct Client *source_p, struct Client *from,
                   const char *comment)
 {
+  dlink_list split = { NULL, NULL, 0 };
+  dlink_node *ptr = NULL, *next = NULL;
+
+  if(!IsMe(source_p))
+  {
+    collect_split_clients(source_p, &split);
+    if(dlink_list_length(&split) > 0)
+      execute_callback(on_split_cb, source_p, &split, "Server Split");
+
+    DLINK_FOREACH_SAFE(ptr, next, split.head)
+    {
+      dlinkDelete(ptr, &split);
+      free_dlink_node(ptr);
+    }
+  }
+
   recurse_remove_clients(source_p);
 }
 
@@ -748,6 +796,7 @@ register_remote_user(struct Client *client_p, struct Client *source_p,
   dlinkAdd(source_p, &source_p->lnode, &source_p->servptr->client_list);
   ilog(L_DEBUG, "Adding client %s!%s@%s from %s", source_p->name, source_p->username,
       source_p->host, server);
+  snapshot_restore_client(source_p);
   execute_callback(on_newuser_cb, source_p);
 }
 
@@ -80,6 +80,7 @@ cleanup_conf()
   unregister_callback(verify_conf);
   unregister_callback(switch_conf_pass);
   unregister_callback(on_config_loaded_cb);
+  on_config_loaded_cb = NULL;
 }
 
 /*
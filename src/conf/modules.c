@@ -329,6 +329,33 @@ unload_module(struct Module *mod)
 #endif
 }
 
+/*
+ * boot_core_modules()
+ *
+ * [API] Initializes the core (protocol) modules ahead of the rest, so the
+ * uplink can be connecting while the others load.
+ *
+ * inputs: none
+ * output: none
+ */
+void
+boot_core_modules(void)
+{
+#ifdef USE_SHARED_MODULES
+  char buf[PATH_MAX];
+  const char **cp;
+
+  for (cp = core_modules; *cp; cp++)
+  {
+    if (find_module(*cp, NO))
+      continue;
+
+    snprintf(buf, sizeof(buf), "%s%s", *cp, SHARED_SUFFIX);
+    load_shared_module(*cp, MODPATH, buf);
+  }
+#endif
+}
+
 /*
  * boot_modules()
  *
@@ -348,15 +375,10 @@ boot_modules(char cold)
 #ifdef USE_SHARED_MODULES
     {
       char buf[PATH_MAX], *pp;
-      const char **cp;
       struct dirent *ldirent;
       DIR *moddir;
 
-      for (cp = core_modules; *cp; cp++)
-      {
-        snprintf(buf, sizeof(buf), "%s%s", *cp, SHARED_SUFFIX);
-        load_shared_module(*cp, MODPATH, buf);
-      }
+      boot_core_modules();
 
       if ((moddir = opendir(AUTOMODPATH)) == NULL)
         ilog(L_WARN, "Could not load modules from %s: %s", AUTOMODPATH,
@@ -25,6 +25,7 @@
 #include "conf/conf.h"
 #include "client.h"
 #include "hash.h"
+#include "crypt.h"
 
 struct ServicesInfoConf ServicesInfo = {};
 char new_uid[TOTALSIDUID + 1] = {0};
@@ -70,6 +71,8 @@ verify_servicesinfo(va_list args)
 
   if(!ServicesInfo.hmac_secret)
     parse_fatal("hmac_secret= field missing in servicesinfo{} section");
+  else
+    hmac_set_key(ServicesInfo.hmac_secret);
 
   recalc_fdlimit(NULL);
 
@@ -233,4 +236,5 @@ cleanup_servicesinfo()
   delete_conf_section(s);
   MyFree(s);
   MyFree(ServicesInfo.hmac_secret);
+  cleanup_hmac();
 }
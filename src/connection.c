@@ -43,6 +43,20 @@ static CNCB serv_connect_callback;
 struct Callback *connected_cb;
 static void try_reconnect(void *);
 
+/* the uplink is connected to while the modules load, but not used before */
+static int uplink_usable = FALSE;
+static struct Client *uplink_held;
+
+static void
+uplink_connected(struct Client *client)
+{
+  comm_setselect(&client->server->fd, COMM_SELECT_READ, read_packet, client, 0);
+
+  dlinkAdd(client, &client->snode, &global_server_list);
+  
+  execute_callback(connected_cb, client);
+}
+
 static void
 serv_connect_callback(fde_t *fd, int status, void *data)
 {
@@ -63,15 +77,43 @@ serv_connect_callback(fde_t *fd, int status, void *data)
   }
 
   ilog(L_DEBUG, "serv_connect_callback: Connect succeeded!");
-  comm_setselect(fd, COMM_SELECT_READ, read_packet, client, 0);
 
-  dlinkAdd(client, &client->node, &global_server_list);
-  
-  execute_callback(connected_cb, client);
+  if(!uplink_usable)
+  {
+    uplink_held = client;
+    return;
+  }
+
+  uplink_connected(client);
 }
 
-void 
-connect_server()
+/* connect_server_ready()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - from now on the uplink is handed to the modules as soon
+ *                as it connects, one that already has is handed over now
+ */
+void
+connect_server_ready()
+{
+  struct Client *client = uplink_held;
+
+  uplink_usable = TRUE;
+  uplink_held = NULL;
+
+  if(client != NULL)
+    uplink_connected(client);
+}
+
+/* make_uplink()
+ *
+ * inputs       - none
+ * output       - a client for the uplink, not yet connected
+ * side effects - loads the server mode list from the protocol module
+ */
+struct Client *
+make_uplink()
 {
   struct Client *client = make_client(NULL);
   struct Server *server = make_server(client);
@@ -107,6 +149,15 @@ connect_server()
     
   dlinkAdd(client, &client->node, &global_client_list);
 
+  return client;
+}
+
+void 
+connect_server()
+{
+  struct Client *client = make_uplink();
+  struct Server *server = client->server;
+
   if(comm_open(&server->fd, AF_INET, SOCK_STREAM, 0, NULL) < 0)
   {
     ilog(L_CRIT, "connect_server: Could not open socket");
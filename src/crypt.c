@@ -58,6 +58,11 @@
 #include "crypt.h"
 #include <openssl/sha.h>
 
+/* the HMAC key's padded blocks, hashed once by hmac_set_key() */
+static EVP_MD_CTX *hmac_inner = NULL;
+static EVP_MD_CTX *hmac_outer = NULL;
+static EVP_MD_CTX *hmac_work = NULL;
+
 static const char saltChars[] = 
   "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
   /* 0 .. 63, ascii - 64 */
@@ -83,7 +88,7 @@ crypt_pass_old(char *password)
 }
 
 char *
-crypt_pass(char *password, int encode)
+crypt_pass(const char *password, int encode)
 {
   EVP_MD_CTX *mdctx;
   const EVP_MD *md;
@@ -114,6 +119,107 @@ crypt_pass(char *password, int encode)
   return ret;
 }
 
+/* hmac_set_key()
+ *
+ * inputs       - the hmac_secret from servicesinfo{}
+ * output       - none
+ * side effects - the key is derived from the secret and its inner and
+ *                outer blocks are hashed, every hmac_digest() starts from
+ *                copies of them.  Called on each (re)load of the config.
+ */
+void
+hmac_set_key(const char *secret)
+{
+  const EVP_MD *md = EVP_sha1();
+  unsigned char pad[EVP_MAX_MD_SIZE * 2];
+  int block = EVP_MD_block_size(md);
+  char *key;
+  int i;
+
+  assert(block <= (int)sizeof(pad));
+
+  if(hmac_inner == NULL)
+  {
+    hmac_inner = EVP_MD_CTX_create();
+    hmac_outer = EVP_MD_CTX_create();
+    hmac_work = EVP_MD_CTX_create();
+  }
+
+  key = crypt_pass(secret, FALSE);
+
+  memset(pad, 0x36, block);
+  for(i = 0; i < DIGEST_LEN; i++)
+    pad[i] ^= key[i];
+  EVP_DigestInit_ex(hmac_inner, md, NULL);
+  EVP_DigestUpdate(hmac_inner, pad, block);
+
+  memset(pad, 0x5c, block);
+  for(i = 0; i < DIGEST_LEN; i++)
+    pad[i] ^= key[i];
+  EVP_DigestInit_ex(hmac_outer, md, NULL);
+  EVP_DigestUpdate(hmac_outer, pad, block);
+
+  OPENSSL_cleanse(pad, sizeof(pad));
+  OPENSSL_cleanse(key, DIGEST_LEN);
+  MyFree(key);
+}
+
+/* hmac_digest()
+ *
+ * inputs       - data, its length, buffer of EVP_MAX_MD_SIZE
+ * output       - length of the HMAC-SHA1 of data stored in the buffer
+ * side effects - none
+ */
+unsigned int
+hmac_digest(const char *data, size_t len, unsigned char *out)
+{
+  unsigned char inner[EVP_MAX_MD_SIZE];
+  unsigned int inner_len, out_len;
+
+  assert(hmac_inner != NULL);
+
+  EVP_MD_CTX_copy_ex(hmac_work, hmac_inner);
+  EVP_DigestUpdate(hmac_work, data, len);
+  EVP_DigestFinal_ex(hmac_work, inner, &inner_len);
+
+  EVP_MD_CTX_copy_ex(hmac_work, hmac_outer);
+  EVP_DigestUpdate(hmac_work, inner, inner_len);
+  EVP_DigestFinal_ex(hmac_work, out, &out_len);
+
+  return out_len;
+}
+
+void
+cleanup_hmac()
+{
+  if(hmac_inner == NULL)
+    return;
+
+  EVP_MD_CTX_destroy(hmac_inner);
+  EVP_MD_CTX_destroy(hmac_outer);
+  EVP_MD_CTX_destroy(hmac_work);
+  hmac_inner = hmac_outer = hmac_work = NULL;
+}
+
+/* two hex digits for each byte value */
+static const char base16_pairs[] =
+  "000102030405060708090A0B0C0D0E0F"
+  "101112131415161718191A1B1C1D1E1F"
+  "202122232425262728292A2B2C2D2E2F"
+  "303132333435363738393A3B3C3D3E3F"
+  "404142434445464748494A4B4C4D4E4F"
+  "505152535455565758595A5B5C5D5E5F"
+  "606162636465666768696A6B6C6D6E6F"
+  "707172737475767778797A7B7C7D7E7F"
+  "808182838485868788898A8B8C8D8E8F"
+  "909192939495969798999A9B9C9D9E9F"
+  "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+  "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+  "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+  "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+  "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+  "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
 /** Encode the <b>srclen</b> bytes at <b>src</b> in a NUL-terminated,
  * uppercase hexadecimal string; store it in the <b>destlen</b>-byte buffer
  * <b>dest</b>.
@@ -121,18 +227,16 @@ crypt_pass(char *password, int encode)
 void
 base16_encode(char *dest, size_t destlen, const char *src, size_t srclen)
 {
-  const char *end;
-  char *cp;
+  const uint8_t *in = (const uint8_t *)src;
+  const uint8_t *end = in + srclen;
+  char *cp = dest;
 
   assert(destlen >= srclen*2+1);
 
-  cp = dest;
-  end = src+srclen;
-  while (src<end) 
+  while(in < end)
   {
-    *cp++ = "0123456789ABCDEF"[ (*(const uint8_t*)src) >> 4 ];
-    *cp++ = "0123456789ABCDEF"[ (*(const uint8_t*)src) & 0xf ];
-    ++src;
+    memcpy(cp, &base16_pairs[*in++ * 2], 2);
+    cp += 2;
   }
   *cp = '\0';
 }
@@ -32,6 +32,9 @@
 #include "interface.h"
 #include "msg.h"
 #include "mqueue.h"
+#include "hash.h"
+#include "channel_mode.h"
+#include "channel.h"
 
 static DBChannel *
 row_to_dbchannel(row_t *row)
@@ -40,23 +43,23 @@ row_to_dbchannel(row_t *row)
 
   channel = MyMalloc(sizeof(DBChannel));
 
-  channel->id = atoi(row->cols[0]);
+  channel->id = db_row_int(row, 0);
   strlcpy(channel->channel, row->cols[1], sizeof(channel->channel));
   if(row->cols[1] != NULL)
     DupString(channel->description, row->cols[2]);
   if(row->cols[2] != NULL)
     DupString(channel->entrymsg, row->cols[3]);
-  channel->regtime = atoi(row->cols[4]);
-  channel->priv = atoi(row->cols[5]);
-  channel->restricted = atoi(row->cols[6]);
-  channel->topic_lock = atoi(row->cols[7]);
-  channel->verbose = atoi(row->cols[8]);
-  channel->autolimit = atoi(row->cols[9]);
-  channel->expirebans = atoi(row->cols[10]);
-  channel->floodserv = atoi(row->cols[11]);
-  channel->autoop = atoi(row->cols[12]);
-  channel->autovoice = atoi(row->cols[13]);
-  channel->leaveops = atoi(row->cols[14]);
+  channel->regtime = db_row_int(row, 4);
+  channel->priv = db_row_int(row, 5);
+  channel->restricted = db_row_int(row, 6);
+  channel->topic_lock = db_row_int(row, 7);
+  channel->verbose = db_row_int(row, 8);
+  channel->autolimit = db_row_int(row, 9);
+  channel->expirebans = db_row_int(row, 10);
+  channel->floodserv = db_row_int(row, 11);
+  channel->autoop = db_row_int(row, 12);
+  channel->autovoice = db_row_int(row, 13);
+  channel->leaveops = db_row_int(row, 14);
   if(row->cols[15] != NULL)
     DupString(channel->url, row->cols[15]);
   if(row->cols[16] != NULL)
@@ -65,9 +68,46 @@ row_to_dbchannel(row_t *row)
     DupString(channel->topic, row->cols[17]);
   if(row->cols[18] != NULL)
     DupString(channel->mlock, row->cols[18]);
-  channel->expirebans_lifetime = atoi(row->cols[19]);
-  channel->autosave = atoi(row->cols[20]);
-  channel->last_used = atoi(row->cols[21]);
+  channel->expirebans_lifetime = db_row_int(row, 19);
+  channel->autosave = db_row_int(row, 20);
+  channel->last_used = db_row_int(row, 21);
+
+  return channel;
+}
+
+/* While the database is down, a registered channel that exists on the
+ * network is still found through the DBChannel attached to it.  The copy
+ * leaves out the floodserv queues, which belong to the attached one.
+ */
+static DBChannel *
+dbchannel_attached(const char *name)
+{
+  struct Channel *chptr = hash_find_channel(name);
+  const DBChannel *from;
+  DBChannel *channel;
+
+  if(chptr == NULL || chptr->regchan == NULL)
+    return NULL;
+
+  from = chptr->regchan;
+  channel = MyMalloc(sizeof(DBChannel));
+  memcpy(channel, from, sizeof(DBChannel));
+  memset(&channel->node, 0, sizeof(channel->node));
+  memset(&channel->flood_list, 0, sizeof(channel->flood_list));
+  channel->flood_hash = NULL;
+  channel->gqueue = NULL;
+  if(from->description != NULL)
+    DupString(channel->description, from->description);
+  if(from->entrymsg != NULL)
+    DupString(channel->entrymsg, from->entrymsg);
+  if(from->url != NULL)
+    DupString(channel->url, from->url);
+  if(from->email != NULL)
+    DupString(channel->email, from->email);
+  if(from->topic != NULL)
+    DupString(channel->topic, from->topic);
+  if(from->mlock != NULL)
+    DupString(channel->mlock, from->mlock);
 
   return channel;
 }
@@ -79,6 +119,9 @@ dbchannel_find(const char *name)
   result_set_t *results;
   int error;
 
+  if(!db_is_connected())
+    return dbchannel_attached(name);
+
   results = db_execute(GET_FULL_CHAN, &error, "s", name);
   if(results == NULL || error)
     return NULL;
@@ -153,34 +196,30 @@ dbchannel_delete_forbid(const char *name)
 int
 dbchannel_register(DBChannel *channel, Nickname *founder)
 {
-  int ret;
-  unsigned int id, flag;
-
-  db_begin_transaction();
-
-  ret = db_execute_nonquery(INSERT_CHAN, "ssii", channel->channel, 
-      channel->description, &CurrentTime, &CurrentTime);
-
-  if(ret == -1)
-    goto failure;
+  struct DBPipeline pipeline;
+  int id, ret;
+  unsigned int account, flag;
 
-  channel->id = db_insertid("channel", "id");
-  if(channel->id == -1)
-    goto failure;
+  /* with the id known up front both rows go in as one pipeline */
+  if((id = db_nextid("channel", "id")) == -1)
+    return FALSE;
 
-  id = nickname_get_id(founder);
+  account = nickname_get_id(founder);
   flag = MASTER_FLAG;
-  ret = db_execute_nonquery(INSERT_CHANACCESS, "iii", &id, &channel->id,
-      &flag);
 
-  if(ret == -1)
-    goto failure;
+  db_pipeline_init(&pipeline);
+  db_pipeline_nonquery(&pipeline, INSERT_CHAN_ID, "issii", &id,
+      channel->channel, channel->description, &CurrentTime, &CurrentTime);
+  db_pipeline_nonquery(&pipeline, INSERT_CHANACCESS, "iii", &account, &id,
+      &flag);
+  ret = db_pipeline_run(&pipeline);
+  db_pipeline_free(&pipeline);
 
-  return db_commit_transaction();
+  if(!ret)
+    return FALSE;
 
-failure:
-  db_rollback_transaction();
-  return FALSE;
+  channel->id = id;
+  return TRUE;
 }
 
 int
@@ -237,6 +276,24 @@ dbchannel_list_forbid_free(dlink_list *list)
   db_string_list_free(list);
 }
 
+inline int
+dbchannel_list_all_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_CHANNELS_OPER_MATCH, list, mask, after, limit);
+}
+
+inline int
+dbchannel_list_regular_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_CHANNELS_MATCH, list, mask, after, limit);
+}
+
+inline int
+dbchannel_list_forbid_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_CHANNEL_FORBIDS_MATCH, list, mask, after, limit);
+}
+
 inline int
 dbchannel_masters_list(unsigned int id, dlink_list *list)
 {
@@ -464,13 +521,11 @@ dbchannel_set_regtime(DBChannel *this, time_t regtime)
 inline int
 dbchannel_set_last_used(DBChannel *this, time_t last_used)
 {
-  if(this->id == 0 || db_execute_nonquery(SET_CHAN_LAST_USED, "ii", &this->id, &last_used) > 0)
-  {
-    this->last_used = last_used;
-    return TRUE;
-  }
-  else
-    return FALSE;
+  if(this->id != 0)
+    db_batch_set_int(BATCH_CHANNEL, this->id, BATCH_LAST_USED, last_used);
+
+  this->last_used = last_used;
+  return TRUE;
 }
 
 inline int
@@ -23,6 +23,8 @@
  */
 
 #include "stdinc.h"
+#include <ctype.h>
+#include <sys/stat.h>
 #include "conf/conf.h"
 #include "dbm.h"
 #include "language.h"
@@ -34,12 +36,79 @@
 #include "msg.h"
 #include "send.h"
 #include "dbmail.h"
+#include "startup.h"
 
 #define LOG_BUFSIZE 2048
 
-static FBFILE *db_log_fb;
+/* seconds between attempts to get a lost connection back */
+#define DB_RECONNECT_TIME 5
+#define JOURNAL_BUFSIZE 8192
+
+static int db_log_stream = -1;
 static database_t *database;
 
+/* the first connection is made on a worker while the boot goes on */
+static struct StartupTask db_connect_task;
+static char db_connect_cstring[IRC_BUFSIZE];
+static int db_connect_ok;
+
+/*
+ * While the database is unreachable, reads fail straight away, except that
+ * nickname_find() and dbchannel_find() answer from the Nickname and
+ * DBChannel attached to online clients and channels.  A miss is then not
+ * proof that a name is unregistered, so callers that would act on it
+ * check db_is_connected() first.  Writes made outside of a transaction
+ * are appended to the journal at JPATH.  Only writes that can safely run
+ * twice are journaled: an entry may be replayed again when services die
+ * halfway through a replay, so INSERTs, and anything else
+ * db_journal_safe() does not list, fail instead.  Every entry is on disk
+ * before the caller is told the write went through.  The connection is
+ * brought back by db_reconnect_event() from the event loop, and once it
+ * is, the journal is replayed in order before anything else gets to use
+ * the database.
+ */
+static int db_down = FALSE;
+static int db_reconnecting = FALSE;
+static int db_reconnect_attempts = 0;
+static time_t db_lost_time = 0;
+static time_t db_next_attempt = 0;
+static int db_in_transaction = FALSE;
+static FBFILE *db_journal_fb;
+
+static void db_reconnect_event(void *);
+static void db_journal_replay();
+
+/*
+ * Updates queued with db_batch_set() are merged per row here and written
+ * out by db_batch_flush() every DB_BATCH_TIME seconds, one multi row
+ * statement per table, all inside one transaction.  Anything security
+ * related must keep using db_execute_nonquery() directly.
+ */
+#define DB_BATCH_TIME     1
+#define DB_BATCH_HASHSIZE 0x1000
+#define DB_BATCH_MAXROWS  1000
+
+struct BatchRow
+{
+  dlink_node node;
+  dlink_node pending;
+  unsigned int id;
+  char *values[BATCH_MAX_COLUMNS];
+};
+
+static const struct
+{
+  int query;
+  const char *types;
+} batch_tables[BATCH_TABLE_COUNT] = {
+  { BATCH_NICK_LAST_SEEN, "i" },
+  { BATCH_ACCOUNT_LAST,   "sssi" },
+  { BATCH_CHAN_LAST_USED, "i" }
+};
+
+static dlink_list batch_hash[BATCH_TABLE_COUNT][DB_BATCH_HASHSIZE];
+static dlink_list batch_pending[BATCH_TABLE_COUNT];
+
 /* A dynamically sized array is probably nicer here, as deletions will be linear */
 static dlink_list dynamic_queries = { 0 };
 struct QueryItem
@@ -48,32 +117,35 @@ struct QueryItem
   char *query;
 };
 
-void
-init_db()
+static void
+db_connect_string(char *buf, size_t len)
 {
-  char logpath[LOG_BUFSIZE];
-  char port[128] = {'\0'};
-  char module[128];
-  char cstring[IRC_BUFSIZE];
-
-  snprintf(module, sizeof(module), "%s.la", Database.driver);
-
-  if(Database.port != 0)
-    snprintf(port, 127, "%d", Database.port);
+  snprintf(buf, len, "host='%s' user='%s' password='%s' dbname='%s' port=%d",
+    Database.hostname, Database.username, Database.password,
+    Database.dbname, Database.port);
+}
 
-  database = load_module(module);
+/* db_connect_work()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - runs on a startup worker, connects the driver and has it
+ *                prepare its statements, nothing but the driver is touched
+ */
+static void
+db_connect_work(void *param)
+{
+  db_connect_ok = database->connect(db_connect_cstring);
+}
 
-  if(database == NULL)
-  {
-    ilog(L_CRIT, "Failed to load a database module, continuing would be unwise.");
-    services_die("Failed to load a database module, continuing would be unwise.", FALSE);
-  }
+static void
+db_connect_done(void *param)
+{
+  char logpath[LOG_BUFSIZE];
 
-  snprintf(cstring, sizeof(cstring), "host='%s' user='%s' password='%s' dbname='%s' port=%d",
-    Database.hostname, Database.username, Database.password,
-    Database.dbname, Database.port);
+  memset(db_connect_cstring, 0, sizeof(db_connect_cstring));
 
-  if(!database->connect(cstring))
+  if(!db_connect_ok)
   {
     ilog(L_CRIT, "%s module could not connect to %s database on %s as %s %s a password",
       Database.driver, Database.dbname, Database.hostname, Database.username,
@@ -81,15 +153,42 @@ init_db()
     exit(-1);
   }
 
+  db_journal_replay();
+
   snprintf(logpath, LOG_BUFSIZE, "%s/%s", LOGDIR, Logging.sqllog);
-  if(db_log_fb == NULL)
+  if(db_log_stream == -1)
   {
-    if(Logging.sqllog[0] != '\0' && (db_log_fb = fbopen(logpath, "r")) != NULL)
-    {
-      fbclose(db_log_fb);
-      db_log_fb = fbopen(logpath, "a");
-    }
+    /* only log queries if the file has been created */
+    if(Logging.sqllog[0] != '\0' && access(logpath, F_OK) == 0)
+      db_log_stream = log_stream_open(logpath);
+  }
+}
+
+/* init_db()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - the driver is loaded and starts connecting in the
+ *                background, db_load_driver() waits for it
+ */
+void
+init_db()
+{
+  char module[128];
+
+  snprintf(module, sizeof(module), "%s.la", Database.driver);
+
+  database = load_module(module);
+
+  if(database == NULL)
+  {
+    ilog(L_CRIT, "Failed to load a database module, continuing would be unwise.");
+    services_die("Failed to load a database module, continuing would be unwise.", FALSE);
   }
+
+  db_connect_string(db_connect_cstring, sizeof(db_connect_cstring));
+  startup_task_start(&db_connect_task, "Database connection", db_connect_work,
+      db_connect_done, NULL);
 }
 
 void
@@ -110,9 +209,15 @@ cleanup_db()
   snprintf(module, sizeof(module), "%s.la", Database.driver);
 
   mod = find_module(module, 0);
+  db_batch_flush(NULL);
+
   if(mod != NULL)
     unload_module(mod);
-  fbclose(db_log_fb);
+  if(db_log_stream != -1)
+    log_stream_close(db_log_stream);
+  db_log_stream = -1;
+  if(db_journal_fb != NULL)
+    fbclose(db_journal_fb);
 }
 
 void
@@ -120,87 +225,531 @@ db_reopen_log()
 {
   char logpath[LOG_BUFSIZE+1];
 
-  if(db_log_fb != NULL)
-  {
-    fbclose(db_log_fb);
-    db_log_fb = NULL;
-  }
-
   snprintf(logpath, LOG_BUFSIZE, "%s/%s", LOGDIR, Logging.sqllog);
-  if(db_log_fb == NULL)
+  if(Logging.sqllog[0] == '\0' || access(logpath, F_OK) != 0)
   {
-    if(Logging.sqllog[0] != '\0' && (db_log_fb = fbopen(logpath, "r")) != NULL)
-    {
-      fbclose(db_log_fb);
-      db_log_fb = fbopen(logpath, "a");
-    }
+    if(db_log_stream != -1)
+      log_stream_close(db_log_stream);
+    db_log_stream = -1;
   }
+  else if(db_log_stream == -1)
+    db_log_stream = log_stream_open(logpath);
+  else
+    log_stream_reopen(db_log_stream, logpath);
 }
 
 void
 db_log(const char *format, ...)
 {
-  char *buf;
-  char lbuf[LOG_BUFSIZE];
   va_list args;
-  size_t bytes;
 
-  if(db_log_fb == NULL)
+  if(db_log_stream == -1)
     return;
 
   va_start(args, format);
-  vasprintf(&buf, format, args);
+  log_stream_vprintf(db_log_stream, format, args);
   va_end(args);
+}
+
+int
+db_log_enabled()
+{
+  return db_log_stream != -1;
+}
+
+/* db_read_upgrade()
+ *
+ * inputs       - driver name as in the sql/ file names, schema version
+ * output       - the script that brings the schema to that version, NULL
+ *                if there is none
+ * side effects - none, the caller frees the script with MyFree()
+ */
+char *
+db_read_upgrade(const char *driver, int version)
+{
+  char path[PATH_MAX];
+  struct stat st;
+  char *sql;
+  ssize_t len;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/%s/%s-upgrade-%03d.sql", DATADIR, PACKAGE,
+      driver, version);
+
+  if((fd = open(path, O_RDONLY)) == -1)
+  {
+    if(errno != ENOENT)
+      ilog(L_CRIT, "Unable to read schema upgrade %s: %s", path,
+          strerror(errno));
+    return NULL;
+  }
+
+  if(fstat(fd, &st) == -1)
+  {
+    close(fd);
+    return NULL;
+  }
 
-  bytes = snprintf(lbuf, sizeof(lbuf), "[%s] %s\n", smalldate(CurrentTime), buf);
-  MyFree(buf);
+  sql = MyMalloc(st.st_size + 1);
+  len = read(fd, sql, st.st_size);
+  close(fd);
 
-  fbputs(lbuf, db_log_fb, bytes);
+  if(len != st.st_size)
+  {
+    ilog(L_CRIT, "Short read on schema upgrade %s", path);
+    MyFree(sql);
+    return NULL;
+  }
+
+  return sql;
 }
 
 void
 db_load_driver()
 {
+  startup_task_wait(&db_connect_task);
+
   eventAdd("Expire sent mail", dbmail_expire_sentmail, NULL, 60); 
+  eventAdd("Flush batched updates", db_batch_flush, NULL, DB_BATCH_TIME);
+  init_nickname_access();
 
   execute_callback(on_db_init_cb);
 }
 
-void
-db_try_reconnect()
+/* db_connection_lost()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - marks the database as down and starts reconnecting to it
+ *                in the background
+ */
+static void
+db_connection_lost()
 {
-  int num_attempts = 0;
-  char cstring[IRC_BUFSIZE];
+  if(db_down)
+    return;
 
   ilog(L_NOTICE, "Database connection lost! Attempting reconnect.");
-  send_queued_all();
 
-  snprintf(cstring, sizeof(cstring), "host='%s' user='%s' password='%s' dbname='%s'",
-    Database.hostname, Database.username, Database.password,
-    Database.dbname);
+  db_down = TRUE;
+  db_reconnecting = FALSE;
+  db_reconnect_attempts = 0;
+  db_lost_time = CurrentTime;
+  db_next_attempt = CurrentTime;
+
+  eventAdd("Database reconnect", db_reconnect_event, NULL, 1);
+}
+
+static void
+db_reconnect_event(void *param)
+{
+  char cstring[IRC_BUFSIZE];
+  dlink_node *ptr = NULL;
+  int ret;
+
+  if(!db_reconnecting)
+  {
+    if(CurrentTime < db_next_attempt)
+      return;
+
+    db_reconnecting = TRUE;
+    db_reconnect_attempts++;
+  }
 
-  while(num_attempts++ < 30)
+  if(database->reconnect_poll != NULL)
+    ret = database->reconnect_poll();
+  else
   {
-    if(database->connect(cstring))
+    db_connect_string(cstring, sizeof(cstring));
+    ret = database->connect(cstring) ? 1 : -1;
+  }
+
+  if(ret == 0)
+    return;
+
+  db_reconnecting = FALSE;
+
+  if(ret < 0)
+  {
+    ilog(L_NOTICE, "Database connection still down. Reconnect attempt %d",
+        db_reconnect_attempts);
+    db_next_attempt = CurrentTime + DB_RECONNECT_TIME;
+    return;
+  }
+
+  DLINK_FOREACH(ptr, dynamic_queries.head)
+  {
+    struct QueryItem *q = (struct QueryItem *)ptr->data;
+    database->prepare(q->id, q->query);
+  }
+
+  eventDelete(db_reconnect_event, NULL);
+  db_down = FALSE;
+
+  ilog(L_NOTICE, "Database connection restored after %d seconds",
+      (int)(CurrentTime - db_lost_time));
+
+  db_journal_replay();
+}
+
+/* db_check_connection()
+ *
+ * inputs       - none
+ * output       - TRUE if the database can be used right now
+ * side effects - starts a reconnect if the connection has just gone away
+ */
+static int
+db_check_connection()
+{
+  if(db_down)
+    return FALSE;
+
+  if(database->is_connected())
+    return TRUE;
+
+  db_connection_lost();
+  return FALSE;
+}
+
+int
+db_is_connected()
+{
+  return !db_down && database->is_connected();
+}
+
+/*
+ * Journal lines are tab separated: query id, format, then one field per
+ * parameter.  Tabs, newlines and backslashes in values are escaped and
+ * \N stands for NULL.
+ */
+static void
+journal_escape(char *buf, size_t len, const char *value)
+{
+  char *end = buf + len - 3;
+
+  for(; *value != '\0' && buf < end; value++)
+  {
+    switch(*value)
+    {
+      case '\t':
+        *buf++ = '\\';
+        *buf++ = 't';
+        break;
+      case '\n':
+        *buf++ = '\\';
+        *buf++ = 'n';
+        break;
+      case '\\':
+        *buf++ = '\\';
+        *buf++ = '\\';
+        break;
+      default:
+        *buf++ = *value;
+        break;
+    }
+  }
+  *buf = '\0';
+}
+
+static void
+journal_unescape(char *value)
+{
+  char *dst = value;
+
+  for(; *value != '\0'; value++)
+  {
+    if(*value == '\\' && value[1] != '\0')
     {
-      dlink_node *ptr = NULL;
+      value++;
+      if(*value == 't')
+        *dst++ = '\t';
+      else if(*value == 'n')
+        *dst++ = '\n';
+      else
+        *dst++ = *value;
+    }
+    else
+      *dst++ = *value;
+  }
+  *dst = '\0';
+}
+
+/* db_journal_safe()
+ *
+ * inputs       - query id
+ * output       - TRUE if running the query twice does no harm
+ * side effects - none
+ *
+ * Only UPDATEs that set columns by key and DELETEs by key are listed, a
+ * query added to db_queries is not journaled until it is added here.
+ */
+static int
+db_journal_safe(int query_id)
+{
+  switch(query_id)
+  {
+    case DELETE_NICK:
+    case DELETE_ACCOUNT:
+    case SET_CHAN_LEVEL:
+    case DELETE_CHAN_ACCESS:
+    case DELETE_CHAN:
+    case SET_NICK_PASSWORD:
+    case SET_NICK_SALT:
+    case SET_NICK_URL:
+    case SET_NICK_EMAIL:
+    case SET_NICK_CLOAK:
+    case SET_NICK_LAST_QUIT:
+    case SET_NICK_LAST_HOST:
+    case SET_NICK_LAST_REALNAME:
+    case SET_NICK_LANGUAGE:
+    case SET_NICK_LAST_QUITTIME:
+    case SET_NICK_LAST_SEEN:
+    case SET_NICK_CLOAKON:
+    case SET_NICK_SECURE:
+    case SET_NICK_ENFORCE:
+    case SET_NICK_ADMIN:
+    case SET_NICK_PRIVATE:
+    case DELETE_NICKACCESS:
+    case DELETE_ALL_NICKACCESS:
+    case SET_CHAN_LAST_USED:
+    case SET_CHAN_DESC:
+    case SET_CHAN_URL:
+    case SET_CHAN_EMAIL:
+    case SET_CHAN_ENTRYMSG:
+    case SET_CHAN_TOPIC:
+    case SET_CHAN_MLOCK:
+    case SET_CHAN_PRIVATE:
+    case SET_CHAN_RESTRICTED:
+    case SET_CHAN_TOPICLOCK:
+    case SET_CHAN_VERBOSE:
+    case SET_CHAN_AUTOLIMIT:
+    case SET_CHAN_EXPIREBANS:
+    case SET_CHAN_FLOODSERV:
+    case SET_CHAN_AUTOOP:
+    case SET_CHAN_AUTOVOICE:
+    case SET_CHAN_AUTOSAVE:
+    case SET_CHAN_LEAVEOPS:
+    case DELETE_FORBID:
+    case DELETE_CHAN_FORBID:
+    case DELETE_AKICK_MASK:
+    case DELETE_AKICK_ACCOUNT:
+    case SET_NICK_MASTER:
+    case DELETE_AKILL:
+    case DELETE_EXPIRED_SENT_MAIL:
+    case SAVE_NICK:
+    case DELETE_NICKCERT:
+    case DELETE_ALL_NICKCERT:
+    case DELETE_JUPE_NAME:
+    case SET_EXPIREBANS_LIFETIME:
+    case DELETE_GROUP:
+    case SET_GROUP_URL:
+    case SET_GROUP_DESC:
+    case SET_GROUP_EMAIL:
+    case SET_GROUP_PRIVATE:
+    case DELETE_GROUPACCESS:
+    case DELETE_AJOIN:
+    case BATCH_NICK_LAST_SEEN:
+    case BATCH_ACCOUNT_LAST:
+    case BATCH_CHAN_LAST_USED:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+/* db_journal_write()
+ *
+ * inputs       - query id, parameter format and list
+ * output       - TRUE if the write was journaled
+ * side effects - the write is appended to the journal file and synced
+ */
+static int
+db_journal_write(int query_id, const char *format, dlink_list *args)
+{
+  char line[JOURNAL_BUFSIZE];
+  char field[JOURNAL_BUFSIZE];
+  dlink_node *ptr;
+  size_t len, i = 0;
+
+  /* dynamic query ids are not stable across restarts */
+  if(query_id >= QUERY_COUNT || !db_journal_safe(query_id))
+    return FALSE;
+
+  if(db_journal_fb == NULL && (db_journal_fb = fbopen(JPATH, "a")) == NULL)
+  {
+    ilog(L_ERROR, "Could not open database journal %s: %s", JPATH,
+        strerror(errno));
+    return FALSE;
+  }
+
+  len = snprintf(line, sizeof(line), "%d\t%s", query_id, format);
 
-      DLINK_FOREACH(ptr, dynamic_queries.head)
+  DLINK_FOREACH(ptr, args->head)
+  {
+    void *value = ptr->data;
+
+    if(value == NULL)
+      strlcpy(field, "\\N", sizeof(field));
+    else if(format[i] == 'i')
+      snprintf(field, sizeof(field), "%d", *(int *)value);
+    else if(format[i] == 'b')
+      strlcpy(field, *(char *)value ? "1" : "0", sizeof(field));
+    else
+      journal_escape(field, sizeof(field), value);
+    i++;
+
+    len += snprintf(line + len, sizeof(line) - len, "\t%s", field);
+    if(len >= sizeof(line) - 1)
+    {
+      ilog(L_ERROR, "Database journal entry for query %d too long", query_id);
+      return FALSE;
+    }
+  }
+
+  line[len++] = '\n';
+  line[len] = '\0';
+
+  if(fbputs(line, db_journal_fb, len) != (int)len ||
+      fsync(db_journal_fb->F.fd) != 0)
+  {
+    ilog(L_ERROR, "Could not write database journal %s: %s", JPATH,
+        strerror(errno));
+    return FALSE;
+  }
+
+  db_log("Journaled query %d", query_id);
+  return TRUE;
+}
+
+/* replays one journal line, returns FALSE if it could not be run */
+static int
+db_journal_run(char *line)
+{
+  dlink_list args = { 0 };
+  dlink_node *ptr, *nptr;
+  char *field, *format, *p;
+  int query_id, ret;
+  size_t i = 0;
+
+  if((p = strchr(line, '\n')) != NULL)
+    *p = '\0';
+
+  if((field = strsep(&line, "\t")) == NULL)
+    return TRUE;
+  query_id = atoi(field);
+
+  if((format = strsep(&line, "\t")) == NULL)
+    return TRUE;
+
+  while((field = strsep(&line, "\t")) != NULL && format[i] != '\0')
+  {
+    void *value = NULL;
+
+    if(strcmp(field, "\\N") != 0)
+    {
+      if(format[i] == 'i')
       {
-        struct QueryItem *q = (struct QueryItem *)ptr->data;
-        database->prepare(q->id, q->query);
+        value = MyMalloc(sizeof(int));
+        *(int *)value = atoi(field);
+      }
+      else if(format[i] == 'b')
+      {
+        value = MyMalloc(sizeof(char));
+        *(char *)value = *field == '1';
+      }
+      else
+      {
+        journal_unescape(field);
+        DupString(p, field);
+        value = p;
       }
-      ilog(L_NOTICE, "Database connection restored after %d seconds",
-          num_attempts * 5);
-      return;
     }
-    sleep(5);
-    ilog(L_NOTICE, "Database connection still down. Reconnect attempt %d",
-        num_attempts);
-    send_queued_all();
+    dlinkAddTail(value, make_dlink_node(), &args);
+    i++;
+  }
+
+  if(i == strlen(format))
+    ret = database->execute_nonquery(query_id, format, &args);
+  else
+  {
+    ilog(L_ERROR, "Skipping malformed database journal entry for query %d",
+        query_id);
+    ret = 0;
+  }
+
+  DLINK_FOREACH_SAFE(ptr, nptr, args.head)
+  {
+    MyFree(ptr->data);
+    dlinkDelete(ptr, &args);
+    free_dlink_node(ptr);
+  }
+
+  return ret != -1 || database->is_connected();
+}
+
+/* db_journal_replay()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - runs every journaled write against the database in the
+ *                order it was made.  Whatever could not be run because
+ *                the connection went away again is kept for next time.
+ */
+static void
+db_journal_replay()
+{
+  char line[JOURNAL_BUFSIZE];
+  char tmppath[PATH_MAX];
+  FBFILE *in, *out = NULL;
+  int count = 0;
+
+  if(db_journal_fb != NULL)
+  {
+    fbclose(db_journal_fb);
+    db_journal_fb = NULL;
+  }
+
+  if((in = fbopen(JPATH, "r")) == NULL)
+    return;
+
+  snprintf(tmppath, sizeof(tmppath), "%s.tmp", JPATH);
+
+  while(fbgets(line, sizeof(line), in) != NULL)
+  {
+    if(out == NULL)
+    {
+      char copy[JOURNAL_BUFSIZE];
+
+      strlcpy(copy, line, sizeof(copy));
+      if(db_journal_run(copy))
+      {
+        count++;
+        continue;
+      }
+
+      if((out = fbopen(tmppath, "w")) == NULL)
+        break;
+    }
+
+    fbputs(line, out, strlen(line));
+  }
+
+  fbclose(in);
+
+  if(out != NULL)
+  {
+    fsync(out->F.fd);
+    fbclose(out);
+    rename(tmppath, JPATH);
+    ilog(L_NOTICE, "Replayed %d journaled database writes, connection lost "
+        "again before the rest", count);
+    db_connection_lost();
+    return;
   }
-  ilog(L_ERROR, "Database reconnect failed");
-  services_die("Could not reconnect to database.", 0);
+
+  unlink(JPATH);
+  if(count > 0)
+    ilog(L_NOTICE, "Replayed %d journaled database writes", count);
 }
 
 int
@@ -260,10 +809,7 @@ db_execute_scalar(int query_id, int *error, const char *format, ...)
 
   va_end(args);
 
-  if(!database->is_connected())
-    db_try_reconnect();
-
-  result = database->execute_scalar(query_id, error, format, &list);
+  result = db_vexecute_scalar(query_id, error, format, &list);
 
   db_execute_list_free(&list);
 
@@ -273,8 +819,11 @@ db_execute_scalar(int query_id, int *error, const char *format, ...)
 char *
 db_vexecute_scalar(int query_id, int *error, const char *format, dlink_list *list)
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  if(!db_check_connection())
+  {
+    *error = -1;
+    return NULL;
+  }
 
   return database->execute_scalar(query_id, error, format, list);
 }
@@ -295,10 +844,7 @@ db_execute(int query_id, int *error, const char *format, ...)
 
   va_end(args);
 
-  if(!database->is_connected())
-    db_try_reconnect();
-
-  results = database->execute(query_id, error, format, &list);
+  results = db_vexecute(query_id, error, format, &list);
 
   db_execute_list_free(&list);
 
@@ -308,8 +854,11 @@ db_execute(int query_id, int *error, const char *format, ...)
 result_set_t *
 db_vexecute(int query_id, int *error, const char *format, dlink_list *list)
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  if(!db_check_connection())
+  {
+    *error = -1;
+    return NULL;
+  }
 
   return database->execute(query_id, error, format, list);
 }
@@ -330,30 +879,46 @@ db_execute_nonquery(int query_id, const char *format, ...)
 
   va_end(args);
 
-  if(!database->is_connected())
-    db_try_reconnect();
-
-  num_rows = database->execute_nonquery(query_id, format, &list);
+  num_rows = db_vexecute_nonquery(query_id, format, &list);
 
   db_execute_list_free(&list);
 
   return num_rows;
 }
 
+/*
+ * Writes outside of a transaction that cannot reach the database are
+ * journaled and reported as having changed one row, so the caller carries
+ * on as if it had gone through.  Inside a transaction, and for writes
+ * that are not safe to replay, they just fail.
+ */
 int
 db_vexecute_nonquery(int query_id, const char *format, dlink_list *list)
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  int num_rows = -1;
+
+  if(db_check_connection())
+  {
+    num_rows = database->execute_nonquery(query_id, format, list);
+    if(num_rows != -1 || database->is_connected())
+      return num_rows;
+
+    db_connection_lost();
+  }
+
+  if(db_in_transaction)
+    return -1;
 
-  return database->execute_nonquery(query_id, format, list);
+  return db_journal_write(query_id, format, list) ? 1 : -1;
 }
 
 int
 db_begin_transaction()
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  db_in_transaction = TRUE;
+
+  if(!db_check_connection())
+    return FALSE;
 
   return database->begin_transaction();
 }
@@ -361,8 +926,10 @@ db_begin_transaction()
 int
 db_commit_transaction()
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  db_in_transaction = FALSE;
+
+  if(!db_check_connection())
+    return FALSE;
 
   return database->commit_transaction();
 }
@@ -370,23 +937,215 @@ db_commit_transaction()
 int
 db_rollback_transaction()
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  db_in_transaction = FALSE;
+
+  if(!db_check_connection())
+    return FALSE;
 
   return database->rollback_transaction();
 }
 
+void
+db_pipeline_init(struct DBPipeline *pipeline)
+{
+  memset(pipeline, 0, sizeof(struct DBPipeline));
+}
+
+static int
+db_pipeline_add(struct DBPipeline *pipeline, int type, int query_id,
+    const char *format, va_list args)
+{
+  struct DBPipelineStep *step;
+  size_t i, len = strlen(format);
+
+  assert(pipeline->count < DB_PIPELINE_MAX);
+
+  step = &pipeline->steps[pipeline->count];
+  step->query = query_id;
+  step->type = type;
+  step->format = format;
+  step->result = NULL;
+  step->rows = -1;
+  step->error = -1;
+
+  for(i = 0; i < len; ++i)
+    dlinkAddTail(va_arg(args, void *), make_dlink_node(), &step->args);
+
+  return pipeline->count++;
+}
+
+/* db_pipeline_execute()
+ *
+ * inputs       - pipeline, query id, format and parameters
+ * output       - the step number, for db_pipeline_result()
+ * side effects - a query whose rows are wanted is queued
+ */
+int
+db_pipeline_execute(struct DBPipeline *pipeline, int query_id,
+    const char *format, ...)
+{
+  va_list args;
+  int step;
+
+  va_start(args, format);
+  step = db_pipeline_add(pipeline, QUERY, query_id, format, args);
+  va_end(args);
+
+  return step;
+}
+
+/* db_pipeline_nonquery()
+ *
+ * inputs       - pipeline, query id, format and parameters
+ * output       - the step number, its rows field holds the rows changed
+ * side effects - a write is queued
+ */
+int
+db_pipeline_nonquery(struct DBPipeline *pipeline, int query_id,
+    const char *format, ...)
+{
+  va_list args;
+  int step;
+
+  va_start(args, format);
+  step = db_pipeline_add(pipeline, EXECUTE, query_id, format, args);
+  va_end(args);
+
+  return step;
+}
+
+/* db_pipeline_run()
+ *
+ * inputs       - pipeline
+ * output       - TRUE if every step succeeded
+ * side effects - the steps are run in order, by the driver in one go if it
+ *                can, otherwise one by one.  Writes are never journaled,
+ *                a pipeline fails while the database is down.
+ */
+int
+db_pipeline_run(struct DBPipeline *pipeline)
+{
+  int i, ok = TRUE;
+  int own_transaction;
+
+  if(!db_check_connection())
+    return FALSE;
+
+  if(database->execute_pipeline != NULL)
+    ok = database->execute_pipeline(pipeline);
+  else
+  {
+    own_transaction = !db_in_transaction && pipeline->count > 1;
+    if(own_transaction && !database->begin_transaction())
+      ok = FALSE;
+
+    for(i = 0; ok && i < pipeline->count; i++)
+    {
+      struct DBPipelineStep *step = &pipeline->steps[i];
+
+      if(step->type == QUERY)
+      {
+        step->result = database->execute(step->query, &step->error,
+            step->format, &step->args);
+        if(step->result == NULL && step->error == 0)
+          step->error = -1;
+      }
+      else
+      {
+        step->rows = database->execute_nonquery(step->query, step->format,
+            &step->args);
+        step->error = step->rows == -1 ? -1 : 0;
+      }
+
+      ok = step->error == 0;
+    }
+
+    if(own_transaction)
+    {
+      if(ok)
+        ok = database->commit_transaction();
+      else
+        database->rollback_transaction();
+    }
+  }
+
+  if(!ok && !database->is_connected())
+    db_connection_lost();
+
+  return ok;
+}
+
+/* db_pipeline_result()
+ *
+ * inputs       - pipeline, step number of a query
+ * output       - its result set, NULL if it failed
+ * side effects - the caller now owns the result and frees it with
+ *                db_free_result()
+ */
+result_set_t *
+db_pipeline_result(struct DBPipeline *pipeline, int step)
+{
+  result_set_t *result = pipeline->steps[step].result;
+
+  pipeline->steps[step].result = NULL;
+  return result;
+}
+
+void
+db_pipeline_free(struct DBPipeline *pipeline)
+{
+  int i;
+
+  for(i = 0; i < pipeline->count; i++)
+  {
+    struct DBPipelineStep *step = &pipeline->steps[i];
+
+    if(step->result != NULL)
+      database->free_result(step->result);
+    step->result = NULL;
+    db_execute_list_free(&step->args);
+  }
+}
+
 void
 db_free_result(result_set_t *result)
 {
   database->free_result(result);
 }
 
+/* db_row_int()
+ *
+ * inputs       - row, column
+ * output       - the column as an integer, 0 if it is NULL
+ * side effects - none
+ */
+int
+db_row_int(const row_t *row, int col)
+{
+  const char *p = row->cols[col];
+  int neg = FALSE;
+  int value = 0;
+
+  if(p == NULL)
+    return 0;
+
+  if(*p == '-')
+  {
+    neg = TRUE;
+    p++;
+  }
+
+  for(; *p >= '0' && *p <= '9'; p++)
+    value = value * 10 + (*p - '0');
+
+  return neg ? -value : value;
+}
+
 int64_t
 db_nextid(const char *table, const char *column)
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  if(!db_check_connection())
+    return -1;
 
   return database->next_id(table, column);
 }
@@ -394,12 +1153,227 @@ db_nextid(const char *table, const char *column)
 int64_t
 db_insertid(const char *table, const char *column)
 {
-  if(!database->is_connected())
-    db_try_reconnect();
+  if(!db_check_connection())
+    return -1;
 
   return database->insert_id(table, column);
 }
 
+/* db_batch_set()
+ *
+ * inputs       - batch table, row id, column and new value
+ * output       - none
+ * side effects - value is queued for the next flush, replacing any value
+ *                already queued for the same column of that row
+ */
+void
+db_batch_set(int table, unsigned int id, int column, const char *value)
+{
+  dlink_list *bucket = &batch_hash[table][id & (DB_BATCH_HASHSIZE - 1)];
+  struct BatchRow *row = NULL;
+  dlink_node *ptr;
+
+  assert(table >= 0 && table < BATCH_TABLE_COUNT);
+  assert(column >= 0 && column < (int)strlen(batch_tables[table].types));
+
+  DLINK_FOREACH(ptr, bucket->head)
+  {
+    struct BatchRow *tmp = ptr->data;
+
+    if(tmp->id == id)
+    {
+      row = tmp;
+      break;
+    }
+  }
+
+  if(row == NULL)
+  {
+    row = MyMalloc(sizeof(struct BatchRow));
+    row->id = id;
+    dlinkAdd(row, &row->node, bucket);
+    dlinkAddTail(row, &row->pending, &batch_pending[table]);
+  }
+
+  MyFree(row->values[column]);
+  if(value != NULL)
+    DupString(row->values[column], value);
+  else
+    row->values[column] = NULL;
+}
+
+void
+db_batch_set_int(int table, unsigned int id, int column, int value)
+{
+  char buf[32];
+
+  snprintf(buf, sizeof(buf), "%d", value);
+  db_batch_set(table, id, column, buf);
+}
+
+/* appends value to a postgres style array literal being built in buf */
+static void
+batch_array_add(char **buf, size_t *len, size_t *size, const char *value,
+    int quote)
+{
+  /* separator, quotes, escapes, plus room for the closing brace */
+  size_t need = (value != NULL ? strlen(value) * 2 : 4) + 6;
+  const char *p;
+  char *out;
+
+  if(*len + need > *size)
+  {
+    while(*len + need > *size)
+      *size *= 2;
+    *buf = MyRealloc(*buf, *size);
+  }
+
+  out = *buf + *len;
+  if((*buf)[*len - 1] != '{')
+    *out++ = ',';
+
+  if(value == NULL)
+    out += strlcpy(out, "NULL", 5);
+  else if(!quote)
+    out += strlcpy(out, value, need);
+  else
+  {
+    *out++ = '"';
+    for(p = value; *p != '\0'; p++)
+    {
+      if(*p == '"' || *p == '\\')
+        *out++ = '\\';
+      *out++ = *p;
+    }
+    *out++ = '"';
+  }
+
+  *out = '\0';
+  *len = out - *buf;
+}
+
+/*
+ * writes out up to DB_BATCH_MAXROWS pending rows of one table starting at
+ * *start, which is moved on to the first row not written
+ */
+static int
+batch_flush_table(int table, dlink_node **start)
+{
+  const char *types = batch_tables[table].types;
+  size_t ncols = strlen(types);
+  char *arrays[BATCH_MAX_COLUMNS + 1];
+  size_t lens[BATCH_MAX_COLUMNS + 1], sizes[BATCH_MAX_COLUMNS + 1];
+  char format[BATCH_MAX_COLUMNS + 2];
+  dlink_list args = { 0 };
+  dlink_node *ptr;
+  size_t i;
+  int count = 0, ret;
+  char idbuf[32];
+
+  for(i = 0; i <= ncols; i++)
+  {
+    sizes[i] = 1024;
+    arrays[i] = MyMalloc(sizes[i]);
+    strlcpy(arrays[i], "{", sizes[i]);
+    lens[i] = 1;
+    format[i] = 's';
+  }
+  format[i] = '\0';
+
+  for(ptr = *start; ptr != NULL && count < DB_BATCH_MAXROWS;
+      ptr = ptr->next, count++)
+  {
+    struct BatchRow *row = ptr->data;
+
+    snprintf(idbuf, sizeof(idbuf), "%u", row->id);
+    batch_array_add(&arrays[0], &lens[0], &sizes[0], idbuf, FALSE);
+
+    for(i = 0; i < ncols; i++)
+      batch_array_add(&arrays[i + 1], &lens[i + 1], &sizes[i + 1],
+          row->values[i], types[i] == 's');
+  }
+  *start = ptr;
+
+  for(i = 0; i <= ncols; i++)
+  {
+    strlcat(arrays[i], "}", sizes[i]);
+    dlinkAddTail(arrays[i], make_dlink_node(), &args);
+  }
+
+  ret = database->execute_nonquery(batch_tables[table].query, format, &args);
+
+  DLINK_FOREACH(ptr, args.head)
+    MyFree(ptr->data);
+  db_execute_list_free(&args);
+
+  return ret;
+}
+
+static void
+batch_forget_rows(int table)
+{
+  dlink_node *ptr, *next;
+
+  DLINK_FOREACH_SAFE(ptr, next, batch_pending[table].head)
+  {
+    struct BatchRow *row = ptr->data;
+    int i;
+
+    dlinkDelete(&row->pending, &batch_pending[table]);
+    dlinkDelete(&row->node,
+        &batch_hash[table][row->id & (DB_BATCH_HASHSIZE - 1)]);
+    for(i = 0; i < BATCH_MAX_COLUMNS; i++)
+      MyFree(row->values[i]);
+    MyFree(row);
+  }
+}
+
+/* db_batch_flush()
+ *
+ * inputs       - unused
+ * output       - none
+ * side effects - all queued updates are written to the database in one
+ *                transaction.  If that fails they stay queued and are
+ *                tried again on the next flush.
+ */
+void
+db_batch_flush(void *param)
+{
+  dlink_node *start;
+  int table;
+
+  for(table = 0; table < BATCH_TABLE_COUNT; table++)
+    if(dlink_list_length(&batch_pending[table]) > 0)
+      break;
+
+  if(table == BATCH_TABLE_COUNT || !db_check_connection())
+    return;
+
+  if(!database->begin_transaction())
+    return;
+
+  /* rows are only dropped from the queue once the commit went through */
+  for(table = 0; table < BATCH_TABLE_COUNT; table++)
+  {
+    start = batch_pending[table].head;
+
+    while(start != NULL)
+    {
+      if(batch_flush_table(table, &start) == -1)
+      {
+        database->rollback_transaction();
+        return;
+      }
+    }
+  }
+
+  if(!database->commit_transaction())
+    return;
+
+  for(table = 0; table < BATCH_TABLE_COUNT; table++)
+    batch_forget_rows(table);
+}
+
 int
 db_string_list(unsigned int query, dlink_list *list)
 {
@@ -421,10 +1395,9 @@ db_string_list(unsigned int query, dlink_list *list)
 
   for(i = 0; i < results->row_count; ++i)
   {
-    char *tmp;
     row_t *row = &results->rows[i];
-    DupString(tmp, row->cols[0]);
-    dlinkAdd(tmp, make_dlink_node(), list);
+    dlinkAdd(arena_strdup(request_arena, row->cols[0]), make_dlink_node(),
+        list);
   }
 
   db_free_result(results);
@@ -453,10 +1426,93 @@ db_string_list_by_id(unsigned int query, dlink_list *list, unsigned int id)
 
   for(i = 0; i < results->row_count; ++i)
   {
-    char *tmp;
     row_t *row = &results->rows[i];
-    DupString(tmp, row->cols[0]);
-    dlinkAdd(tmp, make_dlink_node(), list);
+    dlinkAdd(arena_strdup(request_arena, row->cols[0]), make_dlink_node(),
+        list);
+  }
+
+  db_free_result(results);
+
+  return dlink_list_length(list);
+}
+
+/* db_like_pattern()
+ *
+ * inputs       - IRC style mask
+ * output       - the mask as a LIKE pattern, in the request arena
+ * side effects - * and ? become % and _, the LIKE metacharacters are
+ *                escaped with \ and only ASCII letters are lowercased,
+ *                like lower() on the column does, ToLower() would also
+ *                fold [ into {
+ */
+static char *
+db_like_pattern(const char *mask)
+{
+  char *pattern = arena_alloc(request_arena, strlen(mask) * 2 + 1);
+  char *p = pattern;
+
+  for(; *mask != '\0'; mask++)
+  {
+    switch(*mask)
+    {
+      case '*':
+        *p++ = '%';
+        break;
+      case '?':
+        *p++ = '_';
+        break;
+      case '%':
+      case '_':
+      case '\\':
+        *p++ = '\\';
+        *p++ = *mask;
+        break;
+      default:
+        *p++ = tolower((unsigned char)*mask);
+        break;
+    }
+  }
+  *p = '\0';
+
+  return pattern;
+}
+
+/* db_string_list_match()
+ *
+ * inputs       - one of the *_MATCH queries, list, mask, name to carry
+ *                on after or NULL to start at the beginning, most names
+ *                to return
+ * output       - number of names added to the list
+ * side effects - the database filters, sorts and cuts the list, only the
+ *                rows shown are transferred.  Names are added in order
+ */
+int
+db_string_list_match(unsigned int query, dlink_list *list, const char *mask,
+    const char *after, int limit)
+{
+  int error, i;
+  result_set_t *results;
+  char *pattern = db_like_pattern(mask);
+
+  if(after == NULL)
+    after = "";
+
+  results = db_execute(query, &error, "ssi", pattern, after, &limit);
+
+  if(results == NULL && error != 0)
+  {
+    ilog(L_CRIT, "db_string_list_match: query %d database error %d", query,
+        error);
+    return 0;
+  }
+  else if(results == NULL)
+    return 0;
+
+  for(i = 0; i < results->row_count; ++i)
+  {
+    row_t *row = &results->rows[i];
+    dlinkAddTail(arena_strdup(request_arena, row->cols[0]), make_dlink_node(),
+        list);
   }
 
   db_free_result(results);
@@ -472,10 +1528,9 @@ db_string_list_free(dlink_list *list)
   ilog(L_DEBUG, "Freeing string list %p of length %lu", list,
     dlink_list_length(list));
 
+  /* the strings are in the request arena */
   DLINK_FOREACH_SAFE(ptr, next, list->head)
   {
-    char *tmp = (char *)ptr->data;
-    MyFree(tmp);
     dlinkDelete(ptr, list);
     free_dlink_node(ptr);
   }
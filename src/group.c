@@ -50,14 +50,14 @@ row_to_group(row_t *row)
   Group *group = MyMalloc(sizeof(Group));
   memset(group, 0, sizeof(Group));
 
-  group->id = atoi(row->cols[0]);
+  group->id = db_row_int(row, 0);
   strlcpy(group->name, row->cols[1], sizeof(group->name));
   if(row->cols[2] != NULL)
     DupString(group->desc, row->cols[2]);
   DupString(group->email, row->cols[3]);
   DupString(group->url, row->cols[4]);
-  group->priv = atoi(row->cols[5]);
-  group->reg_time = atoi(row->cols[6]);
+  group->priv = db_row_int(row, 5);
+  group->reg_time = db_row_int(row, 6);
 
   return group;
 }
@@ -114,38 +114,32 @@ group_find(const char *grp)
 int
 group_register(Group *group, Nickname *master)
 {
-  int ret;
-  unsigned int id, flag;
-
-  db_begin_transaction();
+  struct DBPipeline pipeline;
+  int id, ret;
+  unsigned int account, flag;
 
-  ret = db_execute_nonquery(INSERT_GROUP, "ssi", group->name, group->desc,
-          &CurrentTime);
-
-  if(ret == -1)
-    goto failure;
-
-  group->id = db_insertid("group", "id");
-  if(group->id == -1)
-    goto failure;
+  /* with the id known up front both rows go in as one pipeline */
+  if((id = db_nextid("group", "id")) == -1)
+    return FALSE;
 
-  id = nickname_get_id(master);
+  account = nickname_get_id(master);
   flag = GRPMASTER_FLAG;
-  ret = db_execute_nonquery(INSERT_GROUPACCESS, "iii", &id, &group->id, &flag);
 
-  if(ret == -1)
-    goto failure;
+  db_pipeline_init(&pipeline);
+  db_pipeline_nonquery(&pipeline, INSERT_GROUP_ID, "issi", &id, group->name,
+      group->desc, &CurrentTime);
+  db_pipeline_nonquery(&pipeline, INSERT_GROUPACCESS, "iii", &account, &id,
+      &flag);
+  ret = db_pipeline_run(&pipeline);
+  db_pipeline_free(&pipeline);
 
-  if(!db_commit_transaction())
-    goto failure;
+  if(!ret)
+    return FALSE;
 
+  group->id = id;
   group->reg_time = CurrentTime;
 
   return TRUE;
- 
-failure:
-  db_rollback_transaction();
-  return FALSE;
 }
 
 /*
@@ -370,6 +364,18 @@ group_list_regular(dlink_list *list)
   return db_string_list(GET_GROUPS, list);
 }
 
+inline int
+group_list_all_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_GROUPS_OPER_MATCH, list, mask, after, limit);
+}
+
+inline int
+group_list_regular_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_GROUPS_MATCH, list, mask, after, limit);
+}
+
 #if 0
 /*
  * group_save:
@@ -423,10 +429,10 @@ row_to_access_entry(row_t *row)
 {
   struct AccessEntry *entry = MyMalloc(sizeof(struct AccessEntry));
 
-  entry->id = atoi(row->cols[0]);
+  entry->id = db_row_int(row, 0);
   DupString(entry->value, row->cols[1]);
   if(row->cols[2] != NULL)
-    entry->group_id = atoi(row->cols[2]);
+    entry->group_id = db_row_int(row, 2);
   else
     entry->group_id = 0;
 
@@ -635,9 +641,9 @@ static struct InfoList *
 row_to_infochanlist(row_t *row)
 {
   struct InfoList *chan = MyMalloc(sizeof(struct InfoList));
-  chan->id = atoi(row->cols[0]);
+  chan->id = db_row_int(row, 0);
   DupString(chan->name, row->cols[1]);
-  chan->ilevel = atoi(row->cols[2]);
+  chan->ilevel = db_row_int(row, 2);
   switch(chan->ilevel)
   {
     case MASTER_FLAG:
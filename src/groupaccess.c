@@ -41,10 +41,10 @@ row_to_groupaccess(row_t *row)
 {
   struct GroupAccess *access;
   access = MyMalloc(sizeof(struct GroupAccess));
-  access->id = atoi(row->cols[0]);
-  access->group = atoi(row->cols[1]);
-  access->account = atoi(row->cols[2]);
-  access->level = atoi(row->cols[3]);
+  access->id = db_row_int(row, 0);
+  access->group = db_row_int(row, 1);
+  access->account = db_row_int(row, 2);
+  access->level = db_row_int(row, 3);
   return access;
 }
 
@@ -26,6 +26,8 @@
  *  $Id$
  */
 
+#include <stddef.h>
+#include <stdint.h>
 #include "stdinc.h"
 #include "hash.h"
 #include "client.h"
@@ -46,29 +48,57 @@ static struct Service *find_or_add_service(const char *);
 */
 static unsigned int ircd_random_key = 0;
 
-/* The actual hash tables, They MUST be of the same HASHSIZE, variable
- * size tables could be supported but the rehash routine should also
- * rebuild the transformation maps, I kept the tables of equal size 
- * so that I can use one hash function.
+/* The smallest a table is ever allocated or shrunk to */
+#define HASH_MIN_SIZE 64
+
+/* One slot of an open addressing table, the full hash of the key is kept
+ * beside the entry so probes and resizes never have to look at the name
+ * again.  A NULL data pointer marks the slot as free.
  */
-static struct Client *idTable[HASHSIZE];
-static struct Client *clientTable[HASHSIZE];
-static struct Channel *channelTable[HASHSIZE];
-static struct Service *serviceTable[HASHSIZE];
-static struct TorNode *torTable[HASHSIZE];
+struct HashEntry
+{
+  unsigned int hashv;
+  void *data;
+};
+
+/* A growable linear probing table.  The key is always a string embedded
+ * in the stored structure, found at keyoff bytes from its start.
+ */
+struct HashTable
+{
+  struct HashEntry *entries;
+  unsigned int size;    /* always a power of two, 0 until first use */
+  unsigned int count;
+  size_t keyoff;
+};
+
+#define HASH_KEY(t, d) ((const char *)(d) + (t)->keyoff)
+
+static struct HashTable idTable =
+  { NULL, 0, 0, offsetof(struct Client, id) };
+static struct HashTable clientTable =
+  { NULL, 0, 0, offsetof(struct Client, name) };
+static struct HashTable channelTable =
+  { NULL, 0, 0, offsetof(struct Channel, chname) };
+static struct HashTable serviceTable =
+  { NULL, 0, 0, offsetof(struct Service, name) };
+static struct HashTable torTable =
+  { NULL, 0, 0, offsetof(struct TorNode, host) };
+static struct HashTable killHostTable =
+  { NULL, 0, 0, offsetof(struct KillHost, host) };
+static struct HashTable killMaskTable =
+  { NULL, 0, 0, offsetof(struct KillMask, mask) };
 
 /* init_hash()
  *
  * inputs       - NONE
  * output       - NONE
- * side effects - Initialize the maps used by hash
- *                functions and clear the tables
+ * side effects - Seed the hash function, the tables themselves are
+ *                allocated on first use
  */
 void
 init_hash(void)
 {
-  unsigned int i;
-
   /* Default the service/namehost sizes to CLIENT_HEAP_SIZE for now,
    * should be a good close approximation anyway
    * - Dianora
@@ -77,16 +107,6 @@ init_hash(void)
 //  namehost_heap = BlockHeapCreate("namehost", sizeof(struct NameHost), CLIENT_HEAP_SIZE);
 
   ircd_random_key = rand() % 256;  /* better than nothing --adx */
-
-  /* Clear the hash tables first */
-  for (i = 0; i < HASHSIZE; ++i)
-  {
-    idTable[i]          = NULL;
-    clientTable[i]      = NULL;
-    channelTable[i]     = NULL;
-    serviceTable[i]     = NULL;
-    torTable[i]         = NULL;
-  }
 }
 
 /*
@@ -95,6 +115,8 @@ init_hash(void)
  *
  * Here, we use the FNV-1 method, which gives slightly better results
  * than FNV-1a.   -Michael
+ *
+ * Only the fixed HASHSIZE message queue tables still use this.
  */
 unsigned int
 strhash(const char *name)
@@ -114,304 +136,301 @@ strhash(const char *name)
   return (hval >> FNV1_32_BITS) ^ (hval & ((1 << FNV1_32_BITS) -1));
 }
 
-/************************** Externally visible functions ********************/
+/* fold_word()
+ *
+ * Apply ToLower() to eight bytes at once.  ToLower only touches 'A'
+ * through '^' (0x41 - 0x5e), setting 0x20 on each of them; bytes with
+ * the high bit set are left alone.
+ */
+static inline uint64_t
+fold_word(uint64_t x)
+{
+  const uint64_t high = 0x8080808080808080ULL;
+  uint64_t low = x & ~high;
+  uint64_t ge_a = low + 0x3f3f3f3f3f3f3f3fULL;   /* high bit if >= 0x41 */
+  uint64_t gt_caret = low + 0x2121212121212121ULL; /* high bit if >= 0x5f */
+
+  return x | (((ge_a & ~gt_caret & ~x) & high) >> 2);
+}
 
-/* Optimization note: in these functions I supposed that the CSE optimization
- * (Common Subexpression Elimination) does its work decently, this means that
- * I avoided introducing new variables to do the work myself and I did let
- * the optimizer play with more free registers, actual tests proved this
- * solution to be faster than doing things like tmp2=tmp->hnext... and then
- * use tmp2 myself which would have given less freedom to the optimizer.
+#define HASH_MULT 0x9e3779b97f4a7c15ULL
+
+/* hash_string()
+ *
+ * inputs       - name to hash
+ * output       - case insensitive 32 bit hash of name
+ * side effects - none, this consumes the name a word at a time rather
+ *                than a byte at a time like strhash does
+ */
+unsigned int
+hash_string(const char *name)
+{
+  size_t len = strlen(name);
+  uint64_t hval = (ircd_random_key + 1) * HASH_MULT ^ len;
+  uint64_t word;
+
+  for (; len >= sizeof(word); len -= sizeof(word), name += sizeof(word))
+  {
+    memcpy(&word, name, sizeof(word));
+    hval = (hval ^ fold_word(word)) * HASH_MULT;
+    hval ^= hval >> 32;
+  }
+
+  if (len > 0)
+  {
+    word = 0;
+    memcpy(&word, name, len);
+    hval = (hval ^ fold_word(word)) * HASH_MULT;
+    hval ^= hval >> 32;
+  }
+
+  hval ^= hval >> 29;
+  hval *= HASH_MULT;
+  return (unsigned int)(hval ^ (hval >> 32));
+}
+
+/* hash_resize()
+ *
+ * inputs       - table, new size (power of two)
+ * output       - NONE
+ * side effects - moves every entry to a freshly allocated slot array,
+ *                using the stored hash values
  */
+static void
+hash_resize(struct HashTable *table, unsigned int size)
+{
+  struct HashEntry *old = table->entries;
+  unsigned int oldsize = table->size;
+  unsigned int mask = size - 1;
+  unsigned int i, j;
+
+  table->entries = MyMalloc(sizeof(struct HashEntry) * size);
+  table->size = size;
+
+  for (i = 0; i < oldsize; ++i)
+  {
+    if (old[i].data == NULL)
+      continue;
+
+    for (j = old[i].hashv & mask; table->entries[j].data != NULL;
+         j = (j + 1) & mask)
+      ;
+    table->entries[j] = old[i];
+  }
+
+  MyFree(old);
+}
+
+static void
+hash_insert(struct HashTable *table, void *data)
+{
+  unsigned int hashv = hash_string(HASH_KEY(table, data));
+  unsigned int mask, i;
+
+  /* keep the load under 3/4 */
+  if ((table->count + 1) * 4 > table->size * 3)
+    hash_resize(table, table->size ? table->size * 2 : HASH_MIN_SIZE);
+
+  mask = table->size - 1;
+  for (i = hashv & mask; table->entries[i].data != NULL; i = (i + 1) & mask)
+    ;
+
+  table->entries[i].hashv = hashv;
+  table->entries[i].data = data;
+  table->count++;
+}
+
+/* hash_remove()
+ *
+ * inputs       - table, pointer to remove
+ * output       - NONE
+ * side effects - removes data from the table, shifting back the entries
+ *                after it so no probe sequence is broken (no tombstones)
+ */
+static void
+hash_remove(struct HashTable *table, void *data)
+{
+  unsigned int hashv, mask, i, j, home;
+  struct HashEntry *entries = table->entries;
+
+  if (table->count == 0)
+    return;
+
+  hashv = hash_string(HASH_KEY(table, data));
+  mask = table->size - 1;
+
+  for (i = hashv & mask; entries[i].data != data; i = (i + 1) & mask)
+  {
+    if (entries[i].data == NULL)
+      return;
+  }
+
+  for (j = (i + 1) & mask; entries[j].data != NULL; j = (j + 1) & mask)
+  {
+    home = entries[j].hashv & mask;
+
+    /* leave it if its home slot lies cyclically within (i, j] */
+    if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+      continue;
+
+    entries[i] = entries[j];
+    i = j;
+  }
+
+  entries[i].hashv = 0;
+  entries[i].data = NULL;
+  table->count--;
+
+  if (table->size > HASH_MIN_SIZE && table->count * 8 < table->size)
+    hash_resize(table, table->size / 2);
+}
+
+static void *
+hash_find(const struct HashTable *table, const char *name)
+{
+  unsigned int hashv, mask, i;
+  const struct HashEntry *entry;
+
+  if (table->count == 0)
+    return NULL;
+
+  hashv = hash_string(name);
+  mask = table->size - 1;
+
+  for (i = hashv & mask; (entry = &table->entries[i])->data != NULL;
+       i = (i + 1) & mask)
+  {
+    if (entry->hashv == hashv && !irccmp(name, HASH_KEY(table, entry->data)))
+      return entry->data;
+  }
+
+  return NULL;
+}
+
+/************************** Externally visible functions ********************/
 
 /* hash_add_client()
  *
  * inputs       - pointer to client
  * output       - NONE
- * side effects - Adds a client's name in the proper hash linked
- *                list, can't fail, client must have a non-null
- *                name or expect a coredump, the name is infact
- *                taken from client->name
+ * side effects - Adds a client's name to the client table, can't
+ *                fail, client must have a non-null name or expect a
+ *                coredump, the name is infact taken from client->name
  */
 void
 hash_add_client(struct Client *client)
 {
-  unsigned int hashv = strhash(client->name);
-
-  client->hnext = clientTable[hashv];
-  clientTable[hashv] = client;
+  hash_insert(&clientTable, client);
 }
 
 void
 hash_add_service(struct Service *service)
 {
-  unsigned int hashv = strhash(service->name);
-
-  service->hnext = serviceTable[hashv];
-  serviceTable[hashv] = service;
+  hash_insert(&serviceTable, service);
 }
 
 /* hash_add_channel()
  *
  * inputs       - pointer to channel
  * output       - NONE
- * side effects - Adds a channel's name in the proper hash linked
- *                list, can't fail. chptr must have a non-null name
- *                or expect a coredump. As before the name is taken
- *                from chptr->name, we do hash its entire lenght
- *                since this proved to be statistically faster
+ * side effects - Adds a channel's name to the channel table, can't
+ *                fail. chptr must have a non-null name or expect a
+ *                coredump. As before the name is taken from
+ *                chptr->chname
  */
 void
 hash_add_channel(struct Channel *chptr)
 {
-  unsigned int hashv = strhash(chptr->chname);
-
-  chptr->hnextch = channelTable[hashv];
-  channelTable[hashv] = chptr;
+  hash_insert(&channelTable, chptr);
 }
 
 void
 hash_add_id(struct Client *client)
 {
-  unsigned int hashv = strhash(client->id);
-
-  client->idhnext = idTable[hashv];
-  idTable[hashv] = client;
+  hash_insert(&idTable, client);
 }
 
 /* hash_del_id()
  *
  * inputs       - pointer to client
  * output       - NONE
- * side effects - Removes an ID from the hash linked list
+ * side effects - Removes an ID from the id table
  */
 void
 hash_del_id(struct Client *client)
 {
-  unsigned int hashv = strhash(client->id);
-  struct Client *tmp = idTable[hashv];
-
-  if (tmp != NULL)
-  {
-    if (tmp == client)
-    {
-      idTable[hashv] = client->idhnext;
-      client->idhnext = client;
-    }
-    else
-    {
-      while (tmp->idhnext != client)
-      {
-        if ((tmp = tmp->idhnext) == NULL)
-          return;
-      }
-
-      tmp->idhnext = tmp->idhnext->idhnext;
-      client->idhnext = client;
-    }
-  }
+  hash_remove(&idTable, client);
 }
 
 /* hash_del_client()
  *
  * inputs       - pointer to client
  * output       - NONE
- * side effects - Removes a Client's name from the hash linked list
+ * side effects - Removes a Client's name from the client table
  */
 void
 hash_del_client(struct Client *client)
 {
-  unsigned int hashv = strhash(client->name);
-  struct Client *tmp = clientTable[hashv];
-
-  if (tmp != NULL)
-  {
-    if (tmp == client)
-    {
-      clientTable[hashv] = client->hnext;
-      client->hnext = client;
-    }
-    else
-    {
-      while (tmp->hnext != client)
-      {
-        if ((tmp = tmp->hnext) == NULL)
-          return;
-      }
-
-      tmp->hnext = tmp->hnext->hnext;
-      client->hnext = client;
-    }
-  }
+  hash_remove(&clientTable, client);
 }
+
 /* hash_del_service()
  *
  * inputs       - pointer to service 
  * output       - NONE
- * side effects - Removes a service from the hash linked list
+ * side effects - Removes a service from the service table
  */
 void
 hash_del_service(struct Service *service)
 {
-  unsigned int hashv = strhash(service->name);
-  struct Service *tmp = serviceTable[hashv];
-
   /* Ugly, but prevents us from having to do it in every service unload */
   kill_remove_service(service);
 
-  if (tmp != NULL)
-  {
-    if (tmp == service)
-    {
-      serviceTable[hashv] = service->hnext;
-      service->hnext = service;
-    }
-    else
-    {
-      while (tmp->hnext != service)
-      {
-        if ((tmp = tmp->hnext) == NULL)
-          return;
-      }
-
-      tmp->hnext = tmp->hnext->hnext;
-      service->hnext = service;
-    }
-  }
+  hash_remove(&serviceTable, service);
 }
 
 /* hash_del_channel()
  *
  * inputs       - pointer to client
  * output       - NONE
- * side effects - Removes the channel's name from the corresponding
- *                hash linked list
+ * side effects - Removes the channel's name from the channel table
  */
 void
 hash_del_channel(struct Channel *chptr)
 {
-  unsigned int hashv = strhash(chptr->chname);
-  struct Channel *tmp = channelTable[hashv];
-
-  if (tmp != NULL)
-  {
-    if (tmp == chptr)
-    {
-      channelTable[hashv] = chptr->hnextch;
-      chptr->hnextch = chptr;
-    }
-    else
-    {
-      while (tmp->hnextch != chptr)
-      {
-        if ((tmp = tmp->hnextch) == NULL)
-          return;
-      }
-
-      tmp->hnextch = tmp->hnextch->hnextch;
-      chptr->hnextch = chptr;
-    }
-  }
+  hash_remove(&channelTable, chptr);
 }
 
 /* find_client()
  *
  * inputs       - pointer to name
  * output       - NONE
- * side effects - New semantics: finds a client whose name is 'name'
- *                if can't find one returns NULL. If it finds one moves
- *                it to the top of the list and returns it.
+ * side effects - finds a client whose name is 'name' if can't find
+ *                one returns NULL.
  */
 struct Client *
 find_client(const char *name)
 {
-  unsigned int hashv = strhash(name);
-  struct Client *client;
-
-  if ((client = clientTable[hashv]) != NULL)
-  {
-    if (irccmp(name, client->name))
-    {
-      struct Client *prev;
-
-      while (prev = client, (client = client->hnext) != NULL)
-      {
-        if (!irccmp(name, client->name))
-        {
-          prev->hnext = client->hnext;
-          client->hnext = clientTable[hashv];
-          clientTable[hashv] = client;
-          break;
-        }
-      }
-    }
-  }
-
-  return client;
+  return hash_find(&clientTable, name);
 }
 
 /* find_service()
  *
  * inputs       - pointer to name
  * output       - NONE
- * side effects - New semantics: finds a service whose name is 'name'
- *                if can't find one returns NULL. If it finds one moves
- *                it to the top of the list and returns it.
+ * side effects - finds a service whose name is 'name' if can't find
+ *                one returns NULL.
  */
 struct Service *
 find_service(const char *name)
 {
-  unsigned int hashv = strhash(name);
-  struct Service *service;
-
-  if ((service = serviceTable[hashv]) != NULL)
-  {
-    if (irccmp(name, service->name))
-    {
-      struct Service *prev;
-
-      while (prev = service, (service = service->hnext) != NULL)
-      {
-        if (!irccmp(name, service->name))
-        {
-          prev->hnext = service->hnext;
-          service->hnext = serviceTable[hashv];
-          serviceTable[hashv] = service;
-          break;
-        }
-      }
-    }
-  }
-
-  return service;
+  return hash_find(&serviceTable, name);
 }
 
 struct Client *
 hash_find_id(const char *name)
 {
-  unsigned int hashv = strhash(name);
-  struct Client *client;
-
-  if ((client = idTable[hashv]) != NULL)
-  {
-    if (irccmp(name, client->id))
-    {
-      struct Client *prev;
-
-      while (prev = client, (client = client->idhnext) != NULL)
-      {
-        if (!irccmp(name, client->id))
-        {
-          prev->idhnext = client->idhnext;
-          client->idhnext = idTable[hashv];
-          idTable[hashv] = client;
-          break;
-        }
-      }
-    }
-  }
-
-  return client;
+  return hash_find(&idTable, name);
 }
 
 /*
@@ -458,29 +477,28 @@ hash_find_masked_server(const char *name)
 struct Client *
 find_server(const char *name)
 {
-  unsigned int hashv = strhash(name);
   struct Client *client = NULL;
 
   if (IsDigit(*name) && strlen(name) == IRC_MAXSID)
     client = hash_find_id(name);
 
-  if ((client == NULL) && (client = clientTable[hashv]) != NULL)
+  if (client == NULL && clientTable.count != 0)
   {
-    if ((!IsServer(client) && !IsMe(client)) ||
-        irccmp(name, client->name))
+    unsigned int hashv = hash_string(name);
+    unsigned int mask = clientTable.size - 1;
+    unsigned int i;
+    struct HashEntry *entry;
+
+    for (i = hashv & mask; (entry = &clientTable.entries[i])->data != NULL;
+         i = (i + 1) & mask)
     {
-      struct Client *prev;
+      struct Client *target = entry->data;
 
-      while (prev = client, (client = client->hnext) != NULL)
+      if (entry->hashv == hashv && (IsServer(target) || IsMe(target)) &&
+          !irccmp(name, target->name))
       {
-        if ((IsServer(client) || IsMe(client)) &&
-            !irccmp(name, client->name))
-        {
-          prev->hnext = client->hnext;
-          client->hnext = clientTable[hashv];
-          clientTable[hashv] = client;
-          break;
-        }
+        client = target;
+        break;
       }
     }
   }
@@ -492,101 +510,19 @@ find_server(const char *name)
  *
  * inputs       - pointer to name
  * output       - NONE
- * side effects - New semantics: finds a channel whose name is 'name', 
- *                if can't find one returns NULL, if can find it moves
- *                it to the top of the list and returns it.
+ * side effects - finds a channel whose name is 'name', if can't find
+ *                it returns NULL.
  */
 struct Channel *
 hash_find_channel(const char *name)
 {
-  unsigned int hashv = strhash(name);
-  struct Channel *chptr = NULL;
-
-  if ((chptr = channelTable[hashv]) != NULL)
-  {
-    if (irccmp(name, chptr->chname))
-    {
-      struct Channel *prev;
-
-      while (prev = chptr, (chptr = chptr->hnextch) != NULL)
-      {
-        if (!irccmp(name, chptr->chname))
-        {
-          prev->hnextch = chptr->hnextch;
-          chptr->hnextch = channelTable[hashv];
-          channelTable[hashv] = chptr;
-          break;
-        }
-      }
-    }
-  }
-
-  return chptr;
-}
-/* hash_get_bucket(int type, unsigned int hashv)
- *
- * inputs       - hash value (must be between 0 and HASHSIZE - 1)
- * output       - NONE
- * returns      - pointer to first channel in channelTable[hashv]
- *                if that exists;
- *                NULL if there is no channel in that place;
- *                NULL if hashv is an invalid number.
- * side effects - NONE
- */
-void *
-hash_get_bucket(int type, unsigned int hashv)
-{
-  assert(hashv < HASHSIZE);
-  if (hashv >= HASHSIZE)
-      return NULL;
-
-  switch (type)
-  {
-    case HASH_TYPE_ID:
-      return idTable[hashv];
-      break;
-    case HASH_TYPE_CHANNEL:
-      return channelTable[hashv];
-      break;
-    case HASH_TYPE_CLIENT:
-      return clientTable[hashv];
-      break;
-    case HASH_TYPE_SERVICE:
-      return serviceTable[hashv];
-      break;
-    default:
-      assert(0);
-  }
-
-  return NULL;
+  return hash_find(&channelTable, name);
 }
 
 struct Service *
 hash_find_service(const char *host)
 {
-  unsigned int hashv = strhash(host);
-  struct Service *service;
-
-  if ((service = serviceTable[hashv]))
-  {
-    if (irccmp(host, service->name))
-    {
-      struct Service *prev;
-
-      while (prev = service, (service = service->hnext) != NULL)
-      {
-        if (!irccmp(host, service->name))
-        {
-          prev->hnext = service->hnext;
-          service->hnext = serviceTable[hashv];
-          serviceTable[hashv] = service;
-          break;
-        }
-      }
-    }
-  }
-
-  return service;
+  return hash_find(&serviceTable, host);
 }
 
 struct MessageQueue *
@@ -669,63 +605,53 @@ new_mqueue_hash()
 void
 hash_add_tor(struct TorNode *node)
 {
-  unsigned int hashv = strhash(node->host);
-
-  node->next = torTable[hashv];
-  torTable[hashv] = node;
+  hash_insert(&torTable, node);
 }
 
 void
 hash_del_tor(struct TorNode *node)
 {
-  unsigned int hashv = strhash(node->host);
-  struct TorNode *tmp = torTable[hashv];
-
-  if (tmp != NULL)
-  {
-    if (tmp == node)
-    {
-      torTable[hashv] = node->next;
-      node->next = node;
-    }
-    else
-    {
-      while (tmp->next != node)
-      {
-        if ((tmp = tmp->next) == NULL)
-          return;
-      }
-
-      tmp->next = tmp->next->next;
-      node->next = node;
-    }
-  }
+  hash_remove(&torTable, node);
 }
 
 struct TorNode *
 find_tor(const char *host)
 {
-  unsigned int hashv = strhash(host);
-  struct TorNode *node;
+  return hash_find(&torTable, host);
+}
 
-  if ((node = torTable[hashv]) != NULL)
-  {
-    if (irccmp(host, node->host))
-    {
-      struct TorNode *prev;
+void
+hash_add_killhost(struct KillHost *host)
+{
+  hash_insert(&killHostTable, host);
+}
 
-      while (prev = node, (node = node->next) != NULL)
-      {
-        if (!irccmp(host, node->host))
-        {
-          prev->next = node->next;
-          node->next = torTable[hashv];
-          torTable[hashv] = node;
-          break;
-        }
-      }
-    }
-  }
+void
+hash_del_killhost(struct KillHost *host)
+{
+  hash_remove(&killHostTable, host);
+}
+
+struct KillHost *
+find_killhost(const char *host)
+{
+  return hash_find(&killHostTable, host);
+}
+
+void
+hash_add_killmask(struct KillMask *mask)
+{
+  hash_insert(&killMaskTable, mask);
+}
+
+void
+hash_del_killmask(struct KillMask *mask)
+{
+  hash_remove(&killMaskTable, mask);
+}
 
-  return node;
+struct KillMask *
+find_killmask(const char *mask)
+{
+  return hash_find(&killMaskTable, mask);
 }
@@ -43,16 +43,17 @@
 #include "nickserv.h"
 #include "chanaccess.h"
 #include "servicemask.h"
+#include "startup.h"
 
 #include <event.h>
 #include <evdns.h>
-#include <openssl/hmac.h>
 
 dlink_list services_list = { 0 };
 
 struct Callback *send_newuser_cb;
 struct Callback *send_privmsg_cb;
 struct Callback *send_notice_cb;
+struct Callback *send_notices_cb;
 struct Callback *send_gnotice_cb;
 struct Callback *send_umode_cb;
 struct Callback *send_cloak_cb;
@@ -81,6 +82,7 @@ struct Callback *on_nick_change_cb;
 struct Callback *on_join_cb;
 struct Callback *on_part_cb;
 struct Callback *on_quit_cb;
+struct Callback *on_split_cb;
 struct Callback *on_umode_change_cb;
 struct Callback *on_cmode_change_cb;
 struct Callback *on_squit_cb;
@@ -88,6 +90,8 @@ struct Callback *on_newuser_cb;
 struct Callback *on_identify_cb;
 struct Callback *on_channel_created_cb;
 struct Callback *on_channel_destroy_cb;
+struct Callback *on_client_free_cb;
+struct Callback *on_channel_free_cb;
 struct Callback *on_topic_change_cb;
 struct Callback *on_privmsg_cb;
 struct Callback *on_notice_cb;
@@ -108,6 +112,7 @@ struct Callback *on_ctcp_cb;
 struct Callback *do_event_cb;
 
 struct LanguageFile ServicesLanguages[LANG_LAST];
+static struct StartupTask language_task;
 struct ModeList *ServerModeList;
 
 void
@@ -118,6 +123,7 @@ init_interface()
   send_newuser_cb     = register_callback("us introducing user", NULL);
   send_privmsg_cb     = register_callback("message user", NULL);
   send_notice_cb      = register_callback("NOTICE user", NULL);
+  send_notices_cb     = register_callback("NOTICE user lines", NULL);
   send_gnotice_cb     = register_callback("Global Notice", NULL);
   send_umode_cb       = register_callback("Set UMODE", NULL);
   send_cloak_cb       = register_callback("Cloak an user", NULL);
@@ -143,6 +149,7 @@ init_interface()
   on_join_cb          = register_callback("Propagate JOIN", NULL);
   on_part_cb          = register_callback("Propagate PART", NULL);
   on_quit_cb          = register_callback("Propagate QUIT", NULL);
+  on_split_cb         = register_callback("Propagate SPLIT", NULL);
   on_umode_change_cb  = register_callback("Propagate UMODE", NULL);
   on_cmode_change_cb  = register_callback("Propagate CMODE", NULL);
   on_squit_cb         = register_callback("Propagate SQUIT", NULL);
@@ -150,6 +157,8 @@ init_interface()
   on_newuser_cb       = register_callback("New user coming to us", NULL);
   on_channel_created_cb = register_callback("Channel is being created", NULL);
   on_channel_destroy_cb = register_callback("Channel is being destroyed", NULL);
+  on_client_free_cb   = register_callback("Client is being freed", NULL);
+  on_channel_free_cb  = register_callback("Channel is being freed", NULL);
   on_topic_change_cb  = register_callback("Topic changed", NULL);
   on_privmsg_cb       = register_callback("Privmsg for channel received", NULL);
   on_notice_cb        = register_callback("Notice for channel received", NULL);
@@ -166,10 +175,28 @@ init_interface()
   on_group_reg_cb     = register_callback("Newly Registered Group", NULL);
   on_auth_request_cb  = register_callback("Authetication requested", NULL);
   do_event_cb         = register_callback("Event Loop Callback", NULL);
+}
 
+static void
+services_language_work(void *param)
+{
   load_language(ServicesLanguages, "services.en");
 }
 
+/* load_services_language()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - services.en is loaded into ServicesLanguages on a startup
+ *                worker, it is waited for before the uplink is read
+ */
+void
+load_services_language()
+{
+  startup_task_start(&language_task, "Services language",
+      services_language_work, NULL, NULL);
+}
+
 void
 cleanup_interface()
 {
@@ -177,6 +204,7 @@ cleanup_interface()
   unregister_callback(send_newuser_cb);
   unregister_callback(send_privmsg_cb);
   unregister_callback(send_notice_cb);
+  unregister_callback(send_notices_cb);
   unregister_callback(send_gnotice_cb);
   unregister_callback(send_umode_cb);
   unregister_callback(send_cloak_cb);
@@ -189,8 +217,6 @@ cleanup_interface()
   unregister_callback(send_topic_cb);
   unregister_callback(send_kill_cb);
   unregister_callback(send_resv_cb);
-  unregister_callback(send_topic_cb);
-  unregister_callback(send_resv_cb);
   unregister_callback(send_unresv_cb);
   unregister_callback(send_newserver_cb);
   unregister_callback(send_join_cb);
@@ -204,12 +230,15 @@ cleanup_interface()
   unregister_callback(on_join_cb);
   unregister_callback(on_part_cb);
   unregister_callback(on_quit_cb);
+  unregister_callback(on_split_cb);
   unregister_callback(on_umode_change_cb);
   unregister_callback(on_cmode_change_cb);
   unregister_callback(on_identify_cb);
   unregister_callback(on_newuser_cb);
   unregister_callback(on_channel_created_cb);
   unregister_callback(on_channel_destroy_cb);
+  unregister_callback(on_client_free_cb);
+  unregister_callback(on_channel_free_cb);
   unregister_callback(on_topic_change_cb);
   unregister_callback(on_privmsg_cb);
   unregister_callback(on_notice_cb);
@@ -444,6 +473,33 @@ void reply_time(struct Service *service, struct Client *client,
       diff.tm_hour, diff.tm_min, diff.tm_sec);
 }
 
+/* send_reply_lines()
+ *
+ * inputs       - source service, target client, lines and their count
+ * output       - none
+ * side effects - all lines go out as notices in one trip down the
+ *                protocol module's output path
+ */
+static void
+send_reply_lines(struct Service *source, struct Client *client, char **lines,
+    int count)
+{
+  int i;
+
+  if(count == 0)
+    return;
+
+  if(ServicesState.debugmode)
+  {
+    for(i = 0; i < count; i++)
+      ilog(L_DEBUG, "Was going to send: %s to %s", lines[i], client->name);
+    return;
+  }
+
+  execute_callback(send_notices_cb, me.uplink, source->name, client->name,
+      lines, count);
+}
+
 void
 reply_user(struct Service *source, struct Service *service, 
     struct Client *client, unsigned int langid,
@@ -451,44 +507,43 @@ reply_user(struct Service *source, struct Service *service,
 {
   char *buf;
   va_list ap;
-  char *s, *t;
+  char **lines;
   char *langstr = NULL;
-  struct LanguageFile *languages;
+  struct LanguageFile *language;
+  struct LanguageTemplate *template = NULL;
+  int count;
 
   if(service == NULL)
-    languages = ServicesLanguages;
+    language = ServicesLanguages;
   else
-    languages = service->languages;
+    language = service->languages;
   
   if(langid != 0)
   {
-    if(client->nickname == NULL)
-      langstr = languages[0].entries[langid];
-    else
-      langstr = languages[nickname_get_language(client->nickname)].entries[langid];
+    if(client->nickname != NULL)
+      language += nickname_get_language(client->nickname);
+
+    langstr = language->entries[langid];
+    template = language_template(language, langid);
+  }
+
+  if(template != NULL)
+  {
+    send_reply_lines(source, client, template->lines, template->count);
+    return;
   }
    
   if(langstr == NULL)
     langstr = "%s";
   
   va_start(ap, langid);
-  vasprintf(&buf, langstr, ap);
+  buf = arena_vsprintf(request_arena, langstr, ap);
   va_end(ap);
-  s = buf;
-  while (*s) 
-  {
-    t = s;
-    s += strcspn(s, "\n");
-    if (*s)
-      *s++ = 0;
-    if(ServicesState.debugmode)
-      ilog(L_DEBUG, "Was going to send: %s to %s", t, client->name);
-    else
-      execute_callback(send_notice_cb, me.uplink, source->name, client->name, 
-          *t != '\0' ? t : " ");
-  }
 
-  MyFree(buf);
+  lines = arena_alloc(request_arena, language_max_lines(buf) * sizeof(char *));
+  count = language_split(buf, lines);
+
+  send_reply_lines(source, client, lines, count);
 }
 
 void
@@ -628,11 +683,10 @@ send_chops_notice(struct Service *service, struct Channel *chptr,
     return;
 
   va_start(ap, format);
-  vasprintf(&buf, format, ap);
+  buf = arena_vsprintf(request_arena, format, ap);
   va_end(ap);
 
   execute_callback(send_chops_notice_cb, me.uplink, service, chptr, buf);
-  MyFree(buf);
 }
 
 void
@@ -659,7 +713,8 @@ send_nick_change(struct Service *service, struct Client *client,
 }
 
 void
-send_akill(struct Service *service, char *setter, struct ServiceMask *akill)
+send_akill(struct Service *service, const char *setter,
+    struct ServiceMask *akill)
 {
   if(!ServicesState.debugmode)
   {
@@ -1773,20 +1828,15 @@ make_random_string(char *buffer, size_t length)
 char *
 generate_hmac(const char *data)
 {
-  unsigned char hash[EVP_MAX_MD_SIZE] = {0};
+  unsigned char hash[EVP_MAX_MD_SIZE];
   unsigned int len;
-  char *key;
   char *hexdata;
 
-  key = crypt_pass(ServicesInfo.hmac_secret, 0);
-
-  HMAC(EVP_sha1(), key, DIGEST_LEN, (unsigned char*)data, strlen(data), hash, 
-      &len);
+  len = hmac_digest(data, strlen(data), hash);
 
   hexdata = MyMalloc(len*2 + 1);
   base16_encode(hexdata, len*2+1, (char*)hash, len);
 
-  MyFree(key);
   return hexdata;
 }
 
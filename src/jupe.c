@@ -37,10 +37,10 @@ row_to_jupe(row_t *row)
   struct JupeEntry *jupe;
 
   jupe = MyMalloc(sizeof(struct JupeEntry));
-  jupe->id = atoi(row->cols[0]);
+  jupe->id = db_row_int(row, 0);
   DupString(jupe->name, row->cols[1]);
   DupString(jupe->reason, row->cols[2]);
-  jupe->setter = atoi(row->cols[3]);
+  jupe->setter = db_row_int(row, 3);
 
   return jupe;
 }
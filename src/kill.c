@@ -25,46 +25,395 @@
 #include "interface.h"
 #include "kill.h"
 #include "client.h"
+#include "hash.h"
+#include "servicemask.h"
+#include "akill.h"
 
-static dlink_list kill_list = { 0 };
+struct KillStats kill_stats;
+
+static dlink_list kill_queue = { 0 };
+/* KillMasks in the order they were queued, expired from the head */
+static dlink_list kill_masks = { 0 };
 
 static void
-check_kills(void *param)
+kill_queue_add(struct KillRequest *request)
+{
+  dlinkAddTail(request, &request->node, &kill_queue);
+
+  if(dlink_list_length(&kill_queue) > kill_stats.peak)
+    kill_stats.peak = dlink_list_length(&kill_queue);
+}
+
+static void
+kill_free_request(struct KillRequest *request)
+{
+  MyFree(request->setter);
+  MyFree(request->reason);
+  MyFree(request);
+}
+
+static void
+kill_free_mask(struct KillMask *mask)
+{
+  dlinkDelete(&mask->node, &kill_masks);
+  hash_del_killmask(mask);
+  MyFree(mask);
+}
+
+/* kill_detach()
+ *
+ * inputs       - request
+ * output       - none
+ * side effects - the request is taken off the queue, its client and its
+ *                host, an akill that never went out is forgotten.  The
+ *                request itself is not freed.
+ */
+static void
+kill_detach(struct KillRequest *request)
+{
+  struct KillHost *host = request->host;
+
+  dlinkDelete(&request->node, &kill_queue);
+
+  if(request->client != NULL)
+    request->client->kill_node = NULL;
+
+  if(host != NULL)
+  {
+    dlinkDelete(&request->host_node, &host->requests);
+    if(host->requests.head == NULL)
+    {
+      hash_del_killhost(host);
+      MyFree(host);
+    }
+    request->host = NULL;
+  }
+
+  if(request->akill != NULL && request->akill->sent == 0)
+    kill_free_mask(request->akill);
+  request->akill = NULL;
+}
+
+/* kill_sent_lately()
+ *
+ * inputs       - akill mask
+ * output       - TRUE if the same akill waits or went out in the last
+ *                KILL_AKILL_RESEND seconds
+ * side effects - none
+ */
+static int
+kill_sent_lately(const char *mask)
+{
+  struct KillMask *sent = find_killmask(mask);
+
+  return sent != NULL &&
+    (sent->sent == 0 || sent->sent + KILL_AKILL_RESEND > CurrentTime);
+}
+
+/* kill_remember()
+ *
+ * inputs       - akill mask, when it went out or 0 if it is only queued
+ * output       - the entry for it
+ * side effects - the mask is (re)entered at the tail of kill_masks
+ */
+static struct KillMask *
+kill_remember(const char *mask, time_t sent)
+{
+  struct KillMask *entry;
+
+  if((entry = find_killmask(mask)) != NULL)
+    dlinkDelete(&entry->node, &kill_masks);
+  else
+  {
+    entry = MyMalloc(sizeof(struct KillMask));
+    strlcpy(entry->mask, mask, sizeof(entry->mask));
+    hash_add_killmask(entry);
+  }
+
+  entry->sent = sent;
+  dlinkAddTail(entry, &entry->node, &kill_masks);
+
+  return entry;
+}
+
+static void
+kill_expire_masks()
 {
+  dlink_node *ptr;
+
+  while((ptr = kill_masks.head) != NULL)
+  {
+    struct KillMask *mask = ptr->data;
+
+    if(mask->sent == 0 || mask->sent + KILL_AKILL_RESEND > CurrentTime)
+      break;
+
+    kill_free_mask(mask);
+  }
+}
+
+/* kill_akill_host()
+ *
+ * inputs       - a waiting kill whose host has KILL_AKILL_THRESHOLD or more
+ * output       - none
+ * side effects - the host is akilled and every kill waiting on it dropped,
+ *                the ircd removes those clients itself.  The request is
+ *                freed.
+ */
+static void
+kill_akill_host(struct KillRequest *request)
+{
+  struct KillHost *host = request->host;
+  struct ServiceMask akill, *found;
+  char mask[USERHOSTLEN+1];
   dlink_node *ptr, *nptr;
+  unsigned long count = dlink_list_length(&host->requests);
 
-  DLINK_FOREACH_SAFE(ptr, nptr, kill_list.head)
+  snprintf(mask, sizeof(mask), "*@%s", host->host);
+
+  if(!kill_sent_lately(mask))
   {
-    struct KillRequest *request = (struct KillRequest *)ptr->data;
+    memset(&akill, 0, sizeof(akill));
+    akill.mask = mask;
+    akill.reason = request->reason;
+    akill.time_set = CurrentTime;
+    akill.duration = KILL_AKILL_DURATION;
 
-    /* This will exit_one_client which calls kill_remove_client and frees
-       associated ptrs */
-    send_kill(request->service, request->client, request->reason);
+    if((found = akill_find(mask)) != NULL)
+      free_servicemask(found);
+    else
+      akill_add(&akill);
+
+    ilog(L_NOTICE, "%s akilled %s instead of killing %lu clients on it",
+        request->service->name, mask, count);
+
+    send_akill(request->service, request->service->name, &akill);
+    kill_remember(mask, CurrentTime);
+    kill_stats.akills++;
+  }
+  else
+    kill_stats.duplicates++;
+
+  kill_stats.merged += count;
+
+  DLINK_FOREACH_SAFE(ptr, nptr, host->requests.head)
+  {
+    struct KillRequest *waiting = ptr->data;
+
+    kill_detach(waiting);
+    kill_free_request(waiting);
   }
 }
 
+/* check_kills()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - waiting kills and akills are sent oldest first, at most
+ *                KILL_RATE of them and only while the uplink's sendq is
+ *                under KILL_SENDQ_MAX
+ */
+static void
+check_kills(void *param)
+{
+  dlink_node *ptr;
+  unsigned int sent = 0;
+
+  if(CurrentTime - kill_stats.window_start >= KILL_WINDOW)
+  {
+    kill_stats.rate = kill_stats.window_sent /
+      (CurrentTime - kill_stats.window_start);
+    kill_stats.window_start = CurrentTime;
+    kill_stats.window_sent = 0;
+  }
+
+  kill_expire_masks();
+
+  if(me.uplink == NULL)
+    return;
+
+  while((ptr = kill_queue.head) != NULL && sent < KILL_RATE)
+  {
+    struct KillRequest *request = ptr->data;
+
+    if(dbuf_length(&me.uplink->server->buf_sendq) > KILL_SENDQ_MAX)
+    {
+      kill_stats.held++;
+      break;
+    }
+
+    if(request->akill != NULL)
+    {
+      struct ServiceMask akill;
+
+      memset(&akill, 0, sizeof(akill));
+      akill.mask = request->akill->mask;
+      akill.reason = request->reason;
+      akill.time_set = request->time_set;
+      akill.duration = request->duration;
+
+      request->akill->sent = CurrentTime;
+      send_akill(request->service, request->setter, &akill);
+      kill_stats.akills++;
+
+      kill_detach(request);
+      kill_free_request(request);
+    }
+    else if(request->host != NULL &&
+        dlink_list_length(&request->host->requests) >= KILL_AKILL_THRESHOLD)
+      kill_akill_host(request);
+    else
+    {
+      struct Client *client = request->client;
+
+      /* detached first, the exit_client() this ends in must not free it */
+      kill_detach(request);
+      send_kill(request->service, client, request->reason);
+      kill_stats.kills++;
+      kill_free_request(request);
+    }
+
+    sent++;
+  }
+
+  kill_stats.window_sent += sent;
+}
+
 void
 init_kill()
 {
   eventAdd("Check kills", check_kills, NULL, 1);
 }
 
+static void
+kill_queue_client(struct Service *service, struct Client *client,
+    const char *reason, int may_akill)
+{
+  struct KillRequest *request;
+  struct KillHost *host;
+  const char *hostname;
+
+  if(client->kill_node != NULL)
+    return;
+
+  request = MyMalloc(sizeof(struct KillRequest));
+  request->service = service;
+  request->client = client;
+  DupString(request->reason, reason);
+
+  client->kill_node = &request->node;
+  kill_queue_add(request);
+
+  /* a tor exit or an oper's host is shared with innocent users */
+  if(!may_akill || IsOper(client) || find_tor(client->sockhost) != NULL)
+    return;
+
+  hostname = *client->realhost != '\0' ? client->realhost : client->host;
+  if((host = find_killhost(hostname)) == NULL)
+  {
+    host = MyMalloc(sizeof(struct KillHost));
+    strlcpy(host->host, hostname, sizeof(host->host));
+    hash_add_killhost(host);
+  }
+
+  request->host = host;
+  dlinkAddTail(request, &request->host_node, &host->requests);
+}
+
+/* kill_user()
+ *
+ * inputs       - service, client, reason
+ * output       - none
+ * side effects - the client is killed with the next batch, unless it is
+ *                already waiting
+ */
 void
 kill_user(struct Service *service, struct Client *client, const char *reason)
+{
+  kill_queue_client(service, client, reason, FALSE);
+}
+
+/* kill_user_host()
+ *
+ * inputs       - service, client, reason
+ * output       - none
+ * side effects - as kill_user(), but once KILL_AKILL_THRESHOLD kills wait
+ *                on the client's host, the host is akilled instead
+ */
+void
+kill_user_host(struct Service *service, struct Client *client,
+    const char *reason)
+{
+  kill_queue_client(service, client, reason, TRUE);
+}
+
+/* kill_akill()
+ *
+ * inputs       - service, setter, akill
+ * output       - none
+ * side effects - the akill is sent with the next batch, unless the same
+ *                one is waiting or went out lately.  The akill is copied.
+ */
+void
+kill_akill(struct Service *service, const char *setter,
+    struct ServiceMask *akill)
 {
   struct KillRequest *request;
 
-  if (client->kill_node == NULL)
+  if(strlen(akill->mask) >= USERHOSTLEN+1)
+  {
+    /* too long to remember, it goes out as it is */
+    send_akill(service, setter, akill);
+    kill_stats.akills++;
+    return;
+  }
+
+  if(kill_sent_lately(akill->mask))
   {
-    request = MyMalloc(sizeof(struct KillRequest));
+    kill_stats.duplicates++;
+    return;
+  }
 
-    request->service = service;
-    request->client = client;
-    request->reason = reason;
+  request = MyMalloc(sizeof(struct KillRequest));
+  request->service = service;
+  request->akill = kill_remember(akill->mask, 0);
+  if(setter != NULL)
+    DupString(request->setter, setter);
+  DupString(request->reason, akill->reason);
+  request->time_set = akill->time_set;
+  request->duration = akill->duration;
+
+  kill_queue_add(request);
+}
 
-    client->kill_node = make_dlink_node();
-    dlinkAdd(request, client->kill_node, &kill_list);
+/* kill_akill_client()
+ *
+ * inputs       - service, setter, akill, client matching it
+ * output       - none
+ * side effects - as kill_akill(), but if the same akill already went out
+ *                lately the client got on after it, so the client is
+ *                killed by itself instead
+ */
+void
+kill_akill_client(struct Service *service, const char *setter,
+    struct ServiceMask *akill, struct Client *client)
+{
+  struct KillMask *sent = find_killmask(akill->mask);
+
+  if(sent != NULL && sent->sent != 0 &&
+      sent->sent + KILL_AKILL_RESEND > CurrentTime)
+  {
+    kill_user(service, client, akill->reason);
+    return;
   }
+
+  kill_akill(service, setter, akill);
+}
+
+unsigned int
+kill_queue_length()
+{
+  return dlink_list_length(&kill_queue);
 }
 
 void
@@ -72,15 +421,14 @@ kill_remove_service(struct Service *service)
 {
   dlink_node *ptr, *nptr;
 
-  DLINK_FOREACH_SAFE(ptr, nptr, kill_list.head)
+  DLINK_FOREACH_SAFE(ptr, nptr, kill_queue.head)
   {
     struct KillRequest *request = (struct KillRequest *)ptr->data;
 
     if(request->service == service)
     {
-      dlinkDelete(ptr, &kill_list);
-      free_dlink_node(ptr);
-      MyFree(request);
+      kill_detach(request);
+      kill_free_request(request);
     }
   }
 }
@@ -90,11 +438,9 @@ kill_remove_client(struct Client *client)
 {
   if (client->kill_node != NULL)
   {
-    dlink_node *ptr = client->kill_node;
-    struct KillRequest *request = (struct KillRequest *)ptr->data;
-    dlinkDelete(ptr, &kill_list);
-    free_dlink_node(ptr);
-    client->kill_node = NULL;
-    MyFree(request);
+    struct KillRequest *request = client->kill_node->data;
+
+    kill_detach(request);
+    kill_free_request(request);
   }
 }
@@ -23,92 +23,331 @@
  */
 
 #include "stdinc.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "language.h"
 
+/* language_split()
+ *
+ * inputs       - text to split in place, room for one pointer per
+ *                newline plus one
+ * output       - number of lines
+ * side effects - newlines are cut, empty lines become a single space
+ *                since servers drop empty notices
+ */
+int
+language_split(char *text, char **lines)
+{
+  static char blank[] = " ";
+  char *s = text;
+  int count = 0;
+
+  while(*s != '\0')
+  {
+    lines[count] = s;
+    s += strcspn(s, "\n");
+    if(*s != '\0')
+      *s++ = '\0';
+    if(*lines[count] == '\0')
+      lines[count] = blank;
+    count++;
+  }
+
+  return count;
+}
+
+/* language_max_lines()
+ *
+ * inputs       - text
+ * output       - most lines language_split() can make of it
+ * side effects - none
+ */
+int
+language_max_lines(const char *text)
+{
+  int count = 1;
+
+  for(; *text != '\0'; text++)
+    if(*text == '\n')
+      count++;
+
+  return count;
+}
+
+/* a template for entries that have conversions, they are formatted */
+static struct LanguageTemplate no_template;
+
+/* compile_template()
+ *
+ * inputs       - a language entry
+ * output       - its lines, or &no_template if it has conversions in it
+ * side effects - entries that need no formatting are split once here
+ *                instead of on every reply
+ */
+static struct LanguageTemplate *
+compile_template(const char *entry)
+{
+  struct LanguageTemplate *template;
+
+  if(strchr(entry, '%') != NULL)
+    return &no_template;
+
+  template = MyMalloc(sizeof(struct LanguageTemplate));
+  DupString(template->text, entry);
+  template->lines = MyMalloc(language_max_lines(entry) * sizeof(char *));
+  template->count = language_split(template->text, template->lines);
+
+  return template;
+}
+
+static void
+free_template(struct LanguageTemplate *template)
+{
+  if(template == &no_template)
+    return;
+
+  MyFree(template->text);
+  MyFree(template->lines);
+  MyFree(template);
+}
+
+/* language_template()
+ *
+ * inputs       - language table entry, entry number
+ * output       - the entry split into lines, or NULL if it has to be
+ *                formatted or does not exist
+ * side effects - the template is built the first time it is asked for
+ */
+struct LanguageTemplate *
+language_template(struct LanguageFile *language, unsigned int langid)
+{
+  if(langid >= LANG_TABLE_SIZE || language->entries[langid] == NULL)
+    return NULL;
+
+  if(language->templates[langid] == NULL)
+    language->templates[langid] = compile_template(language->entries[langid]);
+
+  if(language->templates[langid] == &no_template)
+    return NULL;
+  return language->templates[langid];
+}
+
+/* clear_language()
+ *
+ * inputs       - language table entry
+ * output       - none
+ * side effects - everything loaded into it is freed or unmapped
+ */
+static void
+clear_language(struct LanguageFile *language)
+{
+  int i;
+
+  for(i = 0; i < LANG_TABLE_SIZE; i++)
+  {
+    if(language->templates[i] != NULL)
+      free_template(language->templates[i]);
+    language->templates[i] = NULL;
+
+    if(language->catalog == NULL)
+      MyFree(language->entries[i]);
+    language->entries[i] = NULL;
+  }
+
+  if(language->catalog != NULL)
+    munmap(language->catalog, language->catalog_size);
+  language->catalog = NULL;
+  language->catalog_size = 0;
+
+  MyFree(language->name);
+  language->name = NULL;
+}
+
+/* map_catalog()
+ *
+ * inputs       - language table, compiled catalog, the .lang it came from
+ * output       - TRUE if the catalog was loaded
+ * side effects - the catalog is mapped read only and the entries point
+ *                into it, a catalog older than its .lang is left alone
+ *                so an edited .lang file is not ignored
+ */
+static int
+map_catalog(struct LanguageFile *language, const char *catfile,
+    const char *langfile)
+{
+  struct LanguageCatalog *header;
+  struct stat catstat, langstat;
+  unsigned int *offsets;
+  char *catalog;
+  size_t size;
+  unsigned int i;
+  int fd;
+
+  if((fd = open(catfile, O_RDONLY)) < 0)
+    return FALSE;
+
+  if(fstat(fd, &catstat) < 0 ||
+      (stat(langfile, &langstat) == 0 && langstat.st_mtime > catstat.st_mtime))
+  {
+    close(fd);
+    return FALSE;
+  }
+
+  size = catstat.st_size;
+  if(size <= sizeof(struct LanguageCatalog))
+  {
+    close(fd);
+    return FALSE;
+  }
+
+  catalog = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(catalog == MAP_FAILED)
+    return FALSE;
+
+  header = (struct LanguageCatalog *)catalog;
+  offsets = (unsigned int *)(header + 1);
+
+  /* every offset has to point at a string that ends inside the file */
+  if(header->magic != LANG_CATALOG_MAGIC ||
+      header->version != LANG_CATALOG_VERSION ||
+      header->lang >= LANG_LAST || header->count > LANG_TABLE_SIZE ||
+      sizeof(*header) + header->count * sizeof(unsigned int) >= size ||
+      header->name >= size || catalog[size - 1] != '\0')
+  {
+    ilog(L_DEBUG, "Language catalog %s is invalid", catfile);
+    munmap(catalog, size);
+    return FALSE;
+  }
+
+  for(i = 0; i < header->count; i++)
+  {
+    if(offsets[i] >= size)
+    {
+      ilog(L_DEBUG, "Language catalog %s is invalid", catfile);
+      munmap(catalog, size);
+      return FALSE;
+    }
+  }
+
+  language += header->lang;
+  clear_language(language);
+
+  language->catalog = catalog;
+  language->catalog_size = size;
+  DupString(language->name, catalog + header->name);
+
+  for(i = 0; i < header->count; i++)
+    if(offsets[i] != 0)
+      language->entries[i] = catalog + offsets[i];
+
+  ilog(L_DEBUG, "Mapped language %d(%s)", header->lang, catfile);
+  return TRUE;
+}
+
+/* load_language()
+ *
+ * inputs       - language table, name of the file
+ * output       - none
+ * side effects - the compiled catalog is mapped if there is one that is
+ *                up to date, otherwise the .lang file is read into the
+ *                table.  stdio is used rather than fbopen() so services.en
+ *                can be loaded on a startup worker
+ */
 void
 load_language(struct LanguageFile *language, const char *langfile)
 {
-  FBFILE *file;
+  FILE *file;
   char buffer[256];
+  char catfile[256];
   char *s;
+  char *text = NULL;
+  size_t len = 0, size = 0;
   int lang, i = 0;
 
   snprintf(buffer, sizeof(buffer), "%s/%s.lang", LANGPATH, langfile);
+  snprintf(catfile, sizeof(catfile), "%s/%s.lng", LANGPATH, langfile);
 
-  if((file = fbopen(buffer, "r")) == NULL)
+  if(map_catalog(language, catfile, buffer))
+    return;
+
+  if((file = fopen(buffer, "r")) == NULL)
   {
     ilog(L_DEBUG, "Failed to open language file %s (%s)", langfile, buffer);
     return;
   }
   
   /* Read the first line which tells us which language this is */
-  fbgets(buffer, sizeof(buffer), file);
-  if((s = strchr(buffer, ' ')) == NULL)
+  if(fgets(buffer, sizeof(buffer), file) == NULL ||
+      (s = strchr(buffer, ' ')) == NULL ||
+      (lang = atoi(buffer)) < 0 || lang >= LANG_LAST)
   {
     ilog(L_DEBUG, "Language file %s is invalid", langfile);
+    fclose(file);
     return;
   }
 
   *s++ = '\0';
-  lang = atoi(buffer);
  
   if(s[strlen(s) - 1] == '\n')
     s[strlen(s) - 1] = '\0';
   
-  DupString(language[lang].name, s);
+  language += lang;
+  clear_language(language);
+  DupString(language->name, s);
   
   ilog(L_DEBUG, "Loading language %d(%s)", lang, langfile);
 
-  while(fbgets(buffer, sizeof(buffer), file) != NULL)
+  /* the lines of an entry are collected in text, which only ever grows
+   * by doubling, and handed over once the next entry starts */
+  for(;;)
   {
-    char *ptr;
+    int more = fgets(buffer, sizeof(buffer), file) != NULL;
 
-    if(buffer[0] != '\t')
+    if(!more || buffer[0] != '\t')
     {
+      if(text != NULL && i < LANG_TABLE_SIZE)
+        language->entries[i] = text;
+      else
+        MyFree(text);
+      text = NULL;
+      len = size = 0;
+
+      if(!more)
+        break;
       i++;
       continue;
     }
 
-    s = buffer;
-    s++;
+    s = buffer + 1;
+    s[strcspn(s, "\n")] = '\0';
 
-    if(language[lang].entries[i] != NULL)
+    if(len + strlen(s) + 2 > size)
     {
-      ptr = MyMalloc(strlen(language[lang].entries[i]) + strlen(s) + 2);
-      sprintf(ptr, "%s\n%s", language[lang].entries[i], s);
-
-      if(ptr[strlen(ptr)-1] == '\n')
-        ptr[strlen(ptr)-1] = '\0';
- 
-      MyFree(language[lang].entries[i]);
-    }
-    else
-    {
-      DupString(ptr, s);
-      if(ptr[strlen(ptr)-1] == '\n')
-        ptr[strlen(ptr)-1] = '\0';
+      while(len + strlen(s) + 2 > size)
+        size = size ? size * 2 : 256;
+      text = MyRealloc(text, size);
     }
-    language[lang].entries[i] = ptr;
+
+    if(len > 0)
+      text[len++] = '\n';
+    strcpy(text + len, s);
+    len += strlen(s);
   }
-  fbclose(file);
+  fclose(file);
 }
 
 void
 unload_languages(struct LanguageFile *languages)
 {
-  int i, j = 1;
+  int i;
 
   for(i = 0; i < LANG_LAST; i++)
   {
-    ilog(L_DEBUG, "Unloading language %s", languages[i].name);
     if(languages[i].name == NULL)
       continue;
-  
-    MyFree(languages[i].name);
-    while(languages[i].entries[j] != NULL)
-    {
-      MyFree(languages[i].entries[j]);
-      j++;
-    }
+
+    ilog(L_DEBUG, "Unloading language %s", languages[i].name);
+    clear_language(&languages[i]);
   }
 }
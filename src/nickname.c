@@ -32,6 +32,34 @@
 #include "interface.h"
 #include "msg.h"
 #include "crypt.h"
+#include "hash.h"
+#include "client.h"
+
+/*
+ * Account access masks and certificate fingerprints are kept in memory,
+ * indexed by account id, so checking a connecting user does not cost any
+ * database queries.  The table is loaded in full at startup, kept up to
+ * date by the functions below that change the lists, and reloaded every
+ * ACCESS_RELOAD_TIME seconds to pick up changes made outside of services.
+ * A failed reload keeps the old table, so the checks carry on working
+ * while the database is away.
+ */
+#define ACCESS_HASH_SIZE    0x4000
+#define ACCESS_RELOAD_TIME  600
+
+struct AccountAccess
+{
+  dlink_node node;
+  unsigned int account_id;
+  dlink_list masks;
+  dlink_list certs;
+};
+
+static dlink_list *access_table = NULL;
+static int access_loaded = FALSE;
+
+static void access_cache_drop(unsigned int);
+static void access_cache_forget_nick(unsigned int, unsigned int);
 
 /*
  * row_to_nickname:
@@ -50,9 +78,9 @@ row_to_nickname(row_t *row)
   Nickname *nick = MyMalloc(sizeof(Nickname));
   memset(nick, 0, sizeof(Nickname));
 
-  nick->id = atoi(row->cols[0]);
-  nick->pri_nickid = atoi(row->cols[1]);
-  nick->nickid = atoi(row->cols[2]);
+  nick->id = db_row_int(row, 0);
+  nick->pri_nickid = db_row_int(row, 1);
+  nick->nickid = db_row_int(row, 2);
   strlcpy(nick->nick, row->cols[3], sizeof(nick->nick));
   strlcpy(nick->pass, row->cols[4], sizeof(nick->pass));
   strlcpy(nick->salt, row->cols[5], sizeof(nick->salt));
@@ -61,14 +89,14 @@ row_to_nickname(row_t *row)
   DupString(nick->email, row->cols[7]);
   if(row->cols[8] != NULL)
     strlcpy(nick->cloak, row->cols[8], sizeof(nick->cloak));
-  nick->enforce = atoi(row->cols[9]);
-  nick->secure = atoi(row->cols[10]);
-  nick->verified = atoi(row->cols[11]);
-  nick->cloak_on = atoi(row->cols[12]);
-  nick->admin = atoi(row->cols[13]);
-  nick->email_verified = atoi(row->cols[14]);
-  nick->priv = atoi(row->cols[15]);
-  nick->language = atoi(row->cols[16]);
+  nick->enforce = db_row_int(row, 9);
+  nick->secure = db_row_int(row, 10);
+  nick->verified = db_row_int(row, 11);
+  nick->cloak_on = db_row_int(row, 12);
+  nick->admin = db_row_int(row, 13);
+  nick->email_verified = db_row_int(row, 14);
+  nick->priv = db_row_int(row, 15);
+  nick->language = db_row_int(row, 16);
   if(row->cols[17] != NULL)
     DupString(nick->last_host, row->cols[17]);
   if(row->cols[18] != NULL)
@@ -76,10 +104,47 @@ row_to_nickname(row_t *row)
   if(row->cols[19] != NULL)
     DupString(nick->last_quit, row->cols[19]);
   if(row->cols[20] != NULL)
-    nick->last_quit_time = atoi(row->cols[20]);
-  nick->reg_time = atoi(row->cols[21]);
-  nick->nick_reg_time = atoi(row->cols[22]);
-  nick->last_seen = atoi(row->cols[23]);
+    nick->last_quit_time = db_row_int(row, 20);
+  nick->reg_time = db_row_int(row, 21);
+  nick->nick_reg_time = db_row_int(row, 22);
+  nick->last_seen = db_row_int(row, 23);
+
+  return nick;
+}
+
+/*
+ * nickname_attached:
+ *
+ * While the database is down, a nickname can still be found on the client
+ * using it.  Returns a copy of the Nickname that client identified to,
+ * which the caller frees as any other, or NULL if nobody online has it.
+ *
+ */
+static Nickname*
+nickname_attached(const char *nickname)
+{
+  struct Client *client = find_client(nickname);
+  const Nickname *from;
+  Nickname *nick;
+
+  if(client == NULL || client->nickname == NULL ||
+      irccmp(client->nickname->nick, nickname) != 0)
+    return NULL;
+
+  from = client->nickname;
+  nick = MyMalloc(sizeof(Nickname));
+  memcpy(nick, from, sizeof(Nickname));
+  memset(&nick->node, 0, sizeof(nick->node));
+  if(from->email != NULL)
+    DupString(nick->email, from->email);
+  if(from->url != NULL)
+    DupString(nick->url, from->url);
+  if(from->last_realname != NULL)
+    DupString(nick->last_realname, from->last_realname);
+  if(from->last_host != NULL)
+    DupString(nick->last_host, from->last_host);
+  if(from->last_quit != NULL)
+    DupString(nick->last_quit, from->last_quit);
 
   return nick;
 }
@@ -91,6 +156,9 @@ row_to_nickname(row_t *row)
  * the nick if one is found.  Allocates the storage for it, which must be
  * freed with nickname_freename.
  *
+ * While the database is down only nicknames that someone online is
+ * identified to are found, see nickname_attached.
+ *
  * Returns the nickname structure on success, NULL on error or if the nickname
  * was not found.
  *
@@ -102,6 +170,9 @@ nickname_find(const char *nickname)
   Nickname *nick;
   int error;
 
+  if(!db_is_connected())
+    return nickname_attached(nickname);
+
   results = db_execute(GET_FULL_NICK, &error, "s", nickname);
   if(error)
   {
@@ -136,52 +207,34 @@ nickname_find(const char *nickname)
 int
 nickname_register(Nickname *nick)
 {
-  int accid, nickid, ret, tmp;
-
-  db_begin_transaction();
+  struct DBPipeline pipeline;
+  int accid, nickid, ret;
 
+  /* with both ids known up front the rows go in as one pipeline */
   nickid = db_nextid("nickname", "id");
   if(nickid == -1)
-    goto failure;
-
-  ret = db_execute_nonquery(INSERT_ACCOUNT, "isssi", &nickid, nick->pass,
-      nick->salt, nick->email, &CurrentTime);
-
-  if(ret == -1)
-    goto failure;
+    return FALSE;
 
-  accid = db_insertid("account", "id");
+  accid = db_nextid("account", "id");
   if(accid == -1)
-    goto failure;
-
-  ret = db_execute_nonquery(INSERT_NICK, "isiii", &nickid, nick->nick, &accid,
-      &CurrentTime, &CurrentTime);
-
-  if(ret == -1)
-    goto failure;
-
-  tmp = db_insertid("nickname", "id");
-  if(tmp == -1)
-    goto failure;
-
-  assert(tmp == nickid);
+    return FALSE;
 
-  ret = db_execute_nonquery(SET_NICK_MASTER, "ii", &nickid, &accid);
-  if(ret == -1)
-    goto failure;
+  db_pipeline_init(&pipeline);
+  db_pipeline_nonquery(&pipeline, INSERT_ACCOUNT_ID, "iisssi", &accid,
+      &nickid, nick->pass, nick->salt, nick->email, &CurrentTime);
+  db_pipeline_nonquery(&pipeline, INSERT_NICK, "isiii", &nickid, nick->nick,
+      &accid, &CurrentTime, &CurrentTime);
+  ret = db_pipeline_run(&pipeline);
+  db_pipeline_free(&pipeline);
 
-  if(!db_commit_transaction())
-    goto failure;
+  if(!ret)
+    return FALSE;
 
   nick->id = accid;
   nick->nickid = nick->pri_nickid = nickid;
   nick->nick_reg_time = nick->reg_time = CurrentTime;
 
   return TRUE;
- 
-failure:
-  db_rollback_transaction();
-  return FALSE;
 }
 
 /*
@@ -204,6 +257,7 @@ int
 nickname_delete(Nickname *nick)
 {
   int newid, ret, error;
+  int dropped = FALSE;
 
   db_begin_transaction();
  
@@ -227,6 +281,7 @@ nickname_delete(Nickname *nick)
       ret = db_execute_nonquery(DELETE_ACCOUNT, "i", &nick->id);
       if(ret == -1)
         goto failure;
+      dropped = TRUE;
     }
     else
     {
@@ -250,6 +305,11 @@ nickname_delete(Nickname *nick)
   if(!db_commit_transaction())
     return FALSE;
 
+  if(dropped)
+    access_cache_drop(nick->id);
+  else
+    access_cache_forget_nick(nick->id, nick->nickid);
+
   execute_callback(on_nick_drop_cb, nick->id, nick->nickid, nick->pri_nickid);
   return TRUE;
 failure:
@@ -482,7 +542,11 @@ nickname_link(Nickname *master, Nickname *child)
   if(ret == -1)
     goto failure;
 
-  return db_commit_transaction();
+  if(!db_commit_transaction())
+    return FALSE;
+
+  access_cache_drop(child->id);
+  return TRUE;
 
 failure:
   db_rollback_transaction();
@@ -615,6 +679,215 @@ nickname_save(Nickname *nick)
   return db_commit_transaction();
 }
 
+struct AccessEntry *
+row_to_access_entry(row_t *row)
+{
+  struct AccessEntry *entry = MyMalloc(sizeof(struct AccessEntry));
+
+  entry->id = db_row_int(row, 0);
+  DupString(entry->value, row->cols[1]);
+  if(row->cols[2] != NULL)
+    entry->nickname_id = db_row_int(row, 2);
+  else
+    entry->nickname_id = 0;
+
+  return entry;
+}
+
+static struct AccountAccess *
+find_account_access(unsigned int account_id, int create)
+{
+  dlink_list *bucket;
+  struct AccountAccess *access;
+  dlink_node *ptr;
+
+  if(access_table == NULL)
+    return NULL;
+
+  bucket = &access_table[account_id & (ACCESS_HASH_SIZE - 1)];
+
+  DLINK_FOREACH(ptr, bucket->head)
+  {
+    access = ptr->data;
+    if(access->account_id == account_id)
+      return access;
+  }
+
+  if(!create)
+    return NULL;
+
+  access = MyMalloc(sizeof(struct AccountAccess));
+  access->account_id = account_id;
+  dlinkAdd(access, &access->node, bucket);
+
+  return access;
+}
+
+static void
+free_access_entries(dlink_list *list)
+{
+  dlink_node *ptr, *next;
+
+  DLINK_FOREACH_SAFE(ptr, next, list->head)
+  {
+    struct AccessEntry *entry = ptr->data;
+
+    MyFree(entry->value);
+    MyFree(entry);
+    dlinkDelete(ptr, list);
+    free_dlink_node(ptr);
+  }
+}
+
+static void
+free_account_access(dlink_list *table, struct AccountAccess *access)
+{
+  dlinkDelete(&access->node,
+      &table[access->account_id & (ACCESS_HASH_SIZE - 1)]);
+  free_access_entries(&access->masks);
+  free_access_entries(&access->certs);
+  MyFree(access);
+}
+
+static void
+free_access_table(dlink_list *table)
+{
+  dlink_node *ptr, *next;
+  int i;
+
+  if(table == NULL)
+    return;
+
+  for(i = 0; i < ACCESS_HASH_SIZE; i++)
+    DLINK_FOREACH_SAFE(ptr, next, table[i].head)
+      free_account_access(table, ptr->data);
+
+  MyFree(table);
+}
+
+static int
+access_load_query(int query, int certs)
+{
+  result_set_t *results;
+  int error, i;
+
+  results = db_execute(query, &error, "");
+  if(results == NULL)
+  {
+    ilog(L_CRIT, "nickname_access_reload: database error %d", error);
+    return FALSE;
+  }
+
+  for(i = 0; i < results->row_count; i++)
+  {
+    struct AccessEntry *entry = row_to_access_entry(&results->rows[i]);
+    struct AccountAccess *access = find_account_access(entry->id, TRUE);
+
+    dlinkAddTail(entry, make_dlink_node(), certs ? &access->certs :
+        &access->masks);
+  }
+
+  db_free_result(results);
+
+  return TRUE;
+}
+
+/*
+ * nickname_access_reload:
+ *
+ * Loads the access and certificate lists from the database into a new
+ * table and swaps it in for the old one.  Until the first load succeeds
+ * the checks query the database directly.
+ *
+ */
+void
+nickname_access_reload(void *param)
+{
+  dlink_list *old_table = access_table;
+
+  if(!db_is_connected())
+    return;
+
+  access_table = MyMalloc(sizeof(dlink_list) * ACCESS_HASH_SIZE);
+
+  if(!access_load_query(GET_ALL_NICKACCESS, FALSE) ||
+     !access_load_query(GET_ALL_NICKCERTS, TRUE))
+  {
+    free_access_table(access_table);
+    access_table = old_table;
+    return;
+  }
+
+  free_access_table(old_table);
+  access_loaded = TRUE;
+}
+
+void
+init_nickname_access()
+{
+  nickname_access_reload(NULL);
+  eventAdd("Reload nickname access", nickname_access_reload, NULL,
+      ACCESS_RELOAD_TIME);
+}
+
+static void
+access_cache_add(dlink_list *list, const struct AccessEntry *entry)
+{
+  struct AccessEntry *copy = MyMalloc(sizeof(struct AccessEntry));
+
+  copy->id = entry->id;
+  copy->nickname_id = entry->nickname_id;
+  DupString(copy->value, entry->value);
+  dlinkAddTail(copy, make_dlink_node(), list);
+}
+
+static void
+access_cache_delete(dlink_list *list, const char *value, int nocase)
+{
+  dlink_node *ptr, *next;
+
+  DLINK_FOREACH_SAFE(ptr, next, list->head)
+  {
+    struct AccessEntry *entry = ptr->data;
+
+    if((nocase ? irccmp(entry->value, value) : strcmp(entry->value, value)) == 0)
+    {
+      MyFree(entry->value);
+      MyFree(entry);
+      dlinkDelete(ptr, list);
+      free_dlink_node(ptr);
+    }
+  }
+}
+
+static void
+access_cache_drop(unsigned int account_id)
+{
+  struct AccountAccess *access = find_account_access(account_id, FALSE);
+
+  if(access != NULL)
+    free_account_access(access_table, access);
+}
+
+/* certificates bound to a dropped nickname are no longer bound to any */
+static void
+access_cache_forget_nick(unsigned int account_id, unsigned int nickname_id)
+{
+  struct AccountAccess *access = find_account_access(account_id, FALSE);
+  dlink_node *ptr;
+
+  if(access == NULL)
+    return;
+
+  DLINK_FOREACH(ptr, access->certs.head)
+  {
+    struct AccessEntry *entry = ptr->data;
+
+    if(entry->nickname_id == nickname_id)
+      entry->nickname_id = 0;
+  }
+}
+
 /*
  * nickname_accesslist_add:
  *
@@ -633,22 +906,10 @@ nickname_accesslist_add(struct AccessEntry *entry)
   if(ret == -1)
     return FALSE;
 
-  return TRUE;
-}
+  if(access_loaded)
+    access_cache_add(&find_account_access(entry->id, TRUE)->masks, entry);
 
-struct AccessEntry *
-row_to_access_entry(row_t *row)
-{
-  struct AccessEntry *entry = MyMalloc(sizeof(struct AccessEntry));
-
-  entry->id = atoi(row->cols[0]);
-  DupString(entry->value, row->cols[1]);
-  if(row->cols[2] != NULL)
-    entry->nickname_id = atoi(row->cols[2]);
-  else
-    entry->nickname_id = 0;
-
-  return entry;
+  return TRUE;
 }
 
 /*
@@ -693,7 +954,13 @@ nickname_accesslist_list(Nickname *nick, dlink_list *list)
 int
 nickname_accesslist_delete(Nickname *nick, const char *value)
 {
-  return db_execute_nonquery(DELETE_NICKACCESS, "is", &nick->id, value);
+  int ret = db_execute_nonquery(DELETE_NICKACCESS, "is", &nick->id, value);
+  struct AccountAccess *access;
+
+  if(ret > 0 && (access = find_account_access(nick->id, FALSE)) != NULL)
+    access_cache_delete(&access->masks, value, FALSE);
+
+  return ret;
 }
 
 void
@@ -722,6 +989,24 @@ nickname_accesslist_check(Nickname *nick, const char *value)
   dlink_node *ptr;
   int found = FALSE;
 
+  if(access_loaded)
+  {
+    struct AccountAccess *access = find_account_access(nick->id, FALSE);
+
+    if(access == NULL)
+      return FALSE;
+
+    DLINK_FOREACH(ptr, access->masks.head)
+    {
+      struct AccessEntry *entry = (struct AccessEntry *)ptr->data;
+
+      if(match(entry->value, value))
+        return TRUE;
+    }
+
+    return FALSE;
+  }
+
   nickname_accesslist_list(nick, &list);
 
   DLINK_FOREACH(ptr, list.head)
@@ -841,13 +1126,22 @@ nickname_cert_add(struct AccessEntry *access)
   if(ret == -1)
     return FALSE;
 
+  if(access_loaded)
+    access_cache_add(&find_account_access(access->id, TRUE)->certs, access);
+
   return TRUE;
 }
 
 int
 nickname_cert_delete(Nickname *nick, const char *value)
 {
-  return db_execute_nonquery(DELETE_NICKCERT, "is", &nick->id, value);
+  int ret = db_execute_nonquery(DELETE_NICKCERT, "is", &nick->id, value);
+  struct AccountAccess *access;
+
+  if(ret > 0 && (access = find_account_access(nick->id, FALSE)) != NULL)
+    access_cache_delete(&access->certs, value, TRUE);
+
+  return ret;
 }
 
 void
@@ -877,6 +1171,31 @@ nickname_cert_check(Nickname *nick, const char *value,
   dlink_node *ptr;
   int found = FALSE;
 
+  if(access_loaded)
+  {
+    struct AccountAccess *access = find_account_access(nick->id, FALSE);
+
+    if(access == NULL)
+      return FALSE;
+
+    DLINK_FOREACH(ptr, access->certs.head)
+    {
+      struct AccessEntry *entry = (struct AccessEntry *)ptr->data;
+
+      if(match(entry->value, value))
+      {
+        if(retentry != NULL)
+        {
+          *retentry = MyMalloc(sizeof(struct AccessEntry));
+          memcpy(*retentry, entry, sizeof(struct AccessEntry));
+        }
+        return TRUE;
+      }
+    }
+
+    return FALSE;
+  }
+
   nickname_cert_list(nick, &list);
 
   DLINK_FOREACH(ptr, list.head)
@@ -916,9 +1235,9 @@ static struct InfoList *
 row_to_infolist(row_t *row, char isgroup)
 {
   struct InfoList *chan = MyMalloc(sizeof(struct InfoList));
-  chan->id = atoi(row->cols[0]);
+  chan->id = db_row_int(row, 0);
   DupString(chan->name, row->cols[1]);
-  chan->ilevel = atoi(row->cols[2]);
+  chan->ilevel = db_row_int(row, 2);
   if(!isgroup)
   {
     switch(chan->ilevel)
@@ -1060,6 +1379,24 @@ nickname_list_forbid_free(dlink_list *list)
   db_string_list_free(list);
 }
 
+inline int
+nickname_list_all_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_NICKS_OPER_MATCH, list, mask, after, limit);
+}
+
+inline int
+nickname_list_regular_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_NICKS_MATCH, list, mask, after, limit);
+}
+
+inline int
+nickname_list_forbid_match(dlink_list *list, const char *mask, const char *after, int limit)
+{
+  return db_string_list_match(GET_FORBIDS_MATCH, list, mask, after, limit);
+}
+
 inline int
 nickname_list_admins(dlink_list *list)
 {
@@ -1404,43 +1741,35 @@ nickname_set_url(Nickname *this, const char *value)
     return FALSE;
 }
 
+/*
+ * The last_* fields change on every identify and quit, so they go through
+ * the batched update queue rather than a query each.
+ */
 inline int
 nickname_set_last_realname(Nickname *this, const char *value)
 {
-  if(db_execute_nonquery(SET_NICK_LAST_REALNAME, "si", value, &this->id) > 0)
-  {
-    MyFree(this->last_realname);
-    DupString(this->last_realname, value);
-    return TRUE;
-  }
-  else
-    return FALSE;
+  db_batch_set(BATCH_ACCOUNT, this->id, BATCH_LAST_REALNAME, value);
+  MyFree(this->last_realname);
+  DupString(this->last_realname, value);
+  return TRUE;
 }
 
 inline int
 nickname_set_last_host(Nickname *this, const char *value)
 {
-  if(db_execute_nonquery(SET_NICK_LAST_HOST, "si", value, &this->id) > 0)
-  {
-    MyFree(this->last_host);
-    DupString(this->last_host, value);
-    return TRUE;
-  }
-  else
-    return FALSE;
+  db_batch_set(BATCH_ACCOUNT, this->id, BATCH_LAST_HOST, value);
+  MyFree(this->last_host);
+  DupString(this->last_host, value);
+  return TRUE;
 }
 
 inline int
 nickname_set_last_quit(Nickname *this, const char *value)
 {
-  if(db_execute_nonquery(SET_NICK_LAST_QUIT, "si", value, &this->id) > 0)
-  {
-    MyFree(this->last_quit);
-    DupString(this->last_quit, value);
-    return TRUE;
-  }
-  else
-    return FALSE;
+  db_batch_set(BATCH_ACCOUNT, this->id, BATCH_LAST_QUIT, value);
+  MyFree(this->last_quit);
+  DupString(this->last_quit, value);
+  return TRUE;
 }
 
 inline int
@@ -1546,24 +1875,16 @@ nickname_set_reg_time(Nickname *this, time_t value)
 inline int
 nickname_set_last_seen(Nickname *this, time_t value)
 {
-  if(db_execute_nonquery(SET_NICK_LAST_SEEN, "ii", &value, &this->nickid) > 0)
-  {
-    this->last_seen = value;
-    return TRUE;
-  }
-  else
-    return FALSE;
+  db_batch_set_int(BATCH_NICKNAME, this->nickid, BATCH_LAST_SEEN, value);
+  this->last_seen = value;
+  return TRUE;
 }
 
 inline int
 nickname_set_last_quit_time(Nickname *this, time_t value)
 {
-  if(db_execute_nonquery(SET_NICK_LAST_QUITTIME, "ii", &value, &this->id) > 0)
-  {
-    this->last_quit_time = value;
-    return TRUE;
-  }
-  else
-    return FALSE;
+  db_batch_set_int(BATCH_ACCOUNT, this->id, BATCH_LAST_QUITTIME, value);
+  this->last_quit_time = value;
+  return TRUE;
 }
 
@@ -30,6 +30,7 @@
 #include "packet.h"
 #include "client.h"
 #include "parse.h"
+#include "replay.h"
 
 struct Callback *iorecv_cb = NULL;
 struct Callback *iosend_cb = NULL;
@@ -60,7 +61,9 @@ client_dopacket(struct Client *client, char *buffer, size_t length)
   me.localClient->recv.bytes += length;
 */
 
+  capture_line(buffer, length);
   parse(client, buffer, buffer + length);
+  arena_reset(request_arena);
 }
 
 
@@ -85,7 +85,7 @@ static char *sender;
 static char *para[IRCD_MAXPARA + 1];
 static char *servpara[IRCD_MAXPARA+1];
 
-static FBFILE *parse_log_fb;
+static int parse_log_stream = -1;
 
 static void handle_command(struct Message *, struct Client *, struct Client *, unsigned int, char **);
 //static void recurse_report_messages(struct Client *source_p, struct MessageTree *mtree);
@@ -100,36 +100,26 @@ init_parser()
   char logpath[LOG_BUFSIZE];
 
   clear_tree_parse(&irc_msg_tree);
-  snprintf(logpath, LOG_BUFSIZE, "%s/%s", LOGDIR, Logging.sqllog);
-  if(parse_log_fb == NULL)
+  snprintf(logpath, LOG_BUFSIZE, "%s/%s", LOGDIR, Logging.parselog);
+  if(parse_log_stream == -1)
   {
-    if(Logging.parselog[0] != '\0' && (parse_log_fb = fbopen(logpath, "r")) != NULL)
-    {
-      fbclose(parse_log_fb);
-      parse_log_fb = fbopen(logpath, "a");
-    }
+    /* only log protocol traffic if the file has been created */
+    if(Logging.parselog[0] != '\0' && access(logpath, F_OK) == 0)
+      parse_log_stream = log_stream_open(logpath);
   }
 }
 
 void
 parse_log(const char *format, ...)
 {
-  char *buf;
-  char lbuf[LOG_BUFSIZE];
   va_list args;
-  size_t bytes;
 
-  if(parse_log_fb == NULL)
+  if(parse_log_stream == -1)
     return;
 
   va_start(args, format);
-  vasprintf(&buf, format, args);
+  log_stream_vprintf(parse_log_stream, format, args);
   va_end(args);
-
-  bytes = snprintf(lbuf, sizeof(lbuf), "[%s] %s\n", smalldate(CurrentTime), buf);
-  MyFree(buf);
-
-  fbputs(lbuf, parse_log_fb, bytes);
 }
 
 void
@@ -137,21 +127,17 @@ parse_reopen_log()
 {
   char logpath[LOG_BUFSIZE+1];
 
-  if(parse_log_fb != NULL)
-  {
-    fbclose(parse_log_fb);
-    parse_log_fb = NULL;
-  }
-
   snprintf(logpath, LOG_BUFSIZE, "%s/%s", LOGDIR, Logging.parselog);
-  if(parse_log_fb == NULL)
+  if(Logging.parselog[0] == '\0' || access(logpath, F_OK) != 0)
   {
-    if(Logging.parselog[0] != '\0' && (parse_log_fb = fbopen(logpath, "r")) != NULL)
-    {
-      fbclose(parse_log_fb);
-      parse_log_fb = fbopen(logpath, "a");
-    }
+    if(parse_log_stream != -1)
+      log_stream_close(parse_log_stream);
+    parse_log_stream = -1;
   }
+  else if(parse_log_stream == -1)
+    parse_log_stream = log_stream_open(logpath);
+  else
+    log_stream_reopen(parse_log_stream, logpath);
 }
 
 /* turn a string into a parc/parv pair */
@@ -394,15 +380,13 @@ handle_services_command(struct ServiceMessage *pmptr,
     
     if(pmptr != NULL)
     {
-      char **parv = MyMalloc(sizeof(char*)*(i+1));
+      char **parv = arena_alloc(request_arena, sizeof(char*)*(i+1));
 
       parv[0] = from->name;
       parv[1] = (char*)mptr->cmd;
       parv[2] = (char*)mptr->cmd;
 
       do_help(service, from, pmptr->cmd, i+1, parv);
-
-      MyFree(parv);
     }
     else
       do_help(service, from, mptr->cmd, i, hpara);
@@ -419,15 +403,13 @@ handle_services_command(struct ServiceMessage *pmptr,
     
     if(pmptr != NULL)
     {
-      char **parv = MyMalloc(sizeof(char*)*(i+1));
+      char **parv = arena_alloc(request_arena, sizeof(char*)*(i+1));
 
       parv[0] = from->name;
       parv[1] = (char*)mptr->cmd;
       parv[2] = (char*)mptr->cmd;
 
       do_help(service, from, pmptr->cmd, i+1, parv);
-
-      MyFree(parv);
     }
     else
       do_help(service, from, mptr->cmd, 1, hpara);
@@ -445,7 +427,11 @@ handle_services_command(struct ServiceMessage *pmptr,
       regchptr = dbchannel_find(hpara[1]);
       if(regchptr == NULL && !(mptr->flags & SFLG_UNREGOK))
       {
-        reply_user(service, NULL, from, SERV_UNREG_CHAN, hpara[1]);
+        /* not found is not the same as unregistered while it is down */
+        if(!db_is_connected())
+          reply_user(service, NULL, from, SERV_DB_DOWN, hpara[1]);
+        else
+          reply_user(service, NULL, from, SERV_UNREG_CHAN, hpara[1]);
         return;
       }
     }
@@ -506,7 +492,10 @@ handle_services_command(struct ServiceMessage *pmptr,
     group = group_find(hpara[1]);
     if(group == NULL && !(mptr->flags & SFLG_UNREGOK))
     {
-      reply_user(service, NULL, from, SERV_UNREG_GROUP, hpara[1]);
+      if(!db_is_connected())
+        reply_user(service, NULL, from, SERV_DB_DOWN, hpara[1]);
+      else
+        reply_user(service, NULL, from, SERV_UNREG_GROUP, hpara[1]);
       return;
     }
 
@@ -1105,6 +1094,7 @@ process_privmsg(int privmsg, struct Client *client, struct Client *source,
   struct Service *service;
   struct ServiceMessage *mptr, *parent = NULL;
   struct Channel *channel;
+  struct ArenaMark mark;
   char *s, *ch, *ch2;
   int i = 0;
 
@@ -1233,8 +1223,11 @@ process_privmsg(int privmsg, struct Client *client, struct Client *source,
 
   servpara[0] = source->name;
 
+  /* whatever the command takes from the request arena goes with it */
+  arena_mark(request_arena, &mark);
   handle_services_command(parent, mptr, service, source, (i == 0) ? i : i-1, 
       servpara);
+  arena_release(request_arena, &mark);
 }
 
 size_t
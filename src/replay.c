@@ -0,0 +1,428 @@
+/*
+ *  oftc-ircservices: an extensible and flexible IRC Services package
+ *  replay.c - capture of uplink traffic and replay of captures
+ *
+ *  Copyright (C) 2012 Stuart Walsh and the OFTC Coding department
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ */
+
+/*
+ * A capture is a text file: the CAPTURE_MAGIC line, then one line per
+ * inbound protocol line as "<seconds>.<microseconds> <line>", stamped with
+ * the SystemTime the line was parsed at.  Replaying one feeds the lines to
+ * parse() back to back, with CurrentTime following the stamps instead of
+ * the wall clock, so timed events fire at the same points they did live.
+ */
+
+#include "stdinc.h"
+#include "client.h"
+#include "connection.h"
+#include "interface.h"
+#include "packet.h"
+#include "parse.h"
+#include "send.h"
+#include "events.h"
+#include "replay.h"
+
+static int capture_fd = -1;
+static char *capture_buf;
+static size_t capture_len;
+
+static struct ReplayCommand replay_commands[REPLAY_MAXCOMMANDS + 1];
+static unsigned int replay_ncommands;
+static unsigned long replay_sent_lines;
+static unsigned long long replay_sent_bytes;
+
+/* capture_flush()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - buffered capture lines are written out, capturing stops
+ *                if the file can not be written
+ */
+static void
+capture_flush()
+{
+  size_t off = 0;
+  ssize_t n;
+
+  while(off < capture_len)
+  {
+    n = write(capture_fd, capture_buf + off, capture_len - off);
+    if(n < 0)
+    {
+      if(errno == EINTR)
+        continue;
+
+      ilog(L_ERROR, "Capture stopped, write failed: %s", strerror(errno));
+      close(capture_fd);
+      capture_fd = -1;
+      break;
+    }
+    off += n;
+  }
+
+  capture_len = 0;
+}
+
+static void
+capture_flush_event(void *param)
+{
+  if(capture_fd != -1 && capture_len > 0)
+    capture_flush();
+}
+
+void
+init_capture(const char *path)
+{
+  /* PASS lines and IDENTIFY passwords end up in here */
+  capture_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if(capture_fd == -1)
+  {
+    ilog(L_ERROR, "Unable to open capture file %s: %s", path,
+        strerror(errno));
+    return;
+  }
+
+  capture_buf = MyMalloc(CAPTURE_BUFSIZE);
+  capture_len = snprintf(capture_buf, CAPTURE_BUFSIZE, "%s\n", CAPTURE_MAGIC);
+
+  eventAdd("Flush capture", capture_flush_event, NULL, 1);
+  ilog(L_NOTICE, "Capturing uplink traffic to %s", path);
+}
+
+void
+cleanup_capture()
+{
+  if(capture_buf == NULL)
+    return;
+
+  eventDelete(capture_flush_event, NULL);
+
+  if(capture_fd != -1)
+  {
+    capture_flush();
+    if(capture_fd != -1)
+      close(capture_fd);
+    capture_fd = -1;
+  }
+
+  MyFree(capture_buf);
+  capture_buf = NULL;
+}
+
+/* capture_line()
+ *
+ * inputs       - line as handed to parse(), its length
+ * output       - none
+ * side effects - the line is stamped and appended to the capture buffer
+ */
+void
+capture_line(const char *line, size_t len)
+{
+  /* "<seconds>.<microseconds> " plus the newline */
+  if(capture_fd == -1)
+    return;
+
+  if(capture_len + len + 32 > CAPTURE_BUFSIZE)
+  {
+    capture_flush();
+    if(capture_fd == -1)
+      return;
+  }
+
+  capture_len += snprintf(capture_buf + capture_len,
+      CAPTURE_BUFSIZE - capture_len, "%lu.%06lu ",
+      (unsigned long)SystemTime.tv_sec, (unsigned long)SystemTime.tv_usec);
+  memcpy(capture_buf + capture_len, line, len);
+  capture_len += len;
+  capture_buf[capture_len++] = '\n';
+}
+
+static double
+replay_clock()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* nothing goes back up the link, just count what would have */
+static void *
+replay_iosend(va_list args)
+{
+  int length;
+
+  va_arg(args, struct Client *);
+  length = va_arg(args, int);
+
+  replay_sent_lines++;
+  replay_sent_bytes += length;
+  return NULL;
+}
+
+/* replay_command()
+ *
+ * inputs       - a protocol line
+ * output       - the timing slot for its command
+ * side effects - a slot is allocated the first time a command is seen,
+ *                once they run out everything else shares the last one
+ */
+static struct ReplayCommand *
+replay_command(const char *line)
+{
+  struct ReplayCommand *cmd;
+  char name[sizeof(cmd->name)];
+  unsigned int i;
+  size_t len;
+
+  if(*line == ':')
+  {
+    while(*line != '\0' && *line != ' ')
+      line++;
+    while(*line == ' ')
+      line++;
+  }
+
+  len = strcspn(line, " ");
+  if(len >= sizeof(name))
+    len = sizeof(name) - 1;
+  memcpy(name, line, len);
+  name[len] = '\0';
+
+  for(i = 0; i < replay_ncommands; i++)
+  {
+    if(strcmp(replay_commands[i].name, name) == 0)
+      return &replay_commands[i];
+  }
+
+  cmd = &replay_commands[replay_ncommands];
+  if(replay_ncommands < REPLAY_MAXCOMMANDS)
+  {
+    strlcpy(cmd->name, name, sizeof(cmd->name));
+    replay_ncommands++;
+  }
+  else
+    strlcpy(cmd->name, "(other)", sizeof(cmd->name));
+
+  return cmd;
+}
+
+static int
+replay_command_compare(const void *a, const void *b)
+{
+  const struct ReplayCommand *ca = a;
+  const struct ReplayCommand *cb = b;
+
+  if(ca->total == cb->total)
+    return 0;
+  return ca->total < cb->total ? 1 : -1;
+}
+
+/* the report goes to the terminal running the replay and to the log */
+static void
+replay_report(const char *format, ...)
+{
+  char buf[256];
+  va_list args;
+
+  va_start(args, format);
+  vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+
+  printf("%s\n", buf);
+  ilog(L_NOTICE, "%s", buf);
+}
+
+/* replay_timed_line()
+ *
+ * inputs       - uplink client, line and its length
+ * output       - seconds spent parsing it
+ * side effects - the line is parsed as if the uplink had sent it
+ */
+static double
+replay_timed_line(struct Client *client, char *line, size_t len)
+{
+  struct ReplayCommand *cmd = replay_command(line);
+  double start, elapsed;
+
+  start = replay_clock();
+  parse(client, line, line + len);
+  arena_reset(request_arena);
+  elapsed = replay_clock() - start;
+
+  cmd->count++;
+  cmd->total += elapsed;
+  if(elapsed > cmd->max)
+    cmd->max = elapsed;
+
+  return elapsed;
+}
+
+/* replay_run()
+ *
+ * inputs       - path of a capture
+ * output       - none, services exits when the capture is done
+ * side effects - the capture is run through parse() as fast as possible
+ *                and the time spent is reported per phase and per command
+ */
+void
+replay_run(const char *path)
+{
+  static const char *phase_names[] = { "burst", "post-burst", "events" };
+  double phase_time[3] = { 0, 0, 0 };
+  unsigned long phase_lines[3] = { 0, 0, 0 };
+  unsigned long lineno = 0, skipped = 0;
+  struct Client *client;
+  struct timeval stamp;
+  char buf[2 * READBUF_SIZE];
+  double start, wall, elapsed;
+  char *line, *end;
+  FILE *file;
+  size_t len;
+  unsigned int i;
+  int phase, fd, first = TRUE;
+
+  if((file = fopen(path, "r")) == NULL)
+  {
+    ilog(L_CRIT, "Unable to open capture %s: %s", path, strerror(errno));
+    services_die("Replay error", YES);
+  }
+
+  if(fgets(buf, sizeof(buf), file) == NULL ||
+      strncmp(buf, CAPTURE_MAGIC, strlen(CAPTURE_MAGIC)) != 0)
+  {
+    ilog(L_CRIT, "%s is not a capture file", path);
+    services_die("Replay error", YES);
+  }
+
+  /* parse() wants an open fd behind the uplink, nothing is ever sent on it */
+  if((fd = open("/dev/null", O_RDWR)) == -1)
+  {
+    ilog(L_CRIT, "Unable to open /dev/null: %s", strerror(errno));
+    services_die("Replay error", YES);
+  }
+
+  install_hook(iosend_cb, replay_iosend);
+
+  client = make_uplink();
+  fd_open(&client->server->fd, fd, 0, "Replayed uplink");
+  dlinkAdd(client, &client->snode, &global_server_list);
+
+  ilog(L_NOTICE, "Replaying %s", path);
+  start = replay_clock();
+
+  execute_callback(connected_cb, client);
+
+  while(fgets(buf, sizeof(buf), file) != NULL)
+  {
+    lineno++;
+
+    len = strcspn(buf, "\r\n");
+    buf[len] = '\0';
+    if(len == 0 || buf[0] == '#')
+      continue;
+
+    stamp.tv_sec = strtoul(buf, &end, 10);
+    if(*end != '.')
+    {
+      skipped++;
+      continue;
+    }
+    stamp.tv_usec = strtoul(end + 1, &end, 10);
+    if(*end != ' ')
+    {
+      skipped++;
+      continue;
+    }
+
+    line = end + 1;
+    len -= line - buf;
+    if(len == 0 || len >= IRC_BUFSIZE)
+    {
+      skipped++;
+      continue;
+    }
+
+    /* the first stamp pulls the clock back, events keep their offsets */
+    if(first && stamp.tv_sec < CurrentTime)
+      set_back_events(CurrentTime - stamp.tv_sec);
+    if(first || stamp.tv_sec > CurrentTime ||
+        (stamp.tv_sec == CurrentTime && stamp.tv_usec > SystemTime.tv_usec))
+    {
+      SystemTime.tv_sec = stamp.tv_sec;
+      SystemTime.tv_usec = stamp.tv_usec;
+    }
+    first = FALSE;
+
+    if(eventNextTime() <= CurrentTime)
+    {
+      wall = replay_clock();
+      while(eventNextTime() <= CurrentTime)
+        eventRun();
+      phase_time[2] += replay_clock() - wall;
+      phase_lines[2]++;
+    }
+
+    phase = ServicesState.fully_connected ? 1 : 0;
+    elapsed = replay_timed_line(client, line, len);
+    phase_time[phase] += elapsed;
+    phase_lines[phase]++;
+
+    if((phase_lines[0] + phase_lines[1]) % REPLAY_POLL_LINES == 0)
+    {
+      execute_callback(do_event_cb);
+      events_loop();
+      send_queued_all();
+    }
+  }
+
+  send_queued_all();
+  wall = replay_clock() - start;
+  fclose(file);
+
+  replay_report("Replayed %lu lines from %s in %.3fs (%.0f lines/s), "
+      "%lu skipped", phase_lines[0] + phase_lines[1], path, wall,
+      (phase_lines[0] + phase_lines[1]) / (wall > 0 ? wall : 1e-9), skipped);
+  replay_report("Sent %lu lines, %llu bytes to the uplink", replay_sent_lines,
+      replay_sent_bytes);
+  replay_report("%-12s %10s %10s", "phase", "runs", "seconds");
+  for(i = 0; i < 3; i++)
+    replay_report("%-12s %10lu %10.3f", phase_names[i], phase_lines[i],
+        phase_time[i]);
+
+  qsort(replay_commands, replay_ncommands + 1, sizeof(struct ReplayCommand),
+      replay_command_compare);
+  replay_report("%-12s %10s %10s %10s %10s", "command", "count", "seconds",
+      "avg us", "max us");
+  for(i = 0; i <= REPLAY_MAXCOMMANDS; i++)
+  {
+    struct ReplayCommand *cmd = &replay_commands[i];
+
+    if(cmd->count == 0)
+      continue;
+    replay_report("%-12s %10u %10.3f %10.1f %10.1f", cmd->name, cmd->count,
+        cmd->total, cmd->total * 1000000 / cmd->count, cmd->max * 1000000);
+  }
+
+  fflush(stdout);
+
+  uninstall_hook(iosend_cb, replay_iosend);
+  services_die("Replay finished", NO);
+}
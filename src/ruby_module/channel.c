@@ -3,6 +3,10 @@
 
 VALUE cChannel = Qnil;
 
+/* one wrapper per struct Channel, see client_values */
+static VALUE channel_values = Qnil;
+static ID id_new;
+
 static VALUE initialize(VALUE, VALUE);
 static VALUE name(VALUE);
 static VALUE name_set(VALUE, VALUE);
@@ -42,6 +46,10 @@ Init_Channel(void)
 
   rb_define_singleton_method(cChannel, "find", find, 1);
   rb_define_singleton_method(cChannel, "all_each", all_each, 0);
+
+  id_new = rb_intern("new");
+  channel_values = rb_hash_new();
+  rb_gc_register_address(&channel_values);
 }
 
 static VALUE
@@ -218,7 +226,7 @@ value_to_channel(VALUE self)
 VALUE
 channel_to_value(struct Channel *channel)
 {
-  VALUE rbchannel, real_channel;
+  VALUE rbchannel, real_channel, key;
 
   if(channel == NULL)
   {
@@ -226,8 +234,13 @@ channel_to_value(struct Channel *channel)
     return Qnil;
   }
 
+  key = ULONG2NUM((unsigned long)channel);
+  real_channel = rb_hash_lookup(channel_values, key);
+  if(real_channel != Qnil)
+    return real_channel;
+
   rbchannel = Data_Wrap_Struct(rb_cObject, 0, 0, channel);
-  real_channel = do_ruby_ret(cChannel, rb_intern("new"), 1, rbchannel);
+  real_channel = do_ruby_ret(cChannel, id_new, 1, rbchannel);
 
   if(real_channel == Qnil)
   {
@@ -235,6 +248,15 @@ channel_to_value(struct Channel *channel)
     return Qnil;
   }
 
+  rb_hash_aset(channel_values, key, real_channel);
+
   return real_channel;
 }
 
+/* drop the cached wrapper once the struct Channel is about to go away */
+void
+release_channel_value(struct Channel *channel)
+{
+  rb_hash_delete(channel_values, ULONG2NUM((unsigned long)channel));
+}
+
@@ -6,6 +6,11 @@
 VALUE cClient = Qnil;
 VALUE cNickname;
 
+/* one wrapper per struct Client, keyed by address, so hooks don't have to
+ * build a fresh Client object for every event */
+static VALUE client_values = Qnil;
+static ID id_new;
+
 static VALUE initialize(VALUE, VALUE);
 static VALUE name(VALUE);
 static VALUE name_set(VALUE, VALUE);
@@ -93,6 +98,10 @@ Init_Client(void)
 
   rb_define_singleton_method(cClient, "find", find, 1);
   rb_define_singleton_method(cClient, "all_servers_each", all_servers_each, 0);
+
+  id_new = rb_intern("new");
+  client_values = rb_hash_new();
+  rb_gc_register_address(&client_values);
 }
 
 static VALUE
@@ -525,9 +534,14 @@ VALUE
 client_to_value(struct Client *client)
 {
   VALUE rbclient, real_client;
+  VALUE key = ULONG2NUM((unsigned long)client);
+
+  real_client = rb_hash_lookup(client_values, key);
+  if(real_client != Qnil)
+    return real_client;
 
   rbclient = Data_Wrap_Struct(rb_cObject, 0, 0, client);
-  real_client = do_ruby_ret(cClient, rb_intern("new"), 1, rbclient);;
+  real_client = do_ruby_ret(cClient, id_new, 1, rbclient);
 
   if(real_client == Qnil)
   {
@@ -535,6 +549,15 @@ client_to_value(struct Client *client)
     return Qnil;
   }
 
+  rb_hash_aset(client_values, key, real_client);
+
   return real_client;
 }
 
+/* drop the cached wrapper once the struct Client is about to go away */
+void
+release_client_value(struct Client *client)
+{
+  rb_hash_delete(client_values, ULONG2NUM((unsigned long)client));
+}
+
@@ -30,9 +30,11 @@ struct Service* get_service(VALUE);
 
 struct Client* value_to_client(VALUE);
 VALUE client_to_value(struct Client*);
+void release_client_value(struct Client*);
 
 struct Channel* value_to_channel(VALUE);
 VALUE channel_to_value(struct Channel*);
+void release_channel_value(struct Channel*);
 
 DBChannel* value_to_dbchannel(VALUE);
 VALUE dbchannel_to_value(DBChannel*);
@@ -98,12 +100,6 @@ struct ruby_args
   VALUE *parv;
 };
 
-struct rhook_args
-{
-  int parc;
-  VALUE *parv;
-};
-
 void check_our_type(VALUE obj, VALUE type);
 
 extern VALUE cServiceModule;
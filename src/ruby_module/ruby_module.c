@@ -43,8 +43,8 @@ static dlink_node *ruby_nick_reg_hook;
 static dlink_node *ruby_chan_reg_hook;
 static dlink_node *ruby_db_init_hook;
 static dlink_node *ruby_eob_hook;
-
-static dlink_node *ruby_event_hook;
+static dlink_node *ruby_client_free_hook;
+static dlink_node *ruby_channel_free_hook;
 
 static VALUE ruby_server_hooks = Qnil;
 static VALUE ruby_server_events = Qnil;
@@ -67,12 +67,12 @@ static void *rb_nick_reg_hdlr(va_list);
 static void *rb_chan_reg_hdlr(va_list);
 static void *rb_db_init_hdlr(va_list);
 static void *rb_eob_hdlr(va_list);
-
-static void *rb_event_hdlr(va_list);
+static void *rb_client_free_hdlr(va_list);
+static void *rb_channel_free_hdlr(va_list);
 
 static void ruby_script_error();
 
-static VALUE rb_do_hook_each(VALUE key, VALUE name, VALUE params);
+static VALUE rb_do_hook_each(VALUE, int, VALUE *);
 static void unhook_callbacks(const char *);
 static void unhook_events(VALUE);
 
@@ -233,12 +233,22 @@ check_our_type(VALUE obj, VALUE type)
   }
 }
 
+/* Every subscriber is stored as an array indexed by HOOK_POSITION, the
+ * method ID is resolved once when the hook is added */
+enum HOOK_POSITION
+{
+  HOOK_SELF = 0,
+  HOOK_METHOD,
+  HOOK_ID,
+  HOOK_NAME,
+  HOOK_COUNT,
+};
+
 static VALUE
 do_hook(VALUE hooks, int parc, ...)
 {
-  struct rhook_args arg;
   VALUE *params = 0;
-  VALUE keys, ret;
+  VALUE ret = Qnil;
   int i;
   va_list args;
 
@@ -247,21 +257,15 @@ do_hook(VALUE hooks, int parc, ...)
   if(parc > 0)
     params = ALLOCA_N(VALUE, parc);
 
-  arg.parc = parc;
-  arg.parv = params;
-
   for(i = 0; i < parc; i++)
     params[i] = va_arg(args, VALUE);
 
   va_end(args);
 
-  keys = do_ruby_ret(hooks, rb_intern("keys"), 0);
-  for(i = 0; i < RARRAY_LEN(keys); ++i)
+  /* a hook may unload its own module, so recheck the length every time */
+  for(i = 0; i < RARRAY_LEN(hooks); ++i)
   {
-    VALUE key, value;
-    key = rb_ary_entry(keys, i);
-    value = rb_hash_aref(hooks, key);
-    ret = rb_do_hook_each(key, value, (VALUE)&arg);
+    ret = rb_do_hook_each(rb_ary_entry(hooks, i), parc, params);
     if(ret == Qfalse)
       break;
   }
@@ -270,32 +274,34 @@ do_hook(VALUE hooks, int parc, ...)
 }
 
 static VALUE
-rb_do_hook_each(VALUE key, VALUE value, VALUE arg)
+rb_do_hook_each(VALUE hook, int parc, VALUE *parv)
 {
-  VALUE self, command, command_id, ret;
-  struct rhook_args *args = (struct rhook_args*)arg;
+  VALUE self, method, name, ret;
 
-  self = rb_ary_entry(value, 0);
-  command = rb_ary_entry(value, 1);
-  command_id = rb_intern(StringValueCStr(command));
+  self = rb_ary_entry(hook, HOOK_SELF);
+  method = rb_ary_entry(hook, HOOK_METHOD);
+  name = rb_ary_entry(hook, HOOK_NAME);
 
-  ret = do_rubyv(self, command_id, args->parc, args->parv);
+  ret = do_rubyv(self, SYM2ID(rb_ary_entry(hook, HOOK_ID)), parc, parv);
 
   switch(ret)
   {
     case Qnil:
-      ilog(L_DEBUG, "{%s} Returned nil while processing callback: %s", StringValueCStr(key),
-        StringValueCStr(command));
+      ilog(L_DEBUG, "{%s} Returned nil while processing callback: %s",
+        StringValueCStr(name), StringValueCStr(method));
       break;
     case Qfalse:
-      ilog(L_DEBUG, "{%s} Interrupted Callback Chain in %s", StringValueCStr(key),
-        StringValueCStr(command));
+      ilog(L_DEBUG, "{%s} Interrupted Callback Chain in %s",
+        StringValueCStr(name), StringValueCStr(method));
       break;
   }
 
   return ret;
 }
 
+/* Nobody listening, so don't bother wrapping the arguments */
+#define NO_HOOKS(x) (RARRAY_LEN(x) == 0)
+
 static void *
 rb_cmode_hdlr(va_list args)
 {
@@ -304,16 +310,19 @@ rb_cmode_hdlr(va_list args)
   int dir = va_arg(args, int);
   char letter = (char)va_arg(args, int);
   char *param = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_CMODE);
 
-  if(param == NULL)
-    ret = do_hook(hooks, 5, client_to_value(source_p),
-        channel_to_value(chptr), INT2NUM(dir), rb_str_new(&letter, 1), 0);
-  else
-    ret = do_hook(hooks, 5, client_to_value(source_p),
-        channel_to_value(chptr), INT2NUM(dir), rb_str_new(&letter, 1),
-        rb_str_new2(param));
+  if(!NO_HOOKS(hooks))
+  {
+    if(param == NULL)
+      ret = do_hook(hooks, 5, client_to_value(source_p),
+          channel_to_value(chptr), INT2NUM(dir), rb_str_new(&letter, 1), 0);
+    else
+      ret = do_hook(hooks, 5, client_to_value(source_p),
+          channel_to_value(chptr), INT2NUM(dir), rb_str_new(&letter, 1),
+          rb_str_new2(param));
+  }
 
   if(ret != Qfalse)
     return pass_callback(ruby_cmode_hook, source_p, chptr, dir, letter, param);
@@ -327,10 +336,11 @@ rb_umode_hdlr(va_list args)
   struct Client *user = va_arg(args, struct Client *);
   int what = va_arg(args, int);
   int mode = va_arg(args, int);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_UMODE);
 
-  ret = do_hook(hooks, 3, client_to_value(user), INT2NUM(what), INT2NUM(mode));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 3, client_to_value(user), INT2NUM(what), INT2NUM(mode));
 
   if(ret != Qfalse)
     return pass_callback(ruby_umode_hook, user, what, mode);
@@ -342,10 +352,11 @@ static void *
 rb_newusr_hdlr(va_list args)
 {
   struct Client *newuser = va_arg(args, struct Client *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_NEWUSR);
 
-  ret = do_hook(hooks, 1, client_to_value(newuser));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 1, client_to_value(newuser));
 
   if(ret != Qfalse)
     return pass_callback(ruby_newusr_hook, newuser);
@@ -359,11 +370,12 @@ rb_privmsg_hdlr(va_list args)
   struct Client *source = va_arg(args, struct Client *);
   struct Channel *channel = va_arg(args, struct Channel *);
   char *message = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_PRIVMSG);
 
-  ret = do_hook(hooks, 3, client_to_value(source),
-      channel_to_value(channel), rb_str_new2(message));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 3, client_to_value(source),
+        channel_to_value(channel), rb_str_new2(message));
 
   if(ret != Qfalse)
     return pass_callback(ruby_privmsg_hook, source, channel, message);
@@ -376,10 +388,11 @@ rb_join_hdlr(va_list args)
 {
   struct Client* source = va_arg(args, struct Client *);
   char *channel = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_JOIN);
 
-  ret = do_hook(hooks, 2, client_to_value(source), rb_str_new2(channel));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 2, client_to_value(source), rb_str_new2(channel));
 
   if(ret != Qfalse)
     return pass_callback(ruby_join_hook, source, channel);
@@ -394,11 +407,12 @@ rb_part_hdlr(va_list args)
   struct Client* source = va_arg(args, struct Client *);
   struct Channel* channel = va_arg(args, struct Channel *);
   char *reason = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_PART);
 
-  ret = do_hook(hooks, 4, client_to_value(client), client_to_value(source),
-    channel_to_value(channel), rb_str_new2(reason));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 4, client_to_value(client), client_to_value(source),
+      channel_to_value(channel), rb_str_new2(reason));
 
   if(ret != Qfalse)
     return pass_callback(ruby_part_hook, client, source, channel, reason);
@@ -411,10 +425,11 @@ rb_quit_hdlr(va_list args)
 {
   struct Client* client = va_arg(args, struct Client *);
   char *reason = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_QUIT);
 
-  ret = do_hook(hooks, 2, client_to_value(client), rb_str_new2(reason));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 2, client_to_value(client), rb_str_new2(reason));
 
   if(ret != Qfalse)
     return pass_callback(ruby_quit_hook, client, reason);
@@ -427,10 +442,11 @@ rb_nick_hdlr(va_list args)
 {
   struct Client *source = va_arg(args, struct Client *);
   char *oldnick = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_NICK);
 
-  ret = do_hook(hooks, 2, client_to_value(source), rb_str_new2(oldnick));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 2, client_to_value(source), rb_str_new2(oldnick));
 
   if(ret != Qfalse)
     return pass_callback(ruby_nick_hook, source, oldnick);
@@ -444,11 +460,12 @@ rb_notice_hdlr(va_list args)
   struct Client *source = va_arg(args, struct Client *);
   struct Channel *channel = va_arg(args, struct Channel *);
   char *message = va_arg(args, char *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_NOTICE);
 
-  ret = do_hook(hooks, 3, client_to_value(source), channel_to_value(channel),
-      rb_str_new2(message));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 3, client_to_value(source), channel_to_value(channel),
+        rb_str_new2(message));
 
   if(ret != Qfalse)
     return pass_callback(ruby_notice_hook, source, channel, message);
@@ -460,10 +477,11 @@ static void *
 rb_chan_create_hdlr(va_list args)
 {
   struct Channel *channel = va_arg(args, struct Channel *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_CHAN_CREATED);
 
-  ret = do_hook(hooks, 1, channel_to_value(channel));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 1, channel_to_value(channel));
 
   if(ret != Qfalse)
     return pass_callback(ruby_chan_create_hook, channel);
@@ -475,10 +493,11 @@ static void *
 rb_chan_delete_hdlr(va_list args)
 {
   struct Channel *channel = va_arg(args, struct Channel *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_CHAN_DELETED);
 
-  ret = do_hook(hooks, 1, channel_to_value(channel));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 1, channel_to_value(channel));
 
   if(ret != Qfalse)
     return pass_callback(ruby_chan_delete_hook, channel);
@@ -516,10 +535,11 @@ rb_chan_reg_hdlr(va_list args)
 {
   struct Client *client = va_arg(args, struct Client *);
   struct Channel *channel = va_arg(args, struct Channel *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_CHAN_REG);
 
-  ret = do_hook(hooks, 2, client_to_value(client), channel_to_value(channel));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 2, client_to_value(client), channel_to_value(channel));
 
   if(ret != Qfalse)
     return pass_callback(ruby_chan_reg_hook, client, channel);
@@ -531,10 +551,11 @@ static void *
 rb_nick_reg_hdlr(va_list args)
 {
   struct Client *client = va_arg(args, struct Client *);
-  VALUE ret;
+  VALUE ret = Qnil;
   VALUE hooks = rb_ary_entry(ruby_server_hooks, RB_HOOKS_NICK_REG);
 
-  ret = do_hook(hooks, 1, client_to_value(client));
+  if(!NO_HOOKS(hooks))
+    ret = do_hook(hooks, 1, client_to_value(client));
 
   if(ret != Qfalse)
     return pass_callback(ruby_nick_reg_hook, client);
@@ -572,14 +593,63 @@ rb_eob_hdlr(va_list args)
     return NULL;
 }
 
+/* not exposed to scripts, so nothing can stop a wrapper being dropped */
+static void *
+rb_client_free_hdlr(va_list args)
+{
+  struct Client *client = va_arg(args, struct Client *);
+
+  release_client_value(client);
+
+  return pass_callback(ruby_client_free_hook, client);
+}
+
+static void *
+rb_channel_free_hdlr(va_list args)
+{
+  struct Channel *channel = va_arg(args, struct Channel *);
+
+  release_channel_value(channel);
+
+  return pass_callback(ruby_channel_free_hook, channel);
+}
+
+/* find the subscriber belonging to service name in hooks, -1 if none */
+static long
+find_hook(VALUE hooks, VALUE name)
+{
+  long i;
+
+  for(i = 0; i < RARRAY_LEN(hooks); ++i)
+  {
+    VALUE hook = rb_ary_entry(hooks, i);
+    if(rb_str_equal(rb_ary_entry(hook, HOOK_NAME), name) == Qtrue)
+      return i;
+  }
+
+  return -1;
+}
+
 void
 rb_add_hook(VALUE self, VALUE hook, int type)
 {
   VALUE hooks = rb_ary_entry(ruby_server_hooks, type);
-  VALUE newhook = rb_ary_new();
-  rb_ary_push(newhook, self);
-  rb_ary_push(newhook, hook);
-  rb_hash_aset(hooks, rb_iv_get(self, "@ServiceName"), newhook);
+  VALUE name = rb_iv_get(self, "@ServiceName");
+  VALUE newhook = rb_ary_new2(HOOK_COUNT);
+  long pos;
+
+  Check_Type(hooks, T_ARRAY);
+
+  rb_ary_store(newhook, HOOK_SELF, self);
+  rb_ary_store(newhook, HOOK_METHOD, hook);
+  rb_ary_store(newhook, HOOK_ID, ID2SYM(rb_intern(StringValueCStr(hook))));
+  rb_ary_store(newhook, HOOK_NAME, name);
+
+  /* a service only ever has one subscriber per hook type */
+  if((pos = find_hook(hooks, name)) >= 0)
+    rb_ary_store(hooks, pos, newhook);
+  else
+    rb_ary_push(hooks, newhook);
 }
 
 static void
@@ -587,6 +657,7 @@ unhook_callbacks(const char* name)
 {
   VALUE rname = rb_str_new2(name);
   int type;
+  long pos;
   VALUE hooks;
 
   ilog(L_DEBUG, "Unhooking ruby hooks for: %s", name);
@@ -594,7 +665,8 @@ unhook_callbacks(const char* name)
   for(type = 0; type < RB_HOOKS_COUNT; ++type)
   {
     hooks = rb_ary_entry(ruby_server_hooks, type);
-    rb_hash_delete(hooks, rname);
+    if((pos = find_hook(hooks, rname)) >= 0)
+      rb_ary_delete_at(hooks, pos);
   }
 }
 
@@ -605,20 +677,80 @@ enum EVENT_POSITION
   EVT_TIMER,
   EVT_LAST,
   EVT_ARG,
+  EVT_ID,
+  EVT_HANDLE,
   EVT_COUNT,
 };
 
+/* C side of a ruby event, this is what sits in the core event table so the
+ * script is only called when its timer is actually due */
+struct RubyEvent
+{
+  char name[NICKLEN*2+1];
+  VALUE event;
+};
+
+static void
+rb_event_timer(void *param)
+{
+  struct RubyEvent *revent = (struct RubyEvent *)param;
+  VALUE event = revent->event;
+
+  /* revent may be freed by the handler deleting its own event */
+  rb_ary_store(event, EVT_LAST, LONG2NUM(CurrentTime));
+  do_ruby(rb_ary_entry(event, EVT_SELF), SYM2ID(rb_ary_entry(event, EVT_ID)),
+      1, rb_ary_entry(event, EVT_ARG));
+}
+
+static void
+free_ruby_event(VALUE event)
+{
+  struct RubyEvent *revent;
+  VALUE handle = rb_ary_entry(event, EVT_HANDLE);
+
+  if(handle == Qnil)
+    return;
+
+  Data_Get_Struct(handle, struct RubyEvent, revent);
+  eventDelete(rb_event_timer, revent);
+  rb_ary_store(event, EVT_HANDLE, Qnil);
+  MyFree(revent);
+}
+
 VALUE
 rb_add_event(VALUE self, VALUE method, VALUE time, VALUE arg)
 {
   VALUE sn = rb_iv_get(self, "@ServiceName");
   VALUE events = rb_hash_aref(ruby_server_events, sn);
-  VALUE event = rb_ary_new2(EVT_COUNT);
+  VALUE event;
+  struct RubyEvent *revent = MyMalloc(sizeof(struct RubyEvent));
+  long when = NUM2LONG(time);
+
+  snprintf(revent->name, sizeof(revent->name), "%s::%s", StringValueCStr(sn),
+      StringValueCStr(method));
+
+  /* a zero frequency would fire on every pass of the main loop */
+  if(when < 1)
+    when = 1;
+
+  /* the core event table is shared with services itself, a timer that does
+   * not fit in it must not look like it was added */
+  if(!eventAdd(revent->name, rb_event_timer, revent, when))
+  {
+    MyFree(revent);
+    rb_raise(rb_eRuntimeError, "Event table is full, %s not added",
+        StringValueCStr(method));
+  }
+
+  event = rb_ary_new2(EVT_COUNT);
   rb_ary_store(event, EVT_SELF, self);
   rb_ary_store(event, EVT_METHOD, method);
   rb_ary_store(event, EVT_TIMER, time);
   rb_ary_store(event, EVT_ARG, arg);
   rb_ary_store(event, EVT_LAST, LONG2NUM(CurrentTime));
+  rb_ary_store(event, EVT_ID, ID2SYM(rb_intern(StringValueCStr(method))));
+  rb_ary_store(event, EVT_HANDLE, Data_Wrap_Struct(rb_cObject, 0, 0, revent));
+  revent->event = event;
 
   if(events == Qnil)
   {
@@ -626,7 +758,7 @@ rb_add_event(VALUE self, VALUE method, VALUE time, VALUE arg)
     rb_hash_aset(ruby_server_events, sn, events);
   }
 
-  ilog(L_DEBUG, "{%s} Adding Event: %s Every %lu", StringValueCStr(sn), StringValueCStr(method), NUM2LONG(time));
+  ilog(L_DEBUG, "{%s} Adding Event: %s Every %lu", StringValueCStr(sn), StringValueCStr(method), when);
   rb_ary_push(events, event);
 
   return event;
@@ -644,6 +776,9 @@ rb_delete_event(VALUE self, VALUE event)
     return Qnil;
   }
 
+  Check_Type(event, T_ARRAY);
+  free_ruby_event(event);
+
   return rb_ary_delete(events, event);
 }
 
@@ -651,48 +786,16 @@ static void
 unhook_events(VALUE self)
 {
   VALUE sn = rb_iv_get(self, "@ServiceName");
-  rb_hash_delete(ruby_server_events, sn);
-}
-
-static void *
-rb_event_hdlr(va_list args)
-{
-  int i, j;
-  int delta;
-  int handled = 0;
-  VALUE keys = do_ruby_ret(ruby_server_events, rb_intern("keys"), 0);
-  VALUE key, events, event, self, method, timer, ltime, arg;
+  VALUE events = rb_hash_aref(ruby_server_events, sn);
+  int i;
 
-  for(i = 0; i < RARRAY_LEN(keys); ++i)
+  if(events != Qnil)
   {
-    key = rb_ary_entry(keys, i);
-    events = rb_hash_aref(ruby_server_events, key);
-
-    for(j = 0; j < RARRAY_LEN(events); ++j)
-    {
-      event = rb_ary_entry(events, j);
-      self = rb_ary_entry(event, EVT_SELF);
-      method = rb_ary_entry(event, EVT_METHOD);
-      timer = rb_ary_entry(event, EVT_TIMER);
-      ltime = rb_ary_entry(event, EVT_LAST);
-      arg = rb_ary_entry(event, EVT_ARG);
-
-      delta = CurrentTime - NUM2LONG(ltime);
-
-      if(delta >= NUM2LONG(timer))
-      {
-        do_ruby(self, rb_intern(StringValueCStr(method)), 1, arg);
-        rb_ary_store(event, EVT_LAST, LONG2NUM(CurrentTime));
-        handled = 1;
-        break;
-      }
-    }
-
-    if(handled)
-      break;
+    for(i = 0; i < RARRAY_LEN(events); ++i)
+      free_ruby_event(rb_ary_entry(events, i));
   }
 
-  return pass_callback(ruby_event_hook);
+  rb_hash_delete(ruby_server_events, sn);
 }
 
 int
@@ -843,7 +946,7 @@ init_ruby(void)
   /* Place holder for hooks */
   ruby_server_hooks = rb_ary_new();
   for(i=0; i < RB_HOOKS_COUNT; ++i)
-    rb_ary_push(ruby_server_hooks, rb_hash_new());
+    rb_ary_push(ruby_server_hooks, rb_ary_new());
 
   ruby_server_events = rb_hash_new();
 
@@ -865,8 +968,8 @@ init_ruby(void)
   ruby_nick_reg_hook = install_hook(on_nick_reg_cb, rb_nick_reg_hdlr);
   ruby_db_init_hook = install_hook(on_db_init_cb, rb_db_init_hdlr);
   ruby_eob_hook = install_hook(on_burst_done_cb, rb_eob_hdlr);
-
-  ruby_event_hook = install_hook(do_event_cb, rb_event_hdlr);
+  ruby_client_free_hook = install_hook(on_client_free_cb, rb_client_free_hdlr);
+  ruby_channel_free_hook = install_hook(on_channel_free_cb, rb_channel_free_hdlr);
 
   /* pin any ruby address we keep on the C side */
   rb_gc_register_address(&ruby_server_hooks);
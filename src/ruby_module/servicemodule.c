@@ -21,6 +21,7 @@ static VALUE ServiceModule_unload(VALUE);
 static VALUE ServiceModule_chain_language(VALUE, VALUE);
 static VALUE ServiceModule_akill_add(VALUE, VALUE, VALUE, VALUE);
 static VALUE ServiceModule_kill_user(VALUE, VALUE, VALUE);
+static VALUE ServiceModule_kill_user_host(VALUE, VALUE, VALUE);
 static VALUE ServiceModule_load_language(VALUE, VALUE);
 static VALUE ServiceModule_lm(VALUE, VALUE);
 static VALUE ServiceModule_drop_nick(VALUE, VALUE);
@@ -286,7 +287,7 @@ ServiceModule_akill_add(VALUE self, VALUE mask, VALUE reason, VALUE duration)
   {
     ilog(L_NOTICE, "%s Added akill on %s because %s for %ld seconds",
       client->name, cmask, creason, akill->duration);
-    send_akill(service, client->name, akill);
+    kill_akill(service, client->name, akill);
     free_servicemask(akill);
     return Qtrue;
   }
@@ -310,6 +311,25 @@ ServiceModule_kill_user(VALUE self, VALUE who, VALUE reason)
   return Qtrue;
 }
 
+/* like kill_user, but enough kills waiting on one host akill it instead */
+static VALUE
+ServiceModule_kill_user_host(VALUE self, VALUE who, VALUE reason)
+{
+  struct Service *service = get_service(self);
+  struct Client *client;
+  const char *creason;
+
+  Check_Type(reason, T_STRING);
+  creason = StringValueCStr(reason);
+
+  Check_OurType(who, cClient);
+  client = value_to_client(who);
+
+  kill_user_host(service, client, creason);
+
+  return Qtrue;
+}
+
 static VALUE
 ServiceModule_load_language(VALUE self, VALUE file)
 {
@@ -616,6 +636,7 @@ Init_ServiceModule(void)
   rb_define_method(cServiceModule, "ctcp_user", ServiceModule_ctcp_user, 2);
   rb_define_method(cServiceModule, "sendto_channel", ServiceModule_sendto_channel, 2);
   rb_define_method(cServiceModule, "kill_user", ServiceModule_kill_user, 2);
+  rb_define_method(cServiceModule, "kill_user_host", ServiceModule_kill_user_host, 2);
 
   rb_define_method(cServiceModule, "load_language", ServiceModule_load_language, 1);
   rb_define_method(cServiceModule, "lm", ServiceModule_lm, 1);
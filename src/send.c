@@ -125,6 +125,50 @@ sendto_server(struct Client *to, const char *pattern, ...)
   send_message(to, buffer, len);
 }
 
+/* sendto_server_lines()
+ *
+ * inputs       - pointer to destination client
+ *              - prefix put in front of every line
+ *              - the lines and how many there are
+ * output       - NONE
+ * side effects - one message per line is queued, the prefix is formatted
+ *                once by the caller and only copied here
+ */
+void
+sendto_server_lines(struct Client *to, const char *prefix, char **lines,
+    int count)
+{
+  char buffer[IRC_BUFSIZE];
+  size_t prefixlen, len;
+  int i;
+
+  if(to == NULL)
+    return;
+
+  if (to->from != NULL)
+    to = to->from;
+  if (IsDead(to->server))
+    return; /* This socket has already been marked as dead */
+
+  prefixlen = strlcpy(buffer, prefix, IRC_BUFSIZE - 1);
+  if(prefixlen > IRC_BUFSIZE - 2)
+    prefixlen = IRC_BUFSIZE - 2;
+
+  for(i = 0; i < count; i++)
+  {
+    len = strlen(lines[i]);
+    if(prefixlen + len > IRC_BUFSIZE - 2)
+      len = IRC_BUFSIZE - 2 - prefixlen;
+
+    memcpy(buffer + prefixlen, lines[i], len);
+    len += prefixlen;
+    buffer[len++] = '\r';
+    buffer[len++] = '\n';
+
+    send_message(to, buffer, len);
+  }
+}
+
 /*
  ** send_message
  **      Internal utility which appends given buffer to the sockets
@@ -1,5 +1,23 @@
 #include "servicemask.h"
 #include "dbm.h"
+#include "client.h"
+#include "hostmask.h"
+
+/*
+ * A mask split into its n!u@h parts with the wildcard parts compiled, so
+ * that checking it against every client on the network does not have to
+ * split and parse the mask string over again each time.
+ */
+struct ServiceMaskMatch
+{
+  struct CompiledMask *name;
+  struct CompiledMask *user;
+  struct CompiledMask *host;
+  char *literal_host;        /* the host part when it has no wildcards */
+  struct irc_ssaddr addr;
+  int bits;
+  int type;
+};
 
 static struct ServiceMask *
 row_to_servicemask(row_t *row)
@@ -7,24 +25,24 @@ row_to_servicemask(row_t *row)
   struct ServiceMask *sban;
 
   sban = MyMalloc(sizeof(struct ServiceMask));
-  sban->id = atoi(row->cols[0]);
-  sban->channel = atoi(row->cols[1]);
+  sban->id = db_row_int(row, 0);
+  sban->channel = db_row_int(row, 1);
 
   if(row->cols[2] != NULL)
-    sban->target = atoi(row->cols[2]);
+    sban->target = db_row_int(row, 2);
   else
     sban->target = 0;
 
   if(row->cols[3] != NULL)
-    sban->setter = atoi(row->cols[3]);
+    sban->setter = db_row_int(row, 3);
   else
     sban->setter = 0;
 
   DupString(sban->mask, row->cols[4]);
   DupString(sban->reason, row->cols[5]);
-  sban->time_set = atoi(row->cols[6]);
-  sban->duration = atoi(row->cols[7]);
-  sban->type = atoi(row->cols[8]);
+  sban->time_set = db_row_int(row, 6);
+  sban->duration = db_row_int(row, 7);
+  sban->type = db_row_int(row, 8);
 
   return sban;
 }
@@ -33,11 +51,103 @@ void
 free_servicemask(struct ServiceMask *ban)
 {
   ilog(L_DEBUG, "Freeing servicemask %p for %s", ban, ban->mask);
+  if(ban->compiled != NULL)
+  {
+    free_compiled_mask(ban->compiled->name);
+    free_compiled_mask(ban->compiled->user);
+    free_compiled_mask(ban->compiled->host);
+    MyFree(ban->compiled->literal_host);
+    MyFree(ban->compiled);
+  }
   MyFree(ban->mask);
   MyFree(ban->reason);
   MyFree(ban);
 }
 
+static struct ServiceMaskMatch *
+compile_servicemask(const char *mask)
+{
+  struct ServiceMaskMatch *sm;
+  struct split_nuh_item nuh;
+  char name[NICKLEN];
+  char user[USERLEN+1];
+  char host[HOSTLEN+1];
+
+  DupString(nuh.nuhmask, mask);
+  nuh.nickptr = name;
+  nuh.userptr = user;
+  nuh.hostptr = host;
+
+  nuh.nicksize = sizeof(name);
+  nuh.usersize = sizeof(user);
+  nuh.hostsize = sizeof(host);
+
+  split_nuh(&nuh);
+
+  sm = MyMalloc(sizeof(struct ServiceMaskMatch));
+  sm->type = parse_netmask(host, &sm->addr, &sm->bits);
+  sm->name = compile_mask(name);
+  sm->user = compile_mask(user);
+  sm->host = compile_mask(host);
+  if(sm->type == HM_HOST && strpbrk(host, "*?#") == NULL)
+    DupString(sm->literal_host, host);
+
+  MyFree(nuh.nuhmask);
+  return sm;
+}
+
+/* servicemask_match_client()
+ *
+ * inputs       - servicemask to check, client to check it against
+ * output       - TRUE if the mask matches the client
+ * side effects - mask is split and compiled the first time it is checked
+ */
+int
+servicemask_match_client(struct ServiceMask *sban, struct Client *client)
+{
+  struct ServiceMaskMatch *sm;
+
+  if(sban->compiled == NULL)
+    sban->compiled = compile_servicemask(sban->mask);
+  sm = sban->compiled;
+
+  if(!match_compiled(sm->name, client->name) ||
+     !match_compiled(sm->user, client->username))
+    return FALSE;
+
+  switch(sm->type)
+  {
+    case HM_HOST:
+      return match_compiled(sm->host, client->host);
+    case HM_IPV4:
+      if (client->aftype == AF_INET)
+        return match_ipv4(&client->ip, &sm->addr, sm->bits);
+      break;
+#ifdef IPV6
+    case HM_IPV6:
+      if (client->aftype == AF_INET6)
+        return match_ipv6(&client->ip, &sm->addr, sm->bits);
+      break;
+#endif
+  }
+
+  return FALSE;
+}
+
+/* servicemask_literal_host()
+ *
+ * inputs       - servicemask
+ * output       - the host part if it only matches that one host, or NULL
+ * side effects - mask is split and compiled if it has not been yet
+ */
+const char *
+servicemask_literal_host(struct ServiceMask *sban)
+{
+  if(sban->compiled == NULL)
+    sban->compiled = compile_servicemask(sban->mask);
+
+  return sban->compiled->literal_host;
+}
 
 static int
 servicemask_add(const char *mask, unsigned int setter, unsigned int channel,
@@ -231,10 +341,9 @@ servicemask_list_masks(unsigned int channel, unsigned int mode, dlink_list *list
 
   for(i = 0; i < results->row_count; ++i)
   {
-    char *tmp;
     row_t *row = &results->rows[i];
-    DupString(tmp, row->cols[0]);
-    dlinkAdd(tmp, make_dlink_node(), list);
+    dlinkAdd(arena_strdup(request_arena, row->cols[0]), make_dlink_node(),
+        list);
   }
 
   db_free_result(results);
@@ -42,6 +42,9 @@
 #include "event.h"
 #include "tor.h"
 #include "kill.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "startup.h"
 
 #include <signal.h>
 #include <sys/wait.h>
@@ -49,6 +52,7 @@
 struct Client me;
 struct ServicesState_t ServicesState = { 0 };
 int dorehash = 0;
+struct Arena *request_arena;
 
 static struct lgetopt myopts[] = {
   {"configfile", &ServicesState.configfile,
@@ -67,6 +71,10 @@ static struct lgetopt myopts[] = {
    YESNO, "Set debug mode and disable all interaction"},
   {"keepmodules", &ServicesState.keepmodules,
    YESNO, "Stops modules from being unloaded.  Helps debugging memory leaks"},
+  {"capture",    &ServicesState.capturefile,
+   STRING, "File to record uplink traffic to, for replaying"},
+  {"replay",     &ServicesState.replayfile,
+   STRING, "Replay a capture instead of connecting, then exit"},
   {"help", NULL, USAGE, "Print this text"},
   {NULL, NULL, STRING, NULL},
 };
@@ -196,6 +204,10 @@ int main(int argc, char *argv[])
     exit(EXIT_SUCCESS);
   }
 
+  /* the timing report is printed when the replay is done */
+  if(ServicesState.replayfile != NULL)
+    ServicesState.foreground = TRUE;
+
   if(chdir(DPATH))
   {
     perror("chdir");
@@ -213,6 +225,8 @@ int main(int argc, char *argv[])
   memset(&me, 0, sizeof(me));
 
   libio_init(!ServicesState.foreground);
+  init_startup();
+  request_arena = arena_create("request", REQUEST_ARENA_SIZE);
   init_events();
   iorecv_cb = register_callback("iorecv", iorecv_default);
   connected_cb = register_callback("server connected", server_connected);
@@ -224,6 +238,11 @@ int main(int argc, char *argv[])
   check_pidfile(ServicesState.pidfile);
   init_log(ServicesState.logfile);
 
+  /* these only need their own data, they load while the rest boots */
+  load_services_language();
+  if(ServicesState.replayfile == NULL)
+    snapshot_load_start();
+
 #ifdef HAVE_RUBY
   init_ruby();
   signal(SIGSEGV, SIG_DFL);
@@ -255,7 +274,6 @@ int main(int argc, char *argv[])
   write_pidfile(ServicesState.pidfile);
   ilog(L_NOTICE, "Services Ready");
 
-  db_load_driver();
 #ifdef USE_SHARED_MODULES
   if(chdir(MODPATH))
   {
@@ -266,13 +284,38 @@ int main(int argc, char *argv[])
 
   /* Go back to DPATH after checking to see if we can chdir to MODPATH */
   chdir(DPATH);
+
+  /*
+   * The protocol module is all connect_server() needs.  Only the TCP
+   * connect goes on while the database is waited for and the other
+   * modules load, the socket is held until connect_server_ready() sends
+   * PASS and SERVER.
+   */
+  boot_core_modules();
+  if(ServicesState.replayfile == NULL)
+    connect_server();
+
+  db_load_driver();
 #else
+  db_load_driver();
   load_all_modules(1);
+
+  if(ServicesState.replayfile == NULL)
+    connect_server();
 #endif
 
   boot_modules(1);
-  
-  connect_server();
+  startup_ready("Modules");
+  startup_wait_all();
+
+  if(ServicesState.replayfile != NULL)
+    replay_run(ServicesState.replayfile);
+
+  init_snapshot();
+  if(ServicesState.capturefile != NULL)
+    init_capture(ServicesState.capturefile);
+  connect_server_ready();
+  startup_ready("Uplink");
 
   for(;;)
   {
@@ -290,6 +333,7 @@ int main(int argc, char *argv[])
 
     comm_select();
     send_queued_all();
+    arena_reset(request_arena);
 
     if(dorehash)
     {
@@ -343,12 +387,19 @@ services_die(const char *msg, int rboot)
 {
   ilog(L_NOTICE, "Dying: %s", msg);
 
+  cleanup_startup();
+
+  snapshot_write();
+  cleanup_snapshot();
+  cleanup_capture();
+
   cleanup_channel_modes();
+  /* before the conf, it needs the driver name */
+  cleanup_db();
   cleanup_conf();
 #ifdef HAVE_RUBY
   cleanup_ruby();
 #endif
-  cleanup_db();
   cleanup_modules();
 
   EVP_cleanup();
@@ -368,6 +419,7 @@ services_die(const char *msg, int rboot)
   unregister_callback(iorecv_cb);
   unregister_callback(connected_cb);
   unregister_callback(iosend_cb);
+  arena_destroy(request_arena);
   libio_cleanup();
   exit(rboot);
 }
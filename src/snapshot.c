@@ -0,0 +1,1023 @@
+/*
+ *  oftc-ircservices: an extensible and flexible IRC Services package
+ *  snapshot.c - network state snapshots for warm restarts
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ */
+
+/*
+ * On a clean shutdown, and every SNAPSHOT_TIME seconds while fully
+ * connected, the remote clients and channels are written to SPATH together
+ * with the Nickname and DBChannel they had resolved to.  A restarting
+ * services maps that file before connecting.  The uplink burst still
+ * builds the network state as usual, but every client and channel it
+ * introduces is looked up in the snapshot first: when it is the same
+ * client (same id, TS, nick, user, host and server) or the same channel,
+ * the cached Nickname or DBChannel is reattached instead of being fetched
+ * from the database, and NickServ and ChanServ skip the checks that
+ * client already passed before the restart.  Once the burst is done they
+ * run them again, NickServ reloading each Nickname, so changes made while
+ * services were down still apply.  Anything the burst does not mention is
+ * simply dropped when the burst completes.
+ */
+
+#include "stdinc.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "client.h"
+#include "channel_mode.h"
+#include "channel.h"
+#include "dbchannel.h"
+#include "nickname.h"
+#include "interface.h"
+#include "snapshot.h"
+#include "startup.h"
+
+#define SNAPSHOT_MAGIC    "OSVSNAP"
+#define SNAPSHOT_VERSION  2
+#define SNAPSHOT_MAXSTR   16
+
+/* only clients in these states are worth carrying over */
+#define SNAPSHOT_CLIENT_FLAGS (FLAGS_ONACCESS|FLAGS_SENTCERT)
+#define SNAPSHOT_MEMBER_FLAGS (CHFL_CHANOP|CHFL_HALFOP|CHFL_VOICE)
+
+enum SnapshotRecordType
+{
+  SNAP_CLIENT = 1,
+  SNAP_NICKNAME,
+  SNAP_CHANNEL,
+  SNAP_DBCHANNEL,
+  SNAP_MEMBER
+};
+
+/* The file is a header followed by records.  Every record starts on an 8
+ * byte boundary with its integers first, so the mapped file is read in
+ * place.  Strings follow the integers, each prefixed by a byte telling
+ * whether it was NULL.
+ */
+struct SnapshotHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t records;
+  int64_t  written;
+  uint64_t length;    /* bytes following the header */
+  uint32_t checksum;  /* FNV-1a of those bytes */
+  uint32_t pad;
+};
+
+struct SnapshotRecord
+{
+  uint16_t type;
+  uint8_t  nints;
+  uint8_t  nstrings;
+  uint32_t length;    /* whole record, header and padding included */
+};
+
+/* a decoded record, pointing into the mapping */
+struct SnapshotView
+{
+  int type;
+  int nints;
+  int nstrings;
+  const int64_t *ints;
+  const char *strs[SNAPSHOT_MAXSTR];
+};
+
+struct SnapshotEntry
+{
+  const char *name;     /* client key or channel name */
+  const char *member;   /* client key, for memberships */
+  const struct SnapshotRecord *record;
+  const struct SnapshotRecord *extra; /* Nickname or DBChannel following */
+};
+
+/* SNAP_CLIENT fields */
+enum { SC_TSINFO, SC_FLAGS, SC_ACCESS, SC_NICKNAME, SC_NINTS };
+enum { SC_KEY, SC_NAME, SC_USERNAME, SC_HOST, SC_REALHOST, SC_CERTFP,
+       SC_SERVER, SC_NSTRS };
+
+/* SNAP_NICKNAME fields */
+enum { SN_ID, SN_NICKID, SN_PRI_NICKID, SN_STATUS, SN_LANGUAGE, SN_ENFORCE,
+       SN_SECURE, SN_VERIFIED, SN_CLOAK_ON, SN_ADMIN, SN_EMAIL_VERIFIED,
+       SN_PRIV, SN_REG_TIME, SN_LAST_SEEN, SN_LAST_QUIT_TIME,
+       SN_NICK_REG_TIME, SN_NINTS };
+enum { SN_NICK, SN_CLOAK, SN_EMAIL, SN_URL,
+       SN_LAST_REALNAME, SN_LAST_HOST, SN_LAST_QUIT, SN_NSTRS };
+
+/* SNAP_CHANNEL fields */
+enum { SH_CHANNELTS, SH_REGISTERED, SH_NINTS };
+enum { SH_NAME, SH_NSTRS };
+
+/* SNAP_DBCHANNEL fields */
+enum { SD_ID, SD_REGTIME, SD_LAST_USED, SD_PRIV, SD_RESTRICTED,
+       SD_TOPIC_LOCK, SD_VERBOSE, SD_AUTOLIMIT, SD_EXPIREBANS, SD_FLOODSERV,
+       SD_AUTOOP, SD_AUTOVOICE, SD_LEAVEOPS, SD_AUTOSAVE,
+       SD_EXPIREBANS_LIFETIME, SD_NINTS };
+enum { SD_CHANNEL, SD_DESCRIPTION, SD_ENTRYMSG, SD_URL, SD_EMAIL, SD_TOPIC,
+       SD_MLOCK, SD_NSTRS };
+
+/* SNAP_MEMBER fields */
+enum { SM_FLAGS, SM_NINTS };
+enum { SM_CLIENT, SM_NSTRS };
+
+static dlink_node *snapshot_burst_hook;
+static struct StartupTask snapshot_task;
+
+/* the snapshot being restored, only mapped until the burst completes */
+static char *snap_map;
+static size_t snap_map_len;
+static struct SnapshotEntry *snap_index;
+static unsigned int snap_index_mask;
+static unsigned int restored_clients, restored_channels, restored_members;
+static unsigned int snap_clients, snap_channels, snap_members;
+
+/* the snapshot being written */
+static char *snap_buf;
+static size_t snap_len, snap_size;
+static size_t snap_record;
+static unsigned int snap_records;
+
+static void snapshot_load();
+static void snapshot_discard();
+
+static uint32_t
+snapshot_checksum(const char *data, size_t len)
+{
+  uint32_t hash = 2166136261U;
+
+  while(len-- > 0)
+  {
+    hash ^= (unsigned char)*data++;
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+/*
+ * Writing
+ */
+
+static void
+snap_reserve(size_t len)
+{
+  if(snap_len + len <= snap_size)
+    return;
+
+  while(snap_len + len > snap_size)
+    snap_size = snap_size ? snap_size * 2 : 65536;
+
+  snap_buf = MyRealloc(snap_buf, snap_size);
+}
+
+static void
+snap_begin(int type)
+{
+  struct SnapshotRecord *record;
+
+  snap_reserve(sizeof(struct SnapshotRecord));
+  snap_record = snap_len;
+  record = (struct SnapshotRecord *)(snap_buf + snap_record);
+  memset(record, 0, sizeof(*record));
+  record->type = type;
+  snap_len += sizeof(struct SnapshotRecord);
+}
+
+/* all integers of a record must be added before its first string */
+static void
+snap_int(int64_t value)
+{
+  struct SnapshotRecord *record;
+
+  snap_reserve(sizeof(value));
+  memcpy(snap_buf + snap_len, &value, sizeof(value));
+  snap_len += sizeof(value);
+
+  record = (struct SnapshotRecord *)(snap_buf + snap_record);
+  assert(record->nstrings == 0);
+  record->nints++;
+}
+
+static void
+snap_str(const char *value)
+{
+  struct SnapshotRecord *record;
+  size_t len = value != NULL ? strlen(value) : 0;
+
+  snap_reserve(len + 2);
+  snap_buf[snap_len++] = value != NULL;
+  if(value != NULL)
+    memcpy(snap_buf + snap_len, value, len);
+  snap_len += len;
+  snap_buf[snap_len++] = '\0';
+
+  record = (struct SnapshotRecord *)(snap_buf + snap_record);
+  record->nstrings++;
+}
+
+static void
+snap_end()
+{
+  struct SnapshotRecord *record;
+  size_t pad = (8 - (snap_len & 7)) & 7;
+
+  snap_reserve(pad);
+  memset(snap_buf + snap_len, 0, pad);
+  snap_len += pad;
+
+  record = (struct SnapshotRecord *)(snap_buf + snap_record);
+  record->length = snap_len - snap_record;
+  snap_records++;
+}
+
+static const char *
+snapshot_client_key(struct Client *client)
+{
+  return HasID(client) ? client->id : client->name;
+}
+
+/* clients that are being enforced or are holding a nick for someone are
+ * left to the burst, the state that belongs to them lives in NickServ
+ */
+static int
+snapshot_client_wanted(struct Client *client)
+{
+  return IsClient(client) && !MyConnect(client) && !IsDefunct(client) &&
+    client->servptr != NULL && client->enforce_time == 0 &&
+    !IsEnforce(client) && client->release_name[0] == '\0';
+}
+
+/* the password and salt are not written, the restored Nickname only
+ * stands in until NickServ reloads it from the database after the burst
+ */
+static void
+snapshot_add_nickname(Nickname *nick)
+{
+  snap_begin(SNAP_NICKNAME);
+  snap_int(nick->id);
+  snap_int(nick->nickid);
+  snap_int(nick->pri_nickid);
+  snap_int(nick->status);
+  snap_int(nick->language);
+  snap_int(nick->enforce);
+  snap_int(nick->secure);
+  snap_int(nick->verified);
+  snap_int(nick->cloak_on);
+  snap_int(nick->admin);
+  snap_int(nick->email_verified);
+  snap_int(nick->priv);
+  snap_int(nick->reg_time);
+  snap_int(nick->last_seen);
+  snap_int(nick->last_quit_time);
+  snap_int(nick->nick_reg_time);
+  snap_str(nick->nick);
+  snap_str(nick->cloak);
+  snap_str(nick->email);
+  snap_str(nick->url);
+  snap_str(nick->last_realname);
+  snap_str(nick->last_host);
+  snap_str(nick->last_quit);
+  snap_end();
+}
+
+static void
+snapshot_add_client(struct Client *client)
+{
+  snap_begin(SNAP_CLIENT);
+  snap_int(client->tsinfo);
+  snap_int(client->flags & SNAPSHOT_CLIENT_FLAGS);
+  snap_int(client->access);
+  snap_int(client->nickname != NULL);
+  snap_str(snapshot_client_key(client));
+  snap_str(client->name);
+  snap_str(client->username);
+  snap_str(client->host);
+  snap_str(client->realhost);
+  snap_str(client->certfp);
+  snap_str(client->servptr->name);
+  snap_end();
+
+  if(client->nickname != NULL)
+    snapshot_add_nickname(client->nickname);
+}
+
+static void
+snapshot_add_dbchannel(DBChannel *regchan)
+{
+  snap_begin(SNAP_DBCHANNEL);
+  snap_int(regchan->id);
+  snap_int(regchan->regtime);
+  snap_int(regchan->last_used);
+  snap_int(regchan->priv);
+  snap_int(regchan->restricted);
+  snap_int(regchan->topic_lock);
+  snap_int(regchan->verbose);
+  snap_int(regchan->autolimit);
+  snap_int(regchan->expirebans);
+  snap_int(regchan->floodserv);
+  snap_int(regchan->autoop);
+  snap_int(regchan->autovoice);
+  snap_int(regchan->leaveops);
+  snap_int(regchan->autosave);
+  snap_int(regchan->expirebans_lifetime);
+  snap_str(regchan->channel);
+  snap_str(regchan->description);
+  snap_str(regchan->entrymsg);
+  snap_str(regchan->url);
+  snap_str(regchan->email);
+  snap_str(regchan->topic);
+  snap_str(regchan->mlock);
+  snap_end();
+}
+
+static void
+snapshot_add_channel(struct Channel *chptr)
+{
+  dlink_node *ptr;
+
+  snap_begin(SNAP_CHANNEL);
+  snap_int(chptr->channelts);
+  snap_int(chptr->regchan != NULL);
+  snap_str(chptr->chname);
+  snap_end();
+
+  if(chptr->regchan != NULL)
+    snapshot_add_dbchannel(chptr->regchan);
+
+  DLINK_FOREACH(ptr, chptr->members.head)
+  {
+    struct Membership *member = ptr->data;
+
+    if(!snapshot_client_wanted(member->client_p))
+      continue;
+
+    snap_begin(SNAP_MEMBER);
+    snap_int(member->flags & SNAPSHOT_MEMBER_FLAGS);
+    snap_str(snapshot_client_key(member->client_p));
+    snap_end();
+  }
+}
+
+/* snapshot_write()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - the remote clients and channels are written to SPATH,
+ *                replacing the previous snapshot atomically
+ */
+void
+snapshot_write()
+{
+  struct SnapshotHeader *header;
+  const char *tmppath = SPATH ".tmp";
+  dlink_node *ptr;
+  size_t off;
+  ssize_t n;
+  int fd;
+
+  /* a snapshot taken mid burst would be missing half the network, and a
+   * replayed network (snapshots never initialised) is not the real one */
+  if(!ServicesState.fully_connected || snap_map != NULL ||
+      snapshot_burst_hook == NULL)
+    return;
+
+  snap_len = 0;
+  snap_records = 0;
+  snap_reserve(sizeof(struct SnapshotHeader));
+  snap_len = sizeof(struct SnapshotHeader);
+
+  DLINK_FOREACH(ptr, global_client_list.head)
+  {
+    struct Client *client = ptr->data;
+
+    if(snapshot_client_wanted(client))
+      snapshot_add_client(client);
+  }
+
+  DLINK_FOREACH(ptr, global_channel_list.head)
+    snapshot_add_channel(ptr->data);
+
+  header = (struct SnapshotHeader *)snap_buf;
+  memset(header, 0, sizeof(*header));
+  strlcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+  header->version = SNAPSHOT_VERSION;
+  header->records = snap_records;
+  header->written = CurrentTime;
+  header->length = snap_len - sizeof(*header);
+  header->checksum = snapshot_checksum(snap_buf + sizeof(*header),
+      header->length);
+
+  if((fd = open(tmppath, O_WRONLY|O_CREAT|O_TRUNC, 0600)) == -1)
+  {
+    ilog(L_ERROR, "Could not write state snapshot %s: %s", tmppath,
+        strerror(errno));
+    return;
+  }
+
+  for(off = 0; off < snap_len; off += n)
+  {
+    if((n = write(fd, snap_buf + off, snap_len - off)) <= 0)
+    {
+      if(n == -1 && errno == EINTR)
+      {
+        n = 0;
+        continue;
+      }
+      ilog(L_ERROR, "Could not write state snapshot %s: %s", tmppath,
+          strerror(errno));
+      close(fd);
+      unlink(tmppath);
+      return;
+    }
+  }
+
+  if(fsync(fd) == -1 || close(fd) == -1 || rename(tmppath, SPATH) == -1)
+  {
+    ilog(L_ERROR, "Could not write state snapshot %s: %s", SPATH,
+        strerror(errno));
+    unlink(tmppath);
+    return;
+  }
+
+  ilog(L_DEBUG, "Wrote state snapshot: %u records, %lu bytes", snap_records,
+      (unsigned long)snap_len);
+
+  /* the buffer is kept for the next run unless it grew unusually large */
+  if(snap_size > 4 * snap_len)
+  {
+    MyFree(snap_buf);
+    snap_buf = NULL;
+    snap_size = 0;
+  }
+}
+
+/*
+ * Reading
+ */
+
+static int
+snapshot_decode(const struct SnapshotRecord *record, struct SnapshotView *view)
+{
+  const char *p, *end = (const char *)record + record->length;
+  int i;
+
+  if(record->nstrings > SNAPSHOT_MAXSTR)
+    return FALSE;
+
+  view->type = record->type;
+  view->nints = record->nints;
+  view->nstrings = record->nstrings;
+  view->ints = (const int64_t *)(record + 1);
+
+  p = (const char *)(view->ints + view->nints);
+  if(p > end)
+    return FALSE;
+
+  for(i = 0; i < view->nstrings; i++)
+  {
+    const char *s;
+
+    if(p >= end)
+      return FALSE;
+
+    s = *p++ ? p : NULL;
+    if((p = memchr(p, '\0', end - p)) == NULL)
+      return FALSE;
+    p++;
+
+    view->strs[i] = s;
+  }
+
+  return TRUE;
+}
+
+static unsigned int
+snapshot_hash(const char *name, const char *member)
+{
+  uint32_t hash = 2166136261U;
+
+  for(; *name != '\0'; name++)
+  {
+    hash ^= ToLower(*name);
+    hash *= 16777619U;
+  }
+
+  if(member != NULL)
+  {
+    hash ^= 1;
+    hash *= 16777619U;
+
+    for(; *member != '\0'; member++)
+    {
+      hash ^= ToLower(*member);
+      hash *= 16777619U;
+    }
+  }
+
+  return hash;
+}
+
+static const struct SnapshotEntry *
+snapshot_find(int type, const char *name, const char *member)
+{
+  unsigned int i;
+
+  if(snap_index == NULL)
+    return NULL;
+
+  for(i = snapshot_hash(name, member) & snap_index_mask;
+      snap_index[i].record != NULL; i = (i + 1) & snap_index_mask)
+  {
+    const struct SnapshotEntry *entry = &snap_index[i];
+
+    if(entry->record->type != type || irccmp(entry->name, name) != 0)
+      continue;
+
+    if(member == NULL || irccmp(entry->member, member) == 0)
+      return entry;
+  }
+
+  return NULL;
+}
+
+static struct SnapshotEntry *
+snapshot_index_add(const char *name, const char *member,
+                   const struct SnapshotRecord *record)
+{
+  unsigned int i = snapshot_hash(name, member) & snap_index_mask;
+
+  while(snap_index[i].record != NULL)
+    i = (i + 1) & snap_index_mask;
+
+  snap_index[i].name = name;
+  snap_index[i].member = member;
+  snap_index[i].record = record;
+
+  return &snap_index[i];
+}
+
+static int
+snapshot_check_record(const struct SnapshotView *view)
+{
+  switch(view->type)
+  {
+    case SNAP_CLIENT:
+      return view->nints == SC_NINTS && view->nstrings == SC_NSTRS &&
+        view->strs[SC_KEY] != NULL && view->strs[SC_NAME] != NULL &&
+        view->strs[SC_USERNAME] != NULL && view->strs[SC_HOST] != NULL &&
+        view->strs[SC_REALHOST] != NULL && view->strs[SC_CERTFP] != NULL &&
+        view->strs[SC_SERVER] != NULL;
+    case SNAP_NICKNAME:
+      return view->nints == SN_NINTS && view->nstrings == SN_NSTRS &&
+        view->strs[SN_NICK] != NULL && view->strs[SN_CLOAK] != NULL;
+    case SNAP_CHANNEL:
+      return view->nints == SH_NINTS && view->nstrings == SH_NSTRS &&
+        view->strs[SH_NAME] != NULL;
+    case SNAP_DBCHANNEL:
+      return view->nints == SD_NINTS && view->nstrings == SD_NSTRS &&
+        view->strs[SD_CHANNEL] != NULL;
+    case SNAP_MEMBER:
+      return view->nints == SM_NINTS && view->nstrings == SM_NSTRS &&
+        view->strs[SM_CLIENT] != NULL;
+    default:
+      return FALSE;
+  }
+}
+
+/* builds the lookup index over a mapped snapshot, FALSE if it is corrupt */
+static int
+snapshot_build_index(const struct SnapshotHeader *header)
+{
+  const char *p = snap_map + sizeof(*header);
+  const char *end = snap_map + snap_map_len;
+  struct SnapshotEntry *owner = NULL;
+  const char *chname = NULL;
+  unsigned int size = 16;
+
+  while(size < header->records * 2)
+    size <<= 1;
+
+  snap_index = MyMalloc(size * sizeof(struct SnapshotEntry));
+  snap_index_mask = size - 1;
+
+  while(p < end)
+  {
+    const struct SnapshotRecord *record = (const struct SnapshotRecord *)p;
+    struct SnapshotView view;
+
+    if((size_t)(end - p) < sizeof(*record) || record->length < sizeof(*record) ||
+        record->length > (size_t)(end - p) || (record->length & 7) != 0 ||
+        !snapshot_decode(record, &view) || !snapshot_check_record(&view))
+      return FALSE;
+
+    switch(view.type)
+    {
+      case SNAP_CLIENT:
+        owner = snapshot_index_add(view.strs[SC_KEY], NULL, record);
+        chname = NULL;
+        snap_clients++;
+        break;
+      case SNAP_CHANNEL:
+        owner = snapshot_index_add(view.strs[SH_NAME], NULL, record);
+        chname = view.strs[SH_NAME];
+        snap_channels++;
+        break;
+      case SNAP_NICKNAME:
+      case SNAP_DBCHANNEL:
+        /* these belong to the client or channel just before them */
+        if(owner == NULL || owner->extra != NULL)
+          return FALSE;
+        owner->extra = record;
+        break;
+      case SNAP_MEMBER:
+        if(chname == NULL)
+          return FALSE;
+        owner = NULL;
+        snapshot_index_add(chname, view.strs[SM_CLIENT], record);
+        snap_members++;
+        break;
+    }
+
+    p += record->length;
+  }
+
+  return TRUE;
+}
+
+static void
+snapshot_load()
+{
+  const struct SnapshotHeader *header;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if((fd = open(SPATH, O_RDONLY)) == -1)
+  {
+    if(errno != ENOENT)
+      ilog(L_ERROR, "Could not open state snapshot %s: %s", SPATH,
+          strerror(errno));
+    return;
+  }
+
+  if(fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(*header))
+  {
+    ilog(L_ERROR, "Ignoring truncated state snapshot %s", SPATH);
+    close(fd);
+    return;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+  {
+    ilog(L_ERROR, "Could not map state snapshot %s: %s", SPATH,
+        strerror(errno));
+    return;
+  }
+
+  snap_map = map;
+  snap_map_len = st.st_size;
+  header = map;
+
+  if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+      header->version != SNAPSHOT_VERSION ||
+      header->length != snap_map_len - sizeof(*header) ||
+      header->checksum != snapshot_checksum(snap_map + sizeof(*header),
+        header->length))
+  {
+    ilog(L_ERROR, "Ignoring corrupt or incompatible state snapshot %s", SPATH);
+    snapshot_discard();
+    return;
+  }
+
+  if(CurrentTime - header->written > SNAPSHOT_MAXAGE)
+  {
+    ilog(L_NOTICE, "Ignoring state snapshot %s, it is %ld seconds old",
+        SPATH, (long)(CurrentTime - header->written));
+    snapshot_discard();
+    return;
+  }
+
+  if(!snapshot_build_index(header))
+  {
+    ilog(L_ERROR, "Ignoring corrupt state snapshot %s", SPATH);
+    snapshot_discard();
+    return;
+  }
+
+  ilog(L_NOTICE, "Loaded state snapshot from %ld seconds ago: %u clients, "
+      "%u channels, %u memberships", (long)(CurrentTime - header->written),
+      snap_clients, snap_channels, snap_members);
+}
+
+static void
+snapshot_discard()
+{
+  if(snap_map == NULL)
+    return;
+
+  if(snap_index != NULL)
+    ilog(L_NOTICE, "Warm restart reused %u/%u clients, %u/%u channels and "
+        "%u/%u memberships from the state snapshot", restored_clients,
+        snap_clients, restored_channels, snap_channels, restored_members,
+        snap_members);
+
+  MyFree(snap_index);
+  snap_index = NULL;
+  munmap(snap_map, snap_map_len);
+  snap_map = NULL;
+  snap_map_len = 0;
+}
+
+/*
+ * Restoring
+ */
+
+static Nickname *
+snapshot_to_nickname(const struct SnapshotRecord *record)
+{
+  Nickname *nick = MyMalloc(sizeof(Nickname));
+  struct SnapshotView view;
+
+  snapshot_decode(record, &view);
+
+  nick->id = view.ints[SN_ID];
+  nick->nickid = view.ints[SN_NICKID];
+  nick->pri_nickid = view.ints[SN_PRI_NICKID];
+  nick->status = view.ints[SN_STATUS];
+  nick->language = view.ints[SN_LANGUAGE];
+  nick->enforce = view.ints[SN_ENFORCE];
+  nick->secure = view.ints[SN_SECURE];
+  nick->verified = view.ints[SN_VERIFIED];
+  nick->cloak_on = view.ints[SN_CLOAK_ON];
+  nick->admin = view.ints[SN_ADMIN];
+  nick->email_verified = view.ints[SN_EMAIL_VERIFIED];
+  nick->priv = view.ints[SN_PRIV];
+  nick->reg_time = view.ints[SN_REG_TIME];
+  nick->last_seen = view.ints[SN_LAST_SEEN];
+  nick->last_quit_time = view.ints[SN_LAST_QUIT_TIME];
+  nick->nick_reg_time = view.ints[SN_NICK_REG_TIME];
+  strlcpy(nick->nick, view.strs[SN_NICK], sizeof(nick->nick));
+  strlcpy(nick->cloak, view.strs[SN_CLOAK], sizeof(nick->cloak));
+  if(view.strs[SN_EMAIL] != NULL)
+    DupString(nick->email, view.strs[SN_EMAIL]);
+  if(view.strs[SN_URL] != NULL)
+    DupString(nick->url, view.strs[SN_URL]);
+  if(view.strs[SN_LAST_REALNAME] != NULL)
+    DupString(nick->last_realname, view.strs[SN_LAST_REALNAME]);
+  if(view.strs[SN_LAST_HOST] != NULL)
+    DupString(nick->last_host, view.strs[SN_LAST_HOST]);
+  if(view.strs[SN_LAST_QUIT] != NULL)
+    DupString(nick->last_quit, view.strs[SN_LAST_QUIT]);
+
+  return nick;
+}
+
+static DBChannel *
+snapshot_to_dbchannel(const struct SnapshotRecord *record)
+{
+  DBChannel *channel = MyMalloc(sizeof(DBChannel));
+  struct SnapshotView view;
+
+  snapshot_decode(record, &view);
+
+  channel->id = view.ints[SD_ID];
+  channel->regtime = view.ints[SD_REGTIME];
+  channel->last_used = view.ints[SD_LAST_USED];
+  channel->priv = view.ints[SD_PRIV];
+  channel->restricted = view.ints[SD_RESTRICTED];
+  channel->topic_lock = view.ints[SD_TOPIC_LOCK];
+  channel->verbose = view.ints[SD_VERBOSE];
+  channel->autolimit = view.ints[SD_AUTOLIMIT];
+  channel->expirebans = view.ints[SD_EXPIREBANS];
+  channel->floodserv = view.ints[SD_FLOODSERV];
+  channel->autoop = view.ints[SD_AUTOOP];
+  channel->autovoice = view.ints[SD_AUTOVOICE];
+  channel->leaveops = view.ints[SD_LEAVEOPS];
+  channel->autosave = view.ints[SD_AUTOSAVE];
+  channel->expirebans_lifetime = view.ints[SD_EXPIREBANS_LIFETIME];
+  strlcpy(channel->channel, view.strs[SD_CHANNEL], sizeof(channel->channel));
+  if(view.strs[SD_DESCRIPTION] != NULL)
+    DupString(channel->description, view.strs[SD_DESCRIPTION]);
+  if(view.strs[SD_ENTRYMSG] != NULL)
+    DupString(channel->entrymsg, view.strs[SD_ENTRYMSG]);
+  if(view.strs[SD_URL] != NULL)
+    DupString(channel->url, view.strs[SD_URL]);
+  if(view.strs[SD_EMAIL] != NULL)
+    DupString(channel->email, view.strs[SD_EMAIL]);
+  if(view.strs[SD_TOPIC] != NULL)
+    DupString(channel->topic, view.strs[SD_TOPIC]);
+  if(view.strs[SD_MLOCK] != NULL)
+    DupString(channel->mlock, view.strs[SD_MLOCK]);
+
+  return channel;
+}
+
+/* snapshot_restore_client()
+ *
+ * inputs       - client just introduced by the burst
+ * output       - none
+ * side effects - if the snapshot holds the very same client, its Nickname
+ *                and NickServ state are reattached and it is marked
+ *                restored so the new user hooks can put their checks off
+ *                until the burst is done
+ */
+void
+snapshot_restore_client(struct Client *client)
+{
+  const struct SnapshotEntry *entry;
+  struct SnapshotView view;
+
+  if((entry = snapshot_find(SNAP_CLIENT, snapshot_client_key(client),
+          NULL)) == NULL)
+    return;
+
+  snapshot_decode(entry->record, &view);
+
+  if(view.ints[SC_TSINFO] != client->tsinfo ||
+      strcmp(view.strs[SC_NAME], client->name) != 0 ||
+      strcmp(view.strs[SC_USERNAME], client->username) != 0 ||
+      strcmp(view.strs[SC_HOST], client->host) != 0 ||
+      irccmp(view.strs[SC_SERVER], client->servptr->name) != 0)
+    return;
+
+  /* identification has to agree with what the ircd says */
+  if(!IsIdentified(client) != (entry->extra == NULL))
+    return;
+
+  if(entry->extra != NULL)
+  {
+    if(client->nickname != NULL)
+      nickname_free(client->nickname);
+    client->nickname = snapshot_to_nickname(entry->extra);
+    client->access = view.ints[SC_ACCESS];
+  }
+
+  client->flags |= view.ints[SC_FLAGS] & SNAPSHOT_CLIENT_FLAGS;
+  if(client->realhost[0] == '\0')
+    strlcpy(client->realhost, view.strs[SC_REALHOST], sizeof(client->realhost));
+  if(client->certfp[0] == '\0')
+    strlcpy(client->certfp, view.strs[SC_CERTFP], sizeof(client->certfp));
+
+  SetRestored(client);
+  restored_clients++;
+}
+
+/* snapshot_restore_channel()
+ *
+ * inputs       - channel just created
+ * output       - TRUE if the snapshot knew the channel and its
+ *                registration was restored from it
+ * side effects - chptr->regchan is set from the snapshot
+ */
+int
+snapshot_restore_channel(struct Channel *chptr)
+{
+  const struct SnapshotEntry *entry;
+
+  if((entry = snapshot_find(SNAP_CHANNEL, chptr->chname, NULL)) == NULL)
+    return FALSE;
+
+  if(entry->extra != NULL)
+    chptr->regchan = snapshot_to_dbchannel(entry->extra);
+  else
+    chptr->regchan = NULL;
+
+  restored_channels++;
+  return TRUE;
+}
+
+/* snapshot_channel_restored()
+ *
+ * inputs       - channel the burst has just created
+ * output       - TRUE if the snapshot has the same incarnation of it
+ * side effects - none
+ */
+int
+snapshot_channel_restored(struct Channel *chptr)
+{
+  const struct SnapshotEntry *entry;
+  struct SnapshotView view;
+
+  if((entry = snapshot_find(SNAP_CHANNEL, chptr->chname, NULL)) == NULL)
+    return FALSE;
+
+  snapshot_decode(entry->record, &view);
+
+  return view.ints[SH_CHANNELTS] == chptr->channelts;
+}
+
+/* snapshot_member_restored()
+ *
+ * inputs       - channel, restored client that joined it during the burst
+ * output       - TRUE if the client was on the channel with the same
+ *                status before the restart
+ * side effects - none
+ */
+int
+snapshot_member_restored(struct Channel *chptr, struct Client *client)
+{
+  const struct SnapshotEntry *entry;
+  struct Membership *member;
+  struct SnapshotView view;
+
+  if(!IsRestored(client) || !snapshot_channel_restored(chptr))
+    return FALSE;
+
+  if((entry = snapshot_find(SNAP_MEMBER, chptr->chname,
+          snapshot_client_key(client))) == NULL)
+    return FALSE;
+
+  if((member = find_channel_link(client, chptr)) == NULL)
+    return FALSE;
+
+  snapshot_decode(entry->record, &view);
+
+  if(view.ints[SM_FLAGS] != (member->flags & SNAPSHOT_MEMBER_FLAGS))
+    return FALSE;
+
+  restored_members++;
+  return TRUE;
+}
+
+static void *
+snapshot_on_burst_done(va_list args)
+{
+  snapshot_discard();
+
+  return pass_callback(snapshot_burst_hook);
+}
+
+static void
+snapshot_write_event(void *param)
+{
+  /* a hook ahead of ours may have stopped the burst done chain */
+  if(snap_map != NULL && ServicesState.fully_connected)
+    snapshot_discard();
+
+  snapshot_write();
+}
+
+static void
+snapshot_load_work(void *param)
+{
+  snapshot_load();
+}
+
+/* snapshot_load_start()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - the snapshot is mapped, checked and indexed on a startup
+ *                worker, init_snapshot() waits for it
+ */
+void
+snapshot_load_start()
+{
+  startup_task_start(&snapshot_task, "State snapshot", snapshot_load_work,
+      NULL, NULL);
+}
+
+void
+init_snapshot()
+{
+  if(snapshot_task.work != NULL)
+    startup_task_wait(&snapshot_task);
+  else
+    snapshot_load();
+
+  snapshot_burst_hook = install_hook(on_burst_done_cb, snapshot_on_burst_done);
+  eventAdd("Write state snapshot", snapshot_write_event, NULL, SNAPSHOT_TIME);
+}
+
+void
+cleanup_snapshot()
+{
+  if(snapshot_burst_hook == NULL)
+    return;
+
+  uninstall_hook(on_burst_done_cb, snapshot_on_burst_done);
+  snapshot_burst_hook = NULL;
+  eventDelete(snapshot_write_event, NULL);
+
+  snapshot_discard();
+  MyFree(snap_buf);
+  snap_buf = NULL;
+  snap_size = 0;
+}
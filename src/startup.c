@@ -0,0 +1,206 @@
+/*
+ *  oftc-ircservices: an extensible and flexible IRC Services package
+ *  startup.c - startup stages run in the background
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307
+ *  USA
+ *
+ */
+
+/*
+ * Stages that do not depend on each other (the database connection and
+ * its prepared statements, the state snapshot, the services language file
+ * and the tor list) are started as early as main() can, each on its own
+ * worker thread.  Whoever needs a stage waits for it right before the
+ * first use, everything still outstanding is waited for before the first
+ * line from the uplink is read.  Without threads, or once startup is over
+ * (a rehash), a stage simply runs where it is started.
+ */
+
+#include "stdinc.h"
+#include <sys/time.h>
+#include <signal.h>
+#include "startup.h"
+
+static dlink_list startup_tasks = { NULL, NULL, 0 };
+static double startup_begin;
+static int startup_over = FALSE;
+
+static double
+startup_clock()
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+void
+init_startup()
+{
+  startup_begin = startup_clock();
+}
+
+static void *
+startup_worker(void *param)
+{
+  struct StartupTask *task = param;
+  double start = startup_clock();
+
+  task->work(task->data);
+  task->elapsed = startup_clock() - start;
+
+  return NULL;
+}
+
+/* startup_task_start()
+ *
+ * inputs       - task, its name, work for the worker, completion for the
+ *                main thread, data for both
+ * output       - none
+ * side effects - the work is started on a worker thread, or run right
+ *                away when there are no threads or startup is over
+ */
+void
+startup_task_start(struct StartupTask *task, const char *name,
+    void (*work)(void *), void (*done)(void *), void *data)
+{
+  task->name = name;
+  task->work = work;
+  task->done = done;
+  task->data = data;
+  task->elapsed = 0;
+
+  if(startup_over)
+  {
+    work(data);
+    if(done != NULL)
+      done(data);
+    return;
+  }
+
+  task->pending = TRUE;
+  dlinkAdd(task, &task->node, &startup_tasks);
+
+#ifdef HAVE_PTHREAD
+  {
+    sigset_t all, old;
+
+    /* signals are for the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    task->threaded = pthread_create(&task->thread, NULL, startup_worker,
+        task) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if(task->threaded)
+      return;
+  }
+#endif
+
+  startup_worker(task);
+}
+
+/* startup_task_wait()
+ *
+ * inputs       - task
+ * output       - none
+ * side effects - blocks until the work is finished, then runs the
+ *                completion and logs how long the stage took
+ */
+void
+startup_task_wait(struct StartupTask *task)
+{
+  double waited = startup_clock();
+
+  if(!task->pending)
+    return;
+
+#ifdef HAVE_PTHREAD
+  if(task->threaded)
+  {
+    pthread_join(task->thread, NULL);
+    task->threaded = FALSE;
+  }
+#endif
+
+  waited = startup_clock() - waited;
+  task->pending = FALSE;
+  dlinkDelete(&task->node, &startup_tasks);
+
+  if(task->done != NULL)
+    task->done(task->data);
+
+  ilog(L_NOTICE, "Startup: %s took %.3fs, waited %.3fs for it, ready %.3fs "
+      "after start", task->name, task->elapsed, waited,
+      startup_clock() - startup_begin);
+}
+
+/* startup_wait_all()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - every outstanding stage is waited for, anything started
+ *                from now on runs in place
+ */
+void
+startup_wait_all()
+{
+  while(startup_tasks.head != NULL)
+    startup_task_wait(startup_tasks.head->data);
+
+  startup_over = TRUE;
+}
+
+/* cleanup_startup()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - workers still running are waited for, their completions
+ *                are skipped, for when services dies during the boot
+ */
+void
+cleanup_startup()
+{
+  dlink_node *ptr, *next_ptr;
+
+  DLINK_FOREACH_SAFE(ptr, next_ptr, startup_tasks.head)
+  {
+    struct StartupTask *task = ptr->data;
+
+#ifdef HAVE_PTHREAD
+    if(task->threaded)
+      pthread_join(task->thread, NULL);
+    task->threaded = FALSE;
+#endif
+    task->pending = FALSE;
+    dlinkDelete(&task->node, &startup_tasks);
+  }
+
+  startup_over = TRUE;
+}
+
+/* startup_ready()
+ *
+ * inputs       - name of a stage run on the main thread
+ * output       - none
+ * side effects - logs how long after start the stage was done
+ */
+void
+startup_ready(const char *name)
+{
+  ilog(L_NOTICE, "Startup: %s ready %.3fs after start", name,
+      startup_clock() - startup_begin);
+}
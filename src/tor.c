@@ -1,11 +1,18 @@
 #include "stdinc.h"
+#include <sys/stat.h>
 #include "conf/conf.h"
 #include "conf/servicesinfo.h"
 #include "hash.h"
 #include "tor.h"
+#include "startup.h"
 
 static dlink_list tornode_list;
 
+/* the list is read on a startup worker, the nodes are added afterwards */
+static struct StartupTask tor_task;
+static char *tor_fname;
+static char *tor_buf;
+
 static BlockHeap *tornode_heap = NULL;
 
 static dlink_node *config_loaded_hook;
@@ -13,26 +20,65 @@ static dlink_node *config_loaded_hook;
 static void tornode_add(const char*);
 static void tornode_clear();
 
+/* tor_read()
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - runs on a startup worker, the whole tor list file is read
+ *                into tor_buf
+ */
+static void
+tor_read(void *param)
+{
+  struct stat st;
+  size_t len = 0;
+  ssize_t n;
+  int fd;
+
+  if((fd = open(tor_fname, O_RDONLY)) == -1)
+    return;
+
+  if(fstat(fd, &st) == 0)
+  {
+    tor_buf = MyMalloc(st.st_size + 1);
+    while(len < (size_t)st.st_size &&
+        (n = read(fd, tor_buf + len, st.st_size - len)) > 0)
+      len += n;
+    tor_buf[len] = '\0';
+  }
+
+  close(fd);
+}
+
+static void
+tor_read_done(void *param)
+{
+  char *line, *next;
+
+  if(tor_buf != NULL)
+  {
+    tornode_clear();
+    for(line = strtok_r(tor_buf, "\r\n", &next); line != NULL;
+        line = strtok_r(NULL, "\r\n", &next))
+      tornode_add(line);
+  }
+
+  MyFree(tor_buf);
+  tor_buf = NULL;
+  MyFree(tor_fname);
+  tor_fname = NULL;
+}
+
 static void*
 config_loaded(va_list args)
 {
   int cold = va_arg(args, int);
-  FBFILE *t = NULL;
-  char buffer[256];
 
   if(!EmptyString(ServicesInfo.tor_list_fname))
   {
     ilog(L_DEBUG, "Opening tor list: %s", ServicesInfo.tor_list_fname);
-    t = fbopen(ServicesInfo.tor_list_fname, "r");
-    if (t != NULL)
-    {
-      tornode_clear();
-      while(fbgets(buffer, sizeof(buffer), t) != NULL)
-      {
-        tornode_add(buffer);
-      }
-      fbclose(t);
-    }
+    DupString(tor_fname, ServicesInfo.tor_list_fname);
+    startup_task_start(&tor_task, "Tor list", tor_read, tor_read_done, NULL);
   }
 
   return pass_callback(config_loaded_hook, cold);